@@ -0,0 +1,287 @@
+/* -*- mode: c; -*- */
+
+/**
+ * Compares `ino_set_t' and `ino_set_shared_t' against the linked list of
+ * per-device inode arrays ( `dev_lst' ) that `map_files_recur' used before.
+ *
+ * Keys mimic a traversal: a handful of devices, mostly increasing inode
+ * numbers with gaps, and roughly one revisit ( hardlink ) in ten.
+ * The legacy structure is quadratic, so at large sizes it is only run for a
+ * fixed time budget and its total is projected from the measured prefix.
+ */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <time.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+/** The structure formerly used by `map_files_recur', kept for reference. */
+typedef struct _dev_lst {
+  dev_t             dev;
+  ino_t           * nodes;
+  size_t            ncnt;
+  size_t            ncap;
+  struct _dev_lst * nxt;
+} dev_lst;
+
+#define DEV_LST_DEFAULT_SIZE 256
+
+  static void
+dev_lst_realloc( dev_lst * elem, size_t nsize )
+{
+  elem->nodes = realloc( elem->nodes, sizeof( ino_t ) * nsize );
+  assert( elem->nodes != NULL );
+  elem->ncap = nsize;
+}
+
+  static bool
+dev_lst_mark( dev_lst * dlst, dev_t dev, ino_t ino )
+{
+  while ( ( dlst->nxt != NULL ) && ( dlst->dev != dev ) ) dlst = dlst->nxt;
+  if ( dlst->dev == dev )
+    {
+      for ( size_t i = 0; i < dlst->ncnt; i++ )
+        {
+          if ( dlst->nodes[i] == ino ) return true;
+        }
+      if ( dlst->ncap <= ( dlst->ncnt + 1 ) )
+        {
+          dev_lst_realloc( dlst, 2 * dlst->ncap );
+        }
+      dlst->nodes[dlst->ncnt++] = ino;
+    }
+  else
+    {
+      dlst->nxt = calloc( 1, sizeof( dev_lst ) );
+      assert( dlst->nxt != NULL );
+      dlst = dlst->nxt;
+      dlst->dev = dev;
+      dev_lst_realloc( dlst, DEV_LST_DEFAULT_SIZE );
+      dlst->nodes[dlst->ncnt++] = ino;
+    }
+  return false;
+}
+
+  static void
+dev_lst_free( dev_lst * dlst )
+{
+  while ( dlst != NULL )
+    {
+      dev_lst * nxt = dlst->nxt;
+      free( dlst->nodes );
+      free( dlst );
+      dlst = nxt;
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct { dev_t dev; ino_t ino; } key_t_;
+
+static key_t_ * keys  = NULL;
+static size_t   nkeys = 0;
+
+  static uint64_t
+xorshift64( uint64_t * s )
+{
+  *s ^= *s << 13;
+  *s ^= *s >> 7;
+  *s ^= *s << 17;
+  return *s;
+}
+
+  static void
+gen_keys( size_t n )
+{
+  uint64_t seed = 0x5eed5eed5eed5eedULL;
+  ino_t    next[4] = { 2, 1000, 50000, 7 };
+
+  keys  = realloc( keys, sizeof( key_t_ ) * n );
+  nkeys = n;
+  assert( keys != NULL );
+
+  for ( size_t i = 0; i < n; i++ )
+    {
+      uint64_t r = xorshift64( & seed );
+      if ( ( i > 0 ) && ( ( r % 10 ) == 0 ) )
+        {
+          keys[i] = keys[( r >> 8 ) % i];   /* Hardlink or revisit */
+          continue;
+        }
+      keys[i].dev  = 0x801 + ( ( r >> 4 ) % 4 );
+      keys[i].ino  = next[( r >> 4 ) % 4];
+      next[( r >> 4 ) % 4] += 1 + ( ( r >> 16 ) % 3 );
+    }
+}
+
+  static double
+now( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, & ts );
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+  static size_t
+heap_used( void )
+{
+  struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+}
+
+  static void
+report( const char * name, size_t n, size_t done, double secs, size_t mem,
+        size_t hits
+      )
+{
+  double total = secs;
+  bool   proj  = ( done < n );
+  /* Per-operation cost of the list grows linearly; project quadratically. */
+  if ( proj ) total = secs * ( (double) n / done ) * ( (double) n / done );
+  printf( "%-22s %10zu %12.3f%s %9.1f %10.1f %10zu\n",
+          name, n, total, proj ? "*" : " ", total * 1e9 / n,
+          (double) mem / ( 1 << 20 ), hits
+        );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+#define LEGACY_BUDGET_SECS 2.0
+
+  static void
+bench_legacy( size_t n )
+{
+  dev_lst * d    = calloc( 1, sizeof( dev_lst ) );
+  size_t    base = heap_used();
+  size_t    hits = 0;
+  size_t    i    = 0;
+  double    t0   = now();
+
+  d->dev = keys[0].dev;
+  dev_lst_realloc( d, DEV_LST_DEFAULT_SIZE );
+  for ( i = 0; i < n; i++ )
+    {
+      hits += dev_lst_mark( d, keys[i].dev, keys[i].ino );
+      if ( ( ( i & 1023 ) == 0 ) && ( ( now() - t0 ) > LEGACY_BUDGET_SECS ) )
+        {
+          i++;
+          break;
+        }
+    }
+  report( "dev_lst (legacy)", n, i, now() - t0, heap_used() - base, hits );
+  dev_lst_free( d );
+}
+
+  static void
+bench_set( size_t n )
+{
+  size_t      base = heap_used();
+  ino_set_t * set  = ino_set_new( 0 );
+  size_t      hits = 0;
+  double      t0   = now();
+
+  for ( size_t i = 0; i < n; i++ )
+    {
+      hits += ino_set_mark( set, keys[i].dev, keys[i].ino );
+    }
+  report( "ino_set", n, n, now() - t0, heap_used() - base, hits );
+  ino_set_free( set );
+}
+
+typedef struct {
+  ino_set_shared_t * set;
+  size_t             from;
+  size_t             to;
+  size_t             hits;
+} shared_job_t;
+
+  static void *
+shared_worker( void * arg )
+{
+  shared_job_t * job = arg;
+  for ( size_t i = job->from; i < job->to; i++ )
+    {
+      job->hits += ino_set_shared_mark( job->set, keys[i].dev, keys[i].ino );
+    }
+  return NULL;
+}
+
+  static void
+bench_shared( size_t n, int nthreads )
+{
+  char               name[32];
+  size_t             base = heap_used();
+  ino_set_shared_t * set  = ino_set_shared_new( 0 );
+  pthread_t          threads[nthreads];
+  shared_job_t       jobs[nthreads];
+  size_t             hits = 0;
+  double             t0   = now();
+
+  for ( int t = 0; t < nthreads; t++ )
+    {
+      jobs[t] = (shared_job_t) { set, n * t / nthreads,
+                                 n * ( t + 1 ) / nthreads, 0 };
+      pthread_create( & threads[t], NULL, shared_worker, & jobs[t] );
+    }
+  for ( int t = 0; t < nthreads; t++ )
+    {
+      pthread_join( threads[t], NULL );
+      hits += jobs[t].hits;
+    }
+
+  snprintf( name, sizeof( name ), "ino_set_shared (%dT)", nthreads );
+  report( name, n, n, now() - t0, heap_used() - base, hits );
+  ino_set_shared_free( set );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  int
+main( int argc, char * argv[], char ** envp )
+{
+  size_t sizes[] = { 10000, 1000000, 10000000 };
+  int    nsizes  = sizeof( sizes ) / sizeof( sizes[0] );
+
+  /* Sizes may be overridden on the command line. */
+  if ( argc > 1 ) nsizes = argc - 1;
+
+  printf( "%-22s %10s %13s %9s %10s %10s\n",
+          "structure", "inodes", "seconds", "ns/op", "MiB", "revisits"
+        );
+  for ( int s = 0; s < nsizes; s++ )
+    {
+      size_t n = ( argc > 1 ) ? strtoull( argv[s + 1], NULL, 10 ) : sizes[s];
+      gen_keys( n );
+      bench_legacy( n );
+      bench_set( n );
+      bench_shared( n, 1 );
+      bench_shared( n, 4 );
+    }
+  printf( "* projected from the prefix completed within %.0fs\n",
+          LEGACY_BUDGET_SECS
+        );
+
+  free( keys );
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
@@ -0,0 +1,265 @@
+/* -*- mode: c; -*- */
+
+/**
+ * Compares the `gelf_getsym'/`elf_strptr' loop `printsyms' used to run with
+ * `elf_map_syms', over the symbol table of a single object.
+ *
+ * Given no arguments a libxul sized object ( one million symbols ) is
+ * synthesized in a temporary file; otherwise the named object is used.
+ */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <libelf.h>
+#include <gelf.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+#define SYNTH_NSYMS 1000000
+#define ROUNDS      5
+
+/**
+ * Write a relocatable x86_64 object holding only a symbol table of `nsyms'
+ * global functions with C++-ish names, plus its string tables.
+ */
+  static void
+synth_object( int fd, size_t nsyms )
+{
+  static const char shstrtab[] = "\0.symtab\0.strtab\0.shstrtab\0.text";
+  Elf64_Ehdr   ehdr;
+  Elf64_Shdr   shdr[5];
+  Elf64_Sym  * syms    = calloc( nsyms, sizeof( Elf64_Sym ) );
+  char       * strtab  = malloc( nsyms * 64 + 1 );
+  size_t       strsize = 1;
+  off_t        off     = sizeof( ehdr );
+
+  assert( ( syms != NULL ) && ( strtab != NULL ) );
+  strtab[0] = '\0';
+  for ( size_t i = 1; i < nsyms; i++ )
+    {
+      syms[i].st_name  = strsize;
+      syms[i].st_info  = ELF64_ST_INFO( ( i % 7 ) ? STB_GLOBAL : STB_LOCAL,
+                                        STT_FUNC
+                                      );
+      syms[i].st_shndx = ( i % 11 ) ? 4 : SHN_UNDEF;
+      syms[i].st_value = i * 16;
+      syms[i].st_size  = 16;
+      strsize += 1 + sprintf( strtab + strsize,
+                              "_ZN7mozilla3dom%zuBindingImpl%zuEv", i % 977, i
+                            );
+    }
+
+  memset( & ehdr, 0, sizeof( ehdr ) );
+  memcpy( ehdr.e_ident, ELFMAG, SELFMAG );
+  ehdr.e_ident[EI_CLASS]   = ELFCLASS64;
+  ehdr.e_ident[EI_DATA]    = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_type      = ET_REL;
+  ehdr.e_machine   = EM_X86_64;
+  ehdr.e_version   = EV_CURRENT;
+  ehdr.e_ehsize    = sizeof( Elf64_Ehdr );
+  ehdr.e_shentsize = sizeof( Elf64_Shdr );
+  ehdr.e_shnum     = 5;
+  ehdr.e_shstrndx  = 3;
+
+  memset( shdr, 0, sizeof( shdr ) );
+  shdr[1] = (Elf64_Shdr) { .sh_name = 1, .sh_type = SHT_SYMTAB, .sh_link = 2,
+                           .sh_offset = off, .sh_info = 1,
+                           .sh_size = nsyms * sizeof( Elf64_Sym ),
+                           .sh_entsize = sizeof( Elf64_Sym ), .sh_addralign = 8
+                         };
+  off += shdr[1].sh_size;
+  shdr[2] = (Elf64_Shdr) { .sh_name = 9, .sh_type = SHT_STRTAB,
+                           .sh_offset = off, .sh_size = strsize,
+                           .sh_addralign = 1
+                         };
+  off += strsize;
+  shdr[3] = (Elf64_Shdr) { .sh_name = 17, .sh_type = SHT_STRTAB,
+                           .sh_offset = off, .sh_size = sizeof( shstrtab ),
+                           .sh_addralign = 1
+                         };
+  off += sizeof( shstrtab );
+  shdr[4] = (Elf64_Shdr) { .sh_name = 27, .sh_type = SHT_NOBITS,
+                           .sh_flags = SHF_ALLOC | SHF_EXECINSTR,
+                           .sh_size = nsyms * 16, .sh_addralign = 16
+                         };
+  off = ( off + 7 ) & ~7;
+  ehdr.e_shoff = off;
+
+  pwrite( fd, & ehdr, sizeof( ehdr ), 0 );
+  pwrite( fd, syms, shdr[1].sh_size, shdr[1].sh_offset );
+  pwrite( fd, strtab, strsize, shdr[2].sh_offset );
+  pwrite( fd, shstrtab, sizeof( shstrtab ), shdr[3].sh_offset );
+  pwrite( fd, shdr, sizeof( shdr ), ehdr.e_shoff );
+
+  free( syms );
+  free( strtab );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static double
+now( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, & ts );
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** Exported names are hashed so neither loop can be optimized away. */
+typedef struct { size_t count; uint64_t hash; } tally_t;
+
+  static void
+tally_name( tally_t * t, const char * name )
+{
+  t->count++;
+  t->hash = ( t->hash * 31 ) + (unsigned char) name[0] + strlen( name );
+}
+
+  static void
+tally_export( const elf_sym_t * sym, void * aux )
+{
+  if ( elf_sym_exportp( sym ) ) tally_name( aux, sym->name );
+}
+
+/** The loop formerly used by `printsyms'. */
+  static void
+run_libelf( int fd, tally_t * t )
+{
+  GElf_Shdr   shdr;
+  Elf       * elf  = elf_begin( fd, ELF_C_READ_MMAP, NULL );
+  Elf_Scn   * scn  = NULL;
+  Elf_Data  * data = NULL;
+
+  while ( ( scn = elf_nextscn( elf, scn ) ) != NULL )
+    {
+      gelf_getshdr( scn, & shdr );
+      if ( shdr.sh_type == SHT_SYMTAB ) break;
+    }
+  if ( scn == NULL )
+    {
+      fprintf( stderr, "Object has no symbol table\n" );
+      exit( EXIT_FAILURE );
+    }
+  data = elf_getdata( scn, NULL );
+
+  for ( size_t i = 0; i < shdr.sh_size / shdr.sh_entsize; i++ )
+    {
+      GElf_Sym     sym;
+      const char * name;
+      gelf_getsym( data, i, & sym );
+      name = elf_strptr( elf, shdr.sh_link, sym.st_name );
+      if ( ( name == NULL ) || ( name[0] == '\0' ) ||
+           ( sym.st_shndx == SHN_UNDEF ) ||
+           ( GELF_ST_BIND( sym.st_info ) == STB_LOCAL ) ||
+           ( GELF_ST_BIND( sym.st_info ) == STB_NUM )
+         )
+        {
+          continue;
+        }
+      tally_name( t, name );
+    }
+  elf_end( elf );
+}
+
+  static void
+run_raw( int fd, tally_t * t )
+{
+  struct stat   st;
+  void        * base = NULL;
+  fstat( fd, & st );
+  base = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  assert( base != MAP_FAILED );
+  if ( ! elf_map_syms( base, st.st_size, SHT_SYMTAB, tally_export, t ) )
+    {
+      fprintf( stderr, "elf_map_syms: rejected object\n" );
+      exit( EXIT_FAILURE );
+    }
+  munmap( base, st.st_size );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  int
+main( int argc, char * argv[], char ** envp )
+{
+  char     tmpl[] = "/tmp/bench-symtab-XXXXXX";
+  int      fd     = -1;
+  double   best[2] = { 1e9, 1e9 };
+  tally_t  t[2];
+
+  elf_version( EV_CURRENT );
+
+  if ( argc > 1 )
+    {
+      fd = open( argv[1], O_RDONLY );
+    }
+  else
+    {
+      fd = mkstemp( tmpl );
+      if ( fd != -1 )
+        {
+          unlink( tmpl );
+          synth_object( fd, SYNTH_NSYMS );
+        }
+    }
+  if ( fd == -1 )
+    {
+      perror( "open" );
+      return EXIT_FAILURE;
+    }
+
+  for ( int r = 0; r < ROUNDS; r++ )
+    {
+      double t0;
+      memset( t, 0, sizeof( t ) );
+      t0 = now();
+      run_libelf( fd, & t[0] );
+      if ( ( now() - t0 ) < best[0] ) best[0] = now() - t0;
+      t0 = now();
+      run_raw( fd, & t[1] );
+      if ( ( now() - t0 ) < best[1] ) best[1] = now() - t0;
+    }
+
+  if ( ( t[0].count != t[1].count ) || ( t[0].hash != t[1].hash ) )
+    {
+      fprintf( stderr, "Readers disagree: %zu vs. %zu exports\n",
+               t[0].count, t[1].count
+             );
+      return EXIT_FAILURE;
+    }
+
+  printf( "%-24s %10s %12s %10s\n", "reader", "exports", "seconds", "ns/sym" );
+  printf( "%-24s %10zu %12.4f %10.1f\n", "gelf_getsym+elf_strptr",
+          t[0].count, best[0], best[0] * 1e9 / t[0].count
+        );
+  printf( "%-24s %10zu %12.4f %10.1f\n", "elf_map_syms",
+          t[1].count, best[1], best[1] * 1e9 / t[1].count
+        );
+  printf( "speedup: %.2fx ( best of %d )\n", best[0] / best[1], ROUNDS );
+
+  close( fd );
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
@@ -0,0 +1,1048 @@
+/* -*- mode: c; -*- */
+
+/**
+ * Measures the traversal and dumping routines over a synthetic tree.
+ *
+ * The tree is generated deterministically from a seed and mixes executables,
+ * shared objects, relocatable objects, large AR archives using GNU and BSD
+ * long member names, non-ELF noise, hardlinks, symlink loops, and a deeply
+ * nested chain of directories.
+ *
+ * Each workload runs in a forked child so that its peak RSS and I/O counters
+ * are its own.
+ * Throughput, bytes passed through `read' ( `rchar' ), bytes fetched from
+ * storage ( `read_bytes' ), and major faults come from timed runs; system
+ * calls are counted in a separate run under `ptrace', which would otherwise
+ * skew the timings.
+ * Heap allocations are counted by wrapping glibc's allocator, so that the
+ * traversal's per-file allocations show up as `alloc/file'.
+ * Cold runs first drop every file of the tree from the page cache with
+ * `posix_fadvise( POSIX_FADV_DONTNEED )'; directory entries and inodes stay
+ * cached, so cold numbers mostly reflect file data.
+ * Page cache only hides latency that storage has, so `io_order' is best
+ * judged with `-t' on a tree copied to a filesystem image on a loop device
+ * backed by a rotating disk, or on a network filesystem.
+ */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <elf.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+#define DEFAULT_NFILES 20000
+#define DEFAULT_SEED   1
+#define ROUNDS         3
+#define DEEP_LEVELS    64
+
+/** xorshift64*, so that trees only depend on the seed. */
+typedef struct { uint64_t s; } rng_t;
+
+  static uint64_t
+rng_next( rng_t * r )
+{
+  r->s ^= r->s >> 12;
+  r->s ^= r->s << 25;
+  r->s ^= r->s >> 27;
+  return r->s * 0x2545f4914f6cdd1dULL;
+}
+
+  static size_t
+rng_below( rng_t * r, size_t n )
+{
+  return rng_next( r ) % n;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Append an x86_64 object of type `type' holding a symbol table of `nsyms'
+ * symbols, mostly global, plus its string tables.
+ * Offsets are relative to the object's first byte so it may be embedded in
+ * an archive.
+ */
+  static void
+synth_elf( obuf_t * ob, uint16_t type, size_t nsyms, rng_t * rng )
+{
+  static const char shstrtab[] = "\0.symtab\0.strtab\0.shstrtab\0.text";
+  static const char pad[8]     = { 0 };
+  Elf64_Ehdr   ehdr;
+  Elf64_Shdr   shdr[5];
+  obuf_t       strtab;
+  Elf64_Sym  * syms = calloc( nsyms, sizeof( Elf64_Sym ) );
+  size_t       off  = sizeof( ehdr );
+
+  assert( syms != NULL );
+  obuf_init( & strtab, nsyms * 24 + 1 );
+  obuf_append( & strtab, "", 1 );
+  for ( size_t i = 1; i < nsyms; i++ )
+    {
+      char name[32];
+      int  len = snprintf( name, sizeof( name ), "sym_%08x_%zu",
+                           (unsigned) rng_next( rng ), i
+                         );
+      syms[i].st_name  = strtab.len;
+      syms[i].st_info  = ELF64_ST_INFO( ( i % 5 ) ? STB_GLOBAL : STB_LOCAL,
+                                        STT_FUNC
+                                      );
+      syms[i].st_shndx = ( i % 9 ) ? 4 : SHN_UNDEF;
+      syms[i].st_value = i * 16;
+      syms[i].st_size  = 16;
+      obuf_append( & strtab, name, len + 1 );
+    }
+
+  memset( & ehdr, 0, sizeof( ehdr ) );
+  memcpy( ehdr.e_ident, ELFMAG, SELFMAG );
+  ehdr.e_ident[EI_CLASS]   = ELFCLASS64;
+  ehdr.e_ident[EI_DATA]    = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_type      = type;
+  ehdr.e_machine   = EM_X86_64;
+  ehdr.e_version   = EV_CURRENT;
+  ehdr.e_ehsize    = sizeof( Elf64_Ehdr );
+  ehdr.e_shentsize = sizeof( Elf64_Shdr );
+  ehdr.e_shnum     = 5;
+  ehdr.e_shstrndx  = 3;
+
+  memset( shdr, 0, sizeof( shdr ) );
+  shdr[1] = (Elf64_Shdr) { .sh_name = 1, .sh_type = SHT_SYMTAB, .sh_link = 2,
+                           .sh_offset = off, .sh_info = 1,
+                           .sh_size = nsyms * sizeof( Elf64_Sym ),
+                           .sh_entsize = sizeof( Elf64_Sym ), .sh_addralign = 8
+                         };
+  off += shdr[1].sh_size;
+  shdr[2] = (Elf64_Shdr) { .sh_name = 9, .sh_type = SHT_STRTAB,
+                           .sh_offset = off, .sh_size = strtab.len,
+                           .sh_addralign = 1
+                         };
+  off += strtab.len;
+  shdr[3] = (Elf64_Shdr) { .sh_name = 17, .sh_type = SHT_STRTAB,
+                           .sh_offset = off, .sh_size = sizeof( shstrtab ),
+                           .sh_addralign = 1
+                         };
+  off += sizeof( shstrtab );
+  shdr[4] = (Elf64_Shdr) { .sh_name = 27, .sh_type = SHT_NOBITS,
+                           .sh_flags = SHF_ALLOC | SHF_EXECINSTR,
+                           .sh_size = nsyms * 16, .sh_addralign = 16
+                         };
+  ehdr.e_shoff = ( off + 7 ) & ~7;
+
+  obuf_append( ob, & ehdr, sizeof( ehdr ) );
+  obuf_append( ob, syms, shdr[1].sh_size );
+  obuf_append( ob, strtab.buf, strtab.len );
+  obuf_append( ob, shstrtab, sizeof( shstrtab ) );
+  obuf_append( ob, pad, ehdr.e_shoff - off );
+  obuf_append( ob, shdr, sizeof( shdr ) );
+
+  obuf_free( & strtab );
+  free( syms );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** `name' is cut to the 16 byte header field. */
+  static void
+ar_header( obuf_t * ob, const char * name, size_t size )
+{
+  char hdr[80];
+  if ( snprintf( hdr, sizeof( hdr ), "%-16.16s%-12d%-6d%-6d%-8o%-10zu`\n",
+                 name, 0, 0, 0, 0644, size
+               ) != 60
+     )
+    {
+      fprintf( stderr, "%s: member too large\n", name );
+      exit( EXIT_FAILURE );
+    }
+  obuf_append( ob, hdr, 60 );
+}
+
+  static void
+ar_pad( obuf_t * ob )
+{
+  if ( ( ob->len % 2 ) != 0 ) obuf_append( ob, "\n", 1 );
+}
+
+  static void
+member_name( char * buf, size_t bufsz, size_t i )
+{
+  if ( ( i % 2 ) == 0 )
+    {
+      snprintf( buf, bufsz, "m%04zu.o", i );
+    }
+  else
+    {
+      snprintf( buf, bufsz, "generated_member_%04zu_with_a_long_name.o", i );
+    }
+}
+
+/**
+ * Append an archive of `nmembers' relocatable objects, naming members as GNU
+ * `ar' does, with a `//' table holding names of 16 bytes or more, or as BSD
+ * `ar' does, with every name inline.
+ */
+  static void
+synth_ar( obuf_t * ob, size_t nmembers, bool bsd, rng_t * rng )
+{
+  char   name[64];
+  char   field[24];  /* Fits any number, `ar_header' keeps 16 bytes */
+  obuf_t obj;
+  obuf_t names;
+
+  obuf_init( & obj, 0 );
+  obuf_init( & names, 0 );
+  obuf_append( ob, AR_MAGIC, AR_MAGIC_SIZE );
+
+  if ( ! bsd )
+    {
+      for ( size_t i = 0; i < nmembers; i++ )
+        {
+          member_name( name, sizeof( name ), i );
+          if ( strlen( name ) < 16 ) continue;
+          obuf_append( & names, name, strlen( name ) );
+          obuf_append( & names, "/\n", 2 );
+        }
+      ar_header( ob, "//", names.len );
+      obuf_append( ob, names.buf, names.len );
+      ar_pad( ob );
+    }
+
+  for ( size_t i = 0, lpos = 0; i < nmembers; i++ )
+    {
+      size_t nlen;
+      obj.len = 0;
+      synth_elf( & obj, ET_REL, 8 + rng_below( rng, 120 ), rng );
+      member_name( name, sizeof( name ), i );
+      nlen = strlen( name );
+      if ( bsd )
+        {
+          snprintf( field, sizeof( field ), "#1/%zu", nlen );
+          ar_header( ob, field, nlen + obj.len );
+          obuf_append( ob, name, nlen );
+        }
+      else if ( nlen >= 16 )
+        {
+          snprintf( field, sizeof( field ), "/%zu", lpos );
+          ar_header( ob, field, obj.len );
+          lpos += nlen + 2;
+        }
+      else
+        {
+          snprintf( field, sizeof( field ), "%.15s/", name );
+          ar_header( ob, field, obj.len );
+        }
+      obuf_append( ob, obj.buf, obj.len );
+      ar_pad( ob );
+    }
+
+  obuf_free( & obj );
+  obuf_free( & names );
+}
+
+/** Text, random bytes, truncated ELF headers, and archives of text. */
+  static void
+synth_noise( obuf_t * ob, rng_t * rng )
+{
+  static const char text[] =
+    "Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n";
+  size_t n = 0;
+
+  switch ( rng_below( rng, 4 ) )
+    {
+      case 0:
+        for ( n = 1 + rng_below( rng, 256 ); n > 0; n-- )
+          {
+            obuf_append( ob, text, sizeof( text ) - 1 );
+          }
+        break;
+
+      case 1:
+        for ( n = 1 + rng_below( rng, 4096 ); n > 0; n-- )
+          {
+            uint32_t w = rng_next( rng ) >> 32;
+            obuf_append( ob, & w, sizeof( w ) );
+          }
+        break;
+
+      case 2:
+        obuf_append( ob, ELFMAG, SELFMAG );
+        break;
+
+      default:
+        obuf_append( ob, AR_MAGIC, AR_MAGIC_SIZE );
+        for ( n = 0; n < 4; n++ )
+          {
+            ar_header( ob, "README/", sizeof( text ) - 1 );
+            obuf_append( ob, text, sizeof( text ) - 1 );
+            ar_pad( ob );
+          }
+        break;
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+write_file( const char * path, const obuf_t * ob, mode_t mode )
+{
+  int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, mode );
+  if ( ( fd == -1 ) ||
+       ( write( fd, ob->buf, ob->len ) != (ssize_t) ob->len )
+     )
+    {
+      perror( path );
+      exit( EXIT_FAILURE );
+    }
+  close( fd );
+}
+
+/**
+ * Format a path of the synthetic tree into `buf', of `size' bytes, exiting if
+ * it does not fit; returns its length.
+ */
+  static size_t
+tree_path( char * buf, size_t size, const char * fmt, ... )
+{
+  va_list ap;
+  int     len;
+
+  va_start( ap, fmt );
+  len = vsnprintf( buf, size, fmt, ap );
+  va_end( ap );
+  if ( ( len < 0 ) || ( (size_t) len >= size ) )
+    {
+      fprintf( stderr, "%s: path too long\n", buf );
+      exit( EXIT_FAILURE );
+    }
+  return len;
+}
+
+/** Create `path' and any missing parents. */
+  static void
+make_dirs( char * path )
+{
+  for ( char * p = path + 1; *p != '\0'; p++ )
+    {
+      if ( *p != '/' ) continue;
+      *p = '\0';
+      mkdir( path, 0755 );
+      *p = '/';
+    }
+  mkdir( path, 0755 );
+}
+
+typedef struct {
+  size_t elfs;
+  size_t archives;
+  size_t members;
+  size_t noise;
+  size_t links;
+  size_t loops;
+  size_t bytes;
+} tree_stats_t;
+
+/** Populate `root' with roughly `nfiles' files. */
+  static void
+synth_tree( const char * root, size_t nfiles, uint64_t seed,
+            tree_stats_t * ts
+          )
+{
+  char   dir[PATH_MAX];
+  char   path[PATH_MAX];
+  char   last_elf[PATH_MAX] = "";
+  rng_t  rng = { seed * 0x9e3779b97f4a7c15ULL + 1 };
+  obuf_t ob;
+
+  memset( ts, 0, sizeof( *ts ) );
+  obuf_init( & ob, 0 );
+
+  for ( size_t i = 0; i < nfiles; i++ )
+    {
+      size_t len   = tree_path( dir, sizeof( dir ), "%s", root );
+      size_t depth = rng_below( & rng, 4 );
+      size_t kind  = rng_below( & rng, 100 );
+
+      for ( size_t d = 0; d < depth; d++ )
+        {
+          len += tree_path( dir + len, sizeof( dir ) - len, "/d%zu",
+                            rng_below( & rng, 6 )
+                          );
+        }
+      make_dirs( dir );
+      ob.len = 0;
+
+      if ( kind < 45 )
+        {
+          /* Executables, shared objects, and relocatable objects. */
+          static const char * const suffix[] = { "", ".so", ".o" };
+          static const uint16_t     type[]   = { ET_EXEC, ET_DYN, ET_REL };
+          size_t t = kind / 15;
+          synth_elf( & ob, type[t], 16 + rng_below( & rng, 1000 ), & rng );
+          tree_path( path, sizeof( path ), "%s/f%zu%s", dir, i, suffix[t] );
+          write_file( path, & ob, ( t == 2 ) ? 0644 : 0755 );
+          tree_path( last_elf, sizeof( last_elf ), "%s", path );
+          ts->elfs++;
+        }
+      else if ( kind < 53 )
+        {
+          size_t nmembers = 32 + rng_below( & rng, 224 );
+          synth_ar( & ob, nmembers, kind >= 49, & rng );
+          tree_path( path, sizeof( path ), "%s/lib%zu.a", dir, i );
+          write_file( path, & ob, 0644 );
+          ts->archives++;
+          ts->members += nmembers;
+        }
+      else if ( kind < 85 )
+        {
+          synth_noise( & ob, & rng );
+          tree_path( path, sizeof( path ), "%s/noise%zu.txt", dir, i );
+          write_file( path, & ob, 0644 );
+          ts->noise++;
+        }
+      else if ( ( kind < 97 ) && ( last_elf[0] != '\0' ) )
+        {
+          tree_path( path, sizeof( path ), "%s/link%zu", dir, i );
+          if ( ( kind < 91 ? link( last_elf, path )
+                           : symlink( last_elf, path )
+               ) == 0
+             )
+            {
+              ts->links++;
+            }
+        }
+      else
+        {
+          tree_path( path, sizeof( path ), "%s/loop%zu", dir, i );
+          if ( symlink( ( kind % 2 ) ? ".." : ".", path ) == 0 ) ts->loops++;
+        }
+      ts->bytes += ob.len;
+    }
+
+  /* A deep chain with an object at the bottom, looping back to its top. */
+  {
+    size_t len = tree_path( dir, sizeof( dir ), "%s/deep", root );
+    for ( size_t d = 0; d < DEEP_LEVELS; d++ )
+      {
+        len += tree_path( dir + len, sizeof( dir ) - len, "/l%02zu", d );
+      }
+    make_dirs( dir );
+    ob.len = 0;
+    synth_elf( & ob, ET_EXEC, 64, & rng );
+    tree_path( path, sizeof( path ), "%s/bottom", dir );
+    write_file( path, & ob, 0755 );
+    tree_path( path, sizeof( path ), "%s/top", dir );
+    tree_path( last_elf, sizeof( last_elf ), "%s/deep", root );
+    if ( symlink( last_elf, path ) == 0 ) ts->loops++;
+    ts->elfs++;
+  }
+
+  obuf_free( & ob );
+}
+
+
+  static int
+remove_one( const char * fpath, const struct stat * sb, int flag,
+            struct FTW * ftw
+          )
+{
+  remove( fpath );
+  return 0;
+}
+
+  static int
+drop_one( const char * fpath, const struct stat * sb, int flag,
+          struct FTW * ftw
+        )
+{
+  int fd = -1;
+  if ( flag != FTW_F ) return 0;
+  if ( ( fd = open( fpath, O_RDONLY | O_NOCTTY | O_NONBLOCK ) ) == -1 )
+    {
+      return 0;
+    }
+  posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+  close( fd );
+  return 0;
+}
+
+  static void
+drop_caches( const char * root )
+{
+  nftw( root, drop_one, 64, FTW_PHYS );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/*
+ * Allocations made by any thread, counted by overriding the allocator entry
+ * points and forwarding to glibc's own.  Frees are not counted, each is
+ * paired with one of these.
+ */
+extern void * __libc_malloc( size_t );
+extern void * __libc_calloc( size_t, size_t );
+extern void * __libc_realloc( void *, size_t );
+extern void * __libc_memalign( size_t, size_t );
+
+static uint64_t nallocs = 0;
+
+#define COUNT_ALLOC() __atomic_add_fetch( & nallocs, 1, __ATOMIC_RELAXED )
+
+  void *
+malloc( size_t size )
+{
+  COUNT_ALLOC();
+  return __libc_malloc( size );
+}
+
+  void *
+calloc( size_t nmemb, size_t size )
+{
+  COUNT_ALLOC();
+  return __libc_calloc( nmemb, size );
+}
+
+  void *
+realloc( void * ptr, size_t size )
+{
+  COUNT_ALLOC();
+  return __libc_realloc( ptr, size );
+}
+
+  int
+posix_memalign( void ** ptr, size_t align, size_t size )
+{
+  COUNT_ALLOC();
+  *ptr = __libc_memalign( align, size );
+  return ( ( *ptr == NULL ) && ( size != 0 ) ) ? ENOMEM : 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Workloads return the number of items they handled, for sanity checks. */
+typedef size_t (*run_fn)( char * root );
+
+  static void
+count_file( const char * fname, void * aux )
+{
+  ( *(size_t *) aux )++;
+}
+
+  static size_t
+run_map_files( char * root )
+{
+  size_t n = 0;
+  map_files_recur( & root, 1, count_file, & n );
+  return n;
+}
+
+  static size_t
+run_print_elfs( char * root )
+{
+  print_elfs_recur( & root, 1 );
+  fflush( stdout );
+  return 0;
+}
+
+/** As `print_elfs_recur', with `io_order'; compare cold runs of both. */
+  static size_t
+run_print_elfs_io_order( char * root )
+{
+  map_opts_t opts = { .nthreads = 0, .concurrent = true, .io_order = true };
+  print_elfs_recur_opts( & root, 1, & opts, NULL, NULL, NULL, OUT_TEXT );
+  fflush( stdout );
+  return 0;
+}
+
+/** As `print_elfs_recur', with `classify'. */
+  static size_t
+run_print_elfs_batch( char * root )
+{
+  map_opts_t opts = { .nthreads = 0, .concurrent = true, .classify = true };
+  print_elfs_recur_opts( & root, 1, & opts, NULL, NULL, NULL, OUT_TEXT );
+  fflush( stdout );
+  return 0;
+}
+
+/**
+ * As `print_elfs_recur', with a query most files fail on their header and
+ * the rest on their symbols; compare with `print_elfs_recur'.
+ */
+  static size_t
+run_print_elfs_query( char * root )
+{
+  map_opts_t    opts  = { .nthreads = 0, .concurrent = true };
+  elf_query_t * query = elf_query_compile( "type=dyn exports=main" );
+  print_elfs_recur_opts( & root, 1, & opts, NULL, NULL, query, OUT_TEXT );
+  fflush( stdout );
+  elf_query_free( query );
+  return 0;
+}
+
+  static void
+count_arelf( const char * fname, void * aux )
+{
+  if ( arelfp( fname ) ) ( *(size_t *) aux )++;
+}
+
+  static size_t
+run_arelfp( char * root )
+{
+  size_t n = 0;
+  map_files_recur( & root, 1, count_arelf, & n );
+  return n;
+}
+
+  static void
+print_export( const elf_sym_t * sym, void * out )
+{
+  if ( elf_sym_exportp( sym ) ) obuf_putline( (obuf_t *) out, sym->name );
+}
+
+/** Output is formatted as `printsyms' does, then discarded. */
+  static void
+dump_object( const elf_view_t * obj, void * aux )
+{
+  obuf_t * out = (obuf_t *) aux;
+  elf_map_syms( obj->data, obj->size, SHT_SYMTAB, print_export, out );
+  if ( out->len >= ( OBUF_DEFAULT_SIZE / 2 ) ) out->len = 0;
+}
+
+  static size_t
+run_printsyms( char * root )
+{
+  obuf_t out;
+  obuf_init( & out, 0 );
+  map_elfs_recur( & root, 1, dump_object, & out );
+  obuf_free( & out );
+  return 1;
+}
+
+typedef struct {
+  const char * name;
+  run_fn       run;
+} workload_t;
+
+static const workload_t workloads[] = {
+  { "map_files_recur",  run_map_files           },
+  { "print_elfs_recur", run_print_elfs          },
+  { "print_elfs_order", run_print_elfs_io_order },
+  { "print_elfs_batch", run_print_elfs_batch    },
+  { "print_elfs_query", run_print_elfs_query    },
+  { "arelfp",           run_arelfp              },
+  { "printsyms",        run_printsyms           }
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+  double   secs;
+  uint64_t rchar;       /* Bytes passed through `read' and friends */
+  uint64_t read_bytes;  /* Bytes fetched from storage */
+  long     majflt;
+  long     maxrss_kb;
+  uint64_t allocs;
+  size_t   items;
+} sample_t;
+
+  static void
+read_proc_io( uint64_t * rchar, uint64_t * read_bytes )
+{
+  char               key[32];
+  unsigned long long val;
+  FILE             * fp = fopen( "/proc/self/io", "r" );
+
+  *rchar = *read_bytes = 0;
+  if ( fp == NULL ) return;
+  while ( fscanf( fp, "%31[^:]: %llu\n", key, & val ) == 2 )
+    {
+      if ( strcmp( key, "rchar" ) == 0 )      *rchar      = val;
+      if ( strcmp( key, "read_bytes" ) == 0 ) *read_bytes = val;
+    }
+  fclose( fp );
+}
+
+  static double
+now( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, & ts );
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/** Children never print, `print_elfs_recur' output is discarded. */
+  static void
+quiet_stdout( void )
+{
+  int fd = open( "/dev/null", O_WRONLY );
+  if ( fd != -1 )
+    {
+      dup2( fd, STDOUT_FILENO );
+      close( fd );
+    }
+}
+
+/** Run `w' in a child, reporting its own counters. */
+  static sample_t
+run_sample( const workload_t * w, char * root )
+{
+  sample_t s;
+  int      fds[2];
+  pid_t    pid;
+
+  memset( & s, 0, sizeof( s ) );
+  if ( pipe( fds ) != 0 ) return s;
+
+  if ( ( pid = fork() ) == 0 )
+    {
+      struct rusage ru;
+      uint64_t      rchar0, rbytes0, allocs0;
+      double        t0;
+
+      close( fds[0] );
+      quiet_stdout();
+      read_proc_io( & rchar0, & rbytes0 );
+      allocs0 = __atomic_load_n( & nallocs, __ATOMIC_RELAXED );
+      t0 = now();
+      s.items = w->run( root );
+      s.secs  = now() - t0;
+      s.allocs = __atomic_load_n( & nallocs, __ATOMIC_RELAXED ) - allocs0;
+      read_proc_io( & s.rchar, & s.read_bytes );
+      s.rchar      -= rchar0;
+      s.read_bytes -= rbytes0;
+      getrusage( RUSAGE_SELF, & ru );
+      s.majflt    = ru.ru_majflt;
+      s.maxrss_kb = ru.ru_maxrss;
+      write( fds[1], & s, sizeof( s ) );
+      _exit( EXIT_SUCCESS );
+    }
+
+  close( fds[1] );
+  if ( ( pid == -1 ) || ( read( fds[0], & s, sizeof( s ) ) != sizeof( s ) ) )
+    {
+      fprintf( stderr, "%s: child failed\n", w->name );
+      exit( EXIT_FAILURE );
+    }
+  close( fds[0] );
+  waitpid( pid, NULL, 0 );
+  return s;
+}
+
+/**
+ * Report the number of files `print_elfs_batch' keeps in flight per batch,
+ * from the library's counters, in a child so they stay off for the samples.
+ */
+  static void
+report_batch_depth( char * root )
+{
+  stats_t st;
+  int     fds[2];
+  pid_t   pid;
+
+  memset( & st, 0, sizeof( st ) );
+  if ( pipe( fds ) != 0 ) return;
+  if ( ( pid = fork() ) == 0 )
+    {
+      close( fds[0] );
+      quiet_stdout();
+      if ( stats_enable() ) run_print_elfs_batch( root );
+      stats_collect( & st );
+      write( fds[1], & st, sizeof( st ) );
+      _exit( EXIT_SUCCESS );
+    }
+
+  close( fds[1] );
+  if ( ( pid != -1 ) &&
+       ( read( fds[0], & st, sizeof( st ) ) == sizeof( st ) ) &&
+       ( st.batches > 0 )
+     )
+    {
+      printf( "  %llu classify batches, %.1f files in flight on average\n",
+              (unsigned long long) st.batches,
+              (double) st.batch_depth / st.batches
+            );
+    }
+  close( fds[0] );
+  if ( pid != -1 ) waitpid( pid, NULL, 0 );
+}
+
+/**
+ * Count the system calls made by `w', following every thread it spawns.
+ * Returns -1 if tracing is not permitted.
+ */
+  static long
+count_syscalls( const workload_t * w, char * root )
+{
+  long  stops = 0;
+  int   status;
+  pid_t pid;
+  pid_t tid;
+
+  if ( ( pid = fork() ) == 0 )
+    {
+      quiet_stdout();
+      if ( ptrace( PTRACE_TRACEME, 0, NULL, NULL ) != 0 ) _exit( EXIT_FAILURE );
+      raise( SIGSTOP );
+      w->run( root );
+      _exit( EXIT_SUCCESS );
+    }
+  if ( ( pid == -1 ) || ( waitpid( pid, & status, 0 ) != pid ) ) return -1;
+  if ( ! WIFSTOPPED( status ) ) return -1;
+
+  ptrace( PTRACE_SETOPTIONS, pid, NULL,
+          PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL
+        );
+  ptrace( PTRACE_SYSCALL, pid, NULL, NULL );
+
+  while ( ( tid = waitpid( -1, & status, __WALL ) ) > 0 )
+    {
+      long sig = 0;
+      if ( WIFEXITED( status ) || WIFSIGNALED( status ) )
+        {
+          if ( tid == pid ) break;
+          continue;
+        }
+      sig = WSTOPSIG( status );
+      if ( sig == ( SIGTRAP | 0x80 ) )
+        {
+          stops++;
+          sig = 0;
+        }
+      else if ( ( sig == SIGTRAP ) || ( sig == SIGSTOP ) )
+        {
+          /* Clone events, and the initial stop of new threads. */
+          sig = 0;
+        }
+      ptrace( PTRACE_SYSCALL, tid, NULL, (void *) sig );
+    }
+
+  /* Each call stops on entry and on exit. */
+  return stops / 2;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * An archive's identification is its first member's: check that a query is
+ * still decided member by member, with the first member of another machine.
+ */
+  static bool
+check_mixed_archive( const char * root )
+{
+  static const struct { const char * query; bool match; } checks[] =
+    { { "machine=x86_64",          true  },
+      { "machine=aarch64",         true  },
+      { "machine=x86_64 type=rel", true  },
+      { "machine=x86_64 kind=elf", false },
+    };
+  char         path[PATH_MAX];
+  rng_t        rng = { 1 };
+  obuf_t       ob;
+  obuf_t       obj;
+  file_class_t fc;
+  bool         ok  = true;
+
+  obuf_init( & ob, 0 );
+  obuf_init( & obj, 0 );
+  obuf_append( & ob, AR_MAGIC, AR_MAGIC_SIZE );
+  for ( size_t i = 0; i < 2; i++ )
+    {
+      obj.len = 0;
+      synth_elf( & obj, ET_REL, 8, & rng );
+      if ( i == 0 ) ( (Elf64_Ehdr *) obj.buf )->e_machine = EM_AARCH64;
+      ar_header( & ob, ( i == 0 ) ? "arm.o/" : "x86.o/", obj.len );
+      obuf_append( & ob, obj.buf, obj.len );
+      ar_pad( & ob );
+    }
+  tree_path( path, sizeof( path ), "%s/mixed.a", root );
+  write_file( path, & ob, 0644 );
+  obuf_free( & obj );
+  obuf_free( & ob );
+
+  classify_path( path, & fc );
+  for ( size_t i = 0; i < sizeof( checks ) / sizeof( checks[0] ); i++ )
+    {
+      elf_query_t * query = elf_query_compile( checks[i].query );
+      assert( query != NULL );
+      if ( elf_query_match_file( query, path, & fc ) != checks[i].match )
+        {
+          fprintf( stderr, "%s: `%s' should %smatch\n", path,
+                   checks[i].query, checks[i].match ? "" : "not "
+                 );
+          ok = false;
+        }
+      elf_query_free( query );
+    }
+  unlink( path );
+  return ok;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+usage( const char * argv0, FILE * out )
+{
+  fprintf( out,
+           "Usage: %s [-n FILES] [-s SEED] [-k] [-t TREE] [DIR]\n"
+           "Generate a synthetic tree in DIR, or a temporary directory, and\n"
+           "measure traversals and symbol dumping over it.\n"
+           "  -n FILES  Approximate number of files, default %d.\n"
+           "  -s SEED   Generator seed, default %d.\n"
+           "  -k        Keep the tree afterwards.\n"
+           "  -t TREE   Measure an existing tree instead.\n",
+           argv0, DEFAULT_NFILES, DEFAULT_SEED
+         );
+}
+
+
+  int
+main( int argc, char * argv[], char ** envp )
+{
+  char           tmpl[] = "/tmp/bench-tree-XXXXXX";
+  char         * root   = NULL;
+  size_t         nfiles = DEFAULT_NFILES;
+  uint64_t       seed   = DEFAULT_SEED;
+  bool           keep   = false;
+  bool           synth  = true;
+  int            opt    = -1;
+  size_t         census = 0;
+  tree_stats_t   ts;
+  double         t0;
+
+  while ( ( opt = getopt( argc, argv, "hkn:s:t:" ) ) != -1 )
+    {
+      switch ( opt )
+        {
+          case 'n': nfiles = strtoul( optarg, NULL, 10 ); break;
+          case 's': seed   = strtoull( optarg, NULL, 10 ); break;
+          case 'k': keep   = true;                         break;
+          case 't':
+            root  = optarg;
+            synth = false;
+            keep  = true;
+            break;
+
+          case 'h':
+            usage( argv[0], stdout );
+            return EXIT_SUCCESS;
+
+          default:
+            usage( argv[0], stderr );
+            return EXIT_FAILURE;
+        }
+    }
+
+  if ( synth )
+    {
+      if ( optind < argc )
+        {
+          root = argv[optind];
+          if ( mkdir( root, 0755 ) != 0 )
+            {
+              fprintf( stderr, "%s: %s\n", root, strerror( errno ) );
+              return EXIT_FAILURE;
+            }
+        }
+      else if ( ( root = mkdtemp( tmpl ) ) == NULL )
+        {
+          perror( "mkdtemp" );
+          return EXIT_FAILURE;
+        }
+      t0 = now();
+      synth_tree( root, nfiles, seed, & ts );
+      /* Dirty pages cannot be dropped, so cold runs need them written. */
+      sync();
+      printf( "tree: %s ( seed %llu, %.2fs to generate )\n", root,
+              (unsigned long long) seed, now() - t0
+            );
+      printf( "  %zu ELF, %zu archives ( %zu members ), %zu noise, "
+              "%zu links, %zu loops, %.1f MiB\n",
+              ts.elfs, ts.archives, ts.members, ts.noise, ts.links, ts.loops,
+              ts.bytes / 1048576.0
+            );
+    }
+  if ( ! check_mixed_archive( root ) ) return EXIT_FAILURE;
+  census = run_map_files( root );
+  printf( "  %zu distinct files visited\n", census );
+  if ( census == 0 )
+    {
+      fprintf( stderr, "Tree is empty\n" );
+      return EXIT_FAILURE;
+    }
+  report_batch_depth( root );
+  putchar( '\n' );
+
+  printf( "%-16s %-5s %10s %9s %11s %11s %10s %8s %8s\n",
+          "workload", "cache", "files/s", "sys/file", "read B/file",
+          "disk B/file", "alloc/file", "majflt", "RSS MiB"
+        );
+  for ( size_t i = 0; i < sizeof( workloads ) / sizeof( workloads[0] ); i++ )
+    {
+      const workload_t * w        = & workloads[i];
+      long               syscalls = count_syscalls( w, root );
+
+      for ( int cold = 0; cold < 2; cold++ )
+        {
+          sample_t best = { .secs = 1e9 };
+
+          /* Warm runs are preceded by an untimed one to fill the cache. */
+          if ( ! cold ) run_sample( w, root );
+          for ( int r = 0; r < ROUNDS; r++ )
+            {
+              sample_t s;
+              if ( cold ) drop_caches( root );
+              s = run_sample( w, root );
+              if ( s.secs < best.secs ) best = s;
+            }
+
+          printf( "%-16s %-5s %10.0f ", w->name, cold ? "cold" : "warm",
+                  census / best.secs
+                );
+          if ( syscalls < 0 ) printf( "%9s ", "-" );
+          else printf( "%9.2f ", (double) syscalls / census );
+          printf( "%11.0f %11.0f %10.3f %8ld %8.1f\n",
+                  (double) best.rchar / census,
+                  (double) best.read_bytes / census,
+                  (double) best.allocs / census,
+                  best.majflt, best.maxrss_kb / 1024.0
+                );
+        }
+    }
+
+  if ( ! keep ) nftw( root, remove_one, 64, FTW_DEPTH | FTW_PHYS );
+
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
@@ -10,11 +10,119 @@
 #endif
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
 
 
 /* -------------------------------------------------------------------------- */
 
+typedef enum {
+  FILE_KIND_OTHER = 0,  /* Unreadable, or neither ELF nor AR */
+  FILE_KIND_ELF,        /* ELF object, shared object, or executable */
+  FILE_KIND_AR,         /* AR archive without ELF members */
+  FILE_KIND_AR_ELF      /* AR archive with at least one ELF member */
+} file_kind_t;
+
+/**
+ * Result of classifying a file.
+ * For `FILE_KIND_ELF' the remaining fields describe the file's ELF header,
+ * and for `FILE_KIND_AR_ELF' that of an ELF member: the first member if it
+ * is ELF, else the first one listed by the archive's symbol table, else the
+ * first ELF one.
+ * Otherwise they are zero.
+ */
+typedef struct {
+  file_kind_t    kind;
+  unsigned char  ei_class;   /* ELFCLASS32 or ELFCLASS64 */
+  unsigned char  ei_data;    /* ELFDATA2LSB or ELFDATA2MSB */
+  unsigned short e_type;     /* ET_REL, ET_EXEC, ET_DYN, ... */
+  unsigned short e_machine;  /* EM_X86_64, EM_AARCH64, ... */
+} file_class_t;
+
+/**
+ * Classify the file open on `fd' from a single `pread' of its leading bytes.
+ * Only archives require further reads, to search for an ELF member.
+ * `fname' is used in diagnostics, `fc' may be NULL.
+ * `fd' is neither closed nor repositioned.
+ */
+file_kind_t classify_fd( int fd, const char * fname, file_class_t * fc )
+  __attribute__(( nonnull( 2 ) ));
+
+/** Classify the file at path `fname' using a single `open'. */
+file_kind_t classify_path( const char * fname, file_class_t * fc )
+  __attribute__(( nonnull( 1 ) ));
+
+/**
+ * Number of leading bytes read by `classify_fd'.
+ * This covers a 64 bit ELF header, and AR magic plus the first member header.
+ */
+#define CLASSIFY_PEEK_SIZE 128
+
+/**
+ * Classify a file from the first `len' bytes of it held in `buf', of which no
+ * more than `CLASSIFY_PEEK_SIZE' are inspected.
+ * `fd' is only read if the file is an archive, to search for an ELF member;
+ * when it is -1 archives are reported as `FILE_KIND_AR'.
+ */
+file_kind_t classify_header( const void * buf, size_t len, int fd,
+                             const char * fname, file_class_t * fc )
+  __attribute__(( nonnull( 4 ) ));
+
+
+/**
+ * Classifies batches of files with many of them being opened or read at
+ * once, so that storage with high latency, such as NFS or network block
+ * devices, is kept busy rather than waited on one file at a time.
+ * Operations are queued to an `io_uring' when the kernel allows it, and are
+ * otherwise spread over a pool of threads.
+ * A batch is run by a single thread at a time.
+ */
+typedef struct classify_batch_s classify_batch_t;
+
+/**
+ * Threads classifying files for batches which cannot use `io_uring', shared
+ * by any number of them running at once.
+ * Its `nthreads' helpers, at most 32, are only created when first needed,
+ * and each caller of `classify_batch_run' helps with its own batch.
+ */
+typedef struct classify_pool_s classify_pool_t;
+
+classify_pool_t * classify_pool_new( unsigned nthreads );
+
+/** Free `pool', once no batch using it runs. */
+void classify_pool_free( classify_pool_t * pool ) __attribute__(( nonnull ));
+
+/**
+ * Create an engine keeping up to `depth' files in flight.
+ * With `uring' false the thread pool is used even if `io_uring' works.
+ * The pool is `pool' if not NULL, and outlives the batch, otherwise one of
+ * `depth' threads, including the caller, private to the batch.
+ */
+classify_batch_t * classify_batch_new( unsigned depth, bool uring,
+                                       classify_pool_t * pool );
+
+void classify_batch_free( classify_batch_t * cb ) __attribute__(( nonnull ));
+
+/** Detect if `cb' queues its operations to an `io_uring'. */
+bool classify_batch_uringp( const classify_batch_t * cb )
+  __attribute__(( nonnull ));
+
+/**
+ * Classify the `n' files at `paths' into `fcs', as `classify_path' would,
+ * returning once all of them are done.
+ */
+void classify_batch_run( classify_batch_t   * cb,
+                         const char * const * paths,
+                         size_t               n,
+                         file_class_t       * fcs
+                       )
+  __attribute__(( nonnull ));
+
+
 /** Detect if the file at path `fname' has ELF format. */
 bool elfp( const char * fname )   __attribute__(( nonnull ));
 
@@ -25,26 +133,676 @@ bool arp( const char * fname )    __attribute__(( nonnull ));
 bool arelfp( const char * fname ) __attribute__(( nonnull ));
 
 
+/**
+ * Predicates on the identification `classify_fd' reads from an ELF header,
+ * so files can be rejected without being examined further.
+ * Archives are judged by their first ELF member.
+ *
+ * `classes' and `types' are bitmasks of `1 << ELFCLASS*' and `1 << ET_*',
+ * and `machines' lists `EM_*' values; each accepts anything when empty.
+ */
+#define ELF_FILTER_MAX_MACHINES 16
+
+typedef struct {
+  unsigned  classes;
+  unsigned  types;
+  uint16_t  machines[ELF_FILTER_MAX_MACHINES];
+  size_t    nmachines;
+} elf_filter_t;
+
+/**
+ * Add the comma separated `list' to the predicate named `what': "class"
+ * ( `32', `64' ), "machine" ( `x86_64', `aarch64', ..., or a number ), or
+ * "type" ( `rel', `exec', `dyn', `core' ).
+ * Returns false, after printing a message, for unknown names.
+ */
+bool elf_filter_add( elf_filter_t *, const char * what, const char * list )
+  __attribute__(( nonnull ));
+
+/**
+ * Name of `value' for the filter `what', as `elf_filter_add' accepts it, or
+ * NULL if it has none.
+ */
+const char * elf_filter_name( const char * what, unsigned value )
+  __attribute__(( nonnull ));
+
+/** Only `FILE_KIND_ELF' and `FILE_KIND_AR_ELF' files can match. */
+bool elf_filter_match( const elf_filter_t *, const file_class_t * fc )
+  __attribute__(( nonnull ));
+
+
 /* -------------------------------------------------------------------------- */
 
+#define AR_MAGIC      "!<arch>\n"
+#define AR_MAGIC_SIZE ( sizeof( AR_MAGIC ) - 1 )
+
+typedef enum {
+  AR_ARMAP_NONE = 0,
+  AR_ARMAP_SYSV,    /* "/", 32 bit big endian offsets */
+  AR_ARMAP_SYSV64,  /* "/SYM64/", 64 bit big endian offsets */
+  AR_ARMAP_BSD,     /* "__.SYMDEF", `ranlib' structures */
+  AR_ARMAP_BSD64    /* "__.SYMDEF_64" */
+} ar_armap_kind_t;
+
+/**
+ * Iterator over the members of an AR archive held in memory, typically a
+ * single mapping of the whole file.
+ * Nothing is copied: member names, data, and the GNU long name table are all
+ * referenced in place, and no system calls are made.
+ * The symbol table, if any, is skipped over but recorded in `armap'.
+ */
+typedef struct {
+  const unsigned char * base;
+  size_t                size;
+  size_t                pos;         /* Offset of the next member header */
+  const char          * fname;
+  bool                  verbose;
+  const char          * extfn;       /* GNU `//' long name table */
+  size_t                extfn_size;
+  const unsigned char * armap;
+  size_t                armap_size;
+  ar_armap_kind_t       armap_kind;
+} ar_iter_t;
+
+/**
+ * A member of an archive.
+ * `name' is not NUL terminated; its length is `name_len'.
+ * `offset' and `size' delimit the member's data, excluding any BSD style
+ * inline name, and are relative to the start of the archive.
+ */
+typedef struct {
+  const char * name;
+  size_t       name_len;
+  size_t       hdr_offset;
+  size_t       offset;
+  size_t       size;
+  time_t       date;
+  mode_t       mode;
+} ar_ent_t;
+
+/**
+ * Returns false, leaving the iterator exhausted, when `base' does not start
+ * with AR magic.
+ * `fname' is used in diagnostics, which are only printed if `verbose'.
+ */
+bool ar_iter_init( ar_iter_t *, const void * base, size_t size,
+                   const char * fname, bool verbose
+                 ) __attribute__(( nonnull( 1, 2, 4 ) ));
+
+/** Fetch the next regular member, returning false at the end or on error. */
+bool ar_iter_next( ar_iter_t *, ar_ent_t * ) __attribute__(( nonnull ));
+
+/**
+ * Writes `archive:member' to `buf' as `snprintf' would, returning the
+ * untruncated length.
+ */
+size_t ar_ent_fullname( const ar_iter_t *, const ar_ent_t *, char * buf,
+                        size_t bufsz
+                      ) __attribute__(( nonnull ));
+
+/**
+ * Locate the archive's symbol table and GNU long name table, reading only the
+ * headers that precede its first regular member, without moving `ar'.
+ * Returns false if the archive has no symbol table.
+ */
+bool ar_iter_armap( ar_iter_t * ) __attribute__(( nonnull ));
+
+/**
+ * Fetch the regular member whose header sits at `hdr_offset', as found in the
+ * symbol table, leaving `ar' positioned after it.
+ * Returns false, without diagnostics, if no member starts there.
+ * Long names are only resolved once `ar_iter_armap' or a previous walk has
+ * found the GNU name table.
+ */
+bool ar_iter_member_at( ar_iter_t *, size_t hdr_offset, ar_ent_t * )
+  __attribute__(( nonnull ));
+
+/**
+ * An entry of an archive's symbol table: a symbol defined by the member
+ * whose header sits at offset `member'.
+ * `name' is NUL terminated, in place within the archive.
+ */
+typedef struct {
+  const char * name;
+  size_t       name_len;
+  size_t       member;
+} ar_sym_t;
+
+/** Iterator over the entries of the symbol table recorded in an `ar_iter_t'. */
+typedef struct {
+  const unsigned char * map;
+  size_t                map_size;
+  ar_armap_kind_t       kind;
+  size_t                width;    /* Bytes per count, offset or index */
+  bool                  be;
+  size_t                count;
+  size_t                index;
+  size_t                ent_pos;  /* Next offset, or BSD `ranlib' entry */
+  size_t                str_pos;  /* Next SysV name, or BSD string table */
+  size_t                str_end;
+} ar_armap_iter_t;
+
+/**
+ * Returns false if `ar' has not recorded a symbol table, or if its layout is
+ * invalid.
+ */
+bool ar_armap_iter_init( ar_armap_iter_t *, const ar_iter_t * )
+  __attribute__(( nonnull ));
+
+/** Fetch the next symbol, returning false at the end or on error. */
+bool ar_armap_iter_next( ar_armap_iter_t *, ar_sym_t * )
+  __attribute__(( nonnull ));
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Set of ( device, inode ) pairs used to avoid visiting a file twice.
+ * Lookups and insertions are O(1) on average.
+ * `hint' is the expected number of members, 0 if unknown.
+ */
+typedef struct ino_set ino_set_t;
+
+ino_set_t * ino_set_new( size_t hint );
+
+/**
+ * Mark the file corresponding to the Device/Inode indicated as "visited".
+ * Return true if the given file had already been visited previously.
+ */
+bool ino_set_mark( ino_set_t *, dev_t, ino_t ) __attribute__(( nonnull ));
+
+size_t ino_set_count( const ino_set_t * ) __attribute__(( nonnull ));
+void   ino_set_free( ino_set_t * )        __attribute__(( nonnull ));
+
+
 /**
- * Lambda which may be applied to filepaths using `map_files_recur'.
- * FIXME: Change to accept file descriptor instead to allow members of AR
- *        archives to be mapped over as if they were regular files.
- *        The alternative is to temporarily extract members, which is
- *        less efficient.
+ * Thread-safe variant of `ino_set_t' which may be shared by several workers.
+ * Members are spread over independently locked shards to limit contention.
  */
+typedef struct ino_set_shared ino_set_shared_t;
+
+ino_set_shared_t * ino_set_shared_new( size_t hint );
+
+bool ino_set_shared_mark( ino_set_shared_t *, dev_t, ino_t )
+  __attribute__(( nonnull ));
+
+size_t ino_set_shared_count( ino_set_shared_t * ) __attribute__(( nonnull ));
+void   ino_set_shared_free( ino_set_shared_t * )  __attribute__(( nonnull ));
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Lambda which may be applied to filepaths using `map_files_recur'. */
 typedef void (*do_file_fn)( const char * fname, void * aux );
 
+/**
+ * An ELF object visited by `map_elfs_recur', either a regular file or a
+ * member of an AR archive.
+ *
+ * `path' names the file on disk, and `fd' is open on it.
+ * For regular files `name' is the same as `path', `offset' is 0, and `size'
+ * is the size of the file.
+ * For archive members `name' has the form `archive:member', and `offset' and
+ * `size' delimit the member inside of the archive.
+ * `data' points to the object's first byte in a private mapping of `fd', so
+ * members are never copied or extracted.
+ * `fc' holds the object's ELF identification.
+ *
+ * Views are only valid for the duration of the callback they are passed to.
+ */
+typedef struct {
+  const char          * name;
+  const char          * path;
+  int                   fd;
+  off_t                 offset;
+  size_t                size;
+  const unsigned char * data;
+  bool                  member;
+  file_class_t          fc;
+} elf_view_t;
+
+/** Lambda which may be applied to ELF objects using `map_elfs_recur'. */
+typedef void (*do_elf_fn)( const elf_view_t * obj, void * aux );
+
+/**
+ * Applies `fn' to the ELF object at path `fname', or to each ELF member if
+ * `fname' is an AR archive.
+ */
+void map_elf_objects( const char * fname, do_elf_fn fn, void * aux )
+  __attribute__(( nonnull( 1, 2 ) ));
+
+/**
+ * The members of an AR archive, listed so that ranges of them can be visited
+ * by different threads.
+ * `ar' holds the archive's mapping, which is private and writable as for
+ * `map_elf_objects', and its name table; `members' are in archive order.
+ */
+typedef struct {
+  ar_iter_t   ar;
+  int         fd;
+  ar_ent_t  * members;
+  size_t      nmembers;
+} ar_table_t;
+
+/**
+ * Like `map_elf_objects', except that AR archives of at least `split_size'
+ * bytes are not visited: their members are listed in `table' instead, and
+ * true is returned.
+ * Listing reads member headers only; the table must be released with
+ * `ar_table_close'.
+ */
+bool map_elf_objects_split( const char * fname, size_t split_size,
+                            ar_table_t * table, do_elf_fn fn, void * aux
+                          ) __attribute__(( nonnull( 1, 3, 4 ) ));
+
+/**
+ * Applies `fn' to the ELF members of `table' numbered `first' to `last',
+ * excluded.
+ * Disjoint ranges may be visited concurrently.
+ */
+void map_ar_table( const ar_table_t * table, size_t first, size_t last,
+                   do_elf_fn fn, void * aux
+                 ) __attribute__(( nonnull( 1, 4 ) ));
+
+void ar_table_close( ar_table_t * ) __attribute__(( nonnull ));
+
 /** Applies a `do_file_fn' to all files. */
 void map_files_recur( char * const *, int, do_file_fn, void * aux )
   __attribute__(( nonnull( 1, 3 ) ));
 
-/** Applies `do_file_fn' to ELF files only. */
-void map_elfs_recur( char * const *, int, do_file_fn, void * aux )
+/** Applies `do_elf_fn' to ELF files and ELF members of AR archives. */
+void map_elfs_recur( char * const *, int, do_elf_fn, void * aux )
   __attribute__(( nonnull( 1, 3 ) ));
 
 
+/**
+ * Options controlling traversals performed by the `*_recur_opts' routines.
+ *
+ * With `nthreads' other than 1 directories are read by a pool of workers which
+ * balance load by stealing queued subdirectories from one another.
+ * A value of 0 selects one worker per online CPU.
+ * The order in which files are visited is unspecified for parallel walks.
+ *
+ * When `concurrent' is true the callback may run on several workers at once
+ * and must be thread-safe; otherwise invocations are serialized, though
+ * directory reading still proceeds in parallel.
+ *
+ * `prune' is a NULL terminated list of `fnmatch' patterns, or NULL.
+ * Directories below the roots which match any of them are neither passed to
+ * the callback nor read.
+ * Patterns containing a `/' are matched against the whole path, others
+ * against the directory's name, so `.git' and `/proc' both work.
+ *
+ * `io_order' favours cold caches on rotating or network storage: the files of
+ * each directory are collected and visited in inode order once the directory
+ * has been read, after hinting the kernel to fetch their first page, so that
+ * header reads reach the device together and close to physical order.
+ * Subdirectories are still visited as they are read, so files then come after
+ * every subdirectory of their own directory.
+ *
+ * With `classify' the regular files of each directory are held back the same
+ * way and classified together by a `classify_batch_t' before being visited,
+ * which sets `walk_ent_t.fc' for them.  Files of several directories are
+ * held until they fill the batch, or briefly, so they may also come after
+ * later directories.
+ */
+typedef struct {
+  int                  nthreads;
+  bool                 concurrent;
+  const char * const * prune;
+  bool                 io_order;
+  bool                 classify;
+} map_opts_t;
+
+/**
+ * A file visited by a traversal, following symlinks when possible.
+ *
+ * Directories are read with `getdents64', and entries are described from
+ * their `d_type' and `d_ino' where possible, so `st' is usually NULL;
+ * `walk_ent_stat' fetches it on demand.
+ * `type' holds the `S_IFMT' bits of the file's mode, and `dev' and `ino'
+ * identify it.
+ * `fc' is the file's classification when the traversal was asked to
+ * classify, and NULL otherwise; `walk_ent_classify' fetches it on demand.
+ * `fd' is -1, unless `io_order' opened the file ahead of its visit, in which
+ * case `walk_ent_stat' and `walk_ent_classify' use it rather than the path;
+ * the traversal closes it after the callback.
+ * All fields are only valid for the duration of the callback.
+ */
+typedef struct {
+  const char         * path;
+  const struct stat  * st;
+  const file_class_t * fc;
+  mode_t               type;
+  dev_t                dev;
+  ino_t                ino;
+  int                  fd;
+} walk_ent_t;
+
+/**
+ * Returns `ent->st' if the traversal had it, or else `stat's the file into
+ * `buf', returning NULL if it has vanished.
+ */
+const struct stat * walk_ent_stat( const walk_ent_t * ent, struct stat * buf )
+  __attribute__(( nonnull ));
+
+/**
+ * Returns `ent->fc' if the traversal classified the file, or else classifies
+ * it into `buf' with `classify_fd' on `ent->fd', or `classify_path'.
+ */
+const file_class_t * walk_ent_classify( const walk_ent_t * ent,
+                                        file_class_t     * buf
+                                      )
+  __attribute__(( nonnull ));
+
+/**
+ * Detect if the directory at `path' matches one of the `prune' patterns, as
+ * described for `map_opts_t'.
+ */
+bool map_prunedp( const char * const * prune, const char * path )
+  __attribute__(( nonnull ));
+
+/** Lambda which may be applied to traversal entries. */
+typedef void (*do_entry_fn)( const walk_ent_t * ent, void * aux );
+
+/**
+ * Like `map_files_recur_opts', but passes each file's type and identity so
+ * callbacks need not `stat' it themselves.
+ */
+void map_entries_recur_opts( char * const *, int, do_entry_fn, void * aux,
+                             const map_opts_t *
+                           ) __attribute__(( nonnull( 1, 3 ) ));
+
+/** Like `map_files_recur', but allows parallel traversal. */
+void map_files_recur_opts( char * const *, int, do_file_fn, void * aux,
+                           const map_opts_t *
+                         ) __attribute__(( nonnull( 1, 3 ) ));
+
+/**
+ * Like `map_elfs_recur', but allows parallel traversal.
+ * ELF detection always runs on the workers, `concurrent' only affects `fn'.
+ */
+void map_elfs_recur_opts( char * const *, int, do_elf_fn, void * aux,
+                          const map_opts_t *
+                        ) __attribute__(( nonnull( 1, 3 ) ));
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Growable output buffer, used to batch many small records into few large
+ * `write' calls.
+ */
+typedef struct {
+  char   * buf;
+  size_t   len;
+  size_t   cap;
+} obuf_t;
+
+#define OBUF_DEFAULT_SIZE ( 1 << 20 )
+
+/** `cap' is the initial capacity, 0 selects `OBUF_DEFAULT_SIZE'. */
+void obuf_init( obuf_t *, size_t cap ) __attribute__(( nonnull ));
+
+/** Ensure `n' more bytes fit without reallocating. */
+void obuf_reserve( obuf_t *, size_t n ) __attribute__(( nonnull ));
+
+void obuf_append( obuf_t *, const void * data, size_t len )
+  __attribute__(( nonnull ));
+
+/** Append `str' followed by a newline. */
+void obuf_putline( obuf_t *, const char * str ) __attribute__(( nonnull ));
+
+/**
+ * Write the buffer's contents to `fd' and empty it.
+ * Returns false if `write' failed, in which case the contents are dropped.
+ */
+bool obuf_flush( obuf_t *, int fd ) __attribute__(( nonnull ));
+
+/**
+ * Write the contents of the `n' buffers `obs' to `fd' in order, with as few
+ * `writev' calls as possible, and empty them.
+ * Returns false as `obuf_flush' does.
+ */
+bool obuf_flushv( obuf_t * const * obs, size_t n, int fd )
+  __attribute__(( nonnull ));
+
+void obuf_free( obuf_t * ) __attribute__(( nonnull ));
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Output formats for records describing ELF objects or their symbols.
+ *
+ * `OUT_TEXT' prints a record's name, being its path or `ARCHIVE:MEMBER',
+ * followed by a space and its symbol if it has one, and a newline.
+ * `OUT_NUL' prints the same fields, each terminated by a NUL byte, so that
+ * any path survives as it does with `find -print0'.
+ *
+ * `OUT_JSONL' prints one object per line, with the members `path', `member'
+ * and `symbol' when the record has them, and `kind', plus `class', `data',
+ * `type' and `machine' for ELF files and archives of them.
+ * Types and machines are named as filters accept them, or else given as
+ * numbers.
+ * Bytes of paths or symbols which are not valid UTF-8 are escaped as the
+ * lone surrogates U+DC80 to U+DCFF, as Python's `surrogateescape' would, so
+ * that they may be recovered exactly.
+ *
+ * `OUT_BINARY' prints records as a 32 bit length followed by that many bytes
+ * holding: `kind', `ei_class' and `ei_data' as a byte each, a byte of
+ * `OUT_BINARY_*' flags, `e_type' and `e_machine' as 16 bit values, then the
+ * path, member and symbol, each as a 32 bit length and its bytes.
+ * Integers are little endian.
+ * Absent fields have zero length, and a flag telling them from empty ones.
+ */
+typedef enum {
+  OUT_TEXT = 0,
+  OUT_NUL,
+  OUT_JSONL,
+  OUT_BINARY
+} out_format_t;
+
+#define OUT_BINARY_MEMBER  0x1  /* The record has a member */
+#define OUT_BINARY_SYMBOL  0x2  /* The record has a symbol */
+
+/**
+ * Parse `text', `nul', `json' or `binary', returning false for other names.
+ */
+bool out_format_parse( const char * name, out_format_t * fmt )
+  __attribute__(( nonnull ));
+
+/** One object, or one of its symbols when `symbol' is not NULL. */
+typedef struct {
+  const char         * path;
+  const char         * member;  /* Name within the archive at `path' */
+  const file_class_t * fc;      /* May be NULL, for `FILE_KIND_OTHER' */
+  const char         * symbol;
+} out_rec_t;
+
+/** Append `rec' to `ob' in format `fmt'. */
+void out_put( obuf_t * ob, out_format_t fmt, const out_rec_t * rec )
+  __attribute__(( nonnull ));
+
+/**
+ * Writes records to a file descriptor for any number of threads.
+ * Records are buffered whole and written in large blocks, so records from
+ * different threads never interleave.
+ */
+typedef struct out_writer_s out_writer_t;
+
+out_writer_t * out_writer_new( int fd, out_format_t fmt );
+
+void out_writer_put( out_writer_t *, const out_rec_t * rec )
+  __attribute__(( nonnull ));
+
+/**
+ * Write out what is buffered and free the writer, returning false if any
+ * write failed.
+ */
+bool out_writer_close( out_writer_t * ) __attribute__(( nonnull ));
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Persistent cache of classification results, allowing files which have not
+ * changed since a previous run to be classified without being opened.
+ *
+ * Records are keyed on path and are valid while the file's device, inode,
+ * size, and modification time all match.
+ * The cache is kept in a compact binary file which is mapped read-only when
+ * opened; results gathered during a run are held in memory until
+ * `scan_cache_save' atomically replaces the file.
+ * Records for paths not visited by a run are kept for `SCAN_CACHE_MAX_AGE'
+ * further saves, so scans of different subtrees may share one cache.
+ */
+typedef struct scan_cache scan_cache_t;
+
+#define SCAN_CACHE_MAX_AGE 4
+
+/** A missing or invalid cache file yields an empty cache. */
+scan_cache_t * scan_cache_open( const char * path ) __attribute__(( nonnull ));
+
+/**
+ * Classify the file at `ent', answering from the cache when possible and
+ * recording the result for the next save.
+ * Files other than regular files are reported as `FILE_KIND_OTHER' without
+ * being opened or recorded.
+ * Safe to call from several threads at once.
+ */
+file_kind_t scan_cache_classify( scan_cache_t *, const walk_ent_t * ent,
+                                 file_class_t * fc
+                               ) __attribute__(( nonnull( 1, 2 ) ));
+
+/** Atomically replace the cache file with the current contents. */
+bool scan_cache_save( scan_cache_t * ) __attribute__(( nonnull ));
+
+/**
+ * Drop records for files which have changed or disappeared since they were
+ * recorded, then save.
+ */
+bool scan_cache_compact( scan_cache_t * ) __attribute__(( nonnull ));
+
+/** Number of lookups answered from the cache, and those which were not. */
+void scan_cache_counts( scan_cache_t *, size_t * hits, size_t * misses )
+  __attribute__(( nonnull( 1 ) ));
+
+void scan_cache_close( scan_cache_t * ) __attribute__(( nonnull ));
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * In-memory set of ELF files keyed on path, with each file's classification.
+ * Members may be added, updated, and removed individually, which lets a
+ * long-running process keep it current from change notifications instead of
+ * rescanning.
+ * Not thread-safe.
+ */
+typedef struct elf_inventory elf_inventory_t;
+
+/** `hint' is the expected number of members, 0 if unknown. */
+elf_inventory_t * elf_inventory_new( size_t hint );
+
+/** Add or update `path', returning true if it was not yet a member. */
+bool elf_inventory_set( elf_inventory_t *, const char * path,
+                        const file_class_t * fc
+                      ) __attribute__(( nonnull ));
+
+/** Returns false if `path' was not a member. */
+bool elf_inventory_remove( elf_inventory_t *, const char * path )
+  __attribute__(( nonnull ));
+
+/**
+ * Remove every member below the directory `dir', returning how many there
+ * were.  Linear in the size of the table.
+ */
+size_t elf_inventory_remove_under( elf_inventory_t *, const char * dir )
+  __attribute__(( nonnull ));
+
+void   elf_inventory_clear( elf_inventory_t * )       __attribute__(( nonnull ));
+size_t elf_inventory_count( const elf_inventory_t * ) __attribute__(( nonnull ));
+
+/**
+ * Append the paths of members accepted by `filter', or of all members if it
+ * is NULL, one per line in no particular order.
+ */
+void elf_inventory_dump( const elf_inventory_t *, const elf_filter_t * filter,
+                         obuf_t * out
+                       ) __attribute__(( nonnull( 1, 3 ) ));
+
+void elf_inventory_free( elf_inventory_t * ) __attribute__(( nonnull ));
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Compound predicates on ELF objects, evaluated in stages of increasing cost
+ * so each object is read only as far as needed to decide it.
+ *
+ * A query is built from tests `FIELD=VALUE', combined with `and', `or' and
+ * `not' in decreasing order of precedence, and parentheses; tests following
+ * each other are joined by `and'.
+ * Values are comma separated lists, any of which may match:
+ *
+ *   Stage                  Field     Value
+ *   `ELF_QUERY_IDENT'      kind      `elf', or `ar' for archives
+ *                          class     as for `elf_filter_add'
+ *   `ELF_QUERY_HEADER'     type      as for `elf_filter_add'
+ *                          machine   as for `elf_filter_add'
+ *   `ELF_QUERY_DYNAMIC'    needs     glob matching a DT_NEEDED entry
+ *                          soname    glob matching DT_SONAME
+ *                          interp    glob matching PT_INTERP
+ *                          runpath   glob matching DT_RUNPATH or DT_RPATH
+ *   `ELF_QUERY_SECTIONS'   section   glob matching a section name
+ *   `ELF_QUERY_SYMBOLS'    exports   glob matching an exported symbol
+ *
+ * The first two stages only need the identification `classify_fd' reads,
+ * later ones map the object; exported symbols are looked up through hash
+ * sections when given without wildcards, otherwise `.dynsym' is scanned, or
+ * `.symtab' for objects without one.
+ * Unknown fields and values are reported when compiling.
+ */
+typedef enum {
+  ELF_QUERY_IDENT = 0,  /* `e_ident' */
+  ELF_QUERY_HEADER,     /* The rest of the ELF header */
+  ELF_QUERY_DYNAMIC,    /* Program headers and the dynamic section */
+  ELF_QUERY_SECTIONS,   /* Section headers */
+  ELF_QUERY_SYMBOLS,    /* Symbol tables */
+  ELF_QUERY_NSTAGES
+} elf_query_stage_t;
+
+typedef struct elf_query_s elf_query_t;
+
+/**
+ * Parse `text' into a plan whose tests are ordered by stage, so that cheap
+ * ones are tried first.
+ * Returns NULL, after printing a message, if `text' is malformed.
+ */
+elf_query_t * elf_query_compile( const char * text ) __attribute__(( nonnull ));
+
+/**
+ * Decide whether the ELF object `obj' satisfies `query', reading it stage by
+ * stage until the answer is known.
+ */
+bool elf_query_match_object( const elf_query_t *, const elf_view_t * obj )
+  __attribute__(( nonnull ));
+
+/**
+ * Decide whether the file `fname', classified as `fc', satisfies `query'.
+ * The file is only mapped if its identification leaves the answer open.
+ * Archives satisfy the query if one of their ELF members does, each member
+ * being judged by its own header; only `kind' is decided before mapping
+ * them.
+ */
+bool elf_query_match_file( const elf_query_t *, const char * fname,
+                           const file_class_t * fc
+                         ) __attribute__(( nonnull ));
+
+void elf_query_free( elf_query_t * ) __attribute__(( nonnull ));
+
+
 /* -------------------------------------------------------------------------- */
 
 void do_print_elf_objects( const char * fpath, void * _unused )
@@ -54,21 +812,452 @@ void do_print_elf_objects( const char * fpath, void * _unused )
  * Print all ELF files within the directories and subdirectories name in the
  * array `paths'.
  * `pathc' indicates the number of elements in `paths'.
+ * Directories are scanned in parallel using one worker per online CPU.
  */
 void print_elfs_recur( char * const *, int ) __attribute__(( nonnull ));
 
+/**
+ * Like `print_elfs_recur', with explicit traversal options, printing a record
+ * in format `fmt' for each file.
+ * If `cache' is non-NULL it is consulted and updated, but not saved.
+ * If `filter' is non-NULL only files it accepts are printed, and likewise
+ * for `query'.
+ * Returns false if writing to `stdout' failed.
+ */
+bool print_elfs_recur_opts( char * const *, int, const map_opts_t *,
+                            scan_cache_t * cache, const elf_filter_t * filter,
+                            const elf_query_t * query, out_format_t fmt
+                          ) __attribute__(( nonnull( 1 ) ));
+
+/**
+ * Print the ELF objects under `paths', archive members included, grouped by
+ * identity as `elf_identify' computes it: each identity is printed on a line
+ * of its own, followed by the names of its objects indented by a tab.
+ * Groups and the names within them are sorted.
+ * If `filter' is non-NULL only objects it accepts are printed, and likewise
+ * for `query'.
+ */
+void print_elf_groups_recur_opts( char * const *, int, const map_opts_t *,
+                                  const elf_filter_t * filter,
+                                  const elf_query_t * query
+                                ) __attribute__(( nonnull( 1 ) ));
+
 
 /* -------------------------------------------------------------------------- */
 
-#if 0
-struct Elf32_Ehdr;
-int elf_get_symval_32( struct Elf32_Ehdr *, int table, unsigned int idx )
+/** A symbol table entry, widened to the 64 bit layout. */
+typedef struct {
+  const char    * name;
+  uint64_t        value;
+  uint64_t        size;
+  unsigned char   info;
+  unsigned char   other;
+  uint16_t        shndx;
+  const char    * version;  /* Only set by `elf_map_dynsyms', else NULL */
+  bool            hidden;   /* `version' is not the default one */
+} elf_sym_t;
+
+/** Lambda which may be applied to symbols using `elf_map_syms'. */
+typedef void (*do_sym_fn)( const elf_sym_t * sym, void * aux );
+
+/**
+ * Applies `fn' to each entry of the first section of type `sh_type'
+ * ( `SHT_SYMTAB' or `SHT_DYNSYM' ) in the ELF object at `data'.
+ *
+ * Symbols are read in place with a reader specialized for the object's class
+ * and data encoding; names point into the object's string table.
+ * Every offset is bounds checked against `size'.
+ * Returns false, without calling `fn', if the object is malformed or has no
+ * such table, in which case callers may fall back to `libelf'.
+ */
+bool elf_map_syms( const void * data, size_t size, unsigned sh_type,
+                   do_sym_fn fn, void * aux
+                 ) __attribute__(( nonnull( 1, 4 ) ));
+
+/**
+ * Applies `fn' to each entry of the dynamic symbol table of the ELF object at
+ * `data', found through `PT_DYNAMIC' as the dynamic linker finds it, so that
+ * stripped objects are handled even without section headers.
+ * The table's size is read from its `DT_HASH' or `DT_GNU_HASH' table.
+ * Symbols defined with a version have it in `version', from `DT_VERSYM' and
+ * `DT_VERDEF', or `DT_VERNEED' for those an executable copies in.
+ * Only the program headers, dynamic section, and the tables it points to are
+ * read, so a mapping of the object only faults in their pages.
+ * Returns false, without calling `fn', if the object has no such table or it
+ * is malformed.
+ */
+bool elf_map_dynsyms( const void * data, size_t size, do_sym_fn fn,
+                      void * aux
+                    ) __attribute__(( nonnull( 1, 3 ) ));
+
+/** A symbol name to look up, with its hashes precomputed. */
+typedef struct {
+  const char * name;
+  uint32_t     gnu_hash;   /* As used by `.gnu.hash' */
+  uint32_t     sysv_hash;  /* As used by `.hash' */
+} elf_sym_query_t;
+
+void elf_sym_query_init( elf_sym_query_t *, const char * name )
   __attribute__(( nonnull ));
 
-struct Elf64_Ehdr;
-int elf_get_symval_64( struct Elf64_Ehdr *, int table, unsigned int idx )
+/**
+ * Look up each of the `count' `queries' in the dynamic symbol table of the
+ * ELF object at `data', probing its `.gnu.hash' section, or its SysV `.hash'
+ * section if it has none.
+ * Objects without section headers have them found through `PT_DYNAMIC'.
+ * Only the headers, the hash section, and the probed symbols and names are
+ * read, so each lookup touches a handful of pages.
+ *
+ * `found[i]' receives the symbol matching `queries[i]', preferring a version
+ * passing `elf_sym_exportp', or has a NULL `name' if there is none.
+ * Returns the number of queries found, or -1 if the object has no usable
+ * hash section, as is the case for relocatable objects.
+ */
+ssize_t elf_lookup_syms( const void * data, size_t size,
+                         const elf_sym_query_t * queries, size_t count,
+                         elf_sym_t * found
+                       ) __attribute__(( nonnull( 1 ) ));
+
+/**
+ * Detect if `sym' is defined and exported: it must be named, defined, and
+ * neither local nor using the fake binding `STB_NUM'.
+ */
+bool elf_sym_exportp( const elf_sym_t * sym ) __attribute__(( nonnull ));
+
+
+/**
+ * Dynamic linking information of an ELF object, read from its program headers
+ * as the dynamic linker does, so objects without section headers are handled.
+ * Strings point into the object; `needed' is allocated, and is released by
+ * `elf_dynamic_free'.
+ */
+typedef struct {
+  const char  * interp;   /* PT_INTERP, NULL if none */
+  const char  * soname;   /* DT_SONAME, NULL if none */
+  const char  * rpath;    /* DT_RPATH, NULL if none */
+  const char  * runpath;  /* DT_RUNPATH, NULL if none */
+  const char ** needed;   /* DT_NEEDED, in order */
+  size_t        nneeded;
+} elf_dynamic_t;
+
+/**
+ * Fill `dyn' from the ELF object at `data', every offset being bounds
+ * checked against `size'.
+ * Statically linked objects yield no entries.
+ * Returns false, leaving `dyn' empty, if the object is malformed.
+ */
+bool elf_read_dynamic( const void * data, size_t size, elf_dynamic_t * dyn )
   __attribute__(( nonnull ));
-#endif
+
+void elf_dynamic_free( elf_dynamic_t * ) __attribute__(( nonnull ));
+
+
+/** A section header, with its name read from the section name table. */
+typedef struct {
+  const char * name;
+  uint32_t     type;
+  uint64_t     flags;
+  uint64_t     size;
+} elf_scn_t;
+
+/** Lambda which may be applied to sections using `elf_map_sections'. */
+typedef void (*do_scn_fn)( const elf_scn_t * scn, void * aux );
+
+/**
+ * Applies `fn' to each section of the ELF object at `data' but the null one,
+ * in order, touching only the section headers and their names.
+ * Returns false, without calling `fn', if the object has no section headers
+ * or they are malformed.
+ */
+bool elf_map_sections( const void * data, size_t size, do_scn_fn fn,
+                       void * aux
+                     ) __attribute__(( nonnull( 1, 3 ) ));
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Longest build-id kept; `ld' writes 20 byte SHA-1 ones by default. */
+#define ELF_ID_MAX 64
+
+typedef enum {
+  ELF_ID_NONE = 0,
+  ELF_ID_BUILD_ID,  /* `NT_GNU_BUILD_ID' note */
+  ELF_ID_HASH       /* `elf_content_hash' of the whole object */
+} elf_id_kind_t;
+
+/**
+ * Identity of an ELF object: copies of an object share it wherever they are,
+ * and whether they are files or archive members.
+ * Only `len' bytes of `bytes' are used.
+ */
+typedef struct {
+  elf_id_kind_t kind;
+  size_t        len;
+  unsigned char bytes[ELF_ID_MAX];
+} elf_id_t;
+
+/** Room for the longest `elf_id_format' output, including its NUL. */
+#define ELF_ID_STRLEN ( sizeof( "build-id:" ) + 2 * ELF_ID_MAX )
+
+/**
+ * Fetch the GNU build-id of the ELF object at `data' from its `PT_NOTE'
+ * segments, or its `SHT_NOTE' sections for relocatable objects, touching
+ * only the headers and the notes.
+ * Returns false, setting `id->kind' to `ELF_ID_NONE', if it has none.
+ */
+bool elf_build_id( const void * data, size_t size, elf_id_t * id )
+  __attribute__(( nonnull ));
+
+/**
+ * Fast non-cryptographic 64 bit hash of `size' bytes at `data', meant to tell
+ * objects apart rather than to resist forgery.
+ * Results depend on the host's byte order.
+ */
+uint64_t elf_content_hash( const void * data, size_t size )
+  __attribute__(( nonnull ));
+
+/**
+ * Identify the ELF object at `data' by its build-id, or failing that by a
+ * hash of its `size' bytes, which reads all of them.
+ */
+void elf_identify( const void * data, size_t size, elf_id_t * id )
+  __attribute__(( nonnull ));
+
+/**
+ * Write `id' as `build-id:HEX' or `hash:HEX' to `buf' as `snprintf' would,
+ * returning the untruncated length.
+ */
+size_t elf_id_format( const elf_id_t * id, char * buf, size_t bufsz )
+  __attribute__(( nonnull ));
+
+/** Order identities, objects sharing one comparing equal. */
+int elf_id_cmp( const elf_id_t * a, const elf_id_t * b )
+  __attribute__(( nonnull ));
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Shared library dependency graph of the ELF executables and shared objects
+ * found under a set of paths, resolved without running anything.
+ *
+ * Objects are read in parallel, then each DT_NEEDED entry is resolved to
+ * another scanned object by searching as the dynamic linker does, with
+ * directories taken relative to a sysroot.
+ * Probes are remembered by path, and matched to objects by device and inode,
+ * so library symlinks resolve to the objects they name.
+ * Each object's own DT_RPATH is honoured, but not those of the objects which
+ * load it.
+ */
+typedef struct dep_graph dep_graph_t;
+
+#define DEP_UNRESOLVED SIZE_MAX
+
+typedef struct {
+  const char    * path;
+  const char    * soname;      /* NULL if none */
+  const char    * rpath;       /* NULL if none */
+  const char    * runpath;     /* NULL if none */
+  bool            executable;  /* Has PT_INTERP */
+  file_class_t    fc;
+  dev_t           dev;
+  ino_t           ino;
+  const char   ** needed;      /* DT_NEEDED, in order */
+  size_t        * deps;        /* Node satisfying each, or `DEP_UNRESOLVED' */
+  size_t          nneeded;
+} dep_node_t;
+
+typedef struct {
+  const char         * sysroot;  /* NULL for `/' */
+  /* NULL terminated, or NULL; searched where `LD_LIBRARY_PATH' would be. */
+  const char * const * libdirs;
+} dep_opts_t;
+
+/**
+ * Scan `paths' and resolve the dependencies of every object found.
+ * Nodes are ordered by path.
+ * Returns NULL if the sysroot does not exist.
+ */
+dep_graph_t * dep_graph_build( char * const *, int, const dep_opts_t *,
+                               const map_opts_t * walk
+                             ) __attribute__(( nonnull( 1 ) ));
+
+size_t dep_graph_count( const dep_graph_t * ) __attribute__(( nonnull ));
+
+const dep_node_t * dep_graph_node( const dep_graph_t *, size_t i )
+  __attribute__(( nonnull ));
+
+/**
+ * Every node reachable from node `i' through resolved edges, sorted, which
+ * only includes `i' itself if it is part of a cycle.
+ * Closures of all nodes are computed together on the first call, one per
+ * strongly connected component, so later calls are O(1).
+ */
+const size_t * dep_graph_closure( dep_graph_t *, size_t i, size_t * count )
+  __attribute__(( nonnull ));
+
+void dep_graph_free( dep_graph_t * ) __attribute__(( nonnull ));
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Index from exported symbol names to the ELF objects defining them,
+ * including members of AR archives.
+ *
+ * A builder gathers the symbols selected by `elf_sym_exportp' from the
+ * `.symtab' of each object it is handed, or from `.dynsym' if the object
+ * was stripped, and writes them out as a single file.
+ * The file is mapped read-only by `sym_index_open', and lookups binary search
+ * it in place without reading any ELF object.
+ */
+typedef struct sym_index_builder sym_index_builder_t;
+typedef struct sym_index         sym_index_t;
+
+sym_index_builder_t * sym_index_builder_new( void );
+
+/** Record the exports of `obj'. Safe to call from several threads at once. */
+void sym_index_add( sym_index_builder_t *, const elf_view_t * obj )
+  __attribute__(( nonnull ));
+
+/**
+ * Atomically replace the file at `path' with the index.
+ * Consumes the builder's contents, leaving it to be freed.
+ */
+bool sym_index_write( sym_index_builder_t *, const char * path )
+  __attribute__(( nonnull ));
+
+void sym_index_builder_free( sym_index_builder_t * ) __attribute__(( nonnull ));
+
+/** Returns NULL, after printing a message, if `path' is not a valid index. */
+sym_index_t * sym_index_open( const char * path ) __attribute__(( nonnull ));
+
+/**
+ * Lambda applied to each object `obj' defining symbol `sym'.
+ * `weak' indicates the definition has binding `STB_WEAK'.
+ */
+typedef void (*do_definer_fn)( const char * sym, const char * obj, bool weak,
+                               void * aux
+                             );
+
+/**
+ * Applies `fn' to each definer of `name', in order of object name.
+ * Returns the number of definers.
+ */
+size_t sym_index_lookup( const sym_index_t *, const char * name,
+                         do_definer_fn fn, void * aux
+                       ) __attribute__(( nonnull( 1, 2, 3 ) ));
+
+/** Like `sym_index_lookup', for every symbol beginning with `prefix'. */
+size_t sym_index_lookup_prefix( const sym_index_t *, const char * prefix,
+                                do_definer_fn fn, void * aux
+                              ) __attribute__(( nonnull( 1, 2, 3 ) ));
+
+/** Number of distinct symbols, and of objects defining at least one. */
+void sym_index_counts( const sym_index_t *, size_t * nsyms, size_t * nobjs )
+  __attribute__(( nonnull( 1 ) ));
+
+void sym_index_close( sym_index_t * ) __attribute__(( nonnull ));
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Counters and timers describing where a run spends its effort.
+ *
+ * Each thread accumulates into its own `stats_t', so counting never contends;
+ * `stats_collect' merges them once work is done.
+ * Counting is off until `stats_enable' is called, and is compiled out
+ * entirely when `AA_ELF_STATS' is not defined; the `STATS_*' macros then
+ * expand to nothing.
+ *
+ * Phases nest: `STATS_PHASE_ARCHIVE' time is also part of
+ * `STATS_PHASE_CLASSIFY' or `STATS_PHASE_SYMBOLS', whichever walked the
+ * archive.
+ */
+typedef enum {
+  STATS_PHASE_WALK = 0,  /* Reading directories and `stat'ing entries */
+  STATS_PHASE_DEDUPE,    /* Marking visited inodes */
+  STATS_PHASE_CLASSIFY,  /* Opening files and reading their leading bytes */
+  STATS_PHASE_ARCHIVE,   /* Iterating over archive members */
+  STATS_PHASE_SYMBOLS,   /* Reading symbol tables */
+  STATS_NPHASES
+} stats_phase_t;
+
+typedef struct {
+  uint64_t files;        /* Non-directory entries visited */
+  uint64_t dirs;         /* Directories read */
+  uint64_t opens;
+  uint64_t bytes_read;   /* By `read' and `pread', excluding mappings */
+  uint64_t mmaps;
+  uint64_t archives;     /* Archives whose members were walked */
+  uint64_t members;
+  uint64_t dedupe_hits;  /* Entries skipped as already visited */
+  uint64_t batches;      /* Runs of a `classify_batch_t' */
+  uint64_t batch_depth;  /* Files they kept in flight, summed over them */
+  uint64_t query_decided[ELF_QUERY_NSTAGES];  /* Objects, by deciding stage */
+  uint64_t phase_ns[STATS_NPHASES];
+} stats_t;
+
+/** Start counting, returning false if counting was compiled out. */
+bool stats_enable( void );
+
+/** Sum the counters of every thread, including those which have exited. */
+void stats_collect( stats_t * ) __attribute__(( nonnull ));
+
+/** Print `stats' as aligned text, or as a single JSON object. */
+void stats_print( FILE * out, const stats_t * stats, bool json )
+  __attribute__(( nonnull ));
+
+#ifdef AA_ELF_STATS
+
+extern bool stats_enabled;
+
+/** The calling thread's counters, created on first use. */
+stats_t * stats_local( void );
+
+uint64_t stats_now_ns( void );
+
+#  define STATS_ADD( field, n )                                              \
+  do {                                                                       \
+    if ( stats_enabled ) stats_local()->field += ( n );                      \
+  } while ( 0 )
+
+/** Declare `var' holding the start time of a phase. */
+#  define STATS_START( var )  uint64_t var = stats_enabled ? stats_now_ns() : 0
+
+#  define STATS_STOP( phase, var )                                           \
+  do {                                                                       \
+    if ( stats_enabled )                                                     \
+      stats_local()->phase_ns[phase] += stats_now_ns() - ( var );            \
+  } while ( 0 )
+
+/** Charge the time since `var' to `phase', and restart `var'. */
+#  define STATS_LAP( phase, var )                                            \
+  do {                                                                       \
+    if ( stats_enabled )                                                     \
+      {                                                                      \
+        uint64_t stats_t1_ = stats_now_ns();                                 \
+        stats_local()->phase_ns[phase] += stats_t1_ - ( var );               \
+        ( var ) = stats_t1_;                                                 \
+      }                                                                      \
+  } while ( 0 )
+
+/** Restart `var' without charging the time since to any phase. */
+#  define STATS_RESTART( var )                                               \
+  do {                                                                       \
+    if ( stats_enabled ) ( var ) = stats_now_ns();                           \
+  } while ( 0 )
+
+#else
+
+#  define STATS_ADD( field, n )     do {} while ( 0 )
+#  define STATS_START( var )        do {} while ( 0 )
+#  define STATS_STOP( phase, var )  do {} while ( 0 )
+#  define STATS_LAP( phase, var )   do {} while ( 0 )
+#  define STATS_RESTART( var )      do {} while ( 0 )
+
+#endif /* AA_ELF_STATS */
 
 
 /* -------------------------------------------------------------------------- */
@@ -0,0 +1,437 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <stdio.h>
+#include <string.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Layout of the fixed size header preceding each archive member.
+ * Fields are ASCII, space padded, and not NUL terminated.
+ */
+typedef struct {
+  char name[16];
+  char date[12];
+  char uid[6];
+  char gid[6];
+  char mode[8];
+  char size[10];
+  char magic[2];
+} ar_hdr_t;
+
+#define AR_HDR_SIZE  sizeof( ar_hdr_t )
+#define AR_FMAG      "`\n"
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Parse a space padded numeric field which is not NUL terminated. */
+  static unsigned long long
+ar_field_num( const char * field, size_t len, int base )
+{
+  unsigned long long n = 0;
+  size_t             i = 0;
+
+  while ( ( i < len ) && ( field[i] == ' ' ) ) i++;
+  for ( ; i < len; i++ )
+    {
+      unsigned d = (unsigned char) field[i] - '0';
+      if ( d >= (unsigned) base ) break;
+      n = n * base + d;
+    }
+  return n;
+}
+
+  static inline bool
+ar_name_eq( const char * name, size_t nlen, const char * lit )
+{
+  return ( strlen( lit ) == nlen ) && ( memcmp( name, lit, nlen ) == 0 );
+}
+
+  static bool
+ar_fail( ar_iter_t * ar, const char * msg )
+{
+  if ( ar->verbose ) fprintf( stderr, "%s: %s\n", ar->fname, msg );
+  ar->pos = ar->size;
+  return false;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+ar_iter_init( ar_iter_t  * ar,
+              const void * base,
+              size_t       size,
+              const char * fname,
+              bool         verbose
+            )
+{
+  memset( ar, 0, sizeof( ar_iter_t ) );
+  ar->base    = base;
+  ar->size    = size;
+  ar->fname   = fname;
+  ar->verbose = verbose;
+
+  if ( ( size < AR_MAGIC_SIZE ) ||
+       ( memcmp( base, AR_MAGIC, AR_MAGIC_SIZE ) != 0 )
+     )
+    {
+      ar->pos = size;
+      return false;
+    }
+
+  ar->pos = AR_MAGIC_SIZE;
+  return true;
+}
+
+
+/**
+ * Headers, names, and the GNU long name table are all read in place from the
+ * archive's mapping, so stepping to the next member costs no system calls.
+ * Symbol tables are skipped, but their location is recorded in `ar'.
+ */
+  bool
+ar_iter_next( ar_iter_t * ar, ar_ent_t * ent )
+{
+  const ar_hdr_t * hdr  = NULL;
+  const char     * name = NULL;
+  size_t           nlen = 0;
+  size_t           data = 0;
+  size_t           size = 0;
+
+  while ( true )
+    {
+      /* Members start on even offsets, '\n' is used for padding. */
+      if ( ( ar->pos & 1 ) && ( ar->pos < ar->size ) ) ar->pos++;
+
+      if ( ( ar->pos + AR_HDR_SIZE ) > ar->size )
+        {
+          ar->pos = ar->size;
+          return false;
+        }
+
+      hdr = (const ar_hdr_t *) ( ar->base + ar->pos );
+      if ( memcmp( hdr->magic, AR_FMAG, 2 ) != 0 )
+        {
+          /* When dealing with corrupt or random embedded cross-compilers, they
+           * may be abusing the archive format; only complain in verbose mode. */
+          return ar_fail( ar, "invalid ar entry" );
+        }
+
+      data = ar->pos + AR_HDR_SIZE;
+      size = ar_field_num( hdr->size, sizeof( hdr->size ), 10 );
+      if ( size > ( ar->size - data ) ) return ar_fail( ar, "truncated member" );
+      ar->pos = data + size;
+
+      name = hdr->name;
+      if ( name[0] != '/' )
+        {
+          if ( ( name[0] == '#' ) && ( name[1] == '1' ) && ( name[2] == '/' ) )
+            {
+              /* BSD extended filename, always in use on Darwin.  The name
+               * leads the member's data and may be NUL padded. */
+              nlen = ar_field_num( name + 3, sizeof( hdr->name ) - 3, 10 );
+              if ( nlen > size ) return ar_fail( ar, "invalid BSD name" );
+              name  = (const char *) ar->base + data;
+              data += nlen;
+              size -= nlen;
+              nlen  = strnlen( name, nlen );
+            }
+          else
+            {
+              /* GNU short names end in '/', BSD ones are only space padded. */
+              nlen = sizeof( hdr->name );
+              while ( ( nlen > 0 ) && ( name[nlen - 1] == ' ' ) ) nlen--;
+              if ( ( nlen > 0 ) && ( name[nlen - 1] == '/' ) ) nlen--;
+            }
+
+          /* BSD symbol tables. */
+          if ( ar_name_eq( name, nlen, "__.SYMDEF" ) ||
+               ar_name_eq( name, nlen, "__.SYMDEF SORTED" )
+             )
+            {
+              ar->armap      = ar->base + data;
+              ar->armap_size = size;
+              ar->armap_kind = AR_ARMAP_BSD;
+              continue;
+            }
+          if ( ar_name_eq( name, nlen, "__.SYMDEF_64" ) ||
+               ar_name_eq( name, nlen, "__.SYMDEF_64 SORTED" )
+             )
+            {
+              ar->armap      = ar->base + data;
+              ar->armap_size = size;
+              ar->armap_kind = AR_ARMAP_BSD64;
+              continue;
+            }
+        }
+      else if ( name[1] == '/' )
+        {
+          /* GNU extended filename table, which `ar_iter_armap' may have
+           * recorded already. */
+          if ( ( ar->extfn != NULL ) &&
+               ( ar->extfn != (const char *) ar->base + data )
+             )
+            {
+              return ar_fail( ar, "Duplicate GNU extended filename section" );
+            }
+          ar->extfn      = (const char *) ar->base + data;
+          ar->extfn_size = size;
+          continue;
+        }
+      else if ( ( name[1] >= '0' ) && ( name[1] <= '9' ) )
+        {
+          /* GNU extended filename, terminated by "/\n" in the table. */
+          size_t off = ar_field_num( name + 1, sizeof( hdr->name ) - 1, 10 );
+          if ( ar->extfn == NULL )
+            {
+              return ar_fail( ar,
+                           "GNU extended filename without special data section"
+                            );
+            }
+          if ( off >= ar->extfn_size ) return ar_fail( ar, "invalid GNU name" );
+          name = ar->extfn + off;
+          for ( nlen = 0;
+                ( ( off + nlen ) < ar->extfn_size ) &&
+                ( name[nlen] != '\n' ) && ( name[nlen] != '\0' );
+                nlen++
+              );
+          if ( ( nlen > 0 ) && ( name[nlen - 1] == '/' ) ) nlen--;
+        }
+      else
+        {
+          /* SysV/GNU symbol tables: "/" with 32 bit offsets, "/SYM64/" with
+           * 64 bit ones. */
+          ar->armap      = ar->base + data;
+          ar->armap_size = size;
+          ar->armap_kind = ( memcmp( name, "/SYM64/", 7 ) == 0 )
+                           ? AR_ARMAP_SYSV64 : AR_ARMAP_SYSV;
+          continue;
+        }
+
+      ent->name       = name;
+      ent->name_len   = nlen;
+      ent->hdr_offset = (const unsigned char *) hdr - ar->base;
+      ent->offset     = data;
+      ent->size       = size;
+      ent->date       = ar_field_num( hdr->date, sizeof( hdr->date ), 10 );
+      ent->mode       = ar_field_num( hdr->mode, sizeof( hdr->mode ), 8 );
+      return true;
+    }
+}
+
+
+/** Writes `archive:member' to `buf', returning the untruncated length. */
+  size_t
+ar_ent_fullname( const ar_iter_t * ar,
+                 const ar_ent_t  * ent,
+                 char            * buf,
+                 size_t            bufsz
+               )
+{
+  int len = snprintf( buf, bufsz, "%s:%.*s",
+                      ar->fname, (int) ent->name_len, ent->name
+                    );
+  return ( len < 0 ) ? 0 : (size_t) len;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * The symbol table and the GNU long name table precede every regular member,
+ * so stepping a copy of `ar' to the first one finds both, reading headers
+ * only.
+ */
+  bool
+ar_iter_armap( ar_iter_t * ar )
+{
+  ar_iter_t probe = *ar;
+  ar_ent_t  ent;
+
+  if ( ar->armap != NULL ) return true;
+  probe.pos     = AR_MAGIC_SIZE;
+  probe.verbose = false;
+  ar_iter_next( & probe, & ent );
+  ar->armap      = probe.armap;
+  ar->armap_size = probe.armap_size;
+  ar->armap_kind = probe.armap_kind;
+  if ( ar->extfn == NULL )
+    {
+      ar->extfn      = probe.extfn;
+      ar->extfn_size = probe.extfn_size;
+    }
+  return ar->armap != NULL;
+}
+
+
+  bool
+ar_iter_member_at( ar_iter_t * ar, size_t hdr_offset, ar_ent_t * ent )
+{
+  bool verbose = ar->verbose;
+  bool found   = false;
+
+  if ( ( hdr_offset < AR_MAGIC_SIZE ) || ( hdr_offset >= ar->size ) )
+    {
+      return false;
+    }
+  /* A stale index may point anywhere, which is not the archive's fault. */
+  ar->verbose = false;
+  ar->pos     = hdr_offset;
+  found = ar_iter_next( ar, ent ) && ( ent->hdr_offset == hdr_offset );
+  ar->verbose = verbose;
+  return found;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static uint64_t
+ar_load( const unsigned char * p, size_t width, bool be )
+{
+  uint64_t v = 0;
+  for ( size_t i = 0; i < width; i++ )
+    {
+      v |= (uint64_t) p[be ? ( width - 1 - i ) : i] << ( 8 * i );
+    }
+  return v;
+}
+
+/**
+ * Lay out a BSD symbol table of `width' byte words: the size in bytes of the
+ * `ranlib' array, the array of ( string index, member offset ) pairs, the
+ * size of the string table, then the strings.
+ * Words are in the byte order of the host that ran `ranlib', so big endian is
+ * tried if the table does not fit as little endian.
+ */
+  static bool
+ar_armap_bsd_init( ar_armap_iter_t * it, size_t width )
+{
+  const unsigned char * p = it->map;
+  size_t                n = it->map_size;
+
+  for ( int be = 0; be < 2; be++ )
+    {
+      uint64_t rsize = 0;
+      uint64_t ssize = 0;
+      if ( n < ( 2 * width ) ) return false;
+      rsize = ar_load( p, width, be );
+      if ( ( rsize > ( n - 2 * width ) ) || ( ( rsize % ( 2 * width ) ) != 0 ) )
+        {
+          continue;
+        }
+      ssize = ar_load( p + width + rsize, width, be );
+      if ( ssize > ( n - 2 * width - rsize ) ) continue;
+      it->be       = be;
+      it->count    = rsize / ( 2 * width );
+      it->ent_pos  = width;
+      it->str_pos  = 2 * width + rsize;
+      it->str_end  = it->str_pos + ssize;
+      return true;
+    }
+  return false;
+}
+
+/**
+ * SysV tables hold a big endian count, as many member offsets, then as many
+ * NUL terminated names in the same order.
+ */
+  static bool
+ar_armap_sysv_init( ar_armap_iter_t * it, size_t width )
+{
+  uint64_t count = 0;
+
+  if ( it->map_size < width ) return false;
+  count = ar_load( it->map, width, true );
+  if ( count > ( ( it->map_size - width ) / width ) ) return false;
+  it->be      = true;
+  it->count   = count;
+  it->ent_pos = width;
+  it->str_pos = width + count * width;
+  it->str_end = it->map_size;
+  return true;
+}
+
+
+  bool
+ar_armap_iter_init( ar_armap_iter_t * it, const ar_iter_t * ar )
+{
+  memset( it, 0, sizeof( ar_armap_iter_t ) );
+  it->map      = ar->armap;
+  it->map_size = ar->armap_size;
+  it->kind     = ar->armap_kind;
+
+  switch ( it->kind )
+    {
+      case AR_ARMAP_SYSV:
+        it->width = 4;
+        return ar_armap_sysv_init( it, 4 );
+      case AR_ARMAP_SYSV64:
+        it->width = 8;
+        return ar_armap_sysv_init( it, 8 );
+      case AR_ARMAP_BSD:
+        it->width = 4;
+        return ar_armap_bsd_init( it, 4 );
+      case AR_ARMAP_BSD64:
+        it->width = 8;
+        return ar_armap_bsd_init( it, 8 );
+      default:
+        return false;
+    }
+}
+
+
+/** Unterminated names or short string tables end the iteration. */
+  static bool
+ar_armap_stop( ar_armap_iter_t * it )
+{
+  it->index = it->count;
+  return false;
+}
+
+  bool
+ar_armap_iter_next( ar_armap_iter_t * it, ar_sym_t * sym )
+{
+  const unsigned char * ent  = it->map + it->ent_pos;
+  bool                  bsd  = ( it->kind == AR_ARMAP_BSD ) ||
+                               ( it->kind == AR_ARMAP_BSD64 );
+  size_t                off  = it->str_pos;
+
+  if ( it->index >= it->count ) return false;
+
+  if ( bsd )
+    {
+      uint64_t strx = ar_load( ent, it->width, it->be );
+      if ( strx >= ( it->str_end - it->str_pos ) ) return ar_armap_stop( it );
+      off         = it->str_pos + strx;
+      sym->member = ar_load( ent + it->width, it->width, it->be );
+    }
+  else
+    {
+      if ( off >= it->str_end ) return ar_armap_stop( it );
+      sym->member = ar_load( ent, it->width, it->be );
+    }
+
+  sym->name     = (const char *) it->map + off;
+  sym->name_len = strnlen( sym->name, it->str_end - off );
+  if ( ( off + sym->name_len ) == it->str_end ) return ar_armap_stop( it );
+
+  it->ent_pos += bsd ? ( 2 * it->width ) : it->width;
+  if ( ! bsd ) it->str_pos += sym->name_len + 1;
+  it->index++;
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
@@ -0,0 +1,194 @@
+/* -*- mode: c; -*- */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "aa-elf-util.h"
+
+
+/* ========================================================================== */
+
+  static void
+usage( const char * argv0, FILE * out )
+{
+  fprintf( out,
+           "Usage: %s ARCHIVE [SYMBOL...]\n"
+           "Print the symbols listed by the index of ARCHIVE, as written by\n"
+           "`ar s' or `ranlib', without reading its objects.\n"
+           "Each symbol is printed as `SYMBOL ARCHIVE:MEMBER OFFSET', where\n"
+           "OFFSET is that of the member's header.\n"
+           "With SYMBOLs, only those are printed, and the exit status is 1\n"
+           "if some SYMBOL is not listed.\n"
+           "Exits with status 2 if ARCHIVE has no index.\n",
+           argv0
+         );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Index of `sym''s name among the `nq' queries, or -1. */
+  static int
+query_index( char * const * queries, int nq, const ar_sym_t * sym )
+{
+  for ( int i = 0; i < nq; i++ )
+    {
+      if ( ( strncmp( queries[i], sym->name, sym->name_len ) == 0 ) &&
+           ( queries[i][sym->name_len] == '\0' )
+         )
+        {
+          return i;
+        }
+    }
+  return -1;
+}
+
+/**
+ * Print each symbol of `ar''s index, or those in `queries' if `nq' > 0,
+ * marking them in `found'.
+ * Symbols of a member are listed together, so its header is only parsed again
+ * when the member changes.
+ */
+  static void
+print_armap( ar_iter_t * ar, char * const * queries, int nq, bool * found,
+             obuf_t * out
+           )
+{
+  ar_armap_iter_t syms;
+  ar_sym_t        sym;
+  ar_ent_t        ent;
+  char            name[PATH_MAX];
+  char            num[24];
+  size_t          member = 0;
+  bool            named  = false;
+
+  ar_armap_iter_init( & syms, ar );
+  while ( ar_armap_iter_next( & syms, & sym ) )
+    {
+      int q = ( nq > 0 ) ? query_index( queries, nq, & sym ) : -1;
+      if ( ( nq > 0 ) && ( q < 0 ) ) continue;
+      if ( q >= 0 ) found[q] = true;
+
+      if ( ( ! named ) || ( sym.member != member ) )
+        {
+          member = sym.member;
+          named  = true;
+          if ( ar_iter_member_at( ar, member, & ent ) )
+            {
+              ar_ent_fullname( ar, & ent, name, sizeof( name ) );
+            }
+          else
+            {
+              snprintf( name, sizeof( name ), "%s:?", ar->fname );
+            }
+        }
+
+      snprintf( num, sizeof( num ), " %zu", member );
+      obuf_append( out, sym.name, sym.name_len );
+      obuf_append( out, " ", 1 );
+      obuf_append( out, name, strlen( name ) );
+      obuf_putline( out, num );
+      if ( out->len >= ( OBUF_DEFAULT_SIZE / 2 ) )
+        {
+          obuf_flush( out, STDOUT_FILENO );
+        }
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  int
+main( int argc, char * argv[], char ** envp )
+{
+  const char    * fname = NULL;
+  unsigned char * base  = MAP_FAILED;
+  bool          * found = NULL;
+  bool            all   = true;
+  bool            ok    = true;
+  int             nq    = 0;
+  int             fd    = -1;
+  int             opt   = -1;
+  ar_iter_t       ar;
+  struct stat     st;
+  obuf_t          out;
+
+  while ( ( opt = getopt( argc, argv, "h" ) ) != -1 )
+    {
+      switch ( opt )
+        {
+          case 'h':
+            usage( argv[0], stdout );
+            return EXIT_SUCCESS;
+
+          default:
+            usage( argv[0], stderr );
+            return EXIT_FAILURE;
+        }
+    }
+
+  if ( ( argc - optind ) < 1 )
+    {
+      usage( argv[0], stderr );
+      return EXIT_FAILURE;
+    }
+  fname = argv[optind];
+  nq    = argc - optind - 1;
+
+  fd = open( fname, O_RDONLY | O_CLOEXEC | O_NOCTTY );
+  if ( ( fd == -1 ) || ( fstat( fd, & st ) != 0 ) )
+    {
+      fprintf( stderr, "%s: %s\n", fname, strerror( errno ) );
+      return 2;
+    }
+  if ( st.st_size > 0 )
+    {
+      base = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    }
+  close( fd );
+  if ( ( base == MAP_FAILED ) ||
+       ( ! ar_iter_init( & ar, base, st.st_size, fname, true ) )
+     )
+    {
+      fprintf( stderr, "%s: not an archive\n", fname );
+      return 2;
+    }
+  if ( ! ar_iter_armap( & ar ) )
+    {
+      fprintf( stderr, "%s: no symbol index\n", fname );
+      return 2;
+    }
+
+  found = calloc( nq + 1, sizeof( bool ) );
+  if ( found == NULL )
+    {
+      perror( "calloc" );
+      return 2;
+    }
+
+  obuf_init( & out, 0 );
+  print_armap( & ar, argv + optind + 1, nq, found, & out );
+  ok = obuf_flush( & out, STDOUT_FILENO );
+  obuf_free( & out );
+  munmap( base, st.st_size );
+
+  for ( int i = 0; i < nq; i++ ) all = all && found[i];
+  free( found );
+
+  if ( ! ok ) return 2;
+  return all ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
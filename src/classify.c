@@ -0,0 +1,576 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+/*
+ * `glibc' has no wrappers for `io_uring', and only three calls and a handful
+ * of ring accesses are needed, so they are made directly rather than through
+ * `liburing'.
+ * Each file goes through `IORING_OP_OPENAT', `IORING_OP_READ' of its leading
+ * `CLASSIFY_PEEK_SIZE' bytes, and `IORING_OP_CLOSE', the next operation being
+ * queued as soon as the previous one completes.
+ * Every file in flight owns a slot holding its descriptor and header buffer,
+ * and has exactly one operation queued or running, so neither ring can
+ * overflow with as many slots as submission queue entries.
+ */
+
+/** Operation of a slot, kept in the low bits of `user_data'. */
+enum { URING_OPEN = 0, URING_READ = 1, URING_CLOSE = 2 };
+#define URING_OP_BITS 2
+
+typedef struct {
+  size_t        idx;  /* Of the file in the batch */
+  int           fd;
+  unsigned char buf[CLASSIFY_PEEK_SIZE];
+} uring_slot_t;
+
+typedef struct {
+  int                    fd;
+  unsigned             * sq_tail;
+  unsigned             * sq_mask;
+  unsigned             * sq_array;
+  unsigned             * cq_head;
+  unsigned             * cq_tail;
+  unsigned             * cq_mask;
+  struct io_uring_sqe  * sqes;
+  struct io_uring_cqe  * cqes;
+  void                 * sq_map;
+  size_t                 sq_map_size;
+  void                 * cq_map;
+  size_t                 cq_map_size;
+  size_t                 sqes_size;
+  unsigned               nqueued;  /* Not yet submitted */
+} uring_t;
+
+
+  static void
+uring_close( uring_t * u )
+{
+  if ( u->sqes != MAP_FAILED ) munmap( u->sqes, u->sqes_size );
+  if ( ( u->cq_map != MAP_FAILED ) && ( u->cq_map != u->sq_map ) )
+    {
+      munmap( u->cq_map, u->cq_map_size );
+    }
+  if ( u->sq_map != MAP_FAILED ) munmap( u->sq_map, u->sq_map_size );
+  if ( u->fd != -1 ) close( u->fd );
+  u->fd = -1;
+}
+
+/** Detect if the kernel behind `u' implements every operation we queue. */
+  static bool
+uring_probe( uring_t * u )
+{
+  static const unsigned   ops[] = { IORING_OP_OPENAT, IORING_OP_READ,
+                                    IORING_OP_CLOSE
+                                  };
+  size_t                  size  = sizeof( struct io_uring_probe ) +
+                                  256 * sizeof( struct io_uring_probe_op );
+  struct io_uring_probe * probe = calloc( 1, size );
+  bool                    ok    = true;
+
+  assert( probe != NULL );
+  if ( syscall( __NR_io_uring_register, u->fd, IORING_REGISTER_PROBE, probe,
+                256
+              ) != 0
+     )
+    {
+      free( probe );
+      return false;
+    }
+  for ( size_t i = 0; i < ( sizeof( ops ) / sizeof( ops[0] ) ); i++ )
+    {
+      ok = ok && ( ops[i] <= probe->last_op ) &&
+           ( ( probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED ) != 0 );
+    }
+  free( probe );
+  return ok;
+}
+
+/**
+ * Set up a ring of `depth' entries, returning false if `io_uring' is missing,
+ * disabled, or forbidden, as it commonly is inside of containers.
+ */
+  static bool
+uring_init( uring_t * u, unsigned depth )
+{
+  struct io_uring_params p;
+
+  memset( u, 0, sizeof( uring_t ) );
+  u->sq_map = u->cq_map = u->sqes = MAP_FAILED;
+  memset( & p, 0, sizeof( p ) );
+  u->fd = syscall( __NR_io_uring_setup, depth, & p );
+  if ( u->fd < 0 )
+    {
+      u->fd = -1;
+      return false;
+    }
+
+  u->sq_map_size = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+  u->cq_map_size = p.cq_off.cqes +
+                   p.cq_entries * sizeof( struct io_uring_cqe );
+  if ( ( p.features & IORING_FEAT_SINGLE_MMAP ) != 0 )
+    {
+      if ( u->cq_map_size > u->sq_map_size ) u->sq_map_size = u->cq_map_size;
+      u->cq_map_size = u->sq_map_size;
+    }
+  u->sq_map = mmap( NULL, u->sq_map_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING
+                  );
+  if ( u->sq_map == MAP_FAILED )
+    {
+      uring_close( u );
+      return false;
+    }
+  u->cq_map = ( ( p.features & IORING_FEAT_SINGLE_MMAP ) != 0 ) ?
+              u->sq_map :
+              mmap( NULL, u->cq_map_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING
+                  );
+  u->sqes_size = p.sq_entries * sizeof( struct io_uring_sqe );
+  u->sqes = mmap( NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES
+                );
+  if ( ( u->cq_map == MAP_FAILED ) || ( u->sqes == MAP_FAILED ) ||
+       ( ! uring_probe( u ) )
+     )
+    {
+      uring_close( u );
+      return false;
+    }
+
+  u->sq_tail  = (unsigned *) ( (char *) u->sq_map + p.sq_off.tail );
+  u->sq_mask  = (unsigned *) ( (char *) u->sq_map + p.sq_off.ring_mask );
+  u->sq_array = (unsigned *) ( (char *) u->sq_map + p.sq_off.array );
+  u->cq_head  = (unsigned *) ( (char *) u->cq_map + p.cq_off.head );
+  u->cq_tail  = (unsigned *) ( (char *) u->cq_map + p.cq_off.tail );
+  u->cq_mask  = (unsigned *) ( (char *) u->cq_map + p.cq_off.ring_mask );
+  u->cqes     = (struct io_uring_cqe *)
+                ( (char *) u->cq_map + p.cq_off.cqes );
+  return true;
+}
+
+/** Queue an operation on `slot', which is only submitted by `uring_wait'. */
+  static void
+uring_queue( uring_t * u, unsigned op, int fd, const void * addr, unsigned len,
+             unsigned slot
+           )
+{
+  unsigned              tail = *u->sq_tail;
+  unsigned              i    = tail & *u->sq_mask;
+  struct io_uring_sqe * sqe  = & u->sqes[i];
+
+  memset( sqe, 0, sizeof( struct io_uring_sqe ) );
+  sqe->opcode    = op;
+  sqe->fd        = fd;
+  sqe->addr      = (uintptr_t) addr;
+  sqe->len       = len;
+  sqe->user_data = ( (uint64_t) slot << URING_OP_BITS ) |
+                   ( ( op == IORING_OP_OPENAT ) ? URING_OPEN :
+                     ( op == IORING_OP_READ )   ? URING_READ : URING_CLOSE );
+  if ( op == IORING_OP_OPENAT )
+    {
+      /* `O_NONBLOCK' keeps FIFOs from stalling the batch. */
+      sqe->open_flags = O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK;
+    }
+  u->sq_array[i] = i;
+  __atomic_store_n( u->sq_tail, tail + 1, __ATOMIC_RELEASE );
+  u->nqueued++;
+}
+
+/** Submit queued operations and wait for at least one completion. */
+  static bool
+uring_wait( uring_t * u )
+{
+  long n = 0;
+  do
+    {
+      n = syscall( __NR_io_uring_enter, u->fd, u->nqueued, 1,
+                   IORING_ENTER_GETEVENTS, NULL, 0
+                 );
+    }
+  while ( ( n < 0 ) && ( errno == EINTR ) );
+  if ( n < 0 )
+    {
+      perror( "io_uring_enter" );
+      return false;
+    }
+  u->nqueued -= n;
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Without `io_uring', the helpers of a `classify_pool_t' and the callers of
+ * `pool_run' classify the files of batches with `classify_path', each
+ * claiming the next file of a batch under `lock'.
+ * Several batches may run at once on a shared pool, queued on `jobs' while
+ * they have files left to claim; callers only claim files of their own
+ * batch, so they progress even when every helper is busy elsewhere.
+ * Claiming costs nothing next to the `open' it precedes.
+ */
+typedef struct pool_job {
+  const char * const * paths;
+  file_class_t       * fcs;
+  size_t               n;
+  size_t               next;
+  unsigned             busy;
+  struct pool_job    * link;   /* Next job in `jobs' */
+} pool_job_t;
+
+struct classify_pool_s {
+  pthread_t          * threads;
+  unsigned             nthreads;
+  bool                 started;  /* Helpers are created on first use */
+  pthread_mutex_t      lock;
+  pthread_cond_t       wake;     /* Files to claim, or `quit' */
+  pthread_cond_t       idle;     /* `busy' of some job dropped to 0 */
+  pool_job_t         * jobs;
+  bool                 quit;
+};
+
+/** Claim the next file of `job', unqueuing it once none are left. */
+  static size_t
+pool_claim( classify_pool_t * pool, pool_job_t * job )
+{
+  size_t i = job->next++;
+
+  job->busy++;
+  if ( job->next == job->n )
+    {
+      pool_job_t ** pj = & pool->jobs;
+      while ( *pj != job ) pj = & ( *pj )->link;
+      *pj = job->link;
+    }
+  return i;
+}
+
+/** Classify file `i' of `job', with `pool->lock' released meanwhile. */
+  static void
+pool_classify( classify_pool_t * pool, pool_job_t * job, size_t i )
+{
+  pthread_mutex_unlock( & pool->lock );
+  classify_path( job->paths[i], & job->fcs[i] );
+  pthread_mutex_lock( & pool->lock );
+  if ( --job->busy == 0 ) pthread_cond_broadcast( & pool->idle );
+}
+
+  static void *
+pool_worker( void * arg )
+{
+  classify_pool_t * pool = (classify_pool_t *) arg;
+  pthread_mutex_lock( & pool->lock );
+  while ( ! pool->quit )
+    {
+      if ( pool->jobs != NULL )
+        {
+          pool_job_t * job = pool->jobs;
+          pool_classify( pool, job, pool_claim( pool, job ) );
+        }
+      else
+        {
+          pthread_cond_wait( & pool->wake, & pool->lock );
+        }
+    }
+  pthread_mutex_unlock( & pool->lock );
+  return NULL;
+}
+
+/** Helpers beyond this are more likely to thrash than to add throughput. */
+#define POOL_MAX_THREADS 32
+
+  classify_pool_t *
+classify_pool_new( unsigned nthreads )
+{
+  classify_pool_t * pool = calloc( 1, sizeof( classify_pool_t ) );
+
+  assert( pool != NULL );
+  pthread_mutex_init( & pool->lock, NULL );
+  pthread_cond_init( & pool->wake, NULL );
+  pthread_cond_init( & pool->idle, NULL );
+  pool->nthreads = ( nthreads > POOL_MAX_THREADS ) ? POOL_MAX_THREADS
+                                                   : nthreads;
+  pool->threads  = calloc( pool->nthreads + 1, sizeof( pthread_t ) );
+  assert( pool->threads != NULL );
+  return pool;
+}
+
+  void
+classify_pool_free( classify_pool_t * pool )
+{
+  pthread_mutex_lock( & pool->lock );
+  pool->quit = true;
+  pthread_cond_broadcast( & pool->wake );
+  pthread_mutex_unlock( & pool->lock );
+  for ( unsigned i = 0; pool->started && ( i < pool->nthreads ); i++ )
+    {
+      pthread_join( pool->threads[i], NULL );
+    }
+  free( pool->threads );
+  pthread_cond_destroy( & pool->idle );
+  pthread_cond_destroy( & pool->wake );
+  pthread_mutex_destroy( & pool->lock );
+  free( pool );
+}
+
+  static void
+pool_run( classify_pool_t * pool, const char * const * paths, size_t n,
+          file_class_t * fcs
+        )
+{
+  pool_job_t job = { .paths = paths, .fcs = fcs, .n = n, .next = 0,
+                     .busy = 0, .link = NULL
+                   };
+
+  if ( n == 0 ) return;
+
+  pthread_mutex_lock( & pool->lock );
+  if ( ! pool->started )
+    {
+      pool->started = true;
+      for ( unsigned i = 0; i < pool->nthreads; i++ )
+        {
+          if ( pthread_create( & pool->threads[i], NULL, pool_worker, pool )
+               != 0
+             )
+            {
+              perror( "pthread_create" );
+              exit( EXIT_FAILURE );
+            }
+        }
+    }
+  job.link   = pool->jobs;
+  pool->jobs = & job;
+  pthread_cond_broadcast( & pool->wake );
+  while ( job.next < job.n )
+    {
+      pool_classify( pool, & job, pool_claim( pool, & job ) );
+    }
+  while ( job.busy > 0 ) pthread_cond_wait( & pool->idle, & pool->lock );
+  pthread_mutex_unlock( & pool->lock );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+struct classify_batch_s {
+  unsigned          depth;
+  bool              uring_ok;
+  uring_t           uring;
+  uring_slot_t    * slots;
+  unsigned        * free_slots;  /* Stack of unused indices into `slots' */
+  size_t          * archives;    /* Files left for after the ring drains */
+  size_t            narchives;
+  size_t            archives_cap;
+  classify_pool_t * pool;        /* Created on first use unless shared */
+  bool              own_pool;
+};
+
+
+  classify_batch_t *
+classify_batch_new( unsigned depth, bool uring, classify_pool_t * pool )
+{
+  classify_batch_t * cb = calloc( 1, sizeof( classify_batch_t ) );
+
+  assert( cb != NULL );
+  cb->depth    = ( depth == 0 ) ? 1 : depth;
+  cb->pool     = pool;
+  cb->uring_ok = uring && uring_init( & cb->uring, cb->depth );
+  if ( cb->uring_ok )
+    {
+      cb->slots      = calloc( cb->depth, sizeof( uring_slot_t ) );
+      cb->free_slots = calloc( cb->depth, sizeof( unsigned ) );
+      assert( ( cb->slots != NULL ) && ( cb->free_slots != NULL ) );
+    }
+  return cb;
+}
+
+
+  void
+classify_batch_free( classify_batch_t * cb )
+{
+  if ( cb->uring_ok ) uring_close( & cb->uring );
+  if ( cb->own_pool ) classify_pool_free( cb->pool );
+  free( cb->slots );
+  free( cb->free_slots );
+  free( cb->archives );
+  free( cb );
+}
+
+
+  bool
+classify_batch_uringp( const classify_batch_t * cb )
+{
+  return cb->uring_ok;
+}
+
+
+/**
+ * Handle one completion from `cb''s ring, queueing the slot's next operation
+ * or releasing it, in which case its file is done.
+ */
+  static void
+uring_complete( classify_batch_t   * cb,
+                const char * const * paths,
+                file_class_t       * fcs,
+                uint64_t             user_data,
+                int                  res,
+                unsigned           * nfree
+              )
+{
+  unsigned       s    = user_data >> URING_OP_BITS;
+  uring_slot_t * slot = & cb->slots[s];
+
+  switch ( user_data & ( ( 1 << URING_OP_BITS ) - 1 ) )
+    {
+      case URING_OPEN:
+        STATS_ADD( opens, 1 );
+        if ( res < 0 )
+          {
+            classify_header( NULL, 0, -1, paths[slot->idx], & fcs[slot->idx] );
+            cb->free_slots[( *nfree )++] = s;
+            return;
+          }
+        slot->fd = res;
+        uring_queue( & cb->uring, IORING_OP_READ, slot->fd, slot->buf,
+                     CLASSIFY_PEEK_SIZE, s
+                   );
+        return;
+
+      case URING_READ:
+        if ( res > 0 ) STATS_ADD( bytes_read, res );
+        /* Searching an archive maps and parses it, which would hold up
+         * every other completion, so archives wait for the ring to drain. */
+        if ( classify_header( slot->buf, ( res > 0 ) ? res : 0, -1,
+                              paths[slot->idx], & fcs[slot->idx]
+                            ) == FILE_KIND_AR
+           )
+          {
+            if ( cb->narchives == cb->archives_cap )
+              {
+                cb->archives_cap = ( cb->archives_cap == 0 )
+                                   ? 64 : ( 2 * cb->archives_cap );
+                cb->archives     = realloc( cb->archives, cb->archives_cap *
+                                                          sizeof( size_t )
+                                          );
+                assert( cb->archives != NULL );
+              }
+            cb->archives[cb->narchives++] = slot->idx;
+          }
+        uring_queue( & cb->uring, IORING_OP_CLOSE, slot->fd, NULL, 0, s );
+        return;
+
+      default:
+        cb->free_slots[( *nfree )++] = s;
+        return;
+    }
+}
+
+  static bool
+uring_run( classify_batch_t   * cb,
+           const char * const * paths,
+           size_t               n,
+           file_class_t       * fcs
+         )
+{
+  uring_t  * u      = & cb->uring;
+  size_t     next   = 0;
+  unsigned   nfree  = cb->depth;
+  unsigned   head   = 0;
+  unsigned   tail   = 0;
+
+  cb->narchives = 0;
+  for ( unsigned i = 0; i < cb->depth; i++ ) cb->free_slots[i] = i;
+
+  while ( ( next < n ) || ( nfree < cb->depth ) )
+    {
+      while ( ( next < n ) && ( nfree > 0 ) )
+        {
+          unsigned s = cb->free_slots[--nfree];
+          cb->slots[s].idx = next;
+          uring_queue( u, IORING_OP_OPENAT, AT_FDCWD, paths[next++], 0, s );
+        }
+
+      if ( ! uring_wait( u ) ) return false;
+
+      head = *u->cq_head;
+      tail = __atomic_load_n( u->cq_tail, __ATOMIC_ACQUIRE );
+      for ( ; head != tail; head++ )
+        {
+          const struct io_uring_cqe * cqe = & u->cqes[head & *u->cq_mask];
+          uring_complete( cb, paths, fcs, cqe->user_data, cqe->res, & nfree );
+        }
+      __atomic_store_n( u->cq_head, head, __ATOMIC_RELEASE );
+    }
+  return true;
+}
+
+
+  void
+classify_batch_run( classify_batch_t   * cb,
+                    const char * const * paths,
+                    size_t               n,
+                    file_class_t       * fcs
+                  )
+{
+  bool ok = false;
+
+  if ( n == 0 ) return;
+  STATS_ADD( batches, 1 );
+  if ( cb->uring_ok )
+    {
+      /* `classify_path' calls, of archives and of the pool, charge
+       * themselves. */
+      STATS_START( t0 );
+      ok = uring_run( cb, paths, n, fcs );
+      STATS_STOP( STATS_PHASE_CLASSIFY, t0 );
+      if ( ok )
+        {
+          STATS_ADD( batch_depth, ( n < cb->depth ) ? n : cb->depth );
+          for ( size_t i = 0; i < cb->narchives; i++ )
+            {
+              classify_path( paths[cb->archives[i]], & fcs[cb->archives[i]] );
+            }
+          return;
+        }
+      /* Closing the ring cancels whatever it still had in flight. */
+      uring_close( & cb->uring );
+      cb->uring_ok = false;
+    }
+  if ( cb->pool == NULL )
+    {
+      /* The caller helps its helpers. */
+      cb->pool     = classify_pool_new( cb->depth - 1 );
+      cb->own_pool = true;
+    }
+  /* Helpers may be busy with other batches, so this is at best reached. */
+  STATS_ADD( batch_depth,
+             ( n <= cb->pool->nthreads ) ? n : ( cb->pool->nthreads + 1 )
+           );
+  pool_run( cb->pool, paths, n, fcs );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
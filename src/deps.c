@@ -0,0 +1,875 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <glob.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <elf.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Open-addressing hash map from strings to indices, using linear probing. */
+typedef struct {
+  uint64_t   hash;
+  char     * key;    /* NULL if empty */
+  size_t     value;
+} dep_slot_t;
+
+typedef struct {
+  dep_slot_t * slots;
+  size_t       mask;   /* Capacity - 1 */
+  size_t       count;
+} dep_map_t;
+
+#define DEP_MAP_MIN_SIZE 1024
+
+/** A strongly connected component, and everything reachable from it. */
+typedef struct {
+  size_t * closure;   /* Sorted node indices */
+  size_t   nclosure;
+} dep_scc_t;
+
+struct dep_graph {
+  pthread_mutex_t      lock;        /* Held while adding nodes during scans */
+  dep_node_t         * nodes;
+  size_t               nnodes;
+  size_t               cap;
+  char               * sysroot;     /* Canonical, "" for `/' */
+  const char * const * libdirs;
+  char              ** conf_dirs;   /* From `ld.so.conf', sysroot prefixed */
+  size_t               nconf_dirs;
+  dep_map_t            inodes;      /* "dev:ino" -> node */
+  dep_map_t            probes;      /* Host path -> node or `DEP_UNRESOLVED' */
+  /* Closures, computed on first use. */
+  dep_scc_t          * sccs;
+  size_t               nsccs;
+  size_t             * node_scc;
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+dep_map_init( dep_map_t * m, size_t cap )
+{
+  m->slots = calloc( cap, sizeof( dep_slot_t ) );
+  assert( m->slots != NULL );
+  m->mask  = cap - 1;
+  m->count = 0;
+}
+
+  static size_t
+dep_map_find( const dep_map_t * m, const char * key, uint64_t h )
+{
+  size_t i = h & m->mask;
+  for ( ; m->slots[i].key != NULL; i = ( i + 1 ) & m->mask )
+    {
+      if ( ( m->slots[i].hash == h ) &&
+           ( strcmp( m->slots[i].key, key ) == 0 )
+         )
+        {
+          break;
+        }
+    }
+  return i;
+}
+
+  static bool
+dep_map_get( const dep_map_t * m, const char * key, size_t * value )
+{
+  size_t i = dep_map_find( m, key, hash_fnv1a( key, strlen( key ) ) );
+  if ( m->slots[i].key == NULL ) return false;
+  *value = m->slots[i].value;
+  return true;
+}
+
+/** Add `key' unless it is present, returning false if it was. */
+  static bool
+dep_map_put( dep_map_t * m, const char * key, size_t value )
+{
+  uint64_t h = hash_fnv1a( key, strlen( key ) );
+  size_t   i = dep_map_find( m, key, h );
+
+  if ( m->slots[i].key != NULL ) return false;
+
+  if ( ( m->count + 1 ) > ( ( m->mask + 1 ) - ( ( m->mask + 1 ) >> 2 ) ) )
+    {
+      dep_slot_t * old  = m->slots;
+      size_t       ocap = m->mask + 1;
+      dep_map_init( m, ocap << 1 );
+      for ( size_t j = 0; j < ocap; j++ )
+        {
+          size_t k;
+          if ( old[j].key == NULL ) continue;
+          for ( k = old[j].hash & m->mask; m->slots[k].key != NULL;
+                k = ( k + 1 ) & m->mask
+              );
+          m->slots[k] = old[j];
+          m->count++;
+        }
+      free( old );
+      i = dep_map_find( m, key, h );
+    }
+
+  m->slots[i].hash  = h;
+  m->slots[i].key   = strdup( key );
+  m->slots[i].value = value;
+  assert( m->slots[i].key != NULL );
+  m->count++;
+  return true;
+}
+
+  static void
+dep_map_free( dep_map_t * m )
+{
+  for ( size_t i = 0; i <= m->mask; i++ ) free( m->slots[i].key );
+  free( m->slots );
+  m->slots = NULL;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Record the loadable object `obj', called concurrently by the scan. */
+  static void
+do_dep_object( const elf_view_t * obj, void * aux )
+{
+  dep_graph_t   * g = (dep_graph_t *) aux;
+  dep_node_t      node;
+  elf_dynamic_t   dyn;
+  struct stat     st;
+
+  if ( obj->member ||
+       ( ( obj->fc.e_type != ET_EXEC ) && ( obj->fc.e_type != ET_DYN ) ) ||
+       ( ! elf_read_dynamic( obj->data, obj->size, & dyn ) ) ||
+       ( fstat( obj->fd, & st ) != 0 )
+     )
+    {
+      return;
+    }
+
+  memset( & node, 0, sizeof( node ) );
+  node.path       = strdup( obj->path );
+  node.soname     = ( dyn.soname == NULL ) ? NULL : strdup( dyn.soname );
+  node.rpath      = ( dyn.rpath == NULL ) ? NULL : strdup( dyn.rpath );
+  node.runpath    = ( dyn.runpath == NULL ) ? NULL : strdup( dyn.runpath );
+  node.executable = ( dyn.interp != NULL );
+  node.fc         = obj->fc;
+  node.dev        = st.st_dev;
+  node.ino        = st.st_ino;
+  node.nneeded    = dyn.nneeded;
+  if ( dyn.nneeded > 0 )
+    {
+      node.needed = malloc( dyn.nneeded * sizeof( char * ) );
+      node.deps   = malloc( dyn.nneeded * sizeof( size_t ) );
+      assert( ( node.needed != NULL ) && ( node.deps != NULL ) );
+      for ( size_t i = 0; i < dyn.nneeded; i++ )
+        {
+          node.needed[i] = strdup( dyn.needed[i] );
+          node.deps[i]   = DEP_UNRESOLVED;
+        }
+    }
+  elf_dynamic_free( & dyn );
+
+  pthread_mutex_lock( & g->lock );
+  if ( g->nnodes == g->cap )
+    {
+      g->cap   = ( g->cap == 0 ) ? 1024 : ( 2 * g->cap );
+      g->nodes = realloc( g->nodes, g->cap * sizeof( dep_node_t ) );
+      assert( g->nodes != NULL );
+    }
+  g->nodes[g->nnodes++] = node;
+  pthread_mutex_unlock( & g->lock );
+}
+
+  static int
+dep_node_cmp( const void * a, const void * b )
+{
+  return strcmp( ( (const dep_node_t *) a )->path,
+                 ( (const dep_node_t *) b )->path
+               );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+dep_add_conf_dir( dep_graph_t * g, const char * dir )
+{
+  g->conf_dirs = realloc( g->conf_dirs,
+                          ( g->nconf_dirs + 1 ) * sizeof( char * )
+                        );
+  assert( g->conf_dirs != NULL );
+  if ( asprintf( & g->conf_dirs[g->nconf_dirs], "%s%s", g->sysroot, dir )
+       < 0
+     )
+    {
+      return;
+    }
+  g->nconf_dirs++;
+}
+
+/**
+ * Collect the directories listed by the `ld.so.conf' at host path `file',
+ * following `include' directives, whose relative patterns are taken from the
+ * including file's directory as `ldconfig' does.
+ */
+  static void
+dep_read_conf( dep_graph_t * g, const char * file, int depth )
+{
+  FILE   * fp   = NULL;
+  char   * line = NULL;
+  size_t   cap  = 0;
+
+  if ( ( depth > 8 ) || ( ( fp = fopen( file, "re" ) ) == NULL ) ) return;
+
+  while ( getline( & line, & cap, fp ) != -1 )
+    {
+      char * p = line;
+      line[strcspn( line, "#\n" )] = '\0';
+      p += strspn( p, " \t" );
+
+      if ( *p == '\0' ) continue;
+      if ( ( strncmp( p, "include", 7 ) == 0 ) &&
+           ( ( p[7] == ' ' ) || ( p[7] == '\t' ) )
+         )
+        {
+          char       * pat   = p + 8 + strspn( p + 8, " \t" );
+          char       * full  = NULL;
+          const char * slash = strrchr( file, '/' );
+          glob_t       gl;
+
+          pat[strcspn( pat, " \t" )] = '\0';
+          if ( pat[0] == '/' )
+            {
+              if ( asprintf( & full, "%s%s", g->sysroot, pat ) < 0 )
+                {
+                  full = NULL;
+                }
+            }
+          else if ( asprintf( & full, "%.*s/%s", (int) ( slash - file ), file,
+                              pat
+                            ) < 0
+                  )
+            {
+              full = NULL;
+            }
+          if ( ( full != NULL ) && ( glob( full, 0, NULL, & gl ) == 0 ) )
+            {
+              for ( size_t i = 0; i < gl.gl_pathc; i++ )
+                {
+                  dep_read_conf( g, gl.gl_pathv[i], depth + 1 );
+                }
+              globfree( & gl );
+            }
+          free( full );
+        }
+      else if ( p[0] == '/' )
+        {
+          p[strcspn( p, " \t" )] = '\0';
+          dep_add_conf_dir( g, p );
+        }
+    }
+
+  free( line );
+  fclose( fp );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * `stat' the host path `path' as the target would see it, with the sysroot as
+ * its root directory: absolute symbolic links restart from the sysroot, and
+ * `..' stops there, rather than escaping to the host's files.
+ * Paths outside the sysroot are `stat'ed as they are.
+ */
+  static int
+dep_stat_in_root( const dep_graph_t * g, const char * path, struct stat * st )
+{
+  size_t       rlen  = strlen( g->sysroot );
+  size_t       clen  = rlen;
+  int          links = 0;
+  char         cur[PATH_MAX];
+  char         target[PATH_MAX];
+  char       * rest  = NULL;
+  const char * p     = NULL;
+  bool         ok    = false;
+  struct stat  lst;
+
+  if ( ( rlen == 0 ) || ( strncmp( path, g->sysroot, rlen ) != 0 ) ||
+       ( ( path[rlen] != '/' ) && ( path[rlen] != '\0' ) )
+     )
+    {
+      return stat( path, st );
+    }
+
+  memcpy( cur, g->sysroot, rlen + 1 );
+  rest = strdup( path + rlen );
+  assert( rest != NULL );
+  for ( p = rest; ! ok; )
+    {
+      size_t  len = 0;
+      ssize_t tlen;
+      char  * next = NULL;
+
+      if ( *p == '/' )
+        {
+          p++;
+          continue;
+        }
+      if ( *p == '\0' )
+        {
+          ok = true;
+          continue;
+        }
+      len = strcspn( p, "/" );
+      if ( ( len == 1 ) && ( p[0] == '.' ) )
+        {
+          p += len;
+          continue;
+        }
+      if ( ( len == 2 ) && ( p[0] == '.' ) && ( p[1] == '.' ) )
+        {
+          while ( ( clen > rlen ) && ( cur[--clen] != '/' ) );
+          cur[clen] = '\0';
+          p += len;
+          continue;
+        }
+
+      if ( ( clen + 1 + len ) >= sizeof( cur ) )
+        {
+          errno = ENAMETOOLONG;
+          break;
+        }
+      cur[clen] = '/';
+      memcpy( cur + clen + 1, p, len );
+      cur[clen + 1 + len] = '\0';
+      p += len;
+      if ( lstat( cur, & lst ) != 0 ) break;
+      if ( ! S_ISLNK( lst.st_mode ) )
+        {
+          clen += 1 + len;
+          continue;
+        }
+
+      /* Splice the link's target in front of what remains. */
+      if ( ++links > 40 )
+        {
+          errno = ELOOP;
+          break;
+        }
+      if ( ( tlen = readlink( cur, target, sizeof( target ) - 1 ) ) < 0 ) break;
+      target[tlen] = '\0';
+      if ( target[0] == '/' ) clen = rlen;
+      cur[clen] = '\0';
+      if ( asprintf( & next, "%s/%s", target, p ) < 0 )
+        {
+          errno = ENOMEM;
+          break;
+        }
+      free( rest );
+      p = rest = next;
+    }
+
+  /* Every component was found, and the last is not a link. */
+  if ( ok ) ok = ( stat( cur, st ) == 0 );
+  free( rest );
+  return ok ? 0 : -1;
+}
+
+/** The node at host path `path', or `DEP_UNRESOLVED', remembering the answer. */
+  static size_t
+dep_probe( dep_graph_t * g, const char * path )
+{
+  size_t      idx = DEP_UNRESOLVED;
+  char        key[64];
+  struct stat st;
+
+  if ( dep_map_get( & g->probes, path, & idx ) ) return idx;
+
+  if ( dep_stat_in_root( g, path, & st ) == 0 )
+    {
+      snprintf( key, sizeof( key ), "%jx:%jx", (uintmax_t) st.st_dev,
+                (uintmax_t) st.st_ino
+              );
+      if ( ! dep_map_get( & g->inodes, key, & idx ) ) idx = DEP_UNRESOLVED;
+    }
+  dep_map_put( & g->probes, path, idx );
+  return idx;
+}
+
+/**
+ * The node at host path `path' if it suits `node', skipping objects built
+ * for another target as the dynamic linker does.
+ */
+  static size_t
+dep_probe_for( dep_graph_t * g, const dep_node_t * node, const char * path )
+{
+  size_t idx = dep_probe( g, path );
+  if ( ( idx != DEP_UNRESOLVED ) &&
+       ( ( g->nodes[idx].fc.ei_class != node->fc.ei_class ) ||
+         ( g->nodes[idx].fc.e_machine != node->fc.e_machine )
+       )
+     )
+    {
+      return DEP_UNRESOLVED;
+    }
+  return idx;
+}
+
+/**
+ * Look for `name' in the directory `dir' of a search path, `len' bytes long,
+ * on behalf of `node'.
+ * `$ORIGIN' expands to the directory holding `node', and `$LIB' to `lib64'
+ * or `lib' by class; entries using `$PLATFORM' are skipped.
+ */
+  static size_t
+dep_search_dir( dep_graph_t      * g,
+                const dep_node_t * node,
+                const char       * dir,
+                size_t             len,
+                const char       * name
+              )
+{
+  obuf_t  path;
+  bool    host = false;
+  size_t  idx  = DEP_UNRESOLVED;
+
+  if ( len == 0 ) return DEP_UNRESOLVED;
+
+  obuf_init( & path, PATH_MAX );
+  for ( size_t i = 0; i < len; )
+    {
+      const char * tok  = NULL;
+      size_t       tlen = 0;
+
+      if ( dir[i] != '$' )
+        {
+          obuf_append( & path, dir + i++, 1 );
+          continue;
+        }
+
+      if ( ( strncmp( dir + i, "$ORIGIN", 7 ) == 0 ) ||
+           ( strncmp( dir + i, "${ORIGIN}", 9 ) == 0 )
+         )
+        {
+          tok  = node->path;
+          tlen = strrchr( node->path, '/' ) - node->path;
+          i   += ( dir[i + 1] == '{' ) ? 9 : 7;
+          /* The object's path is already on the host. */
+          if ( path.len == 0 ) host = true;
+        }
+      else if ( ( strncmp( dir + i, "$LIB", 4 ) == 0 ) ||
+                ( strncmp( dir + i, "${LIB}", 6 ) == 0 )
+              )
+        {
+          tok  = ( node->fc.ei_class == ELFCLASS64 ) ? "lib64" : "lib";
+          tlen = strlen( tok );
+          i   += ( dir[i + 1] == '{' ) ? 6 : 4;
+        }
+      else
+        {
+          obuf_free( & path );
+          return DEP_UNRESOLVED;
+        }
+      obuf_append( & path, tok, tlen );
+    }
+  obuf_append( & path, "/", 1 );
+  obuf_append( & path, name, strlen( name ) + 1 );
+
+  if ( host || ( path.buf[0] != '/' ) )
+    {
+      idx = dep_probe_for( g, node, path.buf );
+    }
+  else
+    {
+      char * full = NULL;
+      if ( asprintf( & full, "%s%s", g->sysroot, path.buf ) >= 0 )
+        {
+          idx = dep_probe_for( g, node, full );
+          free( full );
+        }
+    }
+  obuf_free( & path );
+  return idx;
+}
+
+/** Search each directory of the colon separated `list'. */
+  static size_t
+dep_search_list( dep_graph_t      * g,
+                 const dep_node_t * node,
+                 const char       * list,
+                 const char       * name
+               )
+{
+  size_t idx = DEP_UNRESOLVED;
+  for ( const char * p = list; ( idx == DEP_UNRESOLVED ) && ( *p != '\0' ); )
+    {
+      size_t len = strcspn( p, ":" );
+      idx = dep_search_dir( g, node, p, len, name );
+      p  += len;
+      if ( *p == ':' ) p++;
+    }
+  return idx;
+}
+
+/**
+ * Resolve `name', needed by `node', following the dynamic linker's order:
+ * DT_RPATH unless there is a DT_RUNPATH, `libdirs', DT_RUNPATH,
+ * `ld.so.conf', then the default directories.
+ */
+  static size_t
+dep_resolve( dep_graph_t * g, const dep_node_t * node, const char * name )
+{
+  static const char * const defaults[] = {
+    "/lib64", "/usr/lib64", "/lib", "/usr/lib", NULL
+  };
+  size_t idx = DEP_UNRESOLVED;
+
+  if ( strchr( name, '/' ) != NULL )
+    {
+      const char * slash = strrchr( name, '/' );
+      return dep_search_dir( g, node, name, slash - name, slash + 1 );
+    }
+
+  if ( ( node->rpath != NULL ) && ( node->runpath == NULL ) )
+    {
+      idx = dep_search_list( g, node, node->rpath, name );
+    }
+  for ( const char * const * d = g->libdirs;
+        ( idx == DEP_UNRESOLVED ) && ( d != NULL ) && ( *d != NULL ); d++
+      )
+    {
+      idx = dep_search_dir( g, node, *d, strlen( *d ), name );
+    }
+  if ( ( idx == DEP_UNRESOLVED ) && ( node->runpath != NULL ) )
+    {
+      idx = dep_search_list( g, node, node->runpath, name );
+    }
+  for ( size_t i = 0; ( idx == DEP_UNRESOLVED ) && ( i < g->nconf_dirs ); i++ )
+    {
+      /* Already prefixed by the sysroot. */
+      char * full = NULL;
+      if ( asprintf( & full, "%s/%s", g->conf_dirs[i], name ) >= 0 )
+        {
+          idx = dep_probe_for( g, node, full );
+          free( full );
+        }
+    }
+  /* Only 64 bit objects search the `lib64' directories. */
+  for ( const char * const * d =
+          defaults + ( ( node->fc.ei_class == ELFCLASS64 ) ? 0 : 2 );
+        ( idx == DEP_UNRESOLVED ) && ( *d != NULL ); d++
+      )
+    {
+      idx = dep_search_dir( g, node, *d, strlen( *d ), name );
+    }
+
+  return idx;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  dep_graph_t *
+dep_graph_build( char * const *       paths,
+                 int                  pathc,
+                 const dep_opts_t   * opts,
+                 const map_opts_t   * walk
+               )
+{
+  dep_graph_t * g     = calloc( 1, sizeof( dep_graph_t ) );
+  map_opts_t    wopts = { .nthreads = 0, .concurrent = true };
+  char        * conf  = NULL;
+  char          key[64];
+
+  assert( g != NULL );
+  pthread_mutex_init( & g->lock, NULL );
+
+  if ( ( opts != NULL ) && ( opts->sysroot != NULL ) &&
+       ( strcmp( opts->sysroot, "/" ) != 0 )
+     )
+    {
+      if ( ( g->sysroot = realpath( opts->sysroot, NULL ) ) == NULL )
+        {
+          fprintf( stderr, "%s: %s\n", opts->sysroot, strerror( errno ) );
+          free( g );
+          return NULL;
+        }
+    }
+  else
+    {
+      g->sysroot = strdup( "" );
+    }
+  g->libdirs = ( opts == NULL ) ? NULL : opts->libdirs;
+
+  /* Objects are independent, so they are read on every worker at once. */
+  if ( walk != NULL ) wopts = *walk;
+  wopts.concurrent = true;
+  map_elfs_recur_opts( paths, pathc, do_dep_object, g, & wopts );
+
+  /* Give nodes a stable order, whatever order the workers found them in. */
+  qsort( g->nodes, g->nnodes, sizeof( dep_node_t ), dep_node_cmp );
+
+  dep_map_init( & g->inodes, DEP_MAP_MIN_SIZE );
+  dep_map_init( & g->probes, DEP_MAP_MIN_SIZE );
+  for ( size_t i = 0; i < g->nnodes; i++ )
+    {
+      snprintf( key, sizeof( key ), "%jx:%jx", (uintmax_t) g->nodes[i].dev,
+                (uintmax_t) g->nodes[i].ino
+              );
+      dep_map_put( & g->inodes, key, i );
+    }
+
+  if ( asprintf( & conf, "%s/etc/ld.so.conf", g->sysroot ) >= 0 )
+    {
+      dep_read_conf( g, conf, 0 );
+      free( conf );
+    }
+
+  for ( size_t i = 0; i < g->nnodes; i++ )
+    {
+      dep_node_t * node = & g->nodes[i];
+      for ( size_t j = 0; j < node->nneeded; j++ )
+        {
+          node->deps[j] = dep_resolve( g, node, node->needed[j] );
+        }
+    }
+
+  return g;
+}
+
+
+  size_t
+dep_graph_count( const dep_graph_t * g )
+{
+  return g->nnodes;
+}
+
+
+  const dep_node_t *
+dep_graph_node( const dep_graph_t * g, size_t i )
+{
+  assert( i < g->nnodes );
+  return & g->nodes[i];
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Working state of Tarjan's algorithm. */
+typedef struct {
+  dep_graph_t * g;
+  size_t      * index;  /* Visit order + 1, 0 if unvisited */
+  size_t      * low;
+  bool        * on_stack;
+  size_t      * stack;
+  size_t        depth;
+  size_t        counter;
+  uint32_t    * mark;   /* Stamps deduplicating closure members */
+  uint32_t      stamp;
+  size_t      * buf;
+} dep_tarjan_t;
+
+  static int
+dep_size_cmp( const void * a, const void * b )
+{
+  size_t x = *(const size_t *) a;
+  size_t y = *(const size_t *) b;
+  return ( x > y ) - ( x < y );
+}
+
+/**
+ * Close the component rooted at `v', whose members are on top of the stack.
+ * Components are completed successors first, so each one's closure is the
+ * union of its successors' closures, plus its own members if it is cyclic.
+ */
+  static void
+dep_scc_close( dep_tarjan_t * t, size_t v )
+{
+  dep_graph_t * g     = t->g;
+  size_t        scc   = g->nsccs++;
+  size_t        first = t->depth;
+  size_t        n     = 0;
+  bool          cycle = false;
+
+  do
+    {
+      first--;
+      t->on_stack[t->stack[first]] = false;
+      g->node_scc[t->stack[first]] = scc;
+    }
+  while ( t->stack[first] != v );
+
+  t->stamp++;
+  for ( size_t m = first; m < t->depth; m++ )
+    {
+      const dep_node_t * node = & g->nodes[t->stack[m]];
+      for ( size_t j = 0; j < node->nneeded; j++ )
+        {
+          size_t d = node->deps[j];
+          if ( d == DEP_UNRESOLVED ) continue;
+          if ( g->node_scc[d] == scc )
+            {
+              cycle = true;
+              continue;
+            }
+          if ( t->mark[d] != t->stamp )
+            {
+              t->mark[d] = t->stamp;
+              t->buf[n++] = d;
+            }
+          for ( size_t k = 0; k < g->sccs[g->node_scc[d]].nclosure; k++ )
+            {
+              size_t c = g->sccs[g->node_scc[d]].closure[k];
+              if ( t->mark[c] != t->stamp )
+                {
+                  t->mark[c] = t->stamp;
+                  t->buf[n++] = c;
+                }
+            }
+        }
+    }
+  if ( cycle )
+    {
+      for ( size_t m = first; m < t->depth; m++ )
+        {
+          if ( t->mark[t->stack[m]] != t->stamp )
+            {
+              t->mark[t->stack[m]] = t->stamp;
+              t->buf[n++] = t->stack[m];
+            }
+        }
+    }
+  t->depth = first;
+
+  qsort( t->buf, n, sizeof( size_t ), dep_size_cmp );
+  g->sccs[scc].nclosure = n;
+  g->sccs[scc].closure  = malloc( ( n + 1 ) * sizeof( size_t ) );
+  assert( g->sccs[scc].closure != NULL );
+  memcpy( g->sccs[scc].closure, t->buf, n * sizeof( size_t ) );
+}
+
+  static void
+dep_tarjan_visit( dep_tarjan_t * t, size_t v )
+{
+  const dep_node_t * node = & t->g->nodes[v];
+
+  t->index[v] = t->low[v] = ++t->counter;
+  t->stack[t->depth++] = v;
+  t->on_stack[v] = true;
+
+  for ( size_t j = 0; j < node->nneeded; j++ )
+    {
+      size_t d = node->deps[j];
+      if ( d == DEP_UNRESOLVED ) continue;
+      if ( t->index[d] == 0 )
+        {
+          dep_tarjan_visit( t, d );
+          if ( t->low[d] < t->low[v] ) t->low[v] = t->low[d];
+        }
+      else if ( t->on_stack[d] && ( t->index[d] < t->low[v] ) )
+        {
+          t->low[v] = t->index[d];
+        }
+    }
+
+  if ( t->low[v] == t->index[v] ) dep_scc_close( t, v );
+}
+
+
+  const size_t *
+dep_graph_closure( dep_graph_t * g, size_t i, size_t * count )
+{
+  assert( i < g->nnodes );
+
+  if ( g->sccs == NULL )
+    {
+      size_t       n = g->nnodes;
+      dep_tarjan_t t = {
+        .g        = g,
+        .index    = calloc( n + 1, sizeof( size_t ) ),
+        .low      = calloc( n + 1, sizeof( size_t ) ),
+        .on_stack = calloc( n + 1, sizeof( bool ) ),
+        .stack    = calloc( n + 1, sizeof( size_t ) ),
+        .mark     = calloc( n + 1, sizeof( uint32_t ) ),
+        .buf      = calloc( n + 1, sizeof( size_t ) )
+      };
+      assert( ( t.index != NULL ) && ( t.low != NULL ) &&
+              ( t.on_stack != NULL ) && ( t.stack != NULL ) &&
+              ( t.mark != NULL ) && ( t.buf != NULL )
+            );
+      g->sccs     = calloc( n + 1, sizeof( dep_scc_t ) );
+      g->node_scc = calloc( n + 1, sizeof( size_t ) );
+      assert( ( g->sccs != NULL ) && ( g->node_scc != NULL ) );
+
+      for ( size_t v = 0; v < n; v++ )
+        {
+          if ( t.index[v] == 0 ) dep_tarjan_visit( & t, v );
+        }
+
+      free( t.index );
+      free( t.low );
+      free( t.on_stack );
+      free( t.stack );
+      free( t.mark );
+      free( t.buf );
+    }
+
+  *count = g->sccs[g->node_scc[i]].nclosure;
+  return g->sccs[g->node_scc[i]].closure;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+dep_graph_free( dep_graph_t * g )
+{
+  for ( size_t i = 0; i < g->nnodes; i++ )
+    {
+      dep_node_t * node = & g->nodes[i];
+      free( (char *) node->path );
+      free( (char *) node->soname );
+      free( (char *) node->rpath );
+      free( (char *) node->runpath );
+      for ( size_t j = 0; j < node->nneeded; j++ )
+        {
+          free( (char *) node->needed[j] );
+        }
+      free( node->needed );
+      free( node->deps );
+    }
+  free( g->nodes );
+  for ( size_t i = 0; i < g->nsccs; i++ ) free( g->sccs[i].closure );
+  free( g->sccs );
+  free( g->node_scc );
+  for ( size_t i = 0; i < g->nconf_dirs; i++ ) free( g->conf_dirs[i] );
+  free( g->conf_dirs );
+  dep_map_free( & g->inodes );
+  dep_map_free( & g->probes );
+  free( g->sysroot );
+  pthread_mutex_destroy( & g->lock );
+  free( g );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
@@ -0,0 +1,388 @@
+/* -*- mode: c; -*- */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "aa-elf-util.h"
+
+
+/* ========================================================================== */
+
+  static void
+usage( const char * argv0, FILE * out )
+{
+  fprintf( out,
+           "Usage: %s [--sysroot DIR] [-L DIR]... [-j THREADS]\n"
+           "         [--prune GLOB]... [-a] [-c] [--dot] [PATH...]\n"
+           "Resolve the shared library dependencies of the ELF executables\n"
+           "under PATHs, which default to the sysroot, without running them.\n"
+           "Libraries are only found if they are under PATHs too.\n"
+           "  --sysroot DIR  Search library directories below DIR, including\n"
+           "                 those listed by its `/etc/ld.so.conf'.\n"
+           "  -L DIR         Search DIR after DT_RPATH and before DT_RUNPATH,\n"
+           "                 as `LD_LIBRARY_PATH' would be.  May be repeated.\n"
+           "  -j THREADS     Number of traversal threads, 0 for one per CPU.\n"
+           "  --prune GLOB   Skip directories matching GLOB, as `findelfs'\n"
+           "                 does.  May be repeated.\n"
+           "  -a             Report every shared object, not only executables.\n"
+           "  -c             Report the whole closure of each object, as `ldd'\n"
+           "                 does, rather than its direct dependencies.\n"
+           "  --dot          Print a graph for `dot' instead of lists.\n"
+           "Objects are named by the path the scan found them under, which\n"
+           "for links may vary between runs unless `-j 1' is given.\n",
+           argv0
+         );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** The name `ldd' would show for a loaded object. */
+  static const char *
+node_name( const dep_node_t * node )
+{
+  const char * slash = strrchr( node->path, '/' );
+  if ( node->soname != NULL ) return node->soname;
+  return ( slash == NULL ) ? node->path : ( slash + 1 );
+}
+
+  static void
+put_dep( obuf_t * out, const char * name, const char * path )
+{
+  obuf_append( out, "\t", 1 );
+  obuf_append( out, name, strlen( name ) );
+  obuf_append( out, " => ", 4 );
+  obuf_putline( out, ( path == NULL ) ? "not found" : path );
+}
+
+  static int
+strp_cmp( const void * a, const void * b )
+{
+  return strcmp( *(const char * const *) a, *(const char * const *) b );
+}
+
+/** Detect if one of the `n' nodes at `reach' goes by `name'. */
+  static bool
+reached_namep( dep_graph_t * g, const size_t * reach, size_t n,
+               const char * name
+             )
+{
+  for ( size_t k = 0; k < n; k++ )
+    {
+      if ( strcmp( node_name( dep_graph_node( g, reach[k] ) ), name ) == 0 )
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+/**
+ * Print `i' followed by its dependencies, as `NAME => PATH' lines.
+ * With `closure' every object it loads is listed, and every name missing
+ * anywhere in the closure is reported once, unless another object in the
+ * closure has that SONAME, as the dynamic linker would reuse it.
+ */
+  static void
+print_node( dep_graph_t * g, size_t i, bool closure, obuf_t * out )
+{
+  const dep_node_t  * node    = dep_graph_node( g, i );
+  const size_t      * reach   = NULL;
+  const char       ** missing = NULL;
+  size_t              nreach  = 0;
+  size_t              nmiss   = 0;
+
+  obuf_append( out, node->path, strlen( node->path ) );
+  obuf_putline( out, ":" );
+
+  if ( ! closure )
+    {
+      for ( size_t j = 0; j < node->nneeded; j++ )
+        {
+          put_dep( out, node->needed[j],
+                   ( node->deps[j] == DEP_UNRESOLVED ) ? NULL :
+                   dep_graph_node( g, node->deps[j] )->path
+                 );
+        }
+      return;
+    }
+
+  reach = dep_graph_closure( g, i, & nreach );
+  for ( size_t k = 0; k <= nreach; k++ )
+    {
+      /* The object itself is visited last, for its missing names only. */
+      const dep_node_t * n = dep_graph_node( g, ( k < nreach ) ? reach[k]
+                                                                : i
+                                           );
+      if ( ( k < nreach ) && ( reach[k] != i ) )
+        {
+          put_dep( out, node_name( n ), n->path );
+        }
+      for ( size_t j = 0; j < n->nneeded; j++ )
+        {
+          if ( ( n->deps[j] != DEP_UNRESOLVED ) ||
+               reached_namep( g, reach, nreach, n->needed[j] )
+             )
+            {
+              continue;
+            }
+          missing = realloc( missing, ( nmiss + 1 ) * sizeof( char * ) );
+          if ( missing == NULL )
+            {
+              perror( "realloc" );
+              exit( EXIT_FAILURE );
+            }
+          missing[nmiss++] = n->needed[j];
+        }
+    }
+
+  qsort( missing, nmiss, sizeof( char * ), strp_cmp );
+  for ( size_t k = 0; k < nmiss; k++ )
+    {
+      if ( ( k == 0 ) || ( strcmp( missing[k], missing[k - 1] ) != 0 ) )
+        {
+          put_dep( out, missing[k], NULL );
+        }
+    }
+  free( missing );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+put_dot_id( obuf_t * out, const char * str )
+{
+  obuf_append( out, "\"", 1 );
+  for ( ; *str != '\0'; str++ )
+    {
+      if ( ( *str == '"' ) || ( *str == '\\' ) ) obuf_append( out, "\\", 1 );
+      obuf_append( out, str, 1 );
+    }
+  obuf_append( out, "\"", 1 );
+}
+
+  static void
+put_dot_edge( obuf_t * out, const char * from, const char * to, bool missing )
+{
+  obuf_append( out, "  ", 2 );
+  put_dot_id( out, from );
+  obuf_append( out, " -> ", 4 );
+  put_dot_id( out, to );
+  obuf_putline( out, missing ? " [style=dashed];" : ";" );
+}
+
+/**
+ * Print a graph of the objects in `report'.
+ * Direct edges are drawn from them and from everything they load, while with
+ * `closure' each reported object gets an edge to every object it loads.
+ * Missing libraries are drawn as dashed edges to their names.
+ */
+  static void
+print_dot( dep_graph_t * g, const bool * report, bool closure, obuf_t * out )
+{
+  size_t   n    = dep_graph_count( g );
+  bool   * draw = calloc( n, sizeof( bool ) );
+
+  if ( draw == NULL )
+    {
+      perror( "calloc" );
+      exit( EXIT_FAILURE );
+    }
+
+  obuf_putline( out, "digraph deps {" );
+  for ( size_t i = 0; i < n; i++ )
+    {
+      const dep_node_t * node   = dep_graph_node( g, i );
+      size_t             nreach = 0;
+      const size_t     * reach  = NULL;
+
+      if ( ! report[i] ) continue;
+      reach = dep_graph_closure( g, i, & nreach );
+      if ( ! closure )
+        {
+          draw[i] = true;
+          for ( size_t k = 0; k < nreach; k++ ) draw[reach[k]] = true;
+          continue;
+        }
+      for ( size_t k = 0; k < nreach; k++ )
+        {
+          if ( reach[k] == i ) continue;
+          put_dot_edge( out, node->path, dep_graph_node( g, reach[k] )->path,
+                        false
+                      );
+        }
+      for ( size_t j = 0; j < node->nneeded; j++ )
+        {
+          if ( node->deps[j] != DEP_UNRESOLVED ) continue;
+          put_dot_edge( out, node->path, node->needed[j], true );
+        }
+    }
+
+  for ( size_t i = 0; i < n; i++ )
+    {
+      const dep_node_t * node = dep_graph_node( g, i );
+      if ( ! draw[i] ) continue;
+      for ( size_t j = 0; j < node->nneeded; j++ )
+        {
+          put_dot_edge( out, node->path,
+                        ( node->deps[j] == DEP_UNRESOLVED ) ? node->needed[j] :
+                        dep_graph_node( g, node->deps[j] )->path,
+                        node->deps[j] == DEP_UNRESOLVED
+                      );
+        }
+    }
+  obuf_putline( out, "}" );
+  free( draw );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static const struct option long_opts[] = {
+  { "sysroot", required_argument, NULL, 'R' },
+  { "prune",   required_argument, NULL, 'P' },
+  { "dot",     no_argument,       NULL, 'D' },
+  { NULL,      0,                 NULL, 0   }
+};
+
+/** Append `str' to the NULL terminated list `*list' of `*n' entries. */
+  static void
+push_arg( const char *** list, size_t * n, const char * str )
+{
+  *list = realloc( *list, ( *n + 2 ) * sizeof( char * ) );
+  if ( *list == NULL )
+    {
+      perror( "realloc" );
+      exit( EXIT_FAILURE );
+    }
+  ( *list )[( *n )++] = str;
+  ( *list )[*n]       = NULL;
+}
+
+  int
+main( int argc, char * argv[], char ** envp )
+{
+  map_opts_t     walk    = { .nthreads = 0, .concurrent = true };
+  dep_opts_t     opts    = { .sysroot = NULL, .libdirs = NULL };
+  const char  ** libdirs = NULL;
+  size_t         nlib    = 0;
+  const char  ** prune   = NULL;
+  size_t         nprune  = 0;
+  bool           all     = false;
+  bool           closure = false;
+  bool           dot     = false;
+  bool         * report  = NULL;
+  dep_graph_t  * g       = NULL;
+  char         * root[1] = { NULL };
+  obuf_t         out;
+  int            opt     = -1;
+
+  while ( ( opt = getopt_long( argc, argv, "hj:L:ac", long_opts, NULL ) )
+          != -1
+        )
+    {
+      switch ( opt )
+        {
+          case 'j':
+            walk.nthreads = atoi( optarg );
+            break;
+
+          case 'R':
+            opts.sysroot = optarg;
+            break;
+
+          case 'L':
+            push_arg( & libdirs, & nlib, optarg );
+            break;
+
+          case 'P':
+            push_arg( & prune, & nprune, optarg );
+            break;
+
+          case 'a':
+            all = true;
+            break;
+
+          case 'c':
+            closure = true;
+            break;
+
+          case 'D':
+            dot = true;
+            break;
+
+          case 'h':
+            usage( argv[0], stdout );
+            return EXIT_SUCCESS;
+
+          default:
+            usage( argv[0], stderr );
+            return EXIT_FAILURE;
+        }
+    }
+
+  if ( ( optind == argc ) && ( opts.sysroot == NULL ) )
+    {
+      usage( argv[0], stderr );
+      return EXIT_FAILURE;
+    }
+
+  opts.libdirs = libdirs;
+  walk.prune   = prune;
+  root[0]      = (char *) opts.sysroot;
+  g = ( optind == argc ) ? dep_graph_build( root, 1, & opts, & walk )
+                         : dep_graph_build( argv + optind, argc - optind,
+                                            & opts, & walk
+                                          );
+  if ( g == NULL ) return EXIT_FAILURE;
+
+  report = calloc( dep_graph_count( g ) + 1, sizeof( bool ) );
+  if ( report == NULL )
+    {
+      perror( "calloc" );
+      return EXIT_FAILURE;
+    }
+  for ( size_t i = 0; i < dep_graph_count( g ); i++ )
+    {
+      report[i] = all || dep_graph_node( g, i )->executable;
+    }
+
+  obuf_init( & out, 0 );
+  if ( dot )
+    {
+      print_dot( g, report, closure, & out );
+    }
+  else
+    {
+      for ( size_t i = 0; i < dep_graph_count( g ); i++ )
+        {
+          if ( ! report[i] ) continue;
+          print_node( g, i, closure, & out );
+          if ( out.len >= ( OBUF_DEFAULT_SIZE / 2 ) )
+            {
+              obuf_flush( & out, STDOUT_FILENO );
+            }
+        }
+    }
+  obuf_flush( & out, STDOUT_FILENO );
+  obuf_free( & out );
+
+  free( report );
+  dep_graph_free( g );
+  free( libdirs );
+  free( prune );
+
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
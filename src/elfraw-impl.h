@@ -0,0 +1,1269 @@
+/* -*- mode: c; -*- */
+
+/**
+ * Raw readers for ELF objects held in memory, instantiated by `elfraw.c' once
+ * per combination of ELF class and data encoding.
+ *
+ * The includer defines:
+ *   ELFRAW_BITS    32 or 64
+ *   ELFRAW_SWAP    1 if the object's byte order differs from the host's
+ *   ELFRAW_NAME(x) Pastes the instance's suffix onto `x'
+ *
+ * Because both parameters are constants every field access compiles to a
+ * plain ( possibly byte swapped ) load, with no per-field dispatch on class or
+ * encoding.
+ * Fields are loaded through `memcpy' since archive members are only 2 byte
+ * aligned.
+ */
+
+/* ========================================================================== */
+
+#define ELFRAW_CAT_( a, b, c )  a ## b ## c
+#define ELFRAW_CAT( a, b, c )   ELFRAW_CAT_( a, b, c )
+#define ELFRAW_T( t )           ELFRAW_CAT( Elf, ELFRAW_BITS, _ ## t )
+
+#define Ehdr  ELFRAW_T( Ehdr )
+#define Shdr  ELFRAW_T( Shdr )
+#define Sym   ELFRAW_T( Sym )
+#define Phdr  ELFRAW_T( Phdr )
+#define Dyn   ELFRAW_T( Dyn )
+#define Nhdr  ELFRAW_T( Nhdr )
+#define Verdef   ELFRAW_T( Verdef )
+#define Verdaux  ELFRAW_T( Verdaux )
+#define Verneed  ELFRAW_T( Verneed )
+#define Vernaux  ELFRAW_T( Vernaux )
+
+#if ELFRAW_BITS == 64
+#  define LDW  LD64
+#else
+#  define LDW  LD32
+#endif
+
+#if ELFRAW_SWAP
+#  define BSWAP16( v )  __builtin_bswap16( v )
+#  define BSWAP32( v )  __builtin_bswap32( v )
+#  define BSWAP64( v )  __builtin_bswap64( v )
+#else
+#  define BSWAP16( v )  ( v )
+#  define BSWAP32( v )  ( v )
+#  define BSWAP64( v )  ( v )
+#endif
+
+/** Load field `f' of a `T' located at `p'. */
+#define LD8( p, T, f )   ( ( (const unsigned char *) ( p ) )[offsetof( T, f )] )
+#define LD16( p, T, f )  BSWAP16( elfraw_ld16( (const char *) ( p ) +  \
+                                               offsetof( T, f ) ) )
+#define LD32( p, T, f )  BSWAP32( elfraw_ld32( (const char *) ( p ) +  \
+                                               offsetof( T, f ) ) )
+#define LD64( p, T, f )  BSWAP64( elfraw_ld64( (const char *) ( p ) +  \
+                                               offsetof( T, f ) ) )
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Locate the section header table, validating that it lies within the object.
+ * Handles extended section numbering, where `e_shnum' is 0 and the count is
+ * kept in the first section header.
+ */
+  static bool
+ELFRAW_NAME( elfraw_shdrs )( const unsigned char *  data,
+                             size_t                 size,
+                             const unsigned char ** shdrs,
+                             size_t               * shnum
+                           )
+{
+  uint64_t shoff = 0;
+  size_t   n     = 0;
+
+  if ( size < sizeof( Ehdr ) ) return false;
+
+  shoff = LDW( data, Ehdr, e_shoff );
+  n     = LD16( data, Ehdr, e_shnum );
+
+  if ( ( shoff == 0 ) ||
+       ( LD16( data, Ehdr, e_shentsize ) != sizeof( Shdr ) ) ||
+       ( shoff > size ) || ( ( size - shoff ) < sizeof( Shdr ) )
+     )
+    {
+      return false;
+    }
+
+  if ( n == 0 ) n = LDW( data + shoff, Shdr, sh_size );
+
+  if ( n > ( ( size - shoff ) / sizeof( Shdr ) ) ) return false;
+
+  *shdrs = data + shoff;
+  *shnum = n;
+  return true;
+}
+
+
+/**
+ * Fetch a section's contents, checking it lies within the object and is not
+ * `SHT_NOBITS'.
+ */
+  static bool
+ELFRAW_NAME( elfraw_section )( const unsigned char *  data,
+                               size_t                 size,
+                               const unsigned char  * shdr,
+                               const unsigned char ** sdata,
+                               size_t               * ssize
+                             )
+{
+  uint64_t off = LDW( shdr, Shdr, sh_offset );
+  uint64_t len = LDW( shdr, Shdr, sh_size );
+
+  if ( ( LD32( shdr, Shdr, sh_type ) == SHT_NOBITS ) ||
+       ( off > size ) || ( len > ( size - off ) )
+     )
+    {
+      return false;
+    }
+
+  *sdata = data + off;
+  *ssize = len;
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Fetch the entries of the symbol table described by `symtab', along with its
+ * string table.
+ * The string table must end in NUL so that every name in it is bounded.
+ */
+  static bool
+ELFRAW_NAME( elfraw_symtab )( const unsigned char *  data,
+                              size_t                 size,
+                              const unsigned char  * shdrs,
+                              size_t                 shnum,
+                              const unsigned char  * symtab,
+                              const unsigned char ** syms,
+                              size_t               * nsyms,
+                              const char          ** strs,
+                              size_t               * nstrs
+                            )
+{
+  const unsigned char * str  = NULL;
+  size_t                link = LD32( symtab, Shdr, sh_link );
+
+  if ( ( LDW( symtab, Shdr, sh_entsize ) != sizeof( Sym ) ) ||
+       ( ! ELFRAW_NAME( elfraw_section )( data, size, symtab, syms, nsyms ) )
+     )
+    {
+      return false;
+    }
+  *nsyms /= sizeof( Sym );
+
+  if ( ( link == 0 ) || ( link >= shnum ) ||
+       ( ! ELFRAW_NAME( elfraw_section )( data, size,
+                                          shdrs + link * sizeof( Shdr ),
+                                          & str, nstrs
+                                        )
+       ) ||
+       ( *nstrs == 0 ) || ( str[*nstrs - 1] != '\0' )
+     )
+    {
+      return false;
+    }
+
+  *strs = (const char *) str;
+  return true;
+}
+
+
+/** Widen the symbol at `s', whose name is known to be within `strs'. */
+  static void
+ELFRAW_NAME( elfraw_sym )( const unsigned char * s,
+                           const char          * strs,
+                           elf_sym_t           * sym
+                         )
+{
+  sym->name  = strs + LD32( s, Sym, st_name );
+  sym->value = LDW( s, Sym, st_value );
+#if ELFRAW_BITS == 64
+  sym->size  = LD64( s, Sym, st_size );
+#else
+  sym->size  = LD32( s, Sym, st_size );
+#endif
+  sym->info    = LD8( s, Sym, st_info );
+  sym->other   = LD8( s, Sym, st_other );
+  sym->shndx   = LD16( s, Sym, st_shndx );
+  sym->version = NULL;
+  sym->hidden  = false;
+}
+
+
+  static bool
+ELFRAW_NAME( elfraw_map_syms )( const unsigned char * data,
+                                size_t                size,
+                                unsigned              sh_type,
+                                do_sym_fn             fn,
+                                void                * aux
+                              )
+{
+  const unsigned char * shdrs   = NULL;
+  const unsigned char * symtab  = NULL;
+  const unsigned char * syms    = NULL;
+  const char          * strs    = NULL;
+  size_t                shnum   = 0;
+  size_t                nsyms   = 0;
+  size_t                nstrs   = 0;
+  elf_sym_t             sym;
+
+  if ( ! ELFRAW_NAME( elfraw_shdrs )( data, size, & shdrs, & shnum ) )
+    {
+      return false;
+    }
+
+  for ( size_t i = 0; i < shnum; i++ )
+    {
+      const unsigned char * shdr = shdrs + i * sizeof( Shdr );
+      if ( LD32( shdr, Shdr, sh_type ) == sh_type )
+        {
+          symtab = shdr;
+          break;
+        }
+    }
+
+  if ( ( symtab == NULL ) ||
+       ( ! ELFRAW_NAME( elfraw_symtab )( data, size, shdrs, shnum, symtab,
+                                         & syms, & nsyms, & strs, & nstrs
+                                       )
+       )
+     )
+    {
+      return false;
+    }
+
+  for ( size_t i = 0; i < nsyms; i++ )
+    {
+      const unsigned char * s = syms + i * sizeof( Sym );
+      if ( LD32( s, Sym, st_name ) >= nstrs ) continue;
+      ELFRAW_NAME( elfraw_sym )( s, strs, & sym );
+      fn( & sym, aux );
+    }
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * A hash section and the dynamic symbol table it indexes, with every part
+ * bounds checked up front so probes need no further validation.
+ */
+typedef struct {
+  const unsigned char * syms;
+  size_t                nsyms;
+  const char          * strs;
+  size_t                nstrs;
+  /* `.gnu.hash' */
+  const unsigned char * bloom;
+  uint32_t              bloom_size;  /* In words, a power of two */
+  uint32_t              bloom_shift;
+  uint32_t              symoffset;
+  /* Both, `chain' holds `nchain' words. */
+  bool                  gnu;
+  const unsigned char * buckets;
+  uint32_t              nbuckets;
+  const unsigned char * chain;
+  size_t                nchain;
+} ELFRAW_NAME( elfraw_hash_t );
+
+#define ELFRAW_WORD( p, i )  BSWAP32( elfraw_ld32( ( p ) + 4 * (size_t) ( i ) ) )
+
+  static bool
+ELFRAW_NAME( elfraw_hash_init )( const unsigned char *            data,
+                                 size_t                           size,
+                                 ELFRAW_NAME( elfraw_hash_t )   * ht
+                               )
+{
+  const unsigned char * shdrs = NULL;
+  const unsigned char * hsec  = NULL;
+  const unsigned char * hdata = NULL;
+  size_t                shnum = 0;
+  size_t                hsize = 0;
+  size_t                link  = 0;
+  size_t                words = 0;
+
+  if ( ! ELFRAW_NAME( elfraw_shdrs )( data, size, & shdrs, & shnum ) )
+    {
+      return false;
+    }
+
+  /* Prefer `.gnu.hash', whose bloom filter rejects most misses outright. */
+  for ( size_t i = 0; i < shnum; i++ )
+    {
+      const unsigned char * shdr = shdrs + i * sizeof( Shdr );
+      uint32_t              type = LD32( shdr, Shdr, sh_type );
+      if ( type == SHT_GNU_HASH )
+        {
+          hsec = shdr;
+          break;
+        }
+      /* Some 64 bit targets use 8 byte `.hash' words, which are not handled. */
+      if ( ( type == SHT_HASH ) && ( hsec == NULL ) &&
+           ( LDW( shdr, Shdr, sh_entsize ) == 4 )
+         )
+        {
+          hsec = shdr;
+        }
+    }
+
+  memset( ht, 0, sizeof( *ht ) );
+  if ( ( hsec == NULL ) ||
+       ( ! ELFRAW_NAME( elfraw_section )( data, size, hsec, & hdata,
+                                          & hsize
+                                        )
+       ) ||
+       ( ( link = LD32( hsec, Shdr, sh_link ) ) == 0 ) || ( link >= shnum ) ||
+       ( ! ELFRAW_NAME( elfraw_symtab )( data, size, shdrs, shnum,
+                                         shdrs + link * sizeof( Shdr ),
+                                         & ht->syms, & ht->nsyms,
+                                         & ht->strs, & ht->nstrs
+                                       )
+       )
+     )
+    {
+      return false;
+    }
+
+  words = hsize / 4;
+  ht->gnu = ( LD32( hsec, Shdr, sh_type ) == SHT_GNU_HASH );
+  if ( ht->gnu )
+    {
+      size_t bloom_words = 0;
+      if ( words < 4 ) return false;
+      ht->nbuckets    = ELFRAW_WORD( hdata, 0 );
+      ht->symoffset   = ELFRAW_WORD( hdata, 1 );
+      ht->bloom_size  = ELFRAW_WORD( hdata, 2 );
+      ht->bloom_shift = ELFRAW_WORD( hdata, 3 );
+      bloom_words     = (size_t) ht->bloom_size * ( ELFRAW_BITS / 32 );
+      if ( ( ht->nbuckets == 0 ) || ( ht->bloom_size == 0 ) ||
+           ( ( ht->bloom_size & ( ht->bloom_size - 1 ) ) != 0 ) ||
+           ( ( words - 4 ) < bloom_words ) ||
+           ( ( words - 4 - bloom_words ) < ht->nbuckets )
+         )
+        {
+          return false;
+        }
+      ht->bloom   = hdata + 16;
+      ht->buckets = ht->bloom + 4 * bloom_words;
+      ht->chain   = ht->buckets + 4 * (size_t) ht->nbuckets;
+      ht->nchain  = words - 4 - bloom_words - ht->nbuckets;
+    }
+  else
+    {
+      if ( words < 2 ) return false;
+      ht->nbuckets = ELFRAW_WORD( hdata, 0 );
+      ht->nchain   = ELFRAW_WORD( hdata, 1 );
+      if ( ( ht->nbuckets == 0 ) || ( ( words - 2 ) < ht->nbuckets ) ||
+           ( ( words - 2 - ht->nbuckets ) < ht->nchain )
+         )
+        {
+          return false;
+        }
+      ht->buckets = hdata + 8;
+      ht->chain   = ht->buckets + 4 * (size_t) ht->nbuckets;
+    }
+
+  return true;
+}
+
+
+/**
+ * Check whether symbol `i' is named `q', filling `sym' if so.
+ * Returns true once the search may stop: a match which is an export ends the
+ * search, while other matches are kept in case an exported version follows.
+ */
+  static bool
+ELFRAW_NAME( elfraw_hash_match )( const ELFRAW_NAME( elfraw_hash_t ) * ht,
+                                  size_t                               i,
+                                  const elf_sym_query_t              * q,
+                                  elf_sym_t                          * sym
+                                )
+{
+  const unsigned char * s    = ht->syms + i * sizeof( Sym );
+  uint32_t              name = 0;
+  elf_sym_t             cand;
+
+  if ( i >= ht->nsyms ) return false;
+  name = LD32( s, Sym, st_name );
+  if ( ( name >= ht->nstrs ) || ( strcmp( ht->strs + name, q->name ) != 0 ) )
+    {
+      return false;
+    }
+
+  ELFRAW_NAME( elfraw_sym )( s, ht->strs, & cand );
+  if ( elf_sym_exportp( & cand ) || ( sym->name == NULL ) ) *sym = cand;
+  return elf_sym_exportp( & cand );
+}
+
+  static void
+ELFRAW_NAME( elfraw_hash_find )( const ELFRAW_NAME( elfraw_hash_t ) * ht,
+                                 const elf_sym_query_t              * q,
+                                 elf_sym_t                          * sym
+                               )
+{
+  uint32_t h = 0;
+  size_t   i = 0;
+
+  sym->name = NULL;
+
+  if ( ht->gnu )
+    {
+      const unsigned int C = ELFRAW_BITS;
+      uint64_t           word;
+      size_t             w = ( q->gnu_hash / C ) & ( ht->bloom_size - 1 );
+#if ELFRAW_BITS == 64
+      word = BSWAP64( elfraw_ld64( ht->bloom + 8 * w ) );
+#else
+      word = ELFRAW_WORD( ht->bloom, w );
+#endif
+      if ( ( ( word >> ( q->gnu_hash % C ) ) &
+             ( word >> ( ( q->gnu_hash >> ht->bloom_shift ) % C ) ) & 1
+           ) == 0
+         )
+        {
+          return;
+        }
+
+      i = ELFRAW_WORD( ht->buckets, q->gnu_hash % ht->nbuckets );
+      if ( i < ht->symoffset ) return;
+      /* Chains end with an entry whose low bit is set. */
+      for ( ; ( i - ht->symoffset ) < ht->nchain; i++ )
+        {
+          h = ELFRAW_WORD( ht->chain, i - ht->symoffset );
+          if ( ( ( h | 1 ) == ( q->gnu_hash | 1 ) ) &&
+               ELFRAW_NAME( elfraw_hash_match )( ht, i, q, sym )
+             )
+            {
+              return;
+            }
+          if ( ( h & 1 ) != 0 ) return;
+        }
+    }
+  else
+    {
+      i = ELFRAW_WORD( ht->buckets, q->sysv_hash % ht->nbuckets );
+      /* Bound the walk, so a cyclic chain cannot loop forever. */
+      for ( size_t n = 0; ( i != STN_UNDEF ) && ( i < ht->nchain ) &&
+                          ( n < ht->nchain );
+            i = ELFRAW_WORD( ht->chain, i ), n++
+          )
+        {
+          if ( ELFRAW_NAME( elfraw_hash_match )( ht, i, q, sym ) ) return;
+        }
+    }
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Locate the program header table, validating that it lies within the object.
+ * Handles extended numbering, where `e_phnum' is `PN_XNUM' and the count is
+ * kept in the first section header.
+ */
+  static bool
+ELFRAW_NAME( elfraw_phdrs )( const unsigned char *  data,
+                             size_t                 size,
+                             const unsigned char ** phdrs,
+                             size_t               * phnum
+                           )
+{
+  const unsigned char * shdrs = NULL;
+  uint64_t              phoff = 0;
+  size_t                n     = 0;
+  size_t                shnum = 0;
+
+  if ( size < sizeof( Ehdr ) ) return false;
+
+  phoff = LDW( data, Ehdr, e_phoff );
+  n     = LD16( data, Ehdr, e_phnum );
+
+  if ( ( phoff == 0 ) ||
+       ( LD16( data, Ehdr, e_phentsize ) != sizeof( Phdr ) ) ||
+       ( phoff > size )
+     )
+    {
+      return false;
+    }
+
+  if ( n == PN_XNUM )
+    {
+      if ( ! ELFRAW_NAME( elfraw_shdrs )( data, size, & shdrs, & shnum ) )
+        {
+          return false;
+        }
+      n = LD32( shdrs, Shdr, sh_info );
+    }
+
+  if ( n > ( ( size - phoff ) / sizeof( Phdr ) ) ) return false;
+
+  *phdrs = data + phoff;
+  *phnum = n;
+  return true;
+}
+
+/**
+ * Translate the virtual address `addr' of a `len' byte range to a file
+ * offset using the `PT_LOAD' segments, as the dynamic section refers to its
+ * string table by address.
+ */
+  static bool
+ELFRAW_NAME( elfraw_vaddr )( const unsigned char * phdrs,
+                             size_t                phnum,
+                             size_t                size,
+                             uint64_t              addr,
+                             uint64_t              len,
+                             uint64_t            * off
+                           )
+{
+  for ( size_t i = 0; i < phnum; i++ )
+    {
+      const unsigned char * ph     = phdrs + i * sizeof( Phdr );
+      uint64_t              vaddr  = LDW( ph, Phdr, p_vaddr );
+      uint64_t              filesz = LDW( ph, Phdr, p_filesz );
+      uint64_t              poff   = LDW( ph, Phdr, p_offset );
+
+      if ( ( LD32( ph, Phdr, p_type ) != PT_LOAD ) || ( addr < vaddr ) ||
+           ( ( addr - vaddr ) > filesz ) ||
+           ( len > ( filesz - ( addr - vaddr ) ) )
+         )
+        {
+          continue;
+        }
+      *off = poff + ( addr - vaddr );
+      return ( *off <= size ) && ( len <= ( size - *off ) );
+    }
+  return false;
+}
+
+  static bool
+ELFRAW_NAME( elfraw_read_dynamic )( const unsigned char * data,
+                                    size_t                size,
+                                    elf_dynamic_t       * dyn
+                                  )
+{
+  const unsigned char * phdrs   = NULL;
+  const unsigned char * dyns    = NULL;
+  const char          * strs    = NULL;
+  size_t                phnum   = 0;
+  size_t                ndyns   = 0;
+  uint64_t              strtab  = 0;
+  uint64_t              strsz   = 0;
+  uint64_t              stroff  = 0;
+  uint64_t              soname  = UINT64_MAX;
+  uint64_t              rpath   = UINT64_MAX;
+  uint64_t              runpath = UINT64_MAX;
+  size_t                nneeded = 0;
+
+  memset( dyn, 0, sizeof( elf_dynamic_t ) );
+  if ( ! ELFRAW_NAME( elfraw_phdrs )( data, size, & phdrs, & phnum ) )
+    {
+      return false;
+    }
+
+  for ( size_t i = 0; i < phnum; i++ )
+    {
+      const unsigned char * ph   = phdrs + i * sizeof( Phdr );
+      uint64_t              off  = LDW( ph, Phdr, p_offset );
+      uint64_t              len  = LDW( ph, Phdr, p_filesz );
+      uint32_t              type = LD32( ph, Phdr, p_type );
+
+      if ( ( ( type != PT_DYNAMIC ) && ( type != PT_INTERP ) ) ||
+           ( off > size ) || ( len > ( size - off ) )
+         )
+        {
+          continue;
+        }
+      if ( type == PT_DYNAMIC )
+        {
+          dyns  = data + off;
+          ndyns = len / sizeof( Dyn );
+        }
+      else if ( ( len > 0 ) && ( data[off + len - 1] == '\0' ) )
+        {
+          dyn->interp = (const char *) data + off;
+        }
+    }
+
+  /* Statically linked. */
+  if ( dyns == NULL ) return true;
+
+  for ( size_t i = 0; i < ndyns; i++ )
+    {
+      const unsigned char * d   = dyns + i * sizeof( Dyn );
+      uint64_t              tag = LDW( d, Dyn, d_tag );
+      uint64_t              val = LDW( d, Dyn, d_un );
+
+      if ( tag == DT_NULL ) break;
+      switch ( tag )
+        {
+          case DT_STRTAB:  strtab  = val; break;
+          case DT_STRSZ:   strsz   = val; break;
+          case DT_SONAME:  soname  = val; break;
+          case DT_RPATH:   rpath   = val; break;
+          case DT_RUNPATH: runpath = val; break;
+          case DT_NEEDED:  nneeded++;     break;
+          default:                        break;
+        }
+    }
+
+  /* Every name must be NUL terminated within the table. */
+  if ( ( strsz == 0 ) ||
+       ( ! ELFRAW_NAME( elfraw_vaddr )( phdrs, phnum, size, strtab, strsz,
+                                        & stroff
+                                      )
+       ) ||
+       ( data[stroff + strsz - 1] != '\0' )
+     )
+    {
+      if ( ( nneeded == 0 ) && ( soname == UINT64_MAX ) ) return true;
+      memset( dyn, 0, sizeof( elf_dynamic_t ) );
+      return false;
+    }
+  strs = (const char *) data + stroff;
+
+  if ( soname < strsz )  dyn->soname  = strs + soname;
+  if ( rpath < strsz )   dyn->rpath   = strs + rpath;
+  if ( runpath < strsz ) dyn->runpath = strs + runpath;
+
+  if ( nneeded == 0 ) return true;
+  dyn->needed = malloc( nneeded * sizeof( char * ) );
+  assert( dyn->needed != NULL );
+  for ( size_t i = 0; i < ndyns; i++ )
+    {
+      const unsigned char * d   = dyns + i * sizeof( Dyn );
+      uint64_t              tag = LDW( d, Dyn, d_tag );
+      uint64_t              val = LDW( d, Dyn, d_un );
+
+      if ( tag == DT_NULL ) break;
+      if ( ( tag == DT_NEEDED ) && ( val < strsz ) )
+        {
+          dyn->needed[dyn->nneeded++] = strs + val;
+        }
+    }
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * The dynamic symbol table and its companions, found through `PT_DYNAMIC'
+ * alone, as the dynamic linker finds them.
+ * The table's size is only recorded by the hash sections: `.hash' holds it,
+ * and `.gnu.hash' chains end at the last symbol.
+ * `syms', `strs', `versym' and the hash sections' headers, blooms and
+ * buckets are bounds checked; version definitions are checked as they are
+ * walked.
+ */
+typedef struct {
+  const unsigned char * syms;
+  size_t                nsyms;
+  const char          * strs;
+  size_t                nstrs;
+  const unsigned char * gnu_hash;   /* NULL if none */
+  const unsigned char * sysv_hash;  /* NULL if none */
+  const unsigned char * versym;     /* `nsyms' entries, or NULL */
+  const unsigned char * verdef;     /* NULL if none */
+  size_t                verdefnum;
+  const unsigned char * verneed;    /* NULL if none */
+  size_t                verneednum;
+} ELFRAW_NAME( elfraw_dyntab_t );
+
+  static bool
+ELFRAW_NAME( elfraw_dyntab )( const unsigned char            * data,
+                              size_t                           size,
+                              ELFRAW_NAME( elfraw_dyntab_t ) * dt
+                            )
+{
+  const unsigned char * phdrs   = NULL;
+  const unsigned char * dyns    = NULL;
+  size_t                phnum   = 0;
+  size_t                ndyns   = 0;
+  uint64_t              symtab  = 0;
+  uint64_t              strtab  = 0;
+  uint64_t              strsz   = 0;
+  uint64_t              syment  = sizeof( Sym );
+  uint64_t              gnuhash = 0;
+  uint64_t              hash    = 0;
+  uint64_t              versym  = 0;
+  uint64_t              verdef  = 0;
+  uint64_t              verneed = 0;
+  uint64_t              off     = 0;
+
+  memset( dt, 0, sizeof( *dt ) );
+  if ( ! ELFRAW_NAME( elfraw_phdrs )( data, size, & phdrs, & phnum ) )
+    {
+      return false;
+    }
+  for ( size_t i = 0; i < phnum; i++ )
+    {
+      const unsigned char * ph  = phdrs + i * sizeof( Phdr );
+      uint64_t              len = LDW( ph, Phdr, p_filesz );
+
+      off = LDW( ph, Phdr, p_offset );
+      if ( ( LD32( ph, Phdr, p_type ) == PT_DYNAMIC ) && ( off <= size ) &&
+           ( len <= ( size - off ) )
+         )
+        {
+          dyns  = data + off;
+          ndyns = len / sizeof( Dyn );
+          break;
+        }
+    }
+
+  for ( size_t i = 0; i < ndyns; i++ )
+    {
+      const unsigned char * d   = dyns + i * sizeof( Dyn );
+      uint64_t              tag = LDW( d, Dyn, d_tag );
+      uint64_t              val = LDW( d, Dyn, d_un );
+
+      if ( tag == DT_NULL ) break;
+      switch ( tag )
+        {
+          case DT_SYMTAB:     symtab         = val; break;
+          case DT_STRTAB:     strtab         = val; break;
+          case DT_STRSZ:      strsz          = val; break;
+          case DT_SYMENT:     syment         = val; break;
+          case DT_GNU_HASH:   gnuhash        = val; break;
+          case DT_HASH:       hash           = val; break;
+          case DT_VERSYM:     versym         = val; break;
+          case DT_VERDEF:     verdef         = val; break;
+          case DT_VERDEFNUM:  dt->verdefnum  = val; break;
+          case DT_VERNEED:    verneed        = val; break;
+          case DT_VERNEEDNUM: dt->verneednum = val; break;
+          default:                                  break;
+        }
+    }
+
+  if ( ( symtab == 0 ) || ( syment != sizeof( Sym ) ) || ( strsz == 0 ) ||
+       ( ! ELFRAW_NAME( elfraw_vaddr )( phdrs, phnum, size, strtab, strsz,
+                                        & off
+                                      )
+       ) ||
+       ( data[off + strsz - 1] != '\0' )
+     )
+    {
+      return false;
+    }
+  dt->strs  = (const char *) data + off;
+  dt->nstrs = strsz;
+
+  if ( ( hash != 0 ) &&
+       ELFRAW_NAME( elfraw_vaddr )( phdrs, phnum, size, hash, 8, & off )
+     )
+    {
+      uint64_t nbuckets = ELFRAW_WORD( data + off, 0 );
+      uint64_t nchain   = ELFRAW_WORD( data + off, 1 );
+      if ( ELFRAW_NAME( elfraw_vaddr )( phdrs, phnum, size, hash,
+                                        8 + 4 * ( nbuckets + nchain ), & off
+                                      )
+         )
+        {
+          dt->sysv_hash = data + off;
+          dt->nsyms     = nchain;
+        }
+    }
+
+  if ( ( gnuhash != 0 ) &&
+       ELFRAW_NAME( elfraw_vaddr )( phdrs, phnum, size, gnuhash, 16, & off )
+     )
+    {
+      uint64_t nbuckets  = ELFRAW_WORD( data + off, 0 );
+      uint64_t symoffset = ELFRAW_WORD( data + off, 1 );
+      uint64_t bloom     = ELFRAW_WORD( data + off, 2 ) *
+                           (uint64_t) ( ELFRAW_BITS / 32 );
+      uint64_t len       = 16 + 4 * ( bloom + nbuckets );
+      uint64_t last      = 0;
+
+      if ( ELFRAW_NAME( elfraw_vaddr )( phdrs, phnum, size, gnuhash, len,
+                                        & off
+                                      )
+         )
+        {
+          dt->gnu_hash = data + off;
+        }
+
+      /* Without `.hash' the highest bucket's chain leads to the last symbol. */
+      for ( size_t b = 0; ( dt->gnu_hash != NULL ) && ( dt->sysv_hash == NULL )
+                          && ( b < nbuckets );
+            b++
+          )
+        {
+          uint32_t i = ELFRAW_WORD( dt->gnu_hash + 16 + 4 * bloom, b );
+          if ( i > last ) last = i;
+        }
+      if ( ( dt->gnu_hash != NULL ) && ( dt->sysv_hash == NULL ) )
+        {
+          if ( last == 0 )
+            {
+              dt->nsyms = symoffset;
+            }
+          else if ( last < symoffset )
+            {
+              return false;
+            }
+          else
+            {
+              for ( off += len + 4 * ( last - symoffset ); ; off += 4, last++ )
+                {
+                  if ( ( off > size ) || ( ( size - off ) < 4 ) ) return false;
+                  if ( ( ELFRAW_WORD( data + off, 0 ) & 1 ) != 0 ) break;
+                }
+              dt->nsyms = last + 1;
+            }
+        }
+    }
+
+  if ( ( ( dt->gnu_hash == NULL ) && ( dt->sysv_hash == NULL ) ) ||
+       ( ! ELFRAW_NAME( elfraw_vaddr )( phdrs, phnum, size, symtab,
+                                        dt->nsyms * sizeof( Sym ), & off
+                                      )
+       )
+     )
+    {
+      return false;
+    }
+  dt->syms = data + off;
+
+  /* Versions are optional, and dropped when malformed. */
+  if ( ( versym != 0 ) &&
+       ELFRAW_NAME( elfraw_vaddr )( phdrs, phnum, size, versym,
+                                    2 * dt->nsyms, & off
+                                  )
+     )
+    {
+      dt->versym = data + off;
+    }
+  if ( ( verdef != 0 ) &&
+       ELFRAW_NAME( elfraw_vaddr )( phdrs, phnum, size, verdef,
+                                    sizeof( Verdef ), & off
+                                  )
+     )
+    {
+      dt->verdef = data + off;
+    }
+  if ( ( verneed != 0 ) &&
+       ELFRAW_NAME( elfraw_vaddr )( phdrs, phnum, size, verneed,
+                                    sizeof( Verneed ), & off
+                                  )
+     )
+    {
+      dt->verneed = data + off;
+    }
+
+  return true;
+}
+
+/** Name of the version defined with index `ndx', or NULL. */
+  static const char *
+ELFRAW_NAME( elfraw_verdef_name )( const unsigned char                  * data,
+                                   size_t                                 size,
+                                   const ELFRAW_NAME( elfraw_dyntab_t ) * dt,
+                                   uint16_t                               ndx
+                                 )
+{
+  size_t off = 0;
+
+  if ( dt->verdef == NULL ) return NULL;
+  off = dt->verdef - data;
+  for ( size_t n = 0; n < dt->verdefnum; n++ )
+    {
+      const unsigned char * vd   = data + off;
+      uint64_t              aux  = 0;
+      uint32_t              name = 0;
+
+      if ( ( off > size ) || ( ( size - off ) < sizeof( Verdef ) ) ) break;
+      if ( ( LD16( vd, Verdef, vd_ndx ) == ndx ) &&
+           ( ( LD16( vd, Verdef, vd_flags ) & VER_FLG_BASE ) == 0 )
+         )
+        {
+          aux = off + (uint64_t) LD32( vd, Verdef, vd_aux );
+          if ( ( aux > size ) || ( ( size - aux ) < sizeof( Verdaux ) ) ||
+               ( ( name = LD32( data + aux, Verdaux, vda_name ) ) >= dt->nstrs )
+             )
+            {
+              return NULL;
+            }
+          return dt->strs + name;
+        }
+      if ( LD32( vd, Verdef, vd_next ) == 0 ) break;
+      off += LD32( vd, Verdef, vd_next );
+    }
+  return NULL;
+}
+
+/**
+ * Name of the version with index `ndx' required from another object, or
+ * NULL; executables refer to those for the data they copy in.
+ */
+  static const char *
+ELFRAW_NAME( elfraw_verneed_name )( const unsigned char                  * data,
+                                    size_t                                 size,
+                                    const ELFRAW_NAME( elfraw_dyntab_t ) * dt,
+                                    uint16_t                               ndx
+                                  )
+{
+  size_t off = 0;
+
+  if ( dt->verneed == NULL ) return NULL;
+  off = dt->verneed - data;
+  for ( size_t n = 0; n < dt->verneednum; n++ )
+    {
+      const unsigned char * vn  = data + off;
+      uint64_t              aux = 0;
+
+      if ( ( off > size ) || ( ( size - off ) < sizeof( Verneed ) ) ) break;
+      aux = off + (uint64_t) LD32( vn, Verneed, vn_aux );
+      for ( size_t a = 0; a < LD16( vn, Verneed, vn_cnt ); a++ )
+        {
+          const unsigned char * va   = data + aux;
+          uint32_t              name = 0;
+
+          if ( ( aux > size ) || ( ( size - aux ) < sizeof( Vernaux ) ) ) break;
+          if ( LD16( va, Vernaux, vna_other ) == ndx )
+            {
+              name = LD32( va, Vernaux, vna_name );
+              return ( name < dt->nstrs ) ? ( dt->strs + name ) : NULL;
+            }
+          if ( LD32( va, Vernaux, vna_next ) == 0 ) break;
+          aux += LD32( va, Vernaux, vna_next );
+        }
+      if ( LD32( vn, Verneed, vn_next ) == 0 ) break;
+      off += LD32( vn, Verneed, vn_next );
+    }
+  return NULL;
+}
+
+  static bool
+ELFRAW_NAME( elfraw_map_dynsyms )( const unsigned char * data,
+                                   size_t                size,
+                                   do_sym_fn             fn,
+                                   void                * aux
+                                 )
+{
+  ELFRAW_NAME( elfraw_dyntab_t ) dt;
+  elf_sym_t                      sym;
+
+  if ( ! ELFRAW_NAME( elfraw_dyntab )( data, size, & dt ) ) return false;
+
+  for ( size_t i = 0; i < dt.nsyms; i++ )
+    {
+      const unsigned char * s = dt.syms + i * sizeof( Sym );
+      uint16_t              v = 0;
+
+      if ( LD32( s, Sym, st_name ) >= dt.nstrs ) continue;
+      ELFRAW_NAME( elfraw_sym )( s, dt.strs, & sym );
+      if ( dt.versym != NULL )
+        {
+          v = BSWAP16( elfraw_ld16( dt.versym + 2 * i ) );
+          /* Indices 0 and 1 are local and global, without a name. */
+          if ( ( v & 0x7fff ) > VER_NDX_GLOBAL )
+            {
+              sym.version = ELFRAW_NAME( elfraw_verdef_name )( data, size, & dt,
+                                                               v & 0x7fff
+                                                             );
+              sym.hidden  = ( v & 0x8000 ) != 0;
+            }
+          /* Required versions are never the object's own default. */
+          if ( ( ( v & 0x7fff ) > VER_NDX_GLOBAL ) && ( sym.version == NULL ) )
+            {
+              sym.version = ELFRAW_NAME( elfraw_verneed_name )( data, size,
+                                                                & dt,
+                                                                v & 0x7fff
+                                                              );
+              sym.hidden  = true;
+            }
+        }
+      fn( & sym, aux );
+    }
+
+  return true;
+}
+
+/** As `elfraw_hash_init', finding the hash section through `PT_DYNAMIC'. */
+  static bool
+ELFRAW_NAME( elfraw_hash_init_dynamic )( const unsigned char          * data,
+                                         size_t                         size,
+                                         ELFRAW_NAME( elfraw_hash_t ) * ht
+                                       )
+{
+  ELFRAW_NAME( elfraw_dyntab_t ) dt;
+  const unsigned char          * h = NULL;
+
+  memset( ht, 0, sizeof( *ht ) );
+  if ( ! ELFRAW_NAME( elfraw_dyntab )( data, size, & dt ) ) return false;
+  ht->syms  = dt.syms;
+  ht->nsyms = dt.nsyms;
+  ht->strs  = dt.strs;
+  ht->nstrs = dt.nstrs;
+
+  if ( ( h = dt.gnu_hash ) != NULL )
+    {
+      ht->gnu         = true;
+      ht->nbuckets    = ELFRAW_WORD( h, 0 );
+      ht->symoffset   = ELFRAW_WORD( h, 1 );
+      ht->bloom_size  = ELFRAW_WORD( h, 2 );
+      ht->bloom_shift = ELFRAW_WORD( h, 3 );
+      ht->bloom       = h + 16;
+      ht->buckets     = ht->bloom + 4 * (size_t) ht->bloom_size *
+                                    ( ELFRAW_BITS / 32 );
+      ht->chain       = ht->buckets + 4 * (size_t) ht->nbuckets;
+      if ( ( ht->nbuckets == 0 ) || ( ht->bloom_size == 0 ) ||
+           ( ( ht->bloom_size & ( ht->bloom_size - 1 ) ) != 0 ) ||
+           ( dt.nsyms < ht->symoffset )
+         )
+        {
+          return false;
+        }
+      /* The chain was not bounded when `.hash' gave the symbol count. */
+      ht->nchain = dt.nsyms - ht->symoffset;
+      return ( (size_t) ( ht->chain - data ) <= size ) &&
+             ( ht->nchain <= ( ( size - ( ht->chain - data ) ) / 4 ) );
+    }
+
+  h = dt.sysv_hash;
+  ht->nbuckets = ELFRAW_WORD( h, 0 );
+  ht->nchain   = ELFRAW_WORD( h, 1 );
+  ht->buckets  = h + 8;
+  ht->chain    = ht->buckets + 4 * (size_t) ht->nbuckets;
+  return ht->nbuckets != 0;
+}
+
+
+  static ssize_t
+ELFRAW_NAME( elfraw_lookup_syms )( const unsigned char   * data,
+                                   size_t                  size,
+                                   const elf_sym_query_t * queries,
+                                   size_t                  count,
+                                   elf_sym_t             * found
+                                 )
+{
+  ELFRAW_NAME( elfraw_hash_t ) ht;
+  ssize_t                      n = 0;
+
+  /* Objects stripped of their section headers still have `PT_DYNAMIC'. */
+  if ( ( ! ELFRAW_NAME( elfraw_hash_init )( data, size, & ht ) ) &&
+       ( ! ELFRAW_NAME( elfraw_hash_init_dynamic )( data, size, & ht ) )
+     )
+    {
+      return -1;
+    }
+
+  for ( size_t i = 0; i < count; i++ )
+    {
+      ELFRAW_NAME( elfraw_hash_find )( & ht, & queries[i], & found[i] );
+      if ( found[i].name != NULL ) n++;
+    }
+
+  return n;
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Search the notes held in the `len' bytes at `notes' for the GNU build-id,
+ * names and descriptors being padded to `align' bytes.
+ * Notes run to the end of the range, so a malformed one ends the search.
+ */
+  static bool
+ELFRAW_NAME( elfraw_note_build_id )( const unsigned char * notes,
+                                     size_t                len,
+                                     size_t                align,
+                                     elf_id_t            * id
+                                   )
+{
+  size_t pos = 0;
+
+  while ( ( len - pos ) >= sizeof( Nhdr ) )
+    {
+      const unsigned char * nh     = notes + pos;
+      uint64_t              namesz = LD32( nh, Nhdr, n_namesz );
+      uint64_t              descsz = LD32( nh, Nhdr, n_descsz );
+      uint64_t              name   = pos + sizeof( Nhdr );
+      uint64_t              desc   = name +
+                                     ( ( namesz + align - 1 ) & ~( align - 1 ) );
+
+      if ( ( desc > len ) || ( descsz > ( len - desc ) ) ) return false;
+
+      if ( ( LD32( nh, Nhdr, n_type ) == NT_GNU_BUILD_ID ) &&
+           ( namesz == sizeof( ELF_NOTE_GNU ) ) &&
+           ( memcmp( notes + name, ELF_NOTE_GNU, namesz ) == 0 ) &&
+           ( descsz > 0 ) && ( descsz <= ELF_ID_MAX )
+         )
+        {
+          id->kind = ELF_ID_BUILD_ID;
+          id->len  = descsz;
+          memcpy( id->bytes, notes + desc, descsz );
+          return true;
+        }
+
+      pos = desc + ( ( descsz + align - 1 ) & ~( align - 1 ) );
+      if ( pos > len ) return false;
+    }
+  return false;
+}
+
+/**
+ * `PT_NOTE' segments are searched first, as they sit right after the program
+ * headers in linked objects; relocatable objects have none, so `SHT_NOTE'
+ * sections are searched next.
+ * Only 8 byte aligned notes use 8 byte padding, everything else uses 4.
+ */
+  static bool
+ELFRAW_NAME( elfraw_build_id )( const unsigned char * data,
+                                size_t                size,
+                                elf_id_t            * id
+                              )
+{
+  const unsigned char * hdrs = NULL;
+  size_t                n    = 0;
+
+  if ( ELFRAW_NAME( elfraw_phdrs )( data, size, & hdrs, & n ) )
+    {
+      for ( size_t i = 0; i < n; i++ )
+        {
+          const unsigned char * ph  = hdrs + i * sizeof( Phdr );
+          uint64_t              off = LDW( ph, Phdr, p_offset );
+          uint64_t              len = LDW( ph, Phdr, p_filesz );
+
+          if ( ( LD32( ph, Phdr, p_type ) != PT_NOTE ) ||
+               ( off > size ) || ( len > ( size - off ) )
+             )
+            {
+              continue;
+            }
+          if ( ELFRAW_NAME( elfraw_note_build_id )(
+                 data + off, len, ( LDW( ph, Phdr, p_align ) == 8 ) ? 8 : 4, id
+               )
+             )
+            {
+              return true;
+            }
+        }
+    }
+
+  if ( ELFRAW_NAME( elfraw_shdrs )( data, size, & hdrs, & n ) )
+    {
+      for ( size_t i = 0; i < n; i++ )
+        {
+          const unsigned char * sh    = hdrs + i * sizeof( Shdr );
+          const unsigned char * notes = NULL;
+          size_t                len   = 0;
+
+          if ( ( LD32( sh, Shdr, sh_type ) != SHT_NOTE ) ||
+               ( ! ELFRAW_NAME( elfraw_section )( data, size, sh, & notes,
+                                                  & len
+                                                ) )
+             )
+            {
+              continue;
+            }
+          if ( ELFRAW_NAME( elfraw_note_build_id )(
+                 notes, len, ( LDW( sh, Shdr, sh_addralign ) == 8 ) ? 8 : 4, id
+               )
+             )
+            {
+              return true;
+            }
+        }
+    }
+
+  return false;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static bool
+ELFRAW_NAME( elfraw_map_sections )( const unsigned char * data,
+                                    size_t                size,
+                                    do_scn_fn             fn,
+                                    void                * aux
+                                  )
+{
+  const unsigned char * shdrs = NULL;
+  const unsigned char * str   = NULL;
+  size_t                shnum = 0;
+  size_t                nstrs = 0;
+  size_t                ndx   = 0;
+  elf_scn_t             scn;
+
+  if ( ! ELFRAW_NAME( elfraw_shdrs )( data, size, & shdrs, & shnum ) )
+    {
+      return false;
+    }
+
+  /* With extended numbering the index is kept in the first header. */
+  ndx = LD16( data, Ehdr, e_shstrndx );
+  if ( ndx == SHN_XINDEX ) ndx = LD32( shdrs, Shdr, sh_link );
+  if ( ( ndx == SHN_UNDEF ) || ( ndx >= shnum ) ||
+       ( ! ELFRAW_NAME( elfraw_section )( data, size,
+                                          shdrs + ndx * sizeof( Shdr ),
+                                          & str, & nstrs
+                                        )
+       ) ||
+       ( nstrs == 0 ) || ( str[nstrs - 1] != '\0' )
+     )
+    {
+      return false;
+    }
+
+  for ( size_t i = 1; i < shnum; i++ )
+    {
+      const unsigned char * shdr = shdrs + i * sizeof( Shdr );
+      uint32_t              name = LD32( shdr, Shdr, sh_name );
+      if ( name >= nstrs ) continue;
+      scn.name  = (const char *) str + name;
+      scn.type  = LD32( shdr, Shdr, sh_type );
+      scn.flags = LDW( shdr, Shdr, sh_flags );
+      scn.size  = LDW( shdr, Shdr, sh_size );
+      fn( & scn, aux );
+    }
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+#undef Ehdr
+#undef Shdr
+#undef Sym
+#undef Phdr
+#undef Dyn
+#undef Nhdr
+#undef Verdef
+#undef Verdaux
+#undef Verneed
+#undef Vernaux
+#undef ELFRAW_WORD
+#undef LDW
+#undef LD8
+#undef LD16
+#undef LD32
+#undef LD64
+#undef BSWAP16
+#undef BSWAP32
+#undef BSWAP64
+#undef ELFRAW_T
+#undef ELFRAW_CAT
+#undef ELFRAW_CAT_
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
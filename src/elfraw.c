@@ -0,0 +1,280 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <elf.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+  static inline uint16_t
+elfraw_ld16( const void * p )
+{
+  uint16_t v;
+  memcpy( & v, p, sizeof( v ) );
+  return v;
+}
+
+  static inline uint32_t
+elfraw_ld32( const void * p )
+{
+  uint32_t v;
+  memcpy( & v, p, sizeof( v ) );
+  return v;
+}
+
+  static inline uint64_t
+elfraw_ld64( const void * p )
+{
+  uint64_t v;
+  memcpy( & v, p, sizeof( v ) );
+  return v;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Instantiate readers for each class and data encoding. */
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#  define ELFRAW_SWAP_LSB 0
+#  define ELFRAW_SWAP_MSB 1
+#else
+#  define ELFRAW_SWAP_LSB 1
+#  define ELFRAW_SWAP_MSB 0
+#endif
+
+#define ELFRAW_BITS       32
+#define ELFRAW_SWAP       ELFRAW_SWAP_LSB
+#define ELFRAW_NAME( x )  x ## _32lsb
+#include "elfraw-impl.h"
+#undef ELFRAW_BITS
+#undef ELFRAW_SWAP
+#undef ELFRAW_NAME
+
+#define ELFRAW_BITS       32
+#define ELFRAW_SWAP       ELFRAW_SWAP_MSB
+#define ELFRAW_NAME( x )  x ## _32msb
+#include "elfraw-impl.h"
+#undef ELFRAW_BITS
+#undef ELFRAW_SWAP
+#undef ELFRAW_NAME
+
+#define ELFRAW_BITS       64
+#define ELFRAW_SWAP       ELFRAW_SWAP_LSB
+#define ELFRAW_NAME( x )  x ## _64lsb
+#include "elfraw-impl.h"
+#undef ELFRAW_BITS
+#undef ELFRAW_SWAP
+#undef ELFRAW_NAME
+
+#define ELFRAW_BITS       64
+#define ELFRAW_SWAP       ELFRAW_SWAP_MSB
+#define ELFRAW_NAME( x )  x ## _64msb
+#include "elfraw-impl.h"
+#undef ELFRAW_BITS
+#undef ELFRAW_SWAP
+#undef ELFRAW_NAME
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Index of the instance handling `data', or -1 if it isn't an ELF object. */
+  static int
+elfraw_instance( const unsigned char * data, size_t size )
+{
+  if ( ( size < EI_NIDENT ) || ( memcmp( data, ELFMAG, SELFMAG ) != 0 ) )
+    {
+      return -1;
+    }
+  switch ( ( data[EI_CLASS] << 8 ) | data[EI_DATA] )
+    {
+      case ( ELFCLASS32 << 8 ) | ELFDATA2LSB: return 0;
+      case ( ELFCLASS32 << 8 ) | ELFDATA2MSB: return 1;
+      case ( ELFCLASS64 << 8 ) | ELFDATA2LSB: return 2;
+      case ( ELFCLASS64 << 8 ) | ELFDATA2MSB: return 3;
+      default:                                return -1;
+    }
+}
+
+
+  bool
+elf_map_syms( const void * data,
+              size_t       size,
+              unsigned     sh_type,
+              do_sym_fn    fn,
+              void       * aux
+            )
+{
+  switch ( elfraw_instance( data, size ) )
+    {
+      case 0:  return elfraw_map_syms_32lsb( data, size, sh_type, fn, aux );
+      case 1:  return elfraw_map_syms_32msb( data, size, sh_type, fn, aux );
+      case 2:  return elfraw_map_syms_64lsb( data, size, sh_type, fn, aux );
+      case 3:  return elfraw_map_syms_64msb( data, size, sh_type, fn, aux );
+      default: return false;
+    }
+}
+
+
+  bool
+elf_map_dynsyms( const void * data, size_t size, do_sym_fn fn, void * aux )
+{
+  switch ( elfraw_instance( data, size ) )
+    {
+      case 0:  return elfraw_map_dynsyms_32lsb( data, size, fn, aux );
+      case 1:  return elfraw_map_dynsyms_32msb( data, size, fn, aux );
+      case 2:  return elfraw_map_dynsyms_64lsb( data, size, fn, aux );
+      case 3:  return elfraw_map_dynsyms_64msb( data, size, fn, aux );
+      default: return false;
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+elf_sym_query_init( elf_sym_query_t * q, const char * name )
+{
+  uint32_t gnu  = 5381;
+  uint32_t sysv = 0;
+
+  for ( const unsigned char * c = (const unsigned char *) name; *c != '\0';
+        c++
+      )
+    {
+      uint32_t g = 0;
+      gnu  = gnu * 33 + *c;
+      sysv = ( sysv << 4 ) + *c;
+      g    = sysv & 0xf0000000;
+      if ( g != 0 ) sysv ^= g >> 24;
+      sysv &= ~g;
+    }
+
+  q->name      = name;
+  q->gnu_hash  = gnu;
+  q->sysv_hash = sysv;
+}
+
+
+  ssize_t
+elf_lookup_syms( const void            * data,
+                 size_t                  size,
+                 const elf_sym_query_t * queries,
+                 size_t                  count,
+                 elf_sym_t             * found
+               )
+{
+  switch ( elfraw_instance( data, size ) )
+    {
+      case 0:
+        return elfraw_lookup_syms_32lsb( data, size, queries, count, found );
+      case 1:
+        return elfraw_lookup_syms_32msb( data, size, queries, count, found );
+      case 2:
+        return elfraw_lookup_syms_64lsb( data, size, queries, count, found );
+      case 3:
+        return elfraw_lookup_syms_64msb( data, size, queries, count, found );
+      default:
+        return -1;
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+elf_read_dynamic( const void * data, size_t size, elf_dynamic_t * dyn )
+{
+  switch ( elfraw_instance( data, size ) )
+    {
+      case 0:  return elfraw_read_dynamic_32lsb( data, size, dyn );
+      case 1:  return elfraw_read_dynamic_32msb( data, size, dyn );
+      case 2:  return elfraw_read_dynamic_64lsb( data, size, dyn );
+      case 3:  return elfraw_read_dynamic_64msb( data, size, dyn );
+      default:
+        memset( dyn, 0, sizeof( elf_dynamic_t ) );
+        return false;
+    }
+}
+
+
+  void
+elf_dynamic_free( elf_dynamic_t * dyn )
+{
+  free( dyn->needed );
+  dyn->needed  = NULL;
+  dyn->nneeded = 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+elf_build_id( const void * data, size_t size, elf_id_t * id )
+{
+  bool found = false;
+
+  switch ( elfraw_instance( data, size ) )
+    {
+      case 0:  found = elfraw_build_id_32lsb( data, size, id ); break;
+      case 1:  found = elfraw_build_id_32msb( data, size, id ); break;
+      case 2:  found = elfraw_build_id_64lsb( data, size, id ); break;
+      case 3:  found = elfraw_build_id_64msb( data, size, id ); break;
+      default:                                                  break;
+    }
+  if ( ! found )
+    {
+      id->kind = ELF_ID_NONE;
+      id->len  = 0;
+    }
+  return found;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+elf_map_sections( const void * data, size_t size, do_scn_fn fn, void * aux )
+{
+  switch ( elfraw_instance( data, size ) )
+    {
+      case 0:  return elfraw_map_sections_32lsb( data, size, fn, aux );
+      case 1:  return elfraw_map_sections_32msb( data, size, fn, aux );
+      case 2:  return elfraw_map_sections_64lsb( data, size, fn, aux );
+      case 3:  return elfraw_map_sections_64msb( data, size, fn, aux );
+      default: return false;
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Skip undefined symbols, locals, and the fake `STB_NUM' value.
+ * `STB_NUM' represents the number of valid Symbol Binding types according to
+ * the ELF Spec; the remaining types are extensions.
+ */
+  bool
+elf_sym_exportp( const elf_sym_t * sym )
+{
+  unsigned char bind = ELF64_ST_BIND( sym->info );
+  return ( sym->name[0] != '\0' ) &&
+         ( sym->shndx != SHN_UNDEF ) &&
+         ( bind != STB_LOCAL ) &&
+         ( bind != STB_NUM );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
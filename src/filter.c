@@ -0,0 +1,199 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <elf.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+  const char * name;
+  unsigned     value;
+} elf_name_t;
+
+static const elf_name_t class_names[] = {
+  { "32", ELFCLASS32 },
+  { "64", ELFCLASS64 },
+  { NULL, 0 }
+};
+
+static const elf_name_t type_names[] = {
+  { "rel",  ET_REL  },
+  { "exec", ET_EXEC },
+  { "dyn",  ET_DYN  },
+  { "core", ET_CORE },
+  { NULL, 0 }
+};
+
+/* Names as used by `uname -m' and common aliases. */
+static const elf_name_t machine_names[] = {
+  { "x86_64",      EM_X86_64      },
+  { "amd64",       EM_X86_64      },
+  { "i386",        EM_386         },
+  { "x86",         EM_386         },
+  { "aarch64",     EM_AARCH64     },
+  { "arm64",       EM_AARCH64     },
+  { "arm",         EM_ARM         },
+  { "riscv",       EM_RISCV       },
+  { "ppc",         EM_PPC         },
+  { "ppc64",       EM_PPC64       },
+  { "s390",        EM_S390        },
+  { "mips",        EM_MIPS        },
+  { "sparc",       EM_SPARC       },
+  { "sparcv9",     EM_SPARCV9     },
+  { "ia64",        EM_IA_64       },
+  { "loongarch",   258            },  /* EM_LOONGARCH, absent in old headers */
+  { "m68k",        EM_68K         },
+  { "sh",          EM_SH          },
+  { "alpha",       EM_ALPHA       },
+  { "bpf",         EM_BPF         },
+  { NULL, 0 }
+};
+
+
+  static bool
+elf_name_lookup( const elf_name_t * names, const char * name, size_t len,
+                 unsigned * value
+               )
+{
+  for ( ; names->name != NULL; names++ )
+    {
+      if ( ( strlen( names->name ) == len ) &&
+           ( strncasecmp( names->name, name, len ) == 0 )
+         )
+        {
+          *value = names->value;
+          return true;
+        }
+    }
+  return false;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+elf_filter_add( elf_filter_t * filter, const char * what, const char * list )
+{
+  const elf_name_t * names = NULL;
+
+  if ( strcmp( what, "class" ) == 0 )        names = class_names;
+  else if ( strcmp( what, "type" ) == 0 )    names = type_names;
+  else if ( strcmp( what, "machine" ) == 0 ) names = machine_names;
+  else
+    {
+      fprintf( stderr, "Unknown ELF filter `%s'\n", what );
+      return false;
+    }
+
+  for ( const char * p = list; *p != '\0'; )
+    {
+      size_t   len   = strcspn( p, "," );
+      unsigned value = 0;
+      char   * end   = NULL;
+
+      if ( ! elf_name_lookup( names, p, len, & value ) )
+        {
+          /* Machines may also be given by number. */
+          value = strtoul( p, & end, 0 );
+          if ( ( names != machine_names ) || ( len == 0 ) ||
+               ( end != ( p + len ) ) || ( value > UINT16_MAX )
+             )
+            {
+              fprintf( stderr, "Unknown ELF %s `%.*s'\n", what, (int) len, p );
+              return false;
+            }
+        }
+
+      if ( names == class_names )
+        {
+          filter->classes |= 1u << value;
+        }
+      else if ( names == type_names )
+        {
+          filter->types |= 1u << value;
+        }
+      else if ( filter->nmachines < ELF_FILTER_MAX_MACHINES )
+        {
+          filter->machines[filter->nmachines++] = value;
+        }
+      else
+        {
+          fprintf( stderr, "Too many ELF machines, at most %d may be given\n",
+                   ELF_FILTER_MAX_MACHINES
+                 );
+          return false;
+        }
+
+      p += len;
+      if ( *p == ',' ) p++;
+    }
+
+  return true;
+}
+
+
+  const char *
+elf_filter_name( const char * what, unsigned value )
+{
+  const elf_name_t * names = ( strcmp( what, "class" ) == 0 ) ? class_names :
+                             ( strcmp( what, "type" ) == 0 )  ? type_names  :
+                                                                machine_names;
+  /* The first name given for a value is its canonical one. */
+  for ( ; names->name != NULL; names++ )
+    {
+      if ( names->value == value ) return names->name;
+    }
+  return NULL;
+}
+
+
+  bool
+elf_filter_match( const elf_filter_t * filter, const file_class_t * fc )
+{
+  bool machine = ( filter->nmachines == 0 );
+
+  if ( ( fc->kind != FILE_KIND_ELF ) && ( fc->kind != FILE_KIND_AR_ELF ) )
+    {
+      return false;
+    }
+
+  if ( ( filter->classes != 0 ) &&
+       ( ( filter->classes & ( 1u << fc->ei_class ) ) == 0 )
+     )
+    {
+      return false;
+    }
+
+  /* Processor specific types do not fit the mask, and never match it. */
+  if ( ( filter->types != 0 ) &&
+       ( ( fc->e_type >= 32 ) ||
+         ( ( filter->types & ( 1u << fc->e_type ) ) == 0 )
+       )
+     )
+    {
+      return false;
+    }
+
+  for ( size_t i = 0; ( ! machine ) && ( i < filter->nmachines ); i++ )
+    {
+      machine = ( filter->machines[i] == fc->e_machine );
+    }
+
+  return machine;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
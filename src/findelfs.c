@@ -1,19 +1,257 @@
 /* -*- mode: c; -*- */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
 #include "aa-elf-util.h"
 
 
 /* ========================================================================== */
 
+  static void
+usage( const char * argv0, FILE * out )
+{
+  fprintf( out,
+           "Usage: %s [-j THREADS] [-c CACHE [-C] | --group] [FILTER...]\n"
+           "         [--io-order] [--batch] [--format FORMAT]\n"
+           "         [--stats[=json]] PATH...\n"
+           "Print every ELF file or AR archive of ELF objects under PATHs.\n"
+           "  -j THREADS  Number of traversal threads, 0 for one per CPU.\n"
+           "              Output order is only stable with `-j 1'.\n"
+           "  -c CACHE    Reuse results for unchanged files from CACHE, and\n"
+           "              update it afterwards.\n"
+           "  -C          Drop stale records from CACHE and exit.\n"
+           "  --group     Print every ELF object, archive members included,\n"
+           "              grouped by identity: each `build-id:HEX', or\n"
+           "              `hash:HEX' of the contents for objects without a\n"
+           "              build-id, is followed by its objects' names, each\n"
+           "              indented by a tab.\n"
+           "Filters, each taking a comma separated list:\n"
+           "  --class CLASS      `32' or `64'.\n"
+           "  --machine MACHINE  `x86_64', `aarch64', ..., or a number.\n"
+           "  --type TYPE        `rel', `exec', `dyn', or `core'.\n"
+           "              Archives are matched by their first ELF member,\n"
+           "              or with `--group' each member on its own.\n"
+           "  --prune GLOB       Skip directories matching GLOB, compared with\n"
+           "              the full path if it contains `/', otherwise with\n"
+           "              the name.  May be repeated.\n"
+           "  --query QUERY      Only print objects satisfying QUERY, made of\n"
+           "              tests `FIELD=VALUE,...' joined by `and', `or',\n"
+           "              `not' and parentheses.  FIELD is `kind' ( `elf' or\n"
+           "              `ar' ), `class', `type', `machine', or a glob\n"
+           "              matched against `needs', `soname', `interp',\n"
+           "              `runpath', `section' or `exports'.  Files are\n"
+           "              only read as far as the query requires.\n"
+           "              Archives match if one of their members does.\n"
+           "  --io-order  Visit each directory's files in inode order after\n"
+           "              asking for their headers to be read ahead, which\n"
+           "              helps cold caches on rotating or network storage.\n"
+           "              Files then follow their directory's subdirectories.\n"
+           "  --batch     Classify each directory's files together, keeping\n"
+           "              their opens and reads in flight at once through\n"
+           "              `io_uring', or a pool of threads where it is not\n"
+           "              available.  Ignored with `-c'.\n"
+           "  --format FORMAT  `text' for one name per line, the default,\n"
+           "              `nul' to end names with NUL bytes instead, `json'\n"
+           "              for one JSON object per line also giving each\n"
+           "              file's kind, class, byte order, type and machine,\n"
+           "              or `binary' for length prefixed records carrying\n"
+           "              the same fields.  Not allowed with `--group'.\n"
+           "  --stats     Report counters and per-phase times on stderr,\n"
+           "              as JSON with `--stats=json'.\n",
+           argv0
+         );
+}
+
 
 /* -------------------------------------------------------------------------- */
 
+static const struct option long_opts[] = {
+  { "stats",    optional_argument, NULL, 'S' },
+  { "class",    required_argument, NULL, 'K' },
+  { "machine",  required_argument, NULL, 'M' },
+  { "type",     required_argument, NULL, 'T' },
+  { "prune",    required_argument, NULL, 'P' },
+  { "group",    no_argument,       NULL, 'G' },
+  { "io-order", no_argument,       NULL, 'O' },
+  { "batch",    no_argument,       NULL, 'B' },
+  { "format",   required_argument, NULL, 'F' },
+  { "query",    required_argument, NULL, 'Q' },
+  { NULL,       0,                 NULL, 0   }
+};
+
   int
 main( int argc, char * argv[], char ** envp )
 {
-  print_elfs_recur( argv + 1, argc - 1 );
-  return EXIT_SUCCESS;
+  map_opts_t     opts       = { .nthreads = 0, .concurrent = true };
+  const char   * cache_path = NULL;
+  scan_cache_t * cache      = NULL;
+  bool           compact    = false;
+  bool           group      = false;
+  bool           formatted  = false;
+  out_format_t   fmt        = OUT_TEXT;
+  bool           stats      = false;
+  bool           stats_json = false;
+  bool           ok         = true;
+  int            opt        = -1;
+  elf_filter_t   filter     = { .classes = 0, .types = 0, .nmachines = 0 };
+  bool           use_filter = false;
+  const char  ** prune      = NULL;
+  elf_query_t  * query      = NULL;
+  size_t         nprune     = 0;
+
+  while ( ( opt = getopt_long( argc, argv, "hj:c:C", long_opts, NULL ) )
+          != -1
+        )
+    {
+      switch ( opt )
+        {
+          case 'j':
+            opts.nthreads = atoi( optarg );
+            break;
+
+          case 'c':
+            cache_path = optarg;
+            break;
+
+          case 'C':
+            compact = true;
+            break;
+
+          case 'G':
+            group = true;
+            break;
+
+          case 'O':
+            opts.io_order = true;
+            break;
+
+          case 'B':
+            opts.classify = true;
+            break;
+
+          case 'F':
+            formatted = true;
+            if ( ! out_format_parse( optarg, & fmt ) )
+              {
+                fprintf( stderr, "%s: unknown format `%s'\n", argv[0],
+                         optarg
+                       );
+                return EXIT_FAILURE;
+              }
+            break;
+
+          case 'S':
+            stats      = true;
+            stats_json = ( optarg != NULL ) &&
+                         ( strcmp( optarg, "json" ) == 0 );
+            break;
+
+          case 'K':
+          case 'M':
+          case 'T':
+            use_filter = true;
+            if ( ! elf_filter_add( & filter,
+                                   ( opt == 'K' ) ? "class" :
+                                   ( opt == 'M' ) ? "machine" : "type",
+                                   optarg
+                                 )
+               )
+              {
+                return EXIT_FAILURE;
+              }
+            break;
+
+          case 'Q':
+            if ( query != NULL ) elf_query_free( query );
+            if ( ( query = elf_query_compile( optarg ) ) == NULL )
+              {
+                return EXIT_FAILURE;
+              }
+            break;
+
+          case 'P':
+            /* Kept NULL terminated. */
+            prune = realloc( prune, ( nprune + 2 ) * sizeof( char * ) );
+            if ( prune == NULL )
+              {
+                perror( "realloc" );
+                return EXIT_FAILURE;
+              }
+            prune[nprune++] = optarg;
+            prune[nprune]   = NULL;
+            break;
+
+          case 'h':
+            usage( argv[0], stdout );
+            return EXIT_SUCCESS;
+
+          default:
+            usage( argv[0], stderr );
+            return EXIT_FAILURE;
+        }
+    }
+
+  if ( ( compact && ( cache_path == NULL ) ) ||
+       ( group && ( ( cache_path != NULL ) || formatted ) )
+     )
+    {
+      usage( argv[0], stderr );
+      return EXIT_FAILURE;
+    }
+
+  if ( stats && ( ! stats_enable() ) )
+    {
+      fprintf( stderr, "%s: statistics were disabled at build time\n",
+               argv[0]
+             );
+      stats = false;
+    }
+
+  if ( cache_path != NULL ) cache = scan_cache_open( cache_path );
+
+  if ( compact )
+    {
+      ok = scan_cache_compact( cache );
+      scan_cache_close( cache );
+      return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+  opts.prune = prune;
+  if ( group )
+    {
+      print_elf_groups_recur_opts( argv + optind, argc - optind, & opts,
+                                   use_filter ? & filter : NULL, query
+                                 );
+    }
+  else
+    {
+      ok = print_elfs_recur_opts( argv + optind, argc - optind, & opts, cache,
+                                  use_filter ? & filter : NULL, query, fmt
+                                );
+    }
+  free( prune );
+  if ( query != NULL ) elf_query_free( query );
+
+  if ( cache != NULL )
+    {
+      /* Results must reach the cache only after they were printed. */
+      fflush( stdout );
+      ok = scan_cache_save( cache ) && ok;
+      scan_cache_close( cache );
+    }
+
+  if ( stats )
+    {
+      stats_t total;
+      fflush( stdout );
+      stats_collect( & total );
+      stats_print( stderr, & total, stats_json );
+    }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 
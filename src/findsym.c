@@ -0,0 +1,109 @@
+/* -*- mode: c; -*- */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "aa-elf-util.h"
+
+
+/* ========================================================================== */
+
+  static void
+usage( const char * argv0, FILE * out )
+{
+  fprintf( out,
+           "Usage: %s [-p] INDEX SYMBOL...\n"
+           "Print the objects defining each SYMBOL, according to an INDEX\n"
+           "written by `mksymindex'.\n"
+           "Each definition is printed as `SYMBOL OBJECT', followed by\n"
+           "` (weak)' for weak definitions.\n"
+           "Exits with status 1 if some SYMBOL has no definition.\n"
+           "  -p  Treat each SYMBOL as a prefix.\n",
+           argv0
+         );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+print_definer( const char * sym, const char * obj, bool weak, void * aux )
+{
+  obuf_t * out = (obuf_t *) aux;
+  obuf_append( out, sym, strlen( sym ) );
+  obuf_append( out, " ", 1 );
+  if ( weak )
+    {
+      obuf_append( out, obj, strlen( obj ) );
+      obuf_putline( out, " (weak)" );
+    }
+  else
+    {
+      obuf_putline( out, obj );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  int
+main( int argc, char * argv[], char ** envp )
+{
+  sym_index_t * idx    = NULL;
+  bool          prefix = false;
+  bool          found  = true;
+  bool          ok     = true;
+  int           opt    = -1;
+  obuf_t        out;
+
+  while ( ( opt = getopt( argc, argv, "hp" ) ) != -1 )
+    {
+      switch ( opt )
+        {
+          case 'p':
+            prefix = true;
+            break;
+
+          case 'h':
+            usage( argv[0], stdout );
+            return EXIT_SUCCESS;
+
+          default:
+            usage( argv[0], stderr );
+            return EXIT_FAILURE;
+        }
+    }
+
+  if ( ( argc - optind ) < 2 )
+    {
+      usage( argv[0], stderr );
+      return EXIT_FAILURE;
+    }
+
+  if ( ( idx = sym_index_open( argv[optind] ) ) == NULL ) return 2;
+
+  obuf_init( & out, 0 );
+  for ( int i = optind + 1; i < argc; i++ )
+    {
+      size_t n = prefix
+                 ? sym_index_lookup_prefix( idx, argv[i], print_definer, & out )
+                 : sym_index_lookup( idx, argv[i], print_definer, & out );
+      if ( n == 0 ) found = false;
+    }
+  ok = obuf_flush( & out, STDOUT_FILENO );
+  obuf_free( & out );
+  sym_index_close( idx );
+
+  if ( ! ok ) return 2;
+  return found ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
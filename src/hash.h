@@ -0,0 +1,35 @@
+/* -*- mode: c; -*- */
+
+#ifndef _AA_ELF_TOOLS_HASH_H
+#define _AA_ELF_TOOLS_HASH_H
+
+/* ========================================================================== */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * FNV-1a, 64 bit, of the `len' bytes at `str', for the library's hash tables.
+ * Scan caches store these values, so they must not change.
+ */
+  static inline uint64_t
+hash_fnv1a( const char * str, size_t len )
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for ( size_t i = 0; i < len; i++ )
+    {
+      h ^= (unsigned char) str[i];
+      h *= 0x100000001b3ULL;
+    }
+  return h;
+}
+
+
+/* ========================================================================== */
+
+#endif /* hash.h */
+
+/* vim: set filetype=c : */
@@ -0,0 +1,276 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+/*
+ * The content hash follows the layout of XXH3: eight lanes each accumulate
+ * the 32x32 bit product of a keyed word's halves, plus the raw word of their
+ * neighbour.
+ * Lanes are independent, so the inner loop compiles to SSE2 `pmuludq' or
+ * wider vector code.
+ * Keys rotate with the stripe's position within a block so that reordered
+ * stripes hash differently, and lanes are scrambled after every block.
+ */
+
+#define HASH_LANES    8
+#define HASH_STRIPE   ( HASH_LANES * sizeof( uint64_t ) )
+#define HASH_BLOCK    16  /* Stripes per block */
+
+#define HASH_PRIME32  0x9e3779b1ULL
+#define HASH_PRIME64  0x9e3779b185ebca87ULL
+
+/* Digits of pi, as arbitrary as any other constants. */
+static const uint64_t hash_keys[HASH_LANES + HASH_BLOCK] = {
+  0x243f6a8885a308d3ULL, 0x13198a2e03707344ULL, 0xa4093822299f31d0ULL,
+  0x082efa98ec4e6c89ULL, 0x452821e638d01377ULL, 0xbe5466cf34e90c6cULL,
+  0xc0ac29b7c97c50ddULL, 0x3f84d5b5b5470917ULL, 0x9216d5d98979fb1bULL,
+  0xd1310ba698dfb5acULL, 0x2ffd72dbd01adfb7ULL, 0xb8e1afed6a267e96ULL,
+  0xba7c9045f12c7f99ULL, 0x24a19947b3916cf7ULL, 0x0801f2e2858efc16ULL,
+  0x636920d871574e69ULL, 0xa458fea3f4933d7eULL, 0x0d95748f728eb658ULL,
+  0x718bcd5882154aeeULL, 0x7b54a41dc25a59b5ULL, 0x9c30d5392af26013ULL,
+  0xc5d1b023286085f0ULL, 0xca417918b8db38efULL, 0x8e79dcb0603a180eULL
+};
+
+  static inline void
+hash_stripe( uint64_t * restrict acc, const unsigned char * stripe,
+             const uint64_t * restrict key
+           )
+{
+  uint64_t w[HASH_LANES];
+
+  memcpy( w, stripe, sizeof( w ) );
+  for ( size_t i = 0; i < HASH_LANES; i++ )
+    {
+      uint64_t k = w[i] ^ key[i];
+      acc[i] += ( k & 0xffffffffULL ) * ( k >> 32 ) + w[i ^ 1];
+    }
+}
+
+  static inline void
+hash_scramble( uint64_t * acc )
+{
+  for ( size_t i = 0; i < HASH_LANES; i++ )
+    {
+      acc[i] = ( acc[i] ^ ( acc[i] >> 47 ) ^ hash_keys[i] ) * HASH_PRIME32;
+    }
+}
+
+/** Final mix of `murmur3', so every input bit affects every output bit. */
+  static inline uint64_t
+hash_avalanche( uint64_t h )
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+
+  uint64_t
+elf_content_hash( const void * data, size_t size )
+{
+  const unsigned char * p        = (const unsigned char *) data;
+  size_t                nstripes = size / HASH_STRIPE;
+  unsigned char         tail[HASH_STRIPE];
+  uint64_t              acc[HASH_LANES];
+  uint64_t              h        = size * HASH_PRIME64;
+
+  for ( size_t i = 0; i < HASH_LANES; i++ ) acc[i] = hash_keys[i] + size;
+
+  for ( size_t s = 0; s < nstripes; s++ )
+    {
+      hash_stripe( acc, p + s * HASH_STRIPE, hash_keys + ( s % HASH_BLOCK ) );
+      if ( ( s % HASH_BLOCK ) == ( HASH_BLOCK - 1 ) ) hash_scramble( acc );
+    }
+
+  /* The tail is zero padded, `size' having been mixed in already. */
+  memset( tail, 0, sizeof( tail ) );
+  memcpy( tail, p + nstripes * HASH_STRIPE, size % HASH_STRIPE );
+  hash_stripe( acc, tail, hash_keys + HASH_BLOCK );
+  hash_scramble( acc );
+
+  for ( size_t i = 0; i < HASH_LANES; i++ )
+    {
+      h = ( h ^ hash_avalanche( acc[i] ) ) * HASH_PRIME64;
+    }
+  return hash_avalanche( h );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+elf_identify( const void * data, size_t size, elf_id_t * id )
+{
+  uint64_t h;
+
+  if ( elf_build_id( data, size, id ) ) return;
+
+  h = elf_content_hash( data, size );
+  id->kind = ELF_ID_HASH;
+  id->len  = sizeof( h );
+  for ( size_t i = 0; i < sizeof( h ); i++ )
+    {
+      id->bytes[i] = h >> ( 8 * ( sizeof( h ) - 1 - i ) );
+    }
+}
+
+
+  size_t
+elf_id_format( const elf_id_t * id, char * buf, size_t bufsz )
+{
+  static const char digits[] = "0123456789abcdef";
+  char              hex[2 * ELF_ID_MAX + 1];
+  int               len      = 0;
+
+  for ( size_t i = 0; i < id->len; i++ )
+    {
+      hex[2 * i]     = digits[id->bytes[i] >> 4];
+      hex[2 * i + 1] = digits[id->bytes[i] & 0xf];
+    }
+  hex[2 * id->len] = '\0';
+
+  len = snprintf( buf, bufsz, "%s:%s",
+                  ( id->kind == ELF_ID_BUILD_ID ) ? "build-id" :
+                  ( id->kind == ELF_ID_HASH )     ? "hash"     : "none",
+                  hex
+                );
+  return ( len < 0 ) ? 0 : (size_t) len;
+}
+
+
+  int
+elf_id_cmp( const elf_id_t * a, const elf_id_t * b )
+{
+  if ( a->kind != b->kind ) return ( a->kind < b->kind ) ? -1 : 1;
+  if ( a->len != b->len ) return ( a->len < b->len ) ? -1 : 1;
+  return memcmp( a->bytes, b->bytes, a->len );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** An object seen by `print_elf_groups_recur_opts'. */
+typedef struct {
+  elf_id_t   id;
+  char     * name;
+} id_rec_t;
+
+/** Records are appended by concurrent workers under `lock'. */
+struct id_groups_aux_s {
+  const elf_filter_t * filter;
+  const elf_query_t  * query;
+  pthread_mutex_t      lock;
+  id_rec_t           * recs;
+  size_t               nrecs;
+  size_t               cap;
+};
+
+  static void
+do_identify_elf( const elf_view_t * obj, void * aux )
+{
+  struct id_groups_aux_s * ga = (struct id_groups_aux_s *) aux;
+  id_rec_t                 rec;
+
+  if ( ( ( ga->filter != NULL ) &&
+         ( ! elf_filter_match( ga->filter, & obj->fc ) )
+       ) ||
+       ( ( ga->query != NULL ) && ( ! elf_query_match_object( ga->query, obj ) ) )
+     )
+    {
+      return;
+    }
+
+  elf_identify( obj->data, obj->size, & rec.id );
+  rec.name = strdup( obj->name );
+  assert( rec.name != NULL );
+
+  pthread_mutex_lock( & ga->lock );
+  if ( ga->nrecs == ga->cap )
+    {
+      ga->cap  = ( ga->cap == 0 ) ? 1024 : 2 * ga->cap;
+      ga->recs = realloc( ga->recs, sizeof( id_rec_t ) * ga->cap );
+      assert( ga->recs != NULL );
+    }
+  ga->recs[ga->nrecs++] = rec;
+  pthread_mutex_unlock( & ga->lock );
+}
+
+  static int
+id_rec_cmp( const void * a, const void * b )
+{
+  const id_rec_t * ra = (const id_rec_t *) a;
+  const id_rec_t * rb = (const id_rec_t *) b;
+  int              c  = elf_id_cmp( & ra->id, & rb->id );
+  return ( c != 0 ) ? c : strcmp( ra->name, rb->name );
+}
+
+
+  void
+print_elf_groups_recur_opts( char       * const * paths,
+                             int                  pathc,
+                             const map_opts_t   * opts,
+                             const elf_filter_t * filter,
+                             const elf_query_t  * query
+                           )
+{
+  struct id_groups_aux_s ga = { .filter = filter, .query = query,
+                                .recs = NULL, .nrecs = 0, .cap = 0
+                              };
+  map_opts_t             mo = { .nthreads = 0, .prune = NULL };
+  char                   idstr[ELF_ID_STRLEN];
+  obuf_t                 out;
+
+  /* Objects without a build-id are hashed whole, which is worth spreading
+   * over every worker whatever `opts' says. */
+  if ( opts != NULL ) mo = *opts;
+  mo.concurrent = true;
+  pthread_mutex_init( & ga.lock, NULL );
+  map_elfs_recur_opts( paths, pathc, do_identify_elf, & ga, & mo );
+  pthread_mutex_destroy( & ga.lock );
+
+  qsort( ga.recs, ga.nrecs, sizeof( id_rec_t ), id_rec_cmp );
+
+  obuf_init( & out, 0 );
+  for ( size_t i = 0; i < ga.nrecs; i++ )
+    {
+      if ( ( i == 0 ) || ( elf_id_cmp( & ga.recs[i].id, & ga.recs[i - 1].id )
+                           != 0 )
+         )
+        {
+          elf_id_format( & ga.recs[i].id, idstr, sizeof( idstr ) );
+          obuf_putline( & out, idstr );
+        }
+      obuf_append( & out, "\t", 1 );
+      obuf_putline( & out, ga.recs[i].name );
+      free( ga.recs[i].name );
+      if ( out.len >= ( OBUF_DEFAULT_SIZE / 2 ) )
+        {
+          obuf_flush( & out, STDOUT_FILENO );
+        }
+    }
+  obuf_flush( & out, STDOUT_FILENO );
+  obuf_free( & out );
+  free( ga.recs );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
@@ -0,0 +1,252 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Open-addressing hash set of ( device, inode ) pairs using linear probing.
+ *
+ * The table is a power of two in size and doubles once it is three quarters
+ * full, so memory stays within a constant factor of the number of members
+ * ( at most ~43 bytes per inode ) no matter how many devices are involved.
+ * The all-zero key marks empty slots; a real ( 0, 0 ) pair is tracked with
+ * `has_zero' instead.
+ */
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+} ino_key_t;
+
+struct ino_set {
+  ino_key_t * slots;
+  size_t      mask;      /* Capacity - 1 */
+  size_t      count;
+  bool        has_zero;
+};
+
+#define INO_SET_MIN_SIZE 1024
+
+/** Shard count for `ino_set_shared_t', must be a power of two. */
+#define INO_SET_SHARDS 64
+
+struct ino_set_shared {
+  struct {
+    pthread_mutex_t lock;
+    ino_set_t       set;
+    /* Keep shards on separate cache lines. */
+  } __attribute__(( aligned( 64 ) )) shards[INO_SET_SHARDS];
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Mixes both halves of the key, finishing with the `splitmix64' finalizer. */
+  static inline uint64_t
+ino_key_hash( dev_t dev, ino_t ino )
+{
+  uint64_t h = ( (uint64_t) ino ) ^ ( ( (uint64_t) dev ) * 0x9e3779b97f4a7c15ULL );
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+  static size_t
+ino_set_capacity_for( size_t hint )
+{
+  size_t cap = INO_SET_MIN_SIZE;
+  /* Leave room so `hint' members fit without a resize. */
+  while ( ( cap - ( cap >> 2 ) ) < hint ) cap <<= 1;
+  return cap;
+}
+
+  static void
+ino_set_init( ino_set_t * set, size_t hint )
+{
+  size_t cap = ino_set_capacity_for( hint );
+  set->slots = calloc( cap, sizeof( ino_key_t ) );
+  assert( set->slots != NULL );
+  set->mask     = cap - 1;
+  set->count    = 0;
+  set->has_zero = false;
+}
+
+  static void
+ino_set_grow( ino_set_t * set )
+{
+  size_t      ocap  = set->mask + 1;
+  size_t      ncap  = ocap << 1;
+  ino_key_t * old   = set->slots;
+  ino_key_t * slots = calloc( ncap, sizeof( ino_key_t ) );
+
+  assert( slots != NULL );
+  for ( size_t i = 0; i < ocap; i++ )
+    {
+      size_t j;
+      if ( ( old[i].dev == 0 ) && ( old[i].ino == 0 ) ) continue;
+      j = ino_key_hash( old[i].dev, old[i].ino ) & ( ncap - 1 );
+      while ( ( slots[j].dev != 0 ) || ( slots[j].ino != 0 ) )
+        {
+          j = ( j + 1 ) & ( ncap - 1 );
+        }
+      slots[j] = old[i];
+    }
+
+  free( old );
+  set->slots = slots;
+  set->mask  = ncap - 1;
+}
+
+  static bool
+ino_set_mark_hashed( ino_set_t * set, dev_t dev, ino_t ino, uint64_t h )
+{
+  size_t i;
+
+  if ( ( dev == 0 ) && ( ino == 0 ) )
+    {
+      bool seen = set->has_zero;
+      if ( ! seen ) set->count++;
+      set->has_zero = true;
+      return seen;
+    }
+
+  for ( i = h & set->mask;
+        ( set->slots[i].dev != 0 ) || ( set->slots[i].ino != 0 );
+        i = ( i + 1 ) & set->mask
+      )
+    {
+      if ( ( set->slots[i].ino == ino ) && ( set->slots[i].dev == dev ) )
+        {
+          return true;
+        }
+    }
+
+  set->slots[i].dev = dev;
+  set->slots[i].ino = ino;
+  set->count++;
+
+  /* Grow at 3/4 load to keep probe sequences short. */
+  if ( set->count > ( set->mask + 1 ) - ( ( set->mask + 1 ) >> 2 ) )
+    {
+      ino_set_grow( set );
+    }
+
+  return false;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  ino_set_t *
+ino_set_new( size_t hint )
+{
+  ino_set_t * set = malloc( sizeof( ino_set_t ) );
+  assert( set != NULL );
+  ino_set_init( set, hint );
+  return set;
+}
+
+  bool
+ino_set_mark( ino_set_t * set, dev_t dev, ino_t ino )
+{
+  return ino_set_mark_hashed( set, dev, ino, ino_key_hash( dev, ino ) );
+}
+
+  size_t
+ino_set_count( const ino_set_t * set )
+{
+  return set->count;
+}
+
+  void
+ino_set_free( ino_set_t * set )
+{
+  free( set->slots );
+  set->slots = NULL;
+  free( set );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  ino_set_shared_t *
+ino_set_shared_new( size_t hint )
+{
+  ino_set_shared_t * set = NULL;
+
+  if ( posix_memalign( (void **) & set, 64, sizeof( ino_set_shared_t ) ) != 0 )
+    {
+      set = NULL;
+    }
+  assert( set != NULL );
+
+  for ( int i = 0; i < INO_SET_SHARDS; i++ )
+    {
+      pthread_mutex_init( & set->shards[i].lock, NULL );
+      ino_set_init( & set->shards[i].set, hint / INO_SET_SHARDS );
+    }
+
+  return set;
+}
+
+/**
+ * The top bits of the hash pick a shard while the low bits pick a slot inside
+ * of it, so both stay well distributed.
+ */
+  bool
+ino_set_shared_mark( ino_set_shared_t * set, dev_t dev, ino_t ino )
+{
+  uint64_t h     = ino_key_hash( dev, ino );
+  size_t   shard = h >> ( 64 - __builtin_ctz( INO_SET_SHARDS ) );
+  bool     seen  = false;
+
+  pthread_mutex_lock( & set->shards[shard].lock );
+  seen = ino_set_mark_hashed( & set->shards[shard].set, dev, ino, h );
+  pthread_mutex_unlock( & set->shards[shard].lock );
+
+  return seen;
+}
+
+  size_t
+ino_set_shared_count( ino_set_shared_t * set )
+{
+  size_t count = 0;
+  for ( int i = 0; i < INO_SET_SHARDS; i++ )
+    {
+      pthread_mutex_lock( & set->shards[i].lock );
+      count += set->shards[i].set.count;
+      pthread_mutex_unlock( & set->shards[i].lock );
+    }
+  return count;
+}
+
+  void
+ino_set_shared_free( ino_set_shared_t * set )
+{
+  for ( int i = 0; i < INO_SET_SHARDS; i++ )
+    {
+      free( set->shards[i].set.slots );
+      set->shards[i].set.slots = NULL;
+      pthread_mutex_destroy( & set->shards[i].lock );
+    }
+  free( set );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
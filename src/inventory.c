@@ -0,0 +1,243 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include "hash.h"
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Open-addressing hash table keyed on path, using linear probing.
+ * Removal shifts later members of the probe sequence back instead of leaving
+ * tombstones, so lookups stay short however much the set churns.
+ */
+typedef struct {
+  uint64_t       hash;
+  char         * path;  /* NULL if empty */
+  file_class_t   fc;
+} inv_slot_t;
+
+struct elf_inventory {
+  inv_slot_t * slots;
+  size_t       mask;     /* Capacity - 1 */
+  size_t       count;
+};
+
+#define INVENTORY_MIN_SIZE 1024
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+inv_alloc( elf_inventory_t * inv, size_t cap )
+{
+  inv->slots = calloc( cap, sizeof( inv_slot_t ) );
+  assert( inv->slots != NULL );
+  inv->mask  = cap - 1;
+  inv->count = 0;
+}
+
+  static void
+inv_grow( elf_inventory_t * inv )
+{
+  size_t       ocap = inv->mask + 1;
+  inv_slot_t * old  = inv->slots;
+
+  inv_alloc( inv, ocap << 1 );
+  for ( size_t i = 0; i < ocap; i++ )
+    {
+      size_t j;
+      if ( old[i].path == NULL ) continue;
+      for ( j = old[i].hash & inv->mask; inv->slots[j].path != NULL;
+            j = ( j + 1 ) & inv->mask
+          );
+      inv->slots[j] = old[i];
+      inv->count++;
+    }
+  free( old );
+}
+
+/** Index of the slot holding `path', or of the empty slot ending its probe. */
+  static size_t
+inv_find( const elf_inventory_t * inv, const char * path, uint64_t h )
+{
+  size_t i = h & inv->mask;
+  for ( ; inv->slots[i].path != NULL; i = ( i + 1 ) & inv->mask )
+    {
+      if ( ( inv->slots[i].hash == h ) &&
+           ( strcmp( inv->slots[i].path, path ) == 0 )
+         )
+        {
+          break;
+        }
+    }
+  return i;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  elf_inventory_t *
+elf_inventory_new( size_t hint )
+{
+  elf_inventory_t * inv = calloc( 1, sizeof( elf_inventory_t ) );
+  size_t            cap = INVENTORY_MIN_SIZE;
+
+  assert( inv != NULL );
+  while ( ( cap - ( cap >> 2 ) ) < hint ) cap <<= 1;
+  inv_alloc( inv, cap );
+  return inv;
+}
+
+
+  bool
+elf_inventory_set( elf_inventory_t    * inv,
+                   const char         * path,
+                   const file_class_t * fc
+                 )
+{
+  uint64_t h = hash_fnv1a( path, strlen( path ) );
+  size_t   i = inv_find( inv, path, h );
+
+  if ( inv->slots[i].path != NULL )
+    {
+      inv->slots[i].fc = *fc;
+      return false;
+    }
+
+  if ( ( inv->count + 1 ) > ( ( inv->mask + 1 ) - ( ( inv->mask + 1 ) >> 2 ) ) )
+    {
+      inv_grow( inv );
+      i = inv_find( inv, path, h );
+    }
+
+  inv->slots[i].hash = h;
+  inv->slots[i].path = strdup( path );
+  inv->slots[i].fc   = *fc;
+  assert( inv->slots[i].path != NULL );
+  inv->count++;
+  return true;
+}
+
+
+  bool
+elf_inventory_remove( elf_inventory_t * inv, const char * path )
+{
+  size_t i = inv_find( inv, path, hash_fnv1a( path, strlen( path ) ) );
+
+  if ( inv->slots[i].path == NULL ) return false;
+
+  free( inv->slots[i].path );
+  inv->slots[i].path = NULL;
+  inv->count--;
+
+  /* Pull back members whose probe sequence passed through the hole. */
+  for ( size_t j = ( i + 1 ) & inv->mask; inv->slots[j].path != NULL;
+        j = ( j + 1 ) & inv->mask
+      )
+    {
+      size_t home = inv->slots[j].hash & inv->mask;
+      if ( ( ( j - home ) & inv->mask ) >= ( ( j - i ) & inv->mask ) )
+        {
+          inv->slots[i]      = inv->slots[j];
+          inv->slots[j].path = NULL;
+          i = j;
+        }
+    }
+
+  return true;
+}
+
+
+  size_t
+elf_inventory_remove_under( elf_inventory_t * inv, const char * dir )
+{
+  size_t   len     = strlen( dir );
+  size_t   nvictim = 0;
+  char  ** victims = NULL;
+
+  /* Removal moves members around, so collect them first. */
+  for ( size_t i = 0; i <= inv->mask; i++ )
+    {
+      const char * p = inv->slots[i].path;
+      if ( ( p != NULL ) && ( strncmp( p, dir, len ) == 0 ) &&
+           ( ( p[len] == '/' ) || ( ( len > 0 ) && ( dir[len - 1] == '/' ) ) )
+         )
+        {
+          victims = realloc( victims, ( nvictim + 1 ) * sizeof( char * ) );
+          assert( victims != NULL );
+          victims[nvictim++] = strdup( p );
+        }
+    }
+
+  for ( size_t i = 0; i < nvictim; i++ )
+    {
+      elf_inventory_remove( inv, victims[i] );
+      free( victims[i] );
+    }
+  free( victims );
+
+  return nvictim;
+}
+
+
+  void
+elf_inventory_clear( elf_inventory_t * inv )
+{
+  for ( size_t i = 0; i <= inv->mask; i++ )
+    {
+      free( inv->slots[i].path );
+      inv->slots[i].path = NULL;
+    }
+  inv->count = 0;
+}
+
+
+  size_t
+elf_inventory_count( const elf_inventory_t * inv )
+{
+  return inv->count;
+}
+
+
+  void
+elf_inventory_dump( const elf_inventory_t * inv,
+                    const elf_filter_t    * filter,
+                    obuf_t                * out
+                  )
+{
+  for ( size_t i = 0; i <= inv->mask; i++ )
+    {
+      if ( ( inv->slots[i].path != NULL ) &&
+           ( ( filter == NULL ) ||
+             elf_filter_match( filter, & inv->slots[i].fc )
+           )
+         )
+        {
+          obuf_putline( out, inv->slots[i].path );
+        }
+    }
+}
+
+
+  void
+elf_inventory_free( elf_inventory_t * inv )
+{
+  elf_inventory_clear( inv );
+  free( inv->slots );
+  free( inv );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
@@ -0,0 +1,90 @@
+/* -*- mode: c; -*- */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "aa-elf-util.h"
+
+
+/* ========================================================================== */
+
+  static void
+usage( const char * argv0, FILE * out )
+{
+  fprintf( out,
+           "Usage: %s [-j THREADS] -o INDEX PATH...\n"
+           "Index the symbols exported by ELF objects under PATHs, including\n"
+           "members of AR archives, for lookup with `findsym'.\n"
+           "  -o INDEX    File to write the index to.\n"
+           "  -j THREADS  Number of worker threads, 0 for one per CPU.\n",
+           argv0
+         );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+index_object( const elf_view_t * obj, void * aux )
+{
+  sym_index_add( (sym_index_builder_t *) aux, obj );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  int
+main( int argc, char * argv[], char ** envp )
+{
+  map_opts_t            opts    = { .nthreads = 0, .concurrent = true };
+  const char          * out     = NULL;
+  sym_index_builder_t * builder = NULL;
+  int                   opt     = -1;
+  bool                  ok      = true;
+
+  while ( ( opt = getopt( argc, argv, "hj:o:" ) ) != -1 )
+    {
+      switch ( opt )
+        {
+          case 'j':
+            opts.nthreads = atoi( optarg );
+            break;
+
+          case 'o':
+            out = optarg;
+            break;
+
+          case 'h':
+            usage( argv[0], stdout );
+            return EXIT_SUCCESS;
+
+          default:
+            usage( argv[0], stderr );
+            return EXIT_FAILURE;
+        }
+    }
+
+  if ( ( out == NULL ) || ( optind >= argc ) )
+    {
+      usage( argv[0], stderr );
+      return EXIT_FAILURE;
+    }
+
+  builder = sym_index_builder_new();
+  map_elfs_recur_opts( argv + optind, argc - optind, index_object, builder,
+                       & opts
+                     );
+  ok = sym_index_write( builder, out );
+  sym_index_builder_free( builder );
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
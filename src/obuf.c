@@ -0,0 +1,135 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+obuf_init( obuf_t * ob, size_t cap )
+{
+  ob->len = 0;
+  ob->cap = ( cap == 0 ) ? OBUF_DEFAULT_SIZE : cap;
+  ob->buf = malloc( ob->cap );
+  assert( ob->buf != NULL );
+}
+
+  void
+obuf_reserve( obuf_t * ob, size_t n )
+{
+  if ( ( ob->cap - ob->len ) >= n ) return;
+  while ( ( ob->cap - ob->len ) < n ) ob->cap *= 2;
+  ob->buf = realloc( ob->buf, ob->cap );
+  assert( ob->buf != NULL );
+}
+
+  void
+obuf_append( obuf_t * ob, const void * data, size_t len )
+{
+  obuf_reserve( ob, len );
+  memcpy( ob->buf + ob->len, data, len );
+  ob->len += len;
+}
+
+  void
+obuf_putline( obuf_t * ob, const char * str )
+{
+  size_t len = strlen( str );
+  obuf_reserve( ob, len + 1 );
+  memcpy( ob->buf + ob->len, str, len );
+  ob->buf[ob->len + len] = '\n';
+  ob->len += len + 1;
+}
+
+/** Write the whole buffer to `fd', retrying short writes, then empty it. */
+  bool
+obuf_flush( obuf_t * ob, int fd )
+{
+  size_t off = 0;
+
+  while ( off < ob->len )
+    {
+      ssize_t n = write( fd, ob->buf + off, ob->len - off );
+      if ( n < 0 )
+        {
+          if ( errno == EINTR ) continue;
+          ob->len = 0;
+          return false;
+        }
+      off += n;
+    }
+
+  ob->len = 0;
+  return true;
+}
+
+/**
+ * Buffers are gathered `IOV_MAX' at a time, and a short write resumes from
+ * the first byte `writev' did not take.
+ */
+  bool
+obuf_flushv( obuf_t * const * obs, size_t n, int fd )
+{
+  struct iovec iov[IOV_MAX];
+  size_t       first = 0;  /* First buffer not fully written */
+  size_t       off   = 0;  /* Bytes of it already written */
+  bool         ok    = true;
+
+  while ( ok && ( first < n ) )
+    {
+      int     niov = 0;
+      ssize_t w    = 0;
+
+      for ( size_t i = first; ( i < n ) && ( niov < IOV_MAX ); i++ )
+        {
+          size_t skip = ( i == first ) ? off : 0;
+          if ( obs[i]->len == skip ) continue;
+          iov[niov].iov_base = obs[i]->buf + skip;
+          iov[niov].iov_len  = obs[i]->len - skip;
+          niov++;
+        }
+      if ( niov == 0 ) break;
+
+      if ( ( w = writev( fd, iov, niov ) ) < 0 )
+        {
+          if ( errno != EINTR ) ok = false;
+          continue;
+        }
+      for ( w += off; ( first < n ) && ( (size_t) w >= obs[first]->len );
+            first++
+          )
+        {
+          w -= obs[first]->len;
+        }
+      off = w;
+    }
+
+  for ( size_t i = 0; i < n; i++ ) obs[i]->len = 0;
+  return ok;
+}
+
+  void
+obuf_free( obuf_t * ob )
+{
+  free( ob->buf );
+  ob->buf = NULL;
+  ob->len = 0;
+  ob->cap = 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
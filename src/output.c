@@ -0,0 +1,358 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <string.h>
+#include <assert.h>
+#include <elf.h>
+#include <pthread.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+out_format_parse( const char * name, out_format_t * fmt )
+{
+  if ( strcmp( name, "text" ) == 0 )        *fmt = OUT_TEXT;
+  else if ( strcmp( name, "nul" ) == 0 )    *fmt = OUT_NUL;
+  else if ( strcmp( name, "json" ) == 0 )   *fmt = OUT_JSONL;
+  else if ( strcmp( name, "binary" ) == 0 ) *fmt = OUT_BINARY;
+  else return false;
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Length of the well formed UTF-8 sequence at `s', or 0 if there is none:
+ * overlong forms, surrogates and code points past U+10FFFF are rejected.
+ */
+  static size_t
+utf8_seq_len( const unsigned char * s )
+{
+  size_t   len = 0;
+  uint32_t cp  = 0;
+  uint32_t min = 0;
+
+  if ( s[0] < 0x80 ) return 1;
+  if ( ( s[0] & 0xe0 ) == 0xc0 )
+    {
+      len = 2;
+      min = 0x80;
+    }
+  else if ( ( s[0] & 0xf0 ) == 0xe0 )
+    {
+      len = 3;
+      min = 0x800;
+    }
+  else if ( ( s[0] & 0xf8 ) == 0xf0 )
+    {
+      len = 4;
+      min = 0x10000;
+    }
+  else
+    {
+      return 0;
+    }
+  cp = s[0] & ( 0x7f >> len );
+
+  /* A NUL terminator fails the test, so `s' is never read past it. */
+  for ( size_t i = 1; i < len; i++ )
+    {
+      if ( ( s[i] & 0xc0 ) != 0x80 ) return 0;
+      cp = ( cp << 6 ) | ( s[i] & 0x3f );
+    }
+  if ( ( cp < min ) || ( cp > 0x10ffff ) ||
+       ( ( cp >= 0xd800 ) && ( cp <= 0xdfff ) )
+     )
+    {
+      return 0;
+    }
+  return len;
+}
+
+/** Append `str' as a JSON string, see `OUT_JSONL'. */
+  static void
+json_put_string( obuf_t * ob, const char * str )
+{
+  static const char     hex[] = "0123456789abcdef";
+  const unsigned char * s     = (const unsigned char *) str;
+  const unsigned char * run   = s;  /* Start of bytes copied as is */
+  size_t                len   = 0;
+  char                  esc[8];
+
+  obuf_append( ob, "\"", 1 );
+  while ( *s != '\0' )
+    {
+      if ( ( *s >= 0x20 ) && ( *s != '"' ) && ( *s != '\\' ) &&
+           ( ( len = utf8_seq_len( s ) ) != 0 )
+         )
+        {
+          s += len;
+          continue;
+        }
+
+      obuf_append( ob, run, s - run );
+      if ( ( *s == '"' ) || ( *s == '\\' ) )
+        {
+          esc[0] = '\\';
+          esc[1] = *s;
+          obuf_append( ob, esc, 2 );
+        }
+      else
+        {
+          /* Control characters as themselves, stray bytes as U+DCxx. */
+          memcpy( esc, ( *s < 0x80 ) ? "\\u00" : "\\udc", 4 );
+          esc[4] = hex[*s >> 4];
+          esc[5] = hex[*s & 0xf];
+          obuf_append( ob, esc, 6 );
+        }
+      run = ++s;
+    }
+  obuf_append( ob, run, s - run );
+  obuf_append( ob, "\"", 1 );
+}
+
+  static void
+json_put_member( obuf_t * ob, const char * key, const char * str, bool first )
+{
+  if ( ! first ) obuf_append( ob, ",", 1 );
+  obuf_append( ob, "\"", 1 );
+  obuf_append( ob, key, strlen( key ) );
+  obuf_append( ob, "\":", 2 );
+  json_put_string( ob, str );
+}
+
+  static void
+json_put_number( obuf_t * ob, const char * key, unsigned value )
+{
+  char buf[32];
+  int  len = snprintf( buf, sizeof( buf ), ",\"%s\":%u", key, value );
+  obuf_append( ob, buf, len );
+}
+
+  static void
+out_put_json( obuf_t * ob, const out_rec_t * rec )
+{
+  static const char * kinds[] = { "other", "elf", "ar", "ar-elf" };
+  const file_class_t * fc     = rec->fc;
+  file_kind_t          kind   = ( fc == NULL ) ? FILE_KIND_OTHER : fc->kind;
+  const char         * name   = NULL;
+
+  obuf_append( ob, "{", 1 );
+  json_put_member( ob, "path", rec->path, true );
+  if ( rec->member != NULL )
+    {
+      json_put_member( ob, "member", rec->member, false );
+    }
+  json_put_member( ob, "kind", kinds[kind], false );
+
+  if ( ( kind == FILE_KIND_ELF ) || ( kind == FILE_KIND_AR_ELF ) )
+    {
+      json_put_number( ob, "class",
+                       ( fc->ei_class == ELFCLASS64 ) ? 64 : 32
+                     );
+      json_put_member( ob, "data",
+                       ( fc->ei_data == ELFDATA2LSB ) ? "lsb" : "msb", false
+                     );
+      if ( ( name = elf_filter_name( "type", fc->e_type ) ) != NULL )
+        {
+          json_put_member( ob, "type", name, false );
+        }
+      else
+        {
+          json_put_number( ob, "type", fc->e_type );
+        }
+      if ( ( name = elf_filter_name( "machine", fc->e_machine ) ) != NULL )
+        {
+          json_put_member( ob, "machine", name, false );
+        }
+      else
+        {
+          json_put_number( ob, "machine", fc->e_machine );
+        }
+    }
+
+  if ( rec->symbol != NULL )
+    {
+      json_put_member( ob, "symbol", rec->symbol, false );
+    }
+  obuf_append( ob, "}\n", 2 );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+bin_put_u16( unsigned char * p, uint16_t v )
+{
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+  static void
+bin_put_u32( unsigned char * p, uint32_t v )
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+/** Append `str', or nothing if it is NULL, after its length. */
+  static void
+bin_put_string( obuf_t * ob, const char * str )
+{
+  unsigned char len[4];
+  size_t        n = ( str == NULL ) ? 0 : strlen( str );
+  bin_put_u32( len, n );
+  obuf_append( ob, len, sizeof( len ) );
+  if ( n > 0 ) obuf_append( ob, str, n );
+}
+
+  static void
+out_put_binary( obuf_t * ob, const out_rec_t * rec )
+{
+  static const file_class_t   none  = { .kind = FILE_KIND_OTHER };
+  const file_class_t        * fc    = ( rec->fc == NULL ) ? & none : rec->fc;
+  const size_t                start = ob->len;
+  unsigned char               head[12];
+
+  /* The length is patched in once the strings are appended. */
+  head[4] = fc->kind;
+  head[5] = fc->ei_class;
+  head[6] = fc->ei_data;
+  head[7] = ( ( rec->member != NULL ) ? OUT_BINARY_MEMBER : 0 ) |
+            ( ( rec->symbol != NULL ) ? OUT_BINARY_SYMBOL : 0 );
+  bin_put_u16( head + 8, fc->e_type );
+  bin_put_u16( head + 10, fc->e_machine );
+  obuf_append( ob, head, sizeof( head ) );
+  bin_put_string( ob, rec->path );
+  bin_put_string( ob, rec->member );
+  bin_put_string( ob, rec->symbol );
+  bin_put_u32( (unsigned char *) ob->buf + start, ob->len - start - 4 );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+out_put( obuf_t * ob, out_format_t fmt, const out_rec_t * rec )
+{
+  char sep = ( fmt == OUT_NUL ) ? '\0' : ' ';
+  char end = ( fmt == OUT_NUL ) ? '\0' : '\n';
+
+  if ( fmt == OUT_JSONL )
+    {
+      out_put_json( ob, rec );
+      return;
+    }
+  if ( fmt == OUT_BINARY )
+    {
+      out_put_binary( ob, rec );
+      return;
+    }
+
+  obuf_append( ob, rec->path, strlen( rec->path ) );
+  if ( rec->member != NULL )
+    {
+      obuf_append( ob, ":", 1 );
+      obuf_append( ob, rec->member, strlen( rec->member ) );
+    }
+  if ( rec->symbol != NULL )
+    {
+      obuf_append( ob, & sep, 1 );
+      obuf_append( ob, rec->symbol, strlen( rec->symbol ) );
+    }
+  obuf_append( ob, & end, 1 );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Records are formatted straight into `buf' under `lock', which is cheaper
+ * than formatting them aside and copying.
+ * A full buffer is swapped with `spare' and written after releasing `lock',
+ * so others keep formatting meanwhile; `wlock' keeps blocks in order.
+ */
+struct out_writer_s {
+  pthread_mutex_t   lock;
+  pthread_mutex_t   wlock;
+  obuf_t            buf;
+  obuf_t            spare;
+  int               fd;
+  out_format_t      fmt;
+  bool              failed;
+};
+
+/** Buffers are written once they hold this much. */
+#define OUT_WRITER_BLOCK ( OBUF_DEFAULT_SIZE / 2 )
+
+
+  out_writer_t *
+out_writer_new( int fd, out_format_t fmt )
+{
+  out_writer_t * w = calloc( 1, sizeof( out_writer_t ) );
+  assert( w != NULL );
+  pthread_mutex_init( & w->lock, NULL );
+  pthread_mutex_init( & w->wlock, NULL );
+  obuf_init( & w->buf, 0 );
+  obuf_init( & w->spare, 0 );
+  w->fd  = fd;
+  w->fmt = fmt;
+  return w;
+}
+
+
+  void
+out_writer_put( out_writer_t * w, const out_rec_t * rec )
+{
+  obuf_t full;
+  bool   ok   = true;
+
+  pthread_mutex_lock( & w->lock );
+  out_put( & w->buf, w->fmt, rec );
+  if ( w->buf.len < OUT_WRITER_BLOCK )
+    {
+      pthread_mutex_unlock( & w->lock );
+      return;
+    }
+
+  /* Take `wlock' before letting go of `lock', so blocks leave in order.
+   * Whoever holds `wlock' owns `spare'. */
+  pthread_mutex_lock( & w->wlock );
+  full   = w->buf;
+  w->buf = w->spare;
+  pthread_mutex_unlock( & w->lock );
+
+  ok       = obuf_flush( & full, w->fd );
+  w->spare = full;
+  if ( ! ok ) w->failed = true;
+  pthread_mutex_unlock( & w->wlock );
+}
+
+
+  bool
+out_writer_close( out_writer_t * w )
+{
+  bool ok = obuf_flush( & w->buf, w->fd ) && ( ! w->failed );
+
+  obuf_free( & w->buf );
+  obuf_free( & w->spare );
+  pthread_mutex_destroy( & w->wlock );
+  pthread_mutex_destroy( & w->lock );
+  free( w );
+  return ok;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
@@ -1,28 +1,107 @@
 
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <libelf.h>
 #include <gelf.h>
+#include "aa-elf-util.h"
 
-  int
-main( int argc, char * argv[], char ** envp )
+
+/* -------------------------------------------------------------------------- */
+
+/** Per file state handed to the dumping callbacks. */
+typedef struct {
+  obuf_t                * out;
+  out_format_t            fmt;
+  const elf_view_t      * obj;      /* Being dumped */
+  const elf_sym_query_t * queries;
+  size_t                  nqueries;
+  elf_sym_t             * found;
+  obuf_t                  name;     /* Scratch for versioned names */
+  bool                    bare;     /* Exports are printed alone */
+} dump_ctx_t;
+
+/**
+ * Print a record of `symname' in the object being dumped.
+ * With `bare', text records hold only the symbol, as exports of a single
+ * object always did.
+ */
+  static void
+print_record( dump_ctx_t * ctx, const char * symname, bool bare )
+{
+  const elf_view_t * obj = ctx->obj;
+  size_t             len = strlen( obj->path );
+  out_rec_t          rec = { .path = obj->name, .member = NULL,
+                             .fc = & obj->fc, .symbol = symname
+                           };
+
+  if ( bare && ( ctx->fmt == OUT_TEXT ) )
+    {
+      obuf_putline( ctx->out, symname );
+      return;
+    }
+  /* Structured formats keep the archive and member apart. */
+  if ( ( ctx->fmt != OUT_TEXT ) && obj->member &&
+       ( strlen( obj->name ) > len )
+     )
+    {
+      rec.path   = obj->path;
+      rec.member = obj->name + len + 1;
+    }
+  out_put( ctx->out, ctx->fmt, & rec );
+}
+
+/**
+ * Versioned symbols are printed as `nm' does, `NAME@@VERSION' by default,
+ * except for the symbols naming the versions themselves.
+ */
+  static void
+print_export( const elf_sym_t * sym, void * aux )
+{
+  dump_ctx_t * ctx = (dump_ctx_t *) aux;
+
+  if ( ! elf_sym_exportp( sym ) ) return;
+  if ( ( sym->version == NULL ) || ( strcmp( sym->name, sym->version ) == 0 ) )
+    {
+      print_record( ctx, sym->name, ctx->bare );
+      return;
+    }
+  ctx->name.len = 0;
+  obuf_append( & ctx->name, sym->name, strlen( sym->name ) );
+  obuf_append( & ctx->name, "@@", sym->hidden ? 1 : 2 );
+  obuf_append( & ctx->name, sym->version, strlen( sym->version ) + 1 );
+  print_record( ctx, ctx->name.buf, ctx->bare );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Print exported symbols through `libelf'.
+ * Used for objects `elf_map_syms' rejects as malformed, since `libelf' is
+ * more forgiving.
+ */
+  static void
+print_exports_libelf( const elf_view_t * obj, dump_ctx_t * ctx )
 {
   GElf_Shdr     shdr;
   Elf         * elf    = NULL;
   Elf_Scn     * scn    = NULL;
   Elf_Data    * data   = NULL;
-  int           fd     = -1;
   int           count  = -1;
   char        * symstr = NULL;
 
-  elf_version( EV_CURRENT );
-
-  fd  = open( argv[1], O_RDONLY );
-  elf = elf_begin( fd, ELF_C_READ, NULL );
+  /* The view is a private mapping, so `libelf' may convert it in place. */
+  elf = elf_memory( (char *) obj->data, obj->size );
+  if ( elf == NULL ) return;
 
   while ( ( scn = elf_nextscn( elf, scn ) ) != NULL )
     {
@@ -34,56 +113,630 @@ main( int argc, char * argv[], char ** envp )
         }
     }
 
-  data  = elf_getdata( scn, NULL );
+  if ( ( scn == NULL ) || ( ( data = elf_getdata( scn, NULL ) ) == NULL ) ||
+       ( shdr.sh_entsize == 0 )
+     )
+    {
+      elf_end( elf );
+      return;
+    }
+
   count = shdr.sh_size / shdr.sh_entsize;
 
   /* print the symbol names */
   for ( int ii = 0; ii < count; ++ii )
     {
-      GElf_Sym sym;
-      gelf_getsym( data, ii, & sym );
-      symstr = elf_strptr( elf, shdr.sh_link, sym.st_name );
-      if ( ( symstr != NULL ) && ( symstr[0] != '\0' ) )
+      GElf_Sym  gsym;
+      elf_sym_t sym;
+      gelf_getsym( data, ii, & gsym );
+      symstr = elf_strptr( elf, shdr.sh_link, gsym.st_name );
+      if ( symstr == NULL ) continue;
+      sym.name  = symstr;
+      sym.value = gsym.st_value;
+      sym.size  = gsym.st_size;
+      sym.info  = gsym.st_info;
+      sym.other   = gsym.st_other;
+      sym.shndx   = gsym.st_shndx;
+      sym.version = NULL;
+      sym.hidden  = false;
+      print_export( & sym, ctx );
+    }
+  elf_end( elf );
+}
+
+
+  static void
+print_exports( const elf_view_t * obj, void * aux )
+{
+  dump_ctx_t * ctx = (dump_ctx_t *) aux;
+  STATS_START( t0 );
+  ctx->obj = obj;
+  if ( elf_map_syms( obj->data, obj->size, SHT_SYMTAB, print_export, ctx ) )
+    {
+      STATS_STOP( STATS_PHASE_SYMBOLS, t0 );
+      return;
+    }
+
+  /* Stripped objects keep their dynamic symbols, which are scattered over a
+   * few pages, so read ahead of them would be wasted. */
+  if ( ! obj->member )
+    {
+      madvise( (void *) obj->data, obj->size, MADV_RANDOM );
+    }
+  if ( ! elf_map_dynsyms( obj->data, obj->size, print_export, ctx ) )
+    {
+      print_exports_libelf( obj, ctx );
+    }
+  STATS_STOP( STATS_PHASE_SYMBOLS, t0 );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Used for objects without a hash section, which are scanned linearly. */
+  static void
+match_export( const elf_sym_t * sym, void * aux )
+{
+  dump_ctx_t * ctx = (dump_ctx_t *) aux;
+  if ( ! elf_sym_exportp( sym ) ) return;
+  for ( size_t i = 0; i < ctx->nqueries; i++ )
+    {
+      if ( strcmp( sym->name, ctx->queries[i].name ) == 0 )
         {
-          #if 0
-          switch ( GELF_ST_BIND( sym.st_info ) )
-            {
-              case STB_GLOBAL:
-              case STB_WEAK:
-              case STB_LOOS:
-              case STB_HIOS:
-              case STB_LOPROC:
-              case STB_HIPROC:
-                printf( "%s\n", symstr );
-                break;
-
-              case STB_LOCAL:
-              case STB_NUM:
-              default:
-                break;
-            }
-          #endif
+          ctx->found[i] = *sym;
+          break;
+        }
+    }
+}
 
-          /* Skip undefined symbols */
-          if ( sym.st_shndx == STN_UNDEF )
-            {
-              continue;
-            }
+/**
+ * Print `OBJECT SYMBOL' for each queried symbol exported by `obj', in query
+ * order.
+ * Shared objects answer through their hash section; others have their
+ * `.symtab' scanned.
+ */
+  static void
+print_matches( const elf_view_t * obj, void * aux )
+{
+  dump_ctx_t * ctx = (dump_ctx_t *) aux;
+
+  STATS_START( t0 );
+  if ( elf_lookup_syms( obj->data, obj->size, ctx->queries, ctx->nqueries,
+                        ctx->found
+                      ) < 0
+     )
+    {
+      for ( size_t i = 0; i < ctx->nqueries; i++ ) ctx->found[i].name = NULL;
+      elf_map_syms( obj->data, obj->size, SHT_SYMTAB, match_export, ctx );
+    }
+  STATS_STOP( STATS_PHASE_SYMBOLS, t0 );
+
+  ctx->obj = obj;
+  for ( size_t i = 0; i < ctx->nqueries; i++ )
+    {
+      if ( ( ctx->found[i].name != NULL ) &&
+           elf_sym_exportp( & ctx->found[i] )
+         )
+        {
+          print_record( ctx, ctx->queries[i].name, false );
+        }
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+  char   ** paths;
+  size_t    count;
+  size_t    cap;
+} path_list_t;
+
+/** Run serialized by the traversal, so no locking is needed. */
+  static void
+collect_path( const char * fname, void * aux )
+{
+  path_list_t * lst = (path_list_t *) aux;
+  if ( lst->count == lst->cap )
+    {
+      lst->cap   = ( lst->cap == 0 ) ? 1024 : 2 * lst->cap;
+      lst->paths = realloc( lst->paths, sizeof( char * ) * lst->cap );
+      assert( lst->paths != NULL );
+    }
+  lst->paths[lst->count] = strdup( fname );
+  assert( lst->paths[lst->count] != NULL );
+  lst->count++;
+}
+
+  static int
+path_cmp( const void * a, const void * b )
+{
+  return strcmp( * (char * const *) a, * (char * const *) b );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Archives at least this large have their members dumped by several workers. */
+#define SPLIT_SIZE ( 16 << 20 )
+
+/** Chunks an archive is split into, per worker. */
+#define SPLIT_CHUNKS_PER_WORKER 4
+
+/**
+ * An archive being dumped by whichever workers are free: its members are cut
+ * into `nchunks' runs of similar size, delimited by `bounds', each dumped into
+ * its own buffer in `outs'.
+ * The worker finishing the last chunk joins the buffers, in member order,
+ * into the file's output.
+ */
+typedef struct ar_job {
+  ar_table_t      table;
+  size_t          file;     /* Index in `files' */
+  size_t        * bounds;   /* `nchunks' + 1 member indices */
+  obuf_t        * outs;
+  size_t          nchunks;
+  size_t          next;     /* Next chunk to claim */
+  size_t          ndone;
+  struct ar_job * link;
+} ar_job_t;
+
+/**
+ * Files are claimed in order by a pool of workers, each dumping a file's
+ * exports into a private buffer.
+ * Archives of `SPLIT_SIZE' bytes or more become an `ar_job_t' instead, whose
+ * chunks are claimed by idle workers before any further file, so that one
+ * large archive does not leave the others waiting on a single worker.
+ * Finished buffers are parked in `done' until every earlier file has been
+ * written; whichever worker completes the oldest outstanding file writes out
+ * the run of consecutive finished buffers with one `writev', so output order
+ * never depends on scheduling.
+ * Workers may run at most `window' files ahead of the writer, which bounds
+ * the number of buffers held.
+ */
+typedef struct {
+  path_list_t             files;
+  do_elf_fn               each;      /* Dumps an object into a `dump_ctx_t' */
+  out_format_t            fmt;
+  const elf_sym_query_t * queries;
+  size_t                  nqueries;
+  bool                    bare;      /* Exports are printed alone */
+  size_t                  next;      /* Next file to claim */
+  size_t                  flushed;   /* Next file to write */
+  size_t                  window;
+  obuf_t               ** done;      /* Finished buffers, modulo `window' */
+  obuf_t               ** pool;      /* Idle buffers */
+  obuf_t               ** run;       /* Being written */
+  size_t                  npool;
+  size_t                  split_size;
+  size_t                  nchunks;   /* Per archive */
+  ar_job_t              * jobs;      /* Archives with chunks to claim */
+  size_t                  nplanning; /* Files claimed, not yet known as jobs */
+  bool                    flushing;
+  bool                    failed;
+  pthread_mutex_t         lock;
+  pthread_cond_t          cond;
+} dump_t;
+
+
+  static obuf_t *
+dump_take_buffer( dump_t * d )
+{
+  obuf_t * ob = NULL;
+  if ( d->npool > 0 ) return d->pool[--d->npool];
+  ob = malloc( sizeof( obuf_t ) );
+  assert( ob != NULL );
+  obuf_init( ob, 0 );
+  return ob;
+}
+
+/** Called with `d->lock' held. */
+  static void
+dump_flush_ready( dump_t * d )
+{
+  obuf_t * ob = NULL;
+  size_t   n  = 0;
+  bool     ok = true;
+
+  if ( d->flushing ) return;  /* The active writer will pick ours up. */
+  d->flushing = true;
+  while ( true )
+    {
+      for ( n = 0; ( ( d->flushed + n ) < d->files.count ) && ( n < d->window );
+            n++
+          )
+        {
+          ob = d->done[( d->flushed + n ) % d->window];
+          if ( ob == NULL ) break;
+          d->done[( d->flushed + n ) % d->window] = NULL;
+          d->run[n] = ob;
+        }
+      if ( n == 0 ) break;
+
+      pthread_mutex_unlock( & d->lock );
+      ok = obuf_flushv( d->run, n, STDOUT_FILENO );
+      pthread_mutex_lock( & d->lock );
+      if ( ! ok ) d->failed = true;
+      for ( size_t i = 0; i < n; i++ ) d->pool[d->npool++] = d->run[i];
+      d->flushed += n;
+      pthread_cond_broadcast( & d->cond );
+    }
+  d->flushing = false;
+}
+
+/**
+ * Cut the members of `table' into chunks of similar size, recording it as the
+ * job for file `i'.
+ */
+  static ar_job_t *
+dump_new_job( dump_t * d, const ar_table_t * table, size_t i )
+{
+  ar_job_t * job   = calloc( 1, sizeof( ar_job_t ) );
+  size_t     total = 0;
+  size_t     acc   = 0;
+  size_t     c     = 1;
 
-          /* Skip locals and the fake `STB_NUM' value.
-           * This represents the number of valid Symbol Binding types according
-           * to the ELF Spec.
-           * The remaining types are extensions. */
-          if ( ( GELF_ST_BIND( sym.st_info ) == STB_LOCAL ) ||
-               ( GELF_ST_BIND( sym.st_info ) == STB_NUM ) )
+  assert( job != NULL );
+  job->table   = *table;
+  job->file    = i;
+  job->nchunks = ( table->nmembers < d->nchunks ) ? table->nmembers
+                                                   : d->nchunks;
+  if ( job->nchunks == 0 ) job->nchunks = 1;
+  job->bounds = calloc( job->nchunks + 1, sizeof( size_t ) );
+  job->outs   = calloc( job->nchunks, sizeof( obuf_t ) );
+  assert( ( job->bounds != NULL ) && ( job->outs != NULL ) );
+
+  for ( size_t m = 0; m < table->nmembers; m++ )
+    {
+      total += table->members[m].size;
+    }
+  for ( size_t m = 0; ( m < table->nmembers ) && ( c < job->nchunks ); m++ )
+    {
+      acc += table->members[m].size;
+      if ( acc >= ( total / job->nchunks ) * c ) job->bounds[c++] = m + 1;
+    }
+  for ( ; c <= job->nchunks; c++ ) job->bounds[c] = table->nmembers;
+  for ( c = 0; c < job->nchunks; c++ )
+    {
+      obuf_init( & job->outs[c], 64 * 1024 );
+    }
+  return job;
+}
+
+/**
+ * Called with `d->lock' held once every chunk of `job' is done: join their
+ * output as the file's, and release the job.
+ */
+  static void
+dump_finish_job( dump_t * d, ar_job_t * job )
+{
+  obuf_t * ob = dump_take_buffer( d );
+
+  for ( size_t c = 0; c < job->nchunks; c++ )
+    {
+      obuf_append( ob, job->outs[c].buf, job->outs[c].len );
+      obuf_free( & job->outs[c] );
+    }
+  ar_table_close( & job->table );
+  free( job->outs );
+  free( job->bounds );
+  d->done[job->file % d->window] = ob;
+  free( job );
+  dump_flush_ready( d );
+}
+
+/** Called with `d->lock' held; the first job with a chunk left to claim. */
+  static ar_job_t *
+dump_find_job( dump_t * d )
+{
+  ar_job_t * job = d->jobs;
+  while ( ( job != NULL ) && ( job->next >= job->nchunks ) ) job = job->link;
+  return job;
+}
+
+/** Called with `d->lock' held. */
+  static void
+dump_unlink_job( dump_t * d, ar_job_t * job )
+{
+  ar_job_t ** pp = & d->jobs;
+  while ( *pp != job ) pp = & ( *pp )->link;
+  *pp = job->link;
+}
+
+  static void *
+dump_worker( void * arg )
+{
+  dump_t     * d     = (dump_t *) arg;
+  obuf_t     * ob    = NULL;
+  ar_job_t   * job   = NULL;
+  size_t       i     = 0;
+  size_t       c     = 0;
+  ar_table_t   table;
+  dump_ctx_t   ctx   = { .out = NULL, .fmt = d->fmt, .obj = NULL,
+                         .queries = d->queries, .nqueries = d->nqueries,
+                         .found = NULL, .bare = d->bare
+                       };
+
+  ctx.found = calloc( d->nqueries + 1, sizeof( elf_sym_t ) );
+  assert( ctx.found != NULL );
+  obuf_init( & ctx.name, 256 );
+
+  pthread_mutex_lock( & d->lock );
+  while ( true )
+    {
+      /* Help with archives first, they hold back every later file. */
+      if ( ( job = dump_find_job( d ) ) != NULL )
+        {
+          c = job->next++;
+          pthread_mutex_unlock( & d->lock );
+
+          ctx.out = & job->outs[c];
+          map_ar_table( & job->table, job->bounds[c], job->bounds[c + 1],
+                        d->each, & ctx
+                      );
+
+          pthread_mutex_lock( & d->lock );
+          if ( ++job->ndone == job->nchunks )
             {
-              continue;
+              dump_unlink_job( d, job );
+              dump_finish_job( d, job );
             }
+          continue;
+        }
+
+      /* With every file claimed, linger while one may still become a job. */
+      if ( d->next >= d->files.count )
+        {
+          if ( d->nplanning == 0 ) break;
+          pthread_cond_wait( & d->cond, & d->lock );
+          continue;
+        }
+      if ( ( d->next - d->flushed ) >= d->window )
+        {
+          pthread_cond_wait( & d->cond, & d->lock );
+          continue;
+        }
+
+      i  = d->next++;
+      ob = dump_take_buffer( d );
+      d->nplanning++;
+      pthread_mutex_unlock( & d->lock );
 
-          puts( symstr );
+      ctx.out = ob;
+      if ( map_elf_objects_split( d->files.paths[i], d->split_size, & table,
+                                  d->each, & ctx
+                                )
+         )
+        {
+          job = dump_new_job( d, & table, i );
+          pthread_mutex_lock( & d->lock );
+          d->pool[d->npool++] = ob;
+          job->link = d->jobs;
+          d->jobs   = job;
         }
+      else
+        {
+          pthread_mutex_lock( & d->lock );
+          d->done[i % d->window] = ob;
+          dump_flush_ready( d );
+        }
+      d->nplanning--;
+      pthread_cond_broadcast( & d->cond );
     }
-  elf_end( elf );
-  close( fd );
-  return EXIT_SUCCESS;
+  pthread_mutex_unlock( & d->lock );
+
+  free( ctx.found );
+  obuf_free( & ctx.name );
+  return NULL;
+}
+
+/**
+ * Print the exports of every ELF object in `files', in order, as records in
+ * format `fmt'.
+ * With `nqueries' > 0 only the queried exports are printed.
+ * With `bare', text records of exports hold only the symbol.
+ */
+  static bool
+dump_files( path_list_t             files,
+            int                     nworkers,
+            out_format_t            fmt,
+            const elf_sym_query_t * queries,
+            size_t                  nqueries,
+            bool                    bare
+          )
+{
+  pthread_t * threads = NULL;
+  dump_t      d;
+
+  memset( & d, 0, sizeof( d ) );
+  d.files    = files;
+  d.each     = ( nqueries > 0 ) ? print_matches : print_exports;
+  d.fmt      = fmt;
+  d.queries  = queries;
+  d.nqueries = nqueries;
+  d.bare     = bare;
+  d.window = 4 * nworkers;
+  d.split_size = ( nworkers > 1 ) ? SPLIT_SIZE : SIZE_MAX;
+  d.nchunks    = SPLIT_CHUNKS_PER_WORKER * nworkers;
+  d.done   = calloc( d.window, sizeof( obuf_t * ) );
+  d.pool   = calloc( d.window, sizeof( obuf_t * ) );
+  d.run    = calloc( d.window, sizeof( obuf_t * ) );
+  threads  = calloc( nworkers, sizeof( pthread_t ) );
+  assert( ( d.done != NULL ) && ( d.pool != NULL ) && ( d.run != NULL ) &&
+          ( threads != NULL )
+        );
+  pthread_mutex_init( & d.lock, NULL );
+  pthread_cond_init( & d.cond, NULL );
+
+  /* The main thread serves as the first worker. */
+  for ( int i = 1; i < nworkers; i++ )
+    {
+      if ( pthread_create( & threads[i], NULL, dump_worker, & d ) != 0 )
+        {
+          perror( "pthread_create" );
+          exit( EXIT_FAILURE );
+        }
+    }
+  dump_worker( & d );
+  for ( int i = 1; i < nworkers; i++ ) pthread_join( threads[i], NULL );
+
+  for ( size_t i = 0; i < d.npool; i++ )
+    {
+      obuf_free( d.pool[i] );
+      free( d.pool[i] );
+    }
+  free( d.pool );
+  free( d.run );
+  free( d.done );
+  free( threads );
+  pthread_cond_destroy( & d.cond );
+  pthread_mutex_destroy( & d.lock );
+
+  return ! d.failed;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+usage( const char * argv0, FILE * out )
+{
+  fprintf( out,
+           "Usage: %s [-j THREADS] [-l SYMBOL]... [--format FORMAT]\n"
+           "         [--stats[=json]] PATH...\n"
+           "Print symbols exported by ELF objects under PATHs, including\n"
+           "members of AR archives.\n"
+           "Files are dumped in sorted path order.\n"
+           "Stripped objects, even without section headers, have their\n"
+           "dynamic exports printed with their versions, as\n"
+           "`NAME@@VERSION' or `NAME@VERSION' for non-default ones.\n"
+           "  -j THREADS  Number of worker threads, 0 for one per CPU.\n"
+           "              Archives of 16 MiB or more are split between\n"
+           "              them.\n"
+           "  -l SYMBOL   Only print `OBJECT SYMBOL' for objects exporting\n"
+           "              SYMBOL, using hash sections where available.\n"
+           "              May be repeated.\n"
+           "  --format FORMAT  `text', the default, `nul' to end fields\n"
+           "              with NUL bytes instead of spaces and newlines,\n"
+           "              `json' for one JSON object per line, or `binary'\n"
+           "              for length prefixed records.  Unless `text' is\n"
+           "              used on a single object, not an archive, exports\n"
+           "              are printed along with their object.\n"
+           "  --stats     Report counters and per-phase times on stderr,\n"
+           "              as JSON with `--stats=json'.\n",
+           argv0
+         );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static const struct option long_opts[] = {
+  { "stats",  optional_argument, NULL, 'S' },
+  { "format", required_argument, NULL, 'F' },
+  { NULL,     0,                 NULL, 0   }
+};
+
+  int
+main( int argc, char * argv[], char ** envp )
+{
+  map_opts_t        opts     = { .nthreads = 0, .concurrent = false };
+  path_list_t       files    = { NULL, 0, 0 };
+  elf_sym_query_t * queries  = NULL;
+  size_t            nqueries = 0;
+  int               opt      = -1;
+  bool              ok       = true;
+  bool              stats    = false;
+  bool              json     = false;
+  bool              bare     = false;
+  out_format_t      fmt      = OUT_TEXT;
+  file_class_t      fc;
+
+  queries = calloc( argc, sizeof( elf_sym_query_t ) );
+  assert( queries != NULL );
+
+  while ( ( opt = getopt_long( argc, argv, "hj:l:", long_opts, NULL ) )
+          != -1
+        )
+    {
+      switch ( opt )
+        {
+          case 'j':
+            opts.nthreads = atoi( optarg );
+            break;
+
+          case 'l':
+            elf_sym_query_init( & queries[nqueries++], optarg );
+            break;
+
+          case 'F':
+            if ( ! out_format_parse( optarg, & fmt ) )
+              {
+                fprintf( stderr, "%s: unknown format `%s'\n", argv[0],
+                         optarg
+                       );
+                return EXIT_FAILURE;
+              }
+            break;
+
+          case 'S':
+            stats = true;
+            json  = ( optarg != NULL ) && ( strcmp( optarg, "json" ) == 0 );
+            break;
+
+          case 'h':
+            usage( argv[0], stdout );
+            return EXIT_SUCCESS;
+
+          default:
+            usage( argv[0], stderr );
+            return EXIT_FAILURE;
+        }
+    }
+
+  if ( optind >= argc )
+    {
+      usage( argv[0], stderr );
+      return EXIT_FAILURE;
+    }
+
+  if ( stats && ( ! stats_enable() ) )
+    {
+      fprintf( stderr, "%s: statistics were disabled at build time\n",
+               argv[0]
+             );
+      stats = false;
+    }
+
+  if ( opts.nthreads <= 0 )
+    {
+      long ncpu = sysconf( _SC_NPROCESSORS_ONLN );
+      opts.nthreads = ( ncpu > 0 ) ? (int) ncpu : 1;
+    }
+
+  /* Gather every candidate path, then sort them so that output does not
+   * depend on traversal order. */
+  map_files_recur_opts( argv + optind, argc - optind, collect_path, & files,
+                        & opts
+                      );
+  qsort( files.paths, files.count, sizeof( char * ), path_cmp );
+
+  /* Bare names only say which object they came from when a single one was
+   * named. */
+  bare = ( ( argc - optind ) == 1 ) && ( files.count == 1 ) &&
+         ( classify_path( argv[optind], & fc ) == FILE_KIND_ELF );
+  ok = dump_files( files, opts.nthreads, fmt, queries, nqueries, bare );
+
+  for ( size_t i = 0; i < files.count; i++ ) free( files.paths[i] );
+  free( files.paths );
+  free( queries );
+
+  if ( stats )
+    {
+      stats_t total;
+      stats_collect( & total );
+      stats_print( stderr, & total, json );
+    }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,746 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fnmatch.h>
+#include <elf.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+typedef enum {
+  QF_KIND = 0,
+  QF_CLASS,
+  QF_TYPE,
+  QF_MACHINE,
+  QF_NEEDS,
+  QF_SONAME,
+  QF_INTERP,
+  QF_RUNPATH,
+  QF_SECTION,
+  QF_EXPORTS
+} qfield_t;
+
+static const struct {
+  const char        * name;
+  qfield_t            field;
+  elf_query_stage_t   stage;
+} qfields[] = {
+  { "kind",    QF_KIND,    ELF_QUERY_IDENT    },
+  { "class",   QF_CLASS,   ELF_QUERY_IDENT    },
+  { "type",    QF_TYPE,    ELF_QUERY_HEADER   },
+  { "machine", QF_MACHINE, ELF_QUERY_HEADER   },
+  { "needs",   QF_NEEDS,   ELF_QUERY_DYNAMIC  },
+  { "soname",  QF_SONAME,  ELF_QUERY_DYNAMIC  },
+  { "interp",  QF_INTERP,  ELF_QUERY_DYNAMIC  },
+  { "runpath", QF_RUNPATH, ELF_QUERY_DYNAMIC  },
+  { "section", QF_SECTION, ELF_QUERY_SECTIONS },
+  { "exports", QF_EXPORTS, ELF_QUERY_SYMBOLS  },
+  { NULL,      0,          0                  }
+};
+
+typedef enum {
+  QN_TEST = 0,
+  QN_NOT,
+  QN_AND,
+  QN_OR
+} qop_t;
+
+/**
+ * A node of the plan.
+ * `stage' is the costliest stage its tests need; children of `and' and `or'
+ * are ordered by it, so cheap tests short-circuit costly ones.
+ */
+typedef struct qnode {
+  qop_t               op;
+  elf_query_stage_t   stage;
+  struct qnode      * kids[2];
+  /* Tests */
+  size_t              index;    /* Of its result in `qobj_t.results' */
+  qfield_t            field;
+  elf_filter_t        filter;   /* `class', `type' and `machine' */
+  unsigned            kinds;    /* `kind', as `1 << FILE_KIND_*' */
+  char              * values;   /* Split on commas in place */
+  char             ** globs;    /* Point into `values' */
+  size_t              nglobs;
+  elf_sym_query_t   * syms;     /* `exports' without wildcards, else NULL */
+} qnode_t;
+
+struct elf_query_s {
+  qnode_t  * root;
+  unsigned   stages;  /* `1 << ELF_QUERY_*' for each stage tested */
+  size_t     ntests;
+};
+
+/** Three valued results, `Q_MAYBE' standing for tests of later stages. */
+typedef enum {
+  Q_NO = 0,
+  Q_YES,
+  Q_MAYBE
+} qres_t;
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Tokens are parentheses, or words ended by spaces or parentheses. */
+typedef struct {
+  const char * p;
+  const char * tok;
+  size_t       len;
+} qlex_t;
+
+  static void
+qlex_next( qlex_t * lx )
+{
+  while ( ( *lx->p == ' ' ) || ( *lx->p == '\t' ) || ( *lx->p == '\n' ) )
+    {
+      lx->p++;
+    }
+  lx->tok = lx->p;
+  if ( ( *lx->p == '(' ) || ( *lx->p == ')' ) )
+    {
+      lx->len = 1;
+    }
+  else
+    {
+      lx->len = strcspn( lx->p, " \t\n()" );
+    }
+  lx->p += lx->len;
+}
+
+  static bool
+qlex_is( const qlex_t * lx, const char * word )
+{
+  return ( strlen( word ) == lx->len ) &&
+         ( strncmp( lx->tok, word, lx->len ) == 0 );
+}
+
+  static void
+qlex_error( const qlex_t * lx, const char * expected )
+{
+  if ( lx->len == 0 )
+    {
+      fprintf( stderr, "Malformed query, expected %s at its end\n", expected );
+    }
+  else
+    {
+      fprintf( stderr, "Malformed query, expected %s at `%.*s'\n", expected,
+               (int) lx->len, lx->tok
+             );
+    }
+}
+
+
+  static qnode_t *
+qnode_new( qop_t op, qnode_t * a, qnode_t * b )
+{
+  qnode_t * n = calloc( 1, sizeof( qnode_t ) );
+  assert( n != NULL );
+  n->op      = op;
+  n->kids[0] = a;
+  n->kids[1] = b;
+  return n;
+}
+
+  static void
+qnode_free( qnode_t * n )
+{
+  if ( n == NULL ) return;
+  qnode_free( n->kids[0] );
+  qnode_free( n->kids[1] );
+  free( n->values );
+  free( n->globs );
+  free( n->syms );
+  free( n );
+}
+
+/** Parse the `FIELD=VALUE' test at the current token. */
+  static qnode_t *
+qparse_test( const qlex_t * lx )
+{
+  qnode_t    * n     = NULL;
+  const char * value = memchr( lx->tok, '=', lx->len );
+  const char * end   = lx->tok + lx->len;
+  size_t       i     = 0;
+
+  if ( ( value == NULL ) || ( value == lx->tok ) || ( ( value + 1 ) == end ) )
+    {
+      qlex_error( lx, "`FIELD=VALUE'" );
+      return NULL;
+    }
+  for ( i = 0; qfields[i].name != NULL; i++ )
+    {
+      if ( ( strlen( qfields[i].name ) == (size_t) ( value - lx->tok ) ) &&
+           ( strncmp( qfields[i].name, lx->tok, value - lx->tok ) == 0 )
+         )
+        {
+          break;
+        }
+    }
+  if ( qfields[i].name == NULL )
+    {
+      fprintf( stderr, "Unknown query field `%.*s'\n",
+               (int) ( value - lx->tok ), lx->tok
+             );
+      return NULL;
+    }
+
+  n         = qnode_new( QN_TEST, NULL, NULL );
+  n->field  = qfields[i].field;
+  n->stage  = qfields[i].stage;
+  n->values = strndup( value + 1, end - value - 1 );
+  assert( n->values != NULL );
+
+  if ( ( n->field == QF_CLASS ) || ( n->field == QF_TYPE ) ||
+       ( n->field == QF_MACHINE )
+     )
+    {
+      if ( elf_filter_add( & n->filter, qfields[i].name, n->values ) )
+        {
+          return n;
+        }
+      qnode_free( n );
+      return NULL;
+    }
+
+  n->nglobs = 1;
+  for ( char * c = n->values; *c != '\0'; c++ ) n->nglobs += ( *c == ',' );
+  n->globs = calloc( n->nglobs, sizeof( char * ) );
+  assert( n->globs != NULL );
+  n->nglobs = 0;
+  for ( char * v = n->values; v != NULL; )
+    {
+      char * comma = strchr( v, ',' );
+      if ( comma != NULL ) *comma++ = '\0';
+      if ( *v != '\0' ) n->globs[n->nglobs++] = v;
+      v = comma;
+    }
+
+  if ( n->field == QF_KIND )
+    {
+      for ( i = 0; i < n->nglobs; i++ )
+        {
+          if ( strcmp( n->globs[i], "elf" ) == 0 )
+            {
+              n->kinds |= 1u << FILE_KIND_ELF;
+            }
+          else if ( strcmp( n->globs[i], "ar" ) == 0 )
+            {
+              n->kinds |= 1u << FILE_KIND_AR_ELF;
+            }
+          else
+            {
+              fprintf( stderr, "Unknown ELF kind `%s'\n", n->globs[i] );
+              qnode_free( n );
+              return NULL;
+            }
+        }
+    }
+
+  /* Plain symbol names can be looked up through hash sections. */
+  if ( ( n->field == QF_EXPORTS ) && ( n->nglobs > 0 ) )
+    {
+      bool plain = true;
+      for ( i = 0; plain && ( i < n->nglobs ); i++ )
+        {
+          plain = ( strpbrk( n->globs[i], "*?[\\" ) == NULL );
+        }
+      if ( plain )
+        {
+          n->syms = calloc( n->nglobs, sizeof( elf_sym_query_t ) );
+          assert( n->syms != NULL );
+          for ( i = 0; i < n->nglobs; i++ )
+            {
+              elf_sym_query_init( & n->syms[i], n->globs[i] );
+            }
+        }
+    }
+  return n;
+}
+
+static qnode_t * qparse_or( qlex_t * lx );
+
+  static qnode_t *
+qparse_not( qlex_t * lx )
+{
+  qnode_t * n = NULL;
+
+  if ( qlex_is( lx, "not" ) )
+    {
+      qlex_next( lx );
+      if ( ( n = qparse_not( lx ) ) == NULL ) return NULL;
+      return qnode_new( QN_NOT, n, NULL );
+    }
+
+  if ( qlex_is( lx, "(" ) )
+    {
+      qlex_next( lx );
+      if ( ( n = qparse_or( lx ) ) == NULL ) return NULL;
+      if ( ! qlex_is( lx, ")" ) )
+        {
+          qlex_error( lx, "`)'" );
+          qnode_free( n );
+          return NULL;
+        }
+      qlex_next( lx );
+      return n;
+    }
+
+  if ( ( lx->len == 0 ) || qlex_is( lx, ")" ) || qlex_is( lx, "and" ) ||
+       qlex_is( lx, "or" )
+     )
+    {
+      qlex_error( lx, "a test" );
+      return NULL;
+    }
+
+  n = qparse_test( lx );
+  if ( n != NULL ) qlex_next( lx );
+  return n;
+}
+
+/** Tests side by side are joined by `and', as `find' joins them. */
+  static qnode_t *
+qparse_and( qlex_t * lx )
+{
+  qnode_t * n = qparse_not( lx );
+  qnode_t * m = NULL;
+
+  while ( ( n != NULL ) && ( lx->len > 0 ) && ( ! qlex_is( lx, "or" ) ) &&
+          ( ! qlex_is( lx, ")" ) )
+        )
+    {
+      if ( qlex_is( lx, "and" ) ) qlex_next( lx );
+      if ( ( m = qparse_not( lx ) ) == NULL )
+        {
+          qnode_free( n );
+          return NULL;
+        }
+      n = qnode_new( QN_AND, n, m );
+    }
+  return n;
+}
+
+  static qnode_t *
+qparse_or( qlex_t * lx )
+{
+  qnode_t * n = qparse_and( lx );
+  qnode_t * m = NULL;
+
+  while ( ( n != NULL ) && qlex_is( lx, "or" ) )
+    {
+      qlex_next( lx );
+      if ( ( m = qparse_and( lx ) ) == NULL )
+        {
+          qnode_free( n );
+          return NULL;
+        }
+      n = qnode_new( QN_OR, n, m );
+    }
+  return n;
+}
+
+/**
+ * Fill in the stages of `n''s subtree, moving cheaper children first, and
+ * number its tests from `*ntests' on.
+ */
+  static unsigned
+qplan( qnode_t * n, size_t * ntests )
+{
+  unsigned  stages = 0;
+  qnode_t * tmp    = NULL;
+
+  if ( n->op == QN_TEST )
+    {
+      n->index = ( *ntests )++;
+      return 1u << n->stage;
+    }
+
+  stages   = qplan( n->kids[0], ntests );
+  n->stage = n->kids[0]->stage;
+  if ( n->kids[1] != NULL )
+    {
+      stages |= qplan( n->kids[1], ntests );
+      if ( n->kids[1]->stage < n->kids[0]->stage )
+        {
+          tmp        = n->kids[0];
+          n->kids[0] = n->kids[1];
+          n->kids[1] = tmp;
+        }
+      n->stage = n->kids[1]->stage;
+    }
+  return stages;
+}
+
+
+  elf_query_t *
+elf_query_compile( const char * text )
+{
+  elf_query_t * q  = calloc( 1, sizeof( elf_query_t ) );
+  qlex_t        lx = { .p = text };
+
+  assert( q != NULL );
+  qlex_next( & lx );
+  q->root = qparse_or( & lx );
+  if ( ( q->root != NULL ) && ( lx.len > 0 ) )
+    {
+      qlex_error( & lx, "`and' or `or'" );
+    }
+  else if ( q->root != NULL )
+    {
+      q->stages = qplan( q->root, & q->ntests );
+      return q;
+    }
+
+  elf_query_free( q );
+  return NULL;
+}
+
+
+  void
+elf_query_free( elf_query_t * q )
+{
+  qnode_free( q->root );
+  free( q );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * What is known of an object, read as stages are reached.
+ * Each test runs at most once per object, later stages reusing its result.
+ */
+typedef struct {
+  const file_class_t  * fc;
+  const void          * data;
+  size_t                size;
+  bool                  dyn_read;
+  bool                  dyn_ok;
+  elf_dynamic_t         dyn;
+  qres_t              * results;  /* Per test, `Q_MAYBE' until it runs */
+  bool                  archive;  /* Only `kind' is known until members are */
+} qobj_t;
+
+/** Results of queries with up to this many tests are kept on the stack. */
+#define QUERY_STACK_TESTS 32
+
+/** Point `o->results' at `stack', or at the heap for larger queries. */
+  static void
+qobj_results_init( qobj_t * o, const elf_query_t * q, qres_t * stack )
+{
+  o->results = stack;
+  if ( q->ntests > QUERY_STACK_TESTS )
+    {
+      o->results = malloc( q->ntests * sizeof( qres_t ) );
+      assert( o->results != NULL );
+    }
+  for ( size_t i = 0; i < q->ntests; i++ ) o->results[i] = Q_MAYBE;
+}
+
+  static void
+qobj_results_free( qobj_t * o, const qres_t * stack )
+{
+  if ( o->results != stack ) free( o->results );
+}
+
+/** Lookups through hash sections are done this many names at a time. */
+#define QUERY_SYM_BATCH 16
+
+  static bool
+qglob_any( const qnode_t * n, const char * str )
+{
+  if ( str == NULL ) return false;
+  for ( size_t i = 0; i < n->nglobs; i++ )
+    {
+      if ( fnmatch( n->globs[i], str, 0 ) == 0 ) return true;
+    }
+  return false;
+}
+
+struct qscan_s {
+  const qnode_t * node;
+  bool            found;
+};
+
+  static void
+qscan_section( const elf_scn_t * scn, void * aux )
+{
+  struct qscan_s * qs = (struct qscan_s *) aux;
+  if ( ! qs->found ) qs->found = qglob_any( qs->node, scn->name );
+}
+
+  static void
+qscan_symbol( const elf_sym_t * sym, void * aux )
+{
+  struct qscan_s * qs = (struct qscan_s *) aux;
+  if ( ( ! qs->found ) && elf_sym_exportp( sym ) )
+    {
+      qs->found = qglob_any( qs->node, sym->name );
+    }
+}
+
+  static bool
+qtest_exports( const qnode_t * n, qobj_t * o )
+{
+  struct qscan_s qs     = { n, false };
+  elf_sym_t      found[QUERY_SYM_BATCH];
+  ssize_t        nfound = -1;
+
+  for ( size_t i = 0; ( n->syms != NULL ) && ( i < n->nglobs );
+        i += QUERY_SYM_BATCH
+      )
+    {
+      size_t count = n->nglobs - i;
+      if ( count > QUERY_SYM_BATCH ) count = QUERY_SYM_BATCH;
+      nfound = elf_lookup_syms( o->data, o->size, n->syms + i, count, found );
+      if ( nfound < 0 ) break;
+      for ( size_t j = 0; j < count; j++ )
+        {
+          if ( ( found[j].name != NULL ) && elf_sym_exportp( & found[j] ) )
+            {
+              return true;
+            }
+        }
+    }
+  if ( nfound >= 0 ) return false;
+
+  /* Relocatable objects have no hash section, and no dynamic symbols. */
+  if ( ! elf_map_dynsyms( o->data, o->size, qscan_symbol, & qs ) )
+    {
+      elf_map_syms( o->data, o->size, SHT_SYMTAB, qscan_symbol, & qs );
+    }
+  return qs.found;
+}
+
+  static bool
+qtest( const qnode_t * n, qobj_t * o )
+{
+  struct qscan_s qs = { n, false };
+  bool           r  = false;
+
+  switch ( n->field )
+    {
+      case QF_KIND:
+        return ( n->kinds & ( 1u << o->fc->kind ) ) != 0;
+
+      case QF_CLASS:
+      case QF_TYPE:
+      case QF_MACHINE:
+        return elf_filter_match( & n->filter, o->fc );
+
+      case QF_SECTION:
+        elf_map_sections( o->data, o->size, qscan_section, & qs );
+        return qs.found;
+
+      case QF_EXPORTS:
+        {
+          STATS_START( t0 );
+          r = qtest_exports( n, o );
+          STATS_STOP( STATS_PHASE_SYMBOLS, t0 );
+          return r;
+        }
+
+      default:
+        break;
+    }
+
+  if ( ! o->dyn_read )
+    {
+      o->dyn_read = true;
+      o->dyn_ok   = elf_read_dynamic( o->data, o->size, & o->dyn );
+    }
+  if ( ! o->dyn_ok ) return false;
+  switch ( n->field )
+    {
+      case QF_NEEDS:
+        for ( size_t i = 0; i < o->dyn.nneeded; i++ )
+          {
+            if ( qglob_any( n, o->dyn.needed[i] ) ) return true;
+          }
+        return false;
+
+      case QF_SONAME:
+        return qglob_any( n, o->dyn.soname );
+
+      case QF_INTERP:
+        return qglob_any( n, o->dyn.interp );
+
+      default:
+        return qglob_any( n, o->dyn.runpath ) || qglob_any( n, o->dyn.rpath );
+    }
+}
+
+/**
+ * Evaluate `n' with what stages up to `stage' tell, tests of later stages
+ * being unknown.
+ * Unknowns are resolved as Kleene's logic does, so an answer found early is
+ * the one every later stage would give.
+ * Tests of earlier stages answer from `o->results'.
+ */
+  static qres_t
+qeval( const qnode_t * n, qobj_t * o, elf_query_stage_t stage )
+{
+  qres_t a = Q_MAYBE;
+  qres_t b = Q_MAYBE;
+
+  switch ( n->op )
+    {
+      case QN_TEST:
+        if ( n->stage > stage ) return Q_MAYBE;
+        /* An archive's identification is its first member's, and says
+         * nothing of the others. */
+        if ( o->archive && ( n->field != QF_KIND ) ) return Q_MAYBE;
+        if ( o->results[n->index] == Q_MAYBE )
+          {
+            o->results[n->index] = qtest( n, o ) ? Q_YES : Q_NO;
+          }
+        return o->results[n->index];
+
+      case QN_NOT:
+        a = qeval( n->kids[0], o, stage );
+        return ( a == Q_MAYBE ) ? Q_MAYBE : ( a == Q_YES ) ? Q_NO : Q_YES;
+
+      case QN_AND:
+        if ( ( a = qeval( n->kids[0], o, stage ) ) == Q_NO ) return Q_NO;
+        if ( ( b = qeval( n->kids[1], o, stage ) ) == Q_NO ) return Q_NO;
+        return ( ( a == Q_YES ) && ( b == Q_YES ) ) ? Q_YES : Q_MAYBE;
+
+      default:
+        if ( ( a = qeval( n->kids[0], o, stage ) ) == Q_YES ) return Q_YES;
+        if ( ( b = qeval( n->kids[1], o, stage ) ) == Q_YES ) return Q_YES;
+        return ( ( a == Q_NO ) && ( b == Q_NO ) ) ? Q_NO : Q_MAYBE;
+    }
+}
+
+/**
+ * Run the stages of `q' from `first' to `last', stopping at the first one
+ * which decides `o'.
+ */
+  static qres_t
+qrun( const elf_query_t * q, qobj_t * o, elf_query_stage_t first,
+      elf_query_stage_t last
+    )
+{
+  qres_t r = Q_MAYBE;
+
+  for ( unsigned s = first; ( s <= last ) && ( r == Q_MAYBE ); s++ )
+    {
+      if ( ( q->stages & ( 1u << s ) ) == 0 ) continue;
+      r = qeval( q->root, o, s );
+      if ( r != Q_MAYBE ) STATS_ADD( query_decided[s], 1 );
+    }
+  return r;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Run the stages of `q' from `first' on over `obj', whose earlier stages
+ * already left `results' undecided.
+ */
+  static bool
+qmatch_view( const elf_query_t * q, const elf_view_t * obj, qres_t * results,
+             elf_query_stage_t first
+           )
+{
+  file_class_t fc = obj->fc;
+  qobj_t       o  = { .fc = & fc, .data = obj->data, .size = obj->size,
+                      .results = results
+                    };
+  qres_t       r  = Q_MAYBE;
+
+  /* Members answer `kind' for their archive. */
+  fc.kind = obj->member ? FILE_KIND_AR_ELF : FILE_KIND_ELF;
+  r = qrun( q, & o, first, ELF_QUERY_NSTAGES - 1 );
+  if ( o.dyn_ok ) elf_dynamic_free( & o.dyn );
+  return r == Q_YES;
+}
+
+  bool
+elf_query_match_object( const elf_query_t * q, const elf_view_t * obj )
+{
+  qres_t stack[QUERY_STACK_TESTS];
+  qobj_t o;
+  bool   r = false;
+
+  qobj_results_init( & o, q, stack );
+  r = qmatch_view( q, obj, o.results, ELF_QUERY_IDENT );
+  qobj_results_free( & o, stack );
+  return r;
+}
+
+
+struct qmembers_s {
+  const elf_query_t * query;
+  qres_t            * results;  /* Of the file, unless it is an archive */
+  bool                found;
+};
+
+/**
+ * A plain ELF file is its only object, and resumes after the stages its
+ * identification ran; each archive member is a new object.
+ */
+  static void
+qmatch_member( const elf_view_t * obj, void * aux )
+{
+  struct qmembers_s * qm = (struct qmembers_s *) aux;
+
+  if ( qm->found ) return;
+  if ( ( qm->results != NULL ) && ( ! obj->member ) )
+    {
+      qm->found = qmatch_view( qm->query, obj, qm->results,
+                               ELF_QUERY_DYNAMIC
+                             );
+    }
+  else
+    {
+      qm->found = elf_query_match_object( qm->query, obj );
+    }
+}
+
+  bool
+elf_query_match_file( const elf_query_t  * q,
+                      const char         * fname,
+                      const file_class_t * fc
+                    )
+{
+  qobj_t            o  = { .fc = fc, .data = NULL, .size = 0,
+                           .archive = ( fc->kind == FILE_KIND_AR_ELF )
+                         };
+  struct qmembers_s qm = { .query = q, .results = NULL, .found = false };
+  qres_t            stack[QUERY_STACK_TESTS];
+  qres_t            r  = Q_MAYBE;
+
+  if ( ( fc->kind != FILE_KIND_ELF ) && ( fc->kind != FILE_KIND_AR_ELF ) )
+    {
+      return false;
+    }
+
+  /* Identification is at hand, only map files it leaves undecided. */
+  qobj_results_init( & o, q, stack );
+  r = qrun( q, & o, ELF_QUERY_IDENT, ELF_QUERY_HEADER );
+  if ( r == Q_MAYBE )
+    {
+      if ( fc->kind == FILE_KIND_ELF ) qm.results = o.results;
+      map_elf_objects( fname, qmatch_member, & qm );
+      r = qm.found ? Q_YES : Q_NO;
+    }
+  qobj_results_free( & o, stack );
+  return r == Q_YES;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
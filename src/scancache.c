@@ -0,0 +1,507 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <elf.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * On disk layout, in the writer's byte order:
+ *
+ *   sc_header_t                     Fixed header
+ *   uint32_t[nbuckets]              Hash of path -> record index + 1, 0 empty
+ *   sc_rec_t[nrecs]                 Records
+ *   char[strsize]                   Paths, NUL terminated
+ *
+ * Files written with a different version or byte order are ignored, as are
+ * any whose sections do not fit in the file.
+ */
+#define SCAN_CACHE_MAGIC    "AAELFSC"
+#define SCAN_CACHE_VERSION  1
+#define SCAN_CACHE_ENDIAN   0x01020304
+
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint64_t generation;  /* Incremented by every save */
+  uint64_t nrecs;
+  uint64_t nbuckets;    /* Power of two */
+  uint64_t strsize;
+} sc_header_t;
+
+typedef struct {
+  uint64_t hash;        /* Of the path */
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t size;
+  int64_t  mtime_ns;
+  uint64_t path_off;    /* Into the string pool */
+  uint64_t last_seen;   /* Generation which last visited the path */
+  uint32_t path_len;
+  uint8_t  kind;
+  uint8_t  ei_class;
+  uint8_t  ei_data;
+  uint8_t  pad;
+  uint16_t e_type;
+  uint16_t e_machine;
+  uint32_t pad2;
+} sc_rec_t;
+
+
+struct scan_cache {
+  char            * path;
+  /* Previous contents, mapped read-only. */
+  void            * map;
+  size_t            map_size;
+  uint64_t          generation;
+  const uint32_t  * buckets;
+  uint64_t          nbuckets;
+  const sc_rec_t  * recs;
+  uint64_t          nrecs;
+  const char      * strs;
+  uint64_t          strsize;
+  uint8_t         * superseded;  /* Per old record, set once revisited */
+  /* Records gathered during this run. */
+  pthread_mutex_t   lock;
+  sc_rec_t        * fresh;
+  size_t            nfresh;
+  size_t            fresh_cap;
+  obuf_t            fresh_strs;
+  size_t            hits;
+  size_t            misses;
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+  static int64_t
+sc_mtime_ns( const struct stat * st )
+{
+  return ( (int64_t) st->st_mtim.tv_sec * 1000000000 ) + st->st_mtim.tv_nsec;
+}
+
+  static bool
+sc_rec_matchp( const sc_rec_t * rec, const struct stat * st )
+{
+  return ( rec->dev == (uint64_t) st->st_dev ) &&
+         ( rec->ino == (uint64_t) st->st_ino ) &&
+         ( rec->size == (uint64_t) st->st_size ) &&
+         ( rec->mtime_ns == sc_mtime_ns( st ) );
+}
+
+/** Validate the mapped file and point the lookup tables into it. */
+  static bool
+sc_load( scan_cache_t * sc )
+{
+  const sc_header_t * hdr   = sc->map;
+  uint64_t            off   = sizeof( sc_header_t );
+  uint64_t            empty = 0;
+
+  if ( ( sc->map_size < sizeof( sc_header_t ) ) ||
+       ( memcmp( hdr->magic, SCAN_CACHE_MAGIC, sizeof( hdr->magic ) ) != 0 ) ||
+       ( hdr->version != SCAN_CACHE_VERSION ) ||
+       ( hdr->endian != SCAN_CACHE_ENDIAN ) ||
+       ( hdr->nbuckets == 0 ) ||
+       ( ( hdr->nbuckets & ( hdr->nbuckets - 1 ) ) != 0 ) ||
+       ( hdr->nbuckets > ( sc->map_size / sizeof( uint32_t ) ) ) ||
+       ( hdr->nrecs > ( sc->map_size / sizeof( sc_rec_t ) ) ) ||
+       ( hdr->nrecs >= hdr->nbuckets )
+     )
+    {
+      return false;
+    }
+
+  sc->buckets = (const uint32_t *) ( (const char *) sc->map + off );
+  off += hdr->nbuckets * sizeof( uint32_t );
+  sc->recs = (const sc_rec_t *) ( (const char *) sc->map + off );
+  off += hdr->nrecs * sizeof( sc_rec_t );
+  sc->strs = (const char *) sc->map + off;
+  if ( ( off > sc->map_size ) || ( hdr->strsize != ( sc->map_size - off ) ) )
+    {
+      return false;
+    }
+
+  /* Probes stop at the first empty bucket, so there must be one. */
+  for ( uint64_t b = 0; b < hdr->nbuckets; b++ )
+    {
+      if ( sc->buckets[b] > hdr->nrecs ) return false;
+      empty += ( sc->buckets[b] == 0 );
+    }
+  if ( empty == 0 ) return false;
+
+  /* Paths are used as C strings, and classes and encodings as shifts. */
+  for ( uint64_t i = 0; i < hdr->nrecs; i++ )
+    {
+      const sc_rec_t * rec = & sc->recs[i];
+      if ( ( rec->path_off > hdr->strsize ) ||
+           ( rec->path_len >= ( hdr->strsize - rec->path_off ) ) ||
+           ( sc->strs[rec->path_off + rec->path_len] != '\0' ) ||
+           ( rec->kind > FILE_KIND_AR_ELF ) ||
+           ( rec->ei_class > ELFCLASS64 ) ||
+           ( rec->ei_data > ELFDATA2MSB )
+         )
+        {
+          return false;
+        }
+    }
+
+  sc->generation = hdr->generation;
+  sc->nbuckets   = hdr->nbuckets;
+  sc->nrecs      = hdr->nrecs;
+  sc->strsize    = hdr->strsize;
+  sc->superseded = calloc( sc->nrecs + 1, 1 );
+  assert( sc->superseded != NULL );
+  return true;
+}
+
+
+  scan_cache_t *
+scan_cache_open( const char * path )
+{
+  scan_cache_t * sc = calloc( 1, sizeof( scan_cache_t ) );
+  struct stat    st;
+  int            fd = -1;
+
+  assert( sc != NULL );
+  sc->path = strdup( path );
+  assert( sc->path != NULL );
+  pthread_mutex_init( & sc->lock, NULL );
+  obuf_init( & sc->fresh_strs, 0 );
+
+  if ( ( fd = open( path, O_RDONLY | O_CLOEXEC ) ) == -1 )
+    {
+      if ( errno != ENOENT )
+        {
+          fprintf( stderr, "%s: %s\n", path, strerror( errno ) );
+        }
+      return sc;
+    }
+
+  if ( ( fstat( fd, & st ) == 0 ) && ( st.st_size > 0 ) )
+    {
+      sc->map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+      if ( sc->map == MAP_FAILED )
+        {
+          sc->map = NULL;
+        }
+      else
+        {
+          sc->map_size = st.st_size;
+          if ( ! sc_load( sc ) )
+            {
+              fprintf( stderr, "%s: ignoring invalid scan cache\n", path );
+              munmap( sc->map, sc->map_size );
+              sc->map      = NULL;
+              sc->map_size = 0;
+              sc->nrecs    = 0;
+            }
+        }
+    }
+  close( fd );
+
+  return sc;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Index of the old record for `path', or -1. */
+  static int64_t
+sc_find( const scan_cache_t * sc, const char * path, size_t len, uint64_t h )
+{
+  uint64_t mask = sc->nbuckets - 1;
+
+  if ( sc->nrecs == 0 ) return -1;
+
+  for ( uint64_t b = h & mask; sc->buckets[b] != 0; b = ( b + 1 ) & mask )
+    {
+      const sc_rec_t * rec = & sc->recs[sc->buckets[b] - 1];
+      if ( ( rec->hash == h ) && ( rec->path_len == len ) &&
+           ( memcmp( sc->strs + rec->path_off, path, len ) == 0 )
+         )
+        {
+          return sc->buckets[b] - 1;
+        }
+    }
+
+  return -1;
+}
+
+/** Record the result for `path' for the next save. */
+  static void
+sc_add( scan_cache_t       * sc,
+        const char         * path,
+        size_t               len,
+        uint64_t             h,
+        const struct stat  * st,
+        const file_class_t * fc,
+        bool                 hit
+      )
+{
+  sc_rec_t * rec = NULL;
+
+  pthread_mutex_lock( & sc->lock );
+  if ( sc->nfresh == sc->fresh_cap )
+    {
+      sc->fresh_cap = ( sc->fresh_cap == 0 ) ? 4096 : 2 * sc->fresh_cap;
+      sc->fresh     = realloc( sc->fresh, sizeof( sc_rec_t ) * sc->fresh_cap );
+      assert( sc->fresh != NULL );
+    }
+  rec = & sc->fresh[sc->nfresh++];
+  memset( rec, 0, sizeof( sc_rec_t ) );
+  rec->hash      = h;
+  rec->dev       = st->st_dev;
+  rec->ino       = st->st_ino;
+  rec->size      = st->st_size;
+  rec->mtime_ns  = sc_mtime_ns( st );
+  rec->path_off  = sc->fresh_strs.len;
+  rec->path_len  = len;
+  rec->kind      = fc->kind;
+  rec->ei_class  = fc->ei_class;
+  rec->ei_data   = fc->ei_data;
+  rec->e_type    = fc->e_type;
+  rec->e_machine = fc->e_machine;
+  obuf_append( & sc->fresh_strs, path, len + 1 );
+  if ( hit ) sc->hits++; else sc->misses++;
+  pthread_mutex_unlock( & sc->lock );
+}
+
+
+  file_kind_t
+scan_cache_classify( scan_cache_t * sc, const walk_ent_t * ent,
+                     file_class_t * fc
+                   )
+{
+  file_class_t        scratch;
+  struct stat         buf;
+  const struct stat * st  = NULL;
+  size_t              len = strlen( ent->path );
+  uint64_t            h   = hash_fnv1a( ent->path, len );
+  int64_t             idx = -1;
+
+  if ( fc == NULL ) fc = & scratch;
+
+  /* Only regular files can hold ELF data, and only they are recorded.
+   * Validating a record needs the size and modification time, which the
+   * traversal does not fetch. */
+  if ( ( ! S_ISREG( ent->type ) ) ||
+       ( ( st = walk_ent_stat( ent, & buf ) ) == NULL )
+     )
+    {
+      memset( fc, 0, sizeof( file_class_t ) );
+      return fc->kind = FILE_KIND_OTHER;
+    }
+
+  if ( ( idx = sc_find( sc, ent->path, len, h ) ) >= 0 )
+    {
+      const sc_rec_t * rec = & sc->recs[idx];
+      __atomic_store_n( & sc->superseded[idx], 1, __ATOMIC_RELAXED );
+      if ( sc_rec_matchp( rec, st ) )
+        {
+          fc->kind      = rec->kind;
+          fc->ei_class  = rec->ei_class;
+          fc->ei_data   = rec->ei_data;
+          fc->e_type    = rec->e_type;
+          fc->e_machine = rec->e_machine;
+          sc_add( sc, ent->path, len, h, st, fc, true );
+          return fc->kind;
+        }
+    }
+
+  *fc = *walk_ent_classify( ent, fc );
+  sc_add( sc, ent->path, len, h, st, fc, false );
+  return fc->kind;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static bool
+sc_write_all( int fd, const void * data, size_t len )
+{
+  const char * p = data;
+  while ( len > 0 )
+    {
+      ssize_t n = write( fd, p, len );
+      if ( n < 0 )
+        {
+          if ( errno == EINTR ) continue;
+          return false;
+        }
+      p   += n;
+      len -= n;
+    }
+  return true;
+}
+
+/**
+ * Write records seen during this run, along with old records which were not
+ * revisited but are younger than `SCAN_CACHE_MAX_AGE' generations, to a
+ * temporary file which then atomically replaces the cache.
+ * Concurrent runs each write their own file, so readers always observe a
+ * complete cache; the last to finish wins.
+ */
+  bool
+scan_cache_save( scan_cache_t * sc )
+{
+  sc_header_t   hdr;
+  char        * tmp     = NULL;
+  uint32_t    * buckets = NULL;
+  sc_rec_t    * recs    = NULL;
+  obuf_t        strs;
+  uint64_t      gen     = sc->generation + 1;
+  size_t        n       = 0;
+  int           fd      = -1;
+  bool          ok      = false;
+
+  pthread_mutex_lock( & sc->lock );
+
+  recs = malloc( sizeof( sc_rec_t ) * ( sc->nfresh + sc->nrecs + 1 ) );
+  assert( recs != NULL );
+  obuf_init( & strs, sc->fresh_strs.len + sc->strsize + 1 );
+
+  for ( size_t i = 0; i < sc->nfresh; i++ )
+    {
+      recs[n] = sc->fresh[i];
+      recs[n].last_seen = gen;
+      recs[n].path_off  = strs.len;
+      obuf_append( & strs, sc->fresh_strs.buf + sc->fresh[i].path_off,
+                   sc->fresh[i].path_len + 1
+                 );
+      n++;
+    }
+  for ( uint64_t i = 0; i < sc->nrecs; i++ )
+    {
+      if ( sc->superseded[i] ||
+           ( ( gen - sc->recs[i].last_seen ) > SCAN_CACHE_MAX_AGE )
+         )
+        {
+          continue;
+        }
+      recs[n] = sc->recs[i];
+      recs[n].path_off = strs.len;
+      obuf_append( & strs, sc->strs + sc->recs[i].path_off,
+                   sc->recs[i].path_len + 1
+                 );
+      n++;
+    }
+
+  memset( & hdr, 0, sizeof( hdr ) );
+  memcpy( hdr.magic, SCAN_CACHE_MAGIC, sizeof( hdr.magic ) );
+  hdr.version    = SCAN_CACHE_VERSION;
+  hdr.endian     = SCAN_CACHE_ENDIAN;
+  hdr.generation = gen;
+  hdr.nrecs      = n;
+  hdr.strsize    = strs.len;
+  for ( hdr.nbuckets = 16; hdr.nbuckets < ( 2 * n + 1 ); hdr.nbuckets <<= 1 );
+
+  buckets = calloc( hdr.nbuckets, sizeof( uint32_t ) );
+  assert( buckets != NULL );
+  for ( size_t i = 0; i < n; i++ )
+    {
+      uint64_t b = recs[i].hash & ( hdr.nbuckets - 1 );
+      while ( buckets[b] != 0 ) b = ( b + 1 ) & ( hdr.nbuckets - 1 );
+      buckets[b] = i + 1;
+    }
+
+  if ( asprintf( & tmp, "%s.XXXXXX", sc->path ) < 0 ) tmp = NULL;
+  if ( ( tmp != NULL ) && ( ( fd = mkostemp( tmp, O_CLOEXEC ) ) != -1 ) )
+    {
+      ok = sc_write_all( fd, & hdr, sizeof( hdr ) ) &&
+           sc_write_all( fd, buckets, hdr.nbuckets * sizeof( uint32_t ) ) &&
+           sc_write_all( fd, recs, n * sizeof( sc_rec_t ) ) &&
+           sc_write_all( fd, strs.buf, strs.len ) &&
+           ( fchmod( fd, 0644 ) == 0 ) &&
+           ( fsync( fd ) == 0 );
+      close( fd );
+      if ( ok ) ok = ( rename( tmp, sc->path ) == 0 );
+      if ( ! ok ) unlink( tmp );
+    }
+  if ( ! ok ) fprintf( stderr, "%s: %s\n", sc->path, strerror( errno ) );
+
+  pthread_mutex_unlock( & sc->lock );
+
+  free( tmp );
+  free( buckets );
+  free( recs );
+  obuf_free( & strs );
+  return ok;
+}
+
+
+/**
+ * Re-`stat' every old record which has not been revisited in this run,
+ * dropping those whose file changed or disappeared, then save.
+ */
+  bool
+scan_cache_compact( scan_cache_t * sc )
+{
+  struct stat  st;
+  file_class_t fc;
+
+  for ( uint64_t i = 0; i < sc->nrecs; i++ )
+    {
+      const sc_rec_t * rec  = & sc->recs[i];
+      const char     * path = sc->strs + rec->path_off;
+      if ( sc->superseded[i] ) continue;
+      sc->superseded[i] = 1;
+      if ( ( stat( path, & st ) != 0 ) || ( ! sc_rec_matchp( rec, & st ) ) )
+        {
+          continue;
+        }
+      fc.kind      = rec->kind;
+      fc.ei_class  = rec->ei_class;
+      fc.ei_data   = rec->ei_data;
+      fc.e_type    = rec->e_type;
+      fc.e_machine = rec->e_machine;
+      sc_add( sc, path, rec->path_len, rec->hash, & st, & fc, true );
+    }
+
+  return scan_cache_save( sc );
+}
+
+
+  void
+scan_cache_counts( scan_cache_t * sc, size_t * hits, size_t * misses )
+{
+  pthread_mutex_lock( & sc->lock );
+  if ( hits != NULL ) *hits = sc->hits;
+  if ( misses != NULL ) *misses = sc->misses;
+  pthread_mutex_unlock( & sc->lock );
+}
+
+
+  void
+scan_cache_close( scan_cache_t * sc )
+{
+  if ( sc->map != NULL ) munmap( sc->map, sc->map_size );
+  free( sc->superseded );
+  free( sc->fresh );
+  obuf_free( & sc->fresh_strs );
+  pthread_mutex_destroy( & sc->lock );
+  free( sc->path );
+  free( sc );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
@@ -0,0 +1,180 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+static const char * const phase_names[STATS_NPHASES] = {
+  "walk", "dedupe", "classify", "archive", "symbols"
+};
+
+#ifdef AA_ELF_STATS
+
+bool stats_enabled = false;
+
+/**
+ * Every thread's counters, linked so they outlive their threads and can be
+ * merged at the end.
+ */
+typedef struct stats_node {
+  stats_t             stats;
+  struct stats_node * next;
+} stats_node_t;
+
+static stats_node_t    * stats_all  = NULL;
+static pthread_mutex_t   stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread stats_t * stats_self = NULL;
+
+
+  stats_t *
+stats_local( void )
+{
+  stats_node_t * node = NULL;
+
+  if ( stats_self != NULL ) return stats_self;
+
+  node = calloc( 1, sizeof( stats_node_t ) );
+  assert( node != NULL );
+  pthread_mutex_lock( & stats_lock );
+  node->next = stats_all;
+  stats_all  = node;
+  pthread_mutex_unlock( & stats_lock );
+
+  stats_self = & node->stats;
+  return stats_self;
+}
+
+
+  uint64_t
+stats_now_ns( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, & ts );
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#endif /* AA_ELF_STATS */
+
+
+/* -------------------------------------------------------------------------- */
+
+  bool
+stats_enable( void )
+{
+#ifdef AA_ELF_STATS
+  stats_enabled = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+  void
+stats_collect( stats_t * total )
+{
+  memset( total, 0, sizeof( stats_t ) );
+#ifdef AA_ELF_STATS
+  pthread_mutex_lock( & stats_lock );
+  for ( stats_node_t * n = stats_all; n != NULL; n = n->next )
+    {
+      total->files       += n->stats.files;
+      total->dirs        += n->stats.dirs;
+      total->opens       += n->stats.opens;
+      total->bytes_read  += n->stats.bytes_read;
+      total->mmaps       += n->stats.mmaps;
+      total->archives    += n->stats.archives;
+      total->members     += n->stats.members;
+      total->dedupe_hits += n->stats.dedupe_hits;
+      total->batches     += n->stats.batches;
+      total->batch_depth += n->stats.batch_depth;
+      for ( int q = 0; q < ELF_QUERY_NSTAGES; q++ )
+        {
+          total->query_decided[q] += n->stats.query_decided[q];
+        }
+      for ( int p = 0; p < STATS_NPHASES; p++ )
+        {
+          total->phase_ns[p] += n->stats.phase_ns[p];
+        }
+    }
+  pthread_mutex_unlock( & stats_lock );
+#endif
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  void
+stats_print( FILE * out, const stats_t * stats, bool json )
+{
+  const struct { const char * name; uint64_t value; } counts[] = {
+    { "files",       stats->files       },
+    { "dirs",        stats->dirs        },
+    { "opens",       stats->opens       },
+    { "bytes_read",  stats->bytes_read  },
+    { "mmaps",       stats->mmaps       },
+    { "archives",    stats->archives    },
+    { "members",     stats->members     },
+    { "dedupe_hits", stats->dedupe_hits },
+    { "batches",     stats->batches     },
+    { "batch_depth", stats->batch_depth },
+    /* Objects a query decided at each stage, see `elf_query_stage_t'. */
+    { "query_ident",    stats->query_decided[ELF_QUERY_IDENT]    },
+    { "query_header",   stats->query_decided[ELF_QUERY_HEADER]   },
+    { "query_dynamic",  stats->query_decided[ELF_QUERY_DYNAMIC]  },
+    { "query_sections", stats->query_decided[ELF_QUERY_SECTIONS] },
+    { "query_symbols",  stats->query_decided[ELF_QUERY_SYMBOLS]  }
+  };
+  const size_t ncounts = sizeof( counts ) / sizeof( counts[0] );
+
+  if ( json )
+    {
+      fputc( '{', out );
+      for ( size_t i = 0; i < ncounts; i++ )
+        {
+          fprintf( out, "\"%s\":%llu,", counts[i].name,
+                   (unsigned long long) counts[i].value
+                 );
+        }
+      fputs( "\"phase_seconds\":{", out );
+      for ( int p = 0; p < STATS_NPHASES; p++ )
+        {
+          fprintf( out, "%s\"%s\":%.6f", ( p == 0 ) ? "" : ",",
+                   phase_names[p], stats->phase_ns[p] * 1e-9
+                 );
+        }
+      fputs( "}}\n", out );
+      return;
+    }
+
+  for ( size_t i = 0; i < ncounts; i++ )
+    {
+      fprintf( out, "%-16s %14llu\n", counts[i].name,
+               (unsigned long long) counts[i].value
+             );
+    }
+  /* Phases are summed over threads, so may exceed the elapsed time. */
+  for ( int p = 0; p < STATS_NPHASES; p++ )
+    {
+      fprintf( out, "%-16s %14.6fs\n", phase_names[p],
+               stats->phase_ns[p] * 1e-9
+             );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
@@ -0,0 +1,682 @@
+/* -*- mode: c; -*- */
+
+/* ========================================================================== */
+
+#include "aa-elf-util.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <elf.h>
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * On disk layout, in the writer's byte order:
+ *
+ *   si_header_t                     Fixed header
+ *   si_sym_t[nsyms]                 Symbols, sorted by name
+ *   uint64_t[nobjs]                 Object names, as string pool offsets
+ *   uint32_t[npostings]             Defining objects of each symbol
+ *   char[strsize]                   Names, NUL terminated
+ *
+ * Each symbol owns the run of `npost' postings starting at `post_off'.
+ * A posting is an object index, with `SI_POSTING_WEAK' set if the object's
+ * definition is weak; runs are sorted by object name.
+ * Objects are likewise sorted by name, so the index does not depend on the
+ * order in which objects were added.
+ */
+#define SYM_INDEX_MAGIC    "AAELFSI"
+#define SYM_INDEX_VERSION  1
+#define SYM_INDEX_ENDIAN   0x01020304
+
+#define SI_POSTING_WEAK    0x80000000U
+
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint64_t nsyms;
+  uint64_t nobjs;
+  uint64_t npostings;
+  uint64_t strsize;
+} si_header_t;
+
+typedef struct {
+  uint64_t name_off;
+  uint32_t post_off;
+  uint32_t npost;
+} si_sym_t;
+
+
+/* -------------------------------------------------------------------------- */
+
+/** A definition of symbol `sym' by object `obj', both builder ids. */
+typedef struct {
+  uint32_t sym;
+  uint32_t obj;  /* With `SI_POSTING_WEAK' */
+} si_pair_t;
+
+typedef struct {
+  uint64_t hash;
+  uint32_t id;   /* Symbol id + 1, 0 if empty */
+} si_slot_t;
+
+struct sym_index_builder {
+  pthread_mutex_t   lock;
+  obuf_t            strs;       /* Interned names */
+  si_slot_t       * slots;      /* Name -> symbol id */
+  size_t            nslots;     /* Power of two */
+  uint64_t        * sym_offs;   /* Symbol id -> offset into `strs' */
+  size_t            nsyms;
+  size_t            syms_cap;
+  uint64_t        * obj_offs;   /* Object id -> offset into `strs' */
+  size_t            nobjs;
+  size_t            objs_cap;
+  si_pair_t       * pairs;
+  size_t            npairs;
+  size_t            pairs_cap;
+};
+
+
+  static void *
+si_grow( void * arr, size_t * cap, size_t elsize, size_t init )
+{
+  *cap = ( *cap == 0 ) ? init : 2 * *cap;
+  arr  = realloc( arr, elsize * *cap );
+  assert( arr != NULL );
+  return arr;
+}
+
+
+  sym_index_builder_t *
+sym_index_builder_new( void )
+{
+  sym_index_builder_t * b = calloc( 1, sizeof( sym_index_builder_t ) );
+  assert( b != NULL );
+  pthread_mutex_init( & b->lock, NULL );
+  obuf_init( & b->strs, 0 );
+  b->nslots = 1 << 16;
+  b->slots  = calloc( b->nslots, sizeof( si_slot_t ) );
+  assert( b->slots != NULL );
+  return b;
+}
+
+  static void
+si_rehash( sym_index_builder_t * b )
+{
+  size_t      nslots = 2 * b->nslots;
+  si_slot_t * slots  = calloc( nslots, sizeof( si_slot_t ) );
+
+  assert( slots != NULL );
+  for ( size_t i = 0; i < b->nslots; i++ )
+    {
+      size_t s = b->slots[i].hash & ( nslots - 1 );
+      if ( b->slots[i].id == 0 ) continue;
+      while ( slots[s].id != 0 ) s = ( s + 1 ) & ( nslots - 1 );
+      slots[s] = b->slots[i];
+    }
+  free( b->slots );
+  b->slots  = slots;
+  b->nslots = nslots;
+}
+
+/** Symbol id of `name', adding it if needed. Called with `b->lock' held. */
+  static uint32_t
+si_intern( sym_index_builder_t * b, const char * name )
+{
+  uint64_t h    = hash_fnv1a( name, strlen( name ) );
+  size_t   mask = b->nslots - 1;
+  size_t   s    = h & mask;
+
+  for ( ; b->slots[s].id != 0; s = ( s + 1 ) & mask )
+    {
+      uint32_t id = b->slots[s].id - 1;
+      if ( ( b->slots[s].hash == h ) &&
+           ( strcmp( b->strs.buf + b->sym_offs[id], name ) == 0 )
+         )
+        {
+          return id;
+        }
+    }
+
+  if ( b->nsyms == b->syms_cap )
+    {
+      b->sym_offs = si_grow( b->sym_offs, & b->syms_cap, sizeof( uint64_t ),
+                             4096
+                           );
+    }
+  b->sym_offs[b->nsyms] = b->strs.len;
+  obuf_append( & b->strs, name, strlen( name ) + 1 );
+  b->slots[s].hash = h;
+  b->slots[s].id   = ++b->nsyms;
+
+  if ( ( 4 * b->nsyms ) >= ( 3 * b->nslots ) ) si_rehash( b );
+  return b->nsyms - 1;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+  const char * name;
+  bool         weak;
+} si_export_t;
+
+typedef struct {
+  si_export_t * ents;
+  size_t        count;
+  size_t        cap;
+} si_exports_t;
+
+  static void
+si_collect_export( const elf_sym_t * sym, void * aux )
+{
+  si_exports_t * ex = (si_exports_t *) aux;
+  if ( ! elf_sym_exportp( sym ) ) return;
+  if ( ex->count == ex->cap )
+    {
+      ex->ents = si_grow( ex->ents, & ex->cap, sizeof( si_export_t ), 256 );
+    }
+  ex->ents[ex->count].name = sym->name;
+  ex->ents[ex->count].weak = ( ELF64_ST_BIND( sym->info ) == STB_WEAK );
+  ex->count++;
+}
+
+/**
+ * Symbols are gathered from the view without holding the lock, then interned
+ * in one batch, so workers only serialize on the final bookkeeping.
+ */
+  void
+sym_index_add( sym_index_builder_t * b, const elf_view_t * obj )
+{
+  si_exports_t ex     = { NULL, 0, 0 };
+  uint32_t     obj_id = 0;
+
+  /* Linked objects are usually stripped down to their dynamic symbols. */
+  if ( ! elf_map_syms( obj->data, obj->size, SHT_SYMTAB, si_collect_export,
+                       & ex
+                     )
+     )
+    {
+      elf_map_syms( obj->data, obj->size, SHT_DYNSYM, si_collect_export,
+                    & ex
+                  );
+    }
+
+  if ( ex.count == 0 ) return;
+
+  pthread_mutex_lock( & b->lock );
+
+  if ( b->nobjs == b->objs_cap )
+    {
+      b->obj_offs = si_grow( b->obj_offs, & b->objs_cap, sizeof( uint64_t ),
+                             1024
+                           );
+    }
+  obj_id = b->nobjs++;
+  b->obj_offs[obj_id] = b->strs.len;
+  obuf_append( & b->strs, obj->name, strlen( obj->name ) + 1 );
+
+  for ( size_t i = 0; i < ex.count; i++ )
+    {
+      if ( b->npairs == b->pairs_cap )
+        {
+          b->pairs = si_grow( b->pairs, & b->pairs_cap, sizeof( si_pair_t ),
+                              16384
+                            );
+        }
+      b->pairs[b->npairs].sym = si_intern( b, ex.ents[i].name );
+      b->pairs[b->npairs].obj = obj_id |
+                                ( ex.ents[i].weak ? SI_POSTING_WEAK : 0 );
+      b->npairs++;
+    }
+
+  pthread_mutex_unlock( & b->lock );
+
+  free( ex.ents );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+  const char * name;
+  uint32_t     id;
+} si_named_t;
+
+  static int
+si_named_cmp( const void * a, const void * b )
+{
+  return strcmp( ( (const si_named_t *) a )->name,
+                 ( (const si_named_t *) b )->name
+               );
+}
+
+  static int
+si_pair_cmp( const void * a, const void * b )
+{
+  const si_pair_t * x = a;
+  const si_pair_t * y = b;
+  uint32_t          xo = x->obj & ~SI_POSTING_WEAK;
+  uint32_t          yo = y->obj & ~SI_POSTING_WEAK;
+  if ( x->sym != y->sym ) return ( x->sym < y->sym ) ? -1 : 1;
+  if ( xo != yo ) return ( xo < yo ) ? -1 : 1;
+  if ( x->obj != y->obj ) return ( x->obj < y->obj ) ? -1 : 1;
+  return 0;
+}
+
+/** Sort `count' names found at `offs' in `strs', returning id -> rank. */
+  static uint32_t *
+si_rank( const char * strs, const uint64_t * offs, size_t count,
+         si_named_t ** sorted
+       )
+{
+  si_named_t * named = malloc( sizeof( si_named_t ) * ( count + 1 ) );
+  uint32_t   * rank  = malloc( sizeof( uint32_t ) * ( count + 1 ) );
+
+  assert( ( named != NULL ) && ( rank != NULL ) );
+  for ( size_t i = 0; i < count; i++ )
+    {
+      named[i].name = strs + offs[i];
+      named[i].id   = i;
+    }
+  qsort( named, count, sizeof( si_named_t ), si_named_cmp );
+  for ( size_t i = 0; i < count; i++ ) rank[named[i].id] = i;
+
+  *sorted = named;
+  return rank;
+}
+
+  static bool
+si_write_all( int fd, const void * data, size_t len )
+{
+  const char * p = data;
+  while ( len > 0 )
+    {
+      ssize_t n = write( fd, p, len );
+      if ( n < 0 )
+        {
+          if ( errno == EINTR ) continue;
+          return false;
+        }
+      p   += n;
+      len -= n;
+    }
+  return true;
+}
+
+/**
+ * Symbols and objects are renumbered in name order, and each symbol's
+ * definitions sorted by object; a symbol defined more than once by the same
+ * object keeps a single posting, which is weak only if every definition is.
+ * The index is written to a temporary file which then atomically replaces
+ * `path'.
+ */
+  bool
+sym_index_write( sym_index_builder_t * b, const char * path )
+{
+  si_header_t   hdr;
+  si_named_t  * syms     = NULL;
+  si_named_t  * objs     = NULL;
+  uint32_t    * sym_rank = NULL;
+  uint32_t    * obj_rank = NULL;
+  si_sym_t    * out_syms = NULL;
+  uint64_t    * out_objs = NULL;
+  uint32_t    * postings = NULL;
+  obuf_t        strs;
+  char        * tmp      = NULL;
+  size_t        npost    = 0;
+  int           fd       = -1;
+  bool          ok       = false;
+
+  pthread_mutex_lock( & b->lock );
+
+  if ( ( b->nsyms > UINT32_MAX ) || ( b->npairs > UINT32_MAX ) ||
+       ( b->nobjs >= SI_POSTING_WEAK )
+     )
+    {
+      fprintf( stderr, "%s: too many symbols to index\n", path );
+      pthread_mutex_unlock( & b->lock );
+      return false;
+    }
+
+  sym_rank = si_rank( b->strs.buf, b->sym_offs, b->nsyms, & syms );
+  obj_rank = si_rank( b->strs.buf, b->obj_offs, b->nobjs, & objs );
+
+  for ( size_t i = 0; i < b->npairs; i++ )
+    {
+      uint32_t weak = b->pairs[i].obj & SI_POSTING_WEAK;
+      b->pairs[i].sym = sym_rank[b->pairs[i].sym];
+      b->pairs[i].obj = obj_rank[b->pairs[i].obj & ~SI_POSTING_WEAK] | weak;
+    }
+  qsort( b->pairs, b->npairs, sizeof( si_pair_t ), si_pair_cmp );
+
+  out_syms = calloc( b->nsyms + 1, sizeof( si_sym_t ) );
+  out_objs = calloc( b->nobjs + 1, sizeof( uint64_t ) );
+  postings = calloc( b->npairs + 1, sizeof( uint32_t ) );
+  assert( ( out_syms != NULL ) && ( out_objs != NULL ) && ( postings != NULL )
+        );
+  obuf_init( & strs, b->strs.len + 1 );
+
+  for ( size_t i = 0; i < b->nsyms; i++ )
+    {
+      out_syms[i].name_off = strs.len;
+      obuf_append( & strs, syms[i].name, strlen( syms[i].name ) + 1 );
+    }
+  for ( size_t i = 0; i < b->nobjs; i++ )
+    {
+      out_objs[i] = strs.len;
+      obuf_append( & strs, objs[i].name, strlen( objs[i].name ) + 1 );
+    }
+
+  for ( size_t i = 0; i < b->npairs; i++ )
+    {
+      const si_pair_t * p   = & b->pairs[i];
+      si_sym_t        * sym = & out_syms[p->sym];
+      if ( sym->npost == 0 )
+        {
+          sym->post_off = npost;
+        }
+      else if ( ( postings[npost - 1] & ~SI_POSTING_WEAK ) ==
+                ( p->obj & ~SI_POSTING_WEAK )
+              )
+        {
+          /* Strong definitions sort first, and take precedence. */
+          continue;
+        }
+      postings[npost++] = p->obj;
+      sym->npost++;
+    }
+
+  memset( & hdr, 0, sizeof( hdr ) );
+  memcpy( hdr.magic, SYM_INDEX_MAGIC, sizeof( hdr.magic ) );
+  hdr.version   = SYM_INDEX_VERSION;
+  hdr.endian    = SYM_INDEX_ENDIAN;
+  hdr.nsyms     = b->nsyms;
+  hdr.nobjs     = b->nobjs;
+  hdr.npostings = npost;
+  hdr.strsize   = strs.len;
+
+  if ( asprintf( & tmp, "%s.XXXXXX", path ) < 0 ) tmp = NULL;
+  if ( ( tmp != NULL ) && ( ( fd = mkostemp( tmp, O_CLOEXEC ) ) != -1 ) )
+    {
+      ok = si_write_all( fd, & hdr, sizeof( hdr ) ) &&
+           si_write_all( fd, out_syms, b->nsyms * sizeof( si_sym_t ) ) &&
+           si_write_all( fd, out_objs, b->nobjs * sizeof( uint64_t ) ) &&
+           si_write_all( fd, postings, npost * sizeof( uint32_t ) ) &&
+           si_write_all( fd, strs.buf, strs.len ) &&
+           ( fchmod( fd, 0644 ) == 0 ) &&
+           ( fsync( fd ) == 0 );
+      close( fd );
+      if ( ok ) ok = ( rename( tmp, path ) == 0 );
+      if ( ! ok ) unlink( tmp );
+    }
+  if ( ! ok ) fprintf( stderr, "%s: %s\n", path, strerror( errno ) );
+
+  /* Pairs were renumbered in place, so the builder is spent. */
+  b->npairs = 0;
+  pthread_mutex_unlock( & b->lock );
+
+  free( tmp );
+  free( syms );
+  free( objs );
+  free( sym_rank );
+  free( obj_rank );
+  free( out_syms );
+  free( out_objs );
+  free( postings );
+  obuf_free( & strs );
+  return ok;
+}
+
+
+  void
+sym_index_builder_free( sym_index_builder_t * b )
+{
+  pthread_mutex_destroy( & b->lock );
+  obuf_free( & b->strs );
+  free( b->slots );
+  free( b->sym_offs );
+  free( b->obj_offs );
+  free( b->pairs );
+  free( b );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+struct sym_index {
+  void            * map;
+  size_t            map_size;
+  const si_sym_t  * syms;
+  uint64_t          nsyms;
+  const uint64_t  * objs;
+  uint64_t          nobjs;
+  const uint32_t  * postings;
+  uint64_t          npostings;
+  const char      * strs;
+  uint64_t          strsize;
+};
+
+
+/**
+ * Only the header and section bounds are checked here, so opening costs the
+ * same regardless of the index size; entries are bounds checked as lookups
+ * reach them.
+ * A string pool ending in NUL makes every in-bounds offset a valid string.
+ */
+  static bool
+si_load( sym_index_t * si )
+{
+  const si_header_t * hdr  = si->map;
+  uint64_t            off  = sizeof( si_header_t );
+  uint64_t            left = 0;
+
+  if ( si->map_size < sizeof( si_header_t ) ) return false;
+  left = si->map_size - off;
+
+  if ( ( memcmp( hdr->magic, SYM_INDEX_MAGIC, sizeof( hdr->magic ) ) != 0 ) ||
+       ( hdr->version != SYM_INDEX_VERSION ) ||
+       ( hdr->endian != SYM_INDEX_ENDIAN ) ||
+       ( hdr->nsyms > ( left / sizeof( si_sym_t ) ) )
+     )
+    {
+      return false;
+    }
+
+  si->syms = (const si_sym_t *) ( (const char *) si->map + off );
+  off  += hdr->nsyms * sizeof( si_sym_t );
+  left -= hdr->nsyms * sizeof( si_sym_t );
+  if ( hdr->nobjs > ( left / sizeof( uint64_t ) ) ) return false;
+
+  si->objs = (const uint64_t *) ( (const char *) si->map + off );
+  off  += hdr->nobjs * sizeof( uint64_t );
+  left -= hdr->nobjs * sizeof( uint64_t );
+  if ( hdr->npostings > ( left / sizeof( uint32_t ) ) ) return false;
+
+  si->postings = (const uint32_t *) ( (const char *) si->map + off );
+  off  += hdr->npostings * sizeof( uint32_t );
+  left -= hdr->npostings * sizeof( uint32_t );
+  if ( ( hdr->strsize != left ) ||
+       ( ( left > 0 ) && ( ( (const char *) si->map )[si->map_size - 1] != 0 ) )
+     )
+    {
+      return false;
+    }
+
+  si->strs      = (const char *) si->map + off;
+  si->nsyms     = hdr->nsyms;
+  si->nobjs     = hdr->nobjs;
+  si->npostings = hdr->npostings;
+  si->strsize   = hdr->strsize;
+  return true;
+}
+
+
+  sym_index_t *
+sym_index_open( const char * path )
+{
+  sym_index_t * si = calloc( 1, sizeof( sym_index_t ) );
+  struct stat   st;
+  int           fd = -1;
+
+  assert( si != NULL );
+
+  if ( ( fd = open( path, O_RDONLY | O_CLOEXEC ) ) == -1 )
+    {
+      fprintf( stderr, "%s: %s\n", path, strerror( errno ) );
+      free( si );
+      return NULL;
+    }
+
+  if ( ( fstat( fd, & st ) == 0 ) && ( st.st_size > 0 ) )
+    {
+      si->map = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+      if ( si->map == MAP_FAILED ) si->map = NULL;
+      else si->map_size = st.st_size;
+    }
+  close( fd );
+
+  if ( ( si->map == NULL ) || ( ! si_load( si ) ) )
+    {
+      fprintf( stderr, "%s: not a symbol index\n", path );
+      sym_index_close( si );
+      return NULL;
+    }
+
+  return si;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static const char *
+si_str( const sym_index_t * si, uint64_t off )
+{
+  return ( off < si->strsize ) ? ( si->strs + off ) : NULL;
+}
+
+/** Index of the first symbol whose name does not sort before `name'. */
+  static uint64_t
+si_lower_bound( const sym_index_t * si, const char * name )
+{
+  uint64_t lo = 0;
+  uint64_t hi = si->nsyms;
+
+  while ( lo < hi )
+    {
+      uint64_t     mid = lo + ( hi - lo ) / 2;
+      const char * str = si_str( si, si->syms[mid].name_off );
+      if ( ( str != NULL ) && ( strcmp( str, name ) < 0 ) ) lo = mid + 1;
+      else hi = mid;
+    }
+
+  return lo;
+}
+
+/** Apply `fn' to each definer of symbol `i', returning how many there were. */
+  static size_t
+si_map_definers( const sym_index_t * si, uint64_t i, do_definer_fn fn,
+                 void * aux
+               )
+{
+  const si_sym_t * sym  = & si->syms[i];
+  const char     * name = si_str( si, sym->name_off );
+  size_t           n    = 0;
+
+  if ( ( name == NULL ) ||
+       ( ( (uint64_t) sym->post_off + sym->npost ) > si->npostings )
+     )
+    {
+      return 0;
+    }
+
+  for ( uint32_t p = 0; p < sym->npost; p++ )
+    {
+      uint32_t     post = si->postings[sym->post_off + p];
+      uint32_t     obj  = post & ~SI_POSTING_WEAK;
+      const char * oname = ( obj < si->nobjs ) ? si_str( si, si->objs[obj] )
+                                               : NULL;
+      if ( oname == NULL ) continue;
+      fn( name, oname, ( post & SI_POSTING_WEAK ) != 0, aux );
+      n++;
+    }
+
+  return n;
+}
+
+
+  size_t
+sym_index_lookup( const sym_index_t * si, const char * name,
+                  do_definer_fn fn, void * aux
+                )
+{
+  uint64_t     i   = si_lower_bound( si, name );
+  const char * str = NULL;
+
+  if ( ( i >= si->nsyms ) ||
+       ( ( str = si_str( si, si->syms[i].name_off ) ) == NULL ) ||
+       ( strcmp( str, name ) != 0 )
+     )
+    {
+      return 0;
+    }
+
+  return si_map_definers( si, i, fn, aux );
+}
+
+
+  size_t
+sym_index_lookup_prefix( const sym_index_t * si, const char * prefix,
+                         do_definer_fn fn, void * aux
+                       )
+{
+  size_t       len = strlen( prefix );
+  size_t       n   = 0;
+  const char * str = NULL;
+
+  for ( uint64_t i = si_lower_bound( si, prefix );
+        ( i < si->nsyms ) &&
+        ( ( str = si_str( si, si->syms[i].name_off ) ) != NULL ) &&
+        ( strncmp( str, prefix, len ) == 0 );
+        i++
+      )
+    {
+      n += si_map_definers( si, i, fn, aux );
+    }
+
+  return n;
+}
+
+
+  void
+sym_index_counts( const sym_index_t * si, size_t * nsyms, size_t * nobjs )
+{
+  if ( nsyms != NULL ) *nsyms = si->nsyms;
+  if ( nobjs != NULL ) *nobjs = si->nobjs;
+}
+
+
+  void
+sym_index_close( sym_index_t * si )
+{
+  if ( si->map != NULL ) munmap( si->map, si->map_size );
+  free( si );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */
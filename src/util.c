@@ -12,10 +12,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
-#include <fts.h>
+#include <sys/sysmacros.h>
 #include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <time.h>
 
 
 /* -------------------------------------------------------------------------- */
@@ -41,673 +45,1576 @@ validate_libelf_version( void )
 /* -------------------------------------------------------------------------- */
 
 /**
- * Note that this return `true' for Object Files, Shared Objects, Executables,
- * and ( most importantly ) for AR archives containing Object Files as well!
- *
- * Actually `arelfp' is pretty redundant, because we could just check the output
- * of `elf_kind' to distinguish between AR archives and the other types.
+ * Validates the identification bytes of an ELF header and records its class,
+ * data encoding, type and machine, with `FILE_KIND_ELF' as its kind.
+ * `e_type' and `e_machine' sit at the same offsets for both classes.
  */
-  bool
-elfp( const char * fname )
+  static bool
+classify_ehdr( const unsigned char * buf, size_t len, file_class_t * fc )
 {
-  Elf_Kind k = ELF_K_NONE;
-  Elf * e = NULL;
-  int fd = open( fname, O_RDONLY );
-
-  if ( fd == -1 )  /* Failed to open file. */
+  if ( ( len < ( EI_NIDENT + 4 ) ) ||
+       ( memcmp( buf, ELFMAG, SELFMAG ) != 0 ) ||
+       ( ( buf[EI_CLASS] != ELFCLASS32 ) && ( buf[EI_CLASS] != ELFCLASS64 ) ) ||
+       ( ( buf[EI_DATA] != ELFDATA2LSB ) && ( buf[EI_DATA] != ELFDATA2MSB ) )
+     )
     {
       return false;
     }
 
-  e = elf_begin( fd, ELF_C_READ, (Elf *) NULL );
-  if ( e == NULL )  /* Not an ELF file. */
+  fc->kind     = FILE_KIND_ELF;
+  fc->ei_class = buf[EI_CLASS];
+  fc->ei_data  = buf[EI_DATA];
+  if ( buf[EI_DATA] == ELFDATA2LSB )
     {
-      //printf( "%s\n", elf_errmsg( elf_errno() ) );
-      close( fd );
-      return false;
+      fc->e_type    = buf[EI_NIDENT]     | ( buf[EI_NIDENT + 1] << 8 );
+      fc->e_machine = buf[EI_NIDENT + 2] | ( buf[EI_NIDENT + 3] << 8 );
+    }
+  else
+    {
+      fc->e_type    = ( buf[EI_NIDENT]     << 8 ) | buf[EI_NIDENT + 1];
+      fc->e_machine = ( buf[EI_NIDENT + 2] << 8 ) | buf[EI_NIDENT + 3];
     }
 
-  k = elf_kind( e );
+  return true;
+}
 
-  elf_end( e );
-  e = NULL;
-  close( fd );
 
-  return ( k == ELF_K_ELF );
+/** Detect if the file at path `fname' has ELF format. */
+  bool
+elfp( const char * fname )
+{
+  return classify_path( fname, NULL ) == FILE_KIND_ELF;
 }
 
 
 /* -------------------------------------------------------------------------- */
 
-#define AR_MAGIC      "!<arch>"
-#define AR_MAGIC_SIZE ( sizeof( AR_MAGIC ) - 1 )
-
   bool
 arp( const char * fname )
 {
-  char buf[AR_MAGIC_SIZE];
-  FILE * f = fopen( fname, "rb" );
-  fread( & buf, AR_MAGIC_SIZE, 1, f );
-  fclose( f );
-  return ( memcmp( buf, AR_MAGIC, AR_MAGIC_SIZE ) == 0 );
+  file_kind_t k = classify_path( fname, NULL );
+  return ( k == FILE_KIND_AR ) || ( k == FILE_KIND_AR_ELF );
 }
 
-typedef struct {
-  char   name[PATH_MAX];
-  time_t date;
-  uid_t  uid;
-  gid_t  gid;
-  mode_t mode;
-  off_t  size;
-  union {
-    char raw[60];
-    struct {
-      char name[16];
-      char date[12];
-      char uid[6];
-      char gid[6];
-      char mode[8];
-      char size[10];
-      char magic[2];
-    } formatted;
-  } buf;
-} ar_member_t;
 
-typedef struct {
-        int      fd;
-  const char   * fname;
-        size_t   skip;
-        char   * extfn;
-        bool     verbose;
-} ar_handle_t;
+/* -------------------------------------------------------------------------- */
 
+/**
+ * Search the members of the archive open on `fd' for one with an ELF header,
+ * recording its identification in `fc'.
+ * Members are inspected in place within a single mapping of the archive.
+ * When the first member is not ELF, archives made by `ar s' or `ranlib'
+ * answer from the member holding the first symbol of their index, so only a
+ * few headers are read; others, and those whose indexed member is not ELF,
+ * are walked.
+ */
   static bool
-ar_open_fd( const char * filename, int fd, ar_handle_t * handle, bool verbose )
+ar_find_elf_member( const char * fname, int fd, file_class_t * fc )
 {
-	char buf[AR_MAGIC_SIZE];
+  ar_iter_t       ar;
+  ar_armap_iter_t syms;
+  ar_sym_t        sym;
+  ar_ent_t        ent;
+  struct stat     st;
+  unsigned char * base   = NULL;
+  size_t          resume = 0;
+  bool            found  = false;
+
+  if ( ( fstat( fd, & st ) != 0 ) || ( st.st_size <= 0 ) ) return false;
+
+  base = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  if ( base == MAP_FAILED ) return false;
+  STATS_ADD( mmaps, 1 );
+  STATS_ADD( archives, 1 );
+  /* Only a few headers are read, readahead around them would be wasted. */
+  madvise( base, st.st_size, MADV_RANDOM );
+
+  STATS_START( t0 );
+  ar_iter_init( & ar, base, st.st_size, fname, true );
+  /* The index, if any, is recorded on the way to the first member. */
+  if ( ar_iter_next( & ar, & ent ) )
+    {
+      STATS_ADD( members, 1 );
+      found = classify_ehdr( base + ent.offset, ent.size, fc );
+    }
+  resume = ar.pos;
+  if ( ( ! found ) && ar_armap_iter_init( & syms, & ar ) &&
+       ar_armap_iter_next( & syms, & sym ) &&
+       ar_iter_member_at( & ar, sym.member, & ent )
+     )
+    {
+      STATS_ADD( members, 1 );
+      found = classify_ehdr( base + ent.offset, ent.size, fc );
+    }
+  ar.pos = resume;
+  while ( ( ! found ) && ar_iter_next( & ar, & ent ) )
+    {
+      STATS_ADD( members, 1 );
+      found = classify_ehdr( base + ent.offset, ent.size, fc );
+    }
+  STATS_STOP( STATS_PHASE_ARCHIVE, t0 );
 
-	if ( ( read( fd, buf, AR_MAGIC_SIZE ) != AR_MAGIC_SIZE ) ||
-	     ( strncmp( buf, AR_MAGIC, AR_MAGIC_SIZE ) != 0 )
-     ) return false;
+  munmap( base, st.st_size );
+  return found;
+}
 
-	handle->fname   = filename;
-	handle->fd      = fd;
-	handle->skip    = 0;
-	handle->extfn   = NULL;
-	handle->verbose = verbose;
 
-	return true;
+  bool
+arelfp( const char * fname )
+{
+  return classify_path( fname, NULL ) == FILE_KIND_AR_ELF;
 }
 
-  static bool
-ar_open( const char * filename, ar_handle_t * handle, bool verbose )
+
+/* -------------------------------------------------------------------------- */
+
+  file_kind_t
+classify_header( const void * buf, size_t len, int fd, const char * fname,
+                 file_class_t * fc
+               )
 {
-	int fd = -1;
+  file_class_t scratch;
 
-	if ( ( fd = open( filename, O_RDONLY ) ) == -1 )
-    {
-      fprintf( stderr, "%s: could not open\n", filename);
-    }
+  if ( fc == NULL ) fc = & scratch;
+  memset( fc, 0, sizeof( file_class_t ) );
+  fc->kind = FILE_KIND_OTHER;
+
+  if ( len > CLASSIFY_PEEK_SIZE ) len = CLASSIFY_PEEK_SIZE;
+  if ( len == 0 ) return fc->kind;
 
-	if ( ! ar_open_fd( filename, fd, handle, verbose ) )
+  if ( ( ! classify_ehdr( buf, len, fc ) ) && ( len >= AR_MAGIC_SIZE ) &&
+       ( memcmp( buf, AR_MAGIC, AR_MAGIC_SIZE ) == 0 )
+     )
     {
-      close( fd );
-      return false;
+      fc->kind = ar_find_elf_member( fname, fd, fc ) ? FILE_KIND_AR_ELF
+                                                      : FILE_KIND_AR;
     }
 
-	return true;
+  return fc->kind;
 }
 
-  static bool
-ar_next( ar_handle_t * ar, ar_member_t * member )
+
+  file_kind_t
+classify_fd( int fd, const char * fname, file_class_t * fc )
 {
-	char    * s   = NULL;
-	ssize_t   len = 0;
+  unsigned char buf[CLASSIFY_PEEK_SIZE];
+  ssize_t       len = pread( fd, buf, sizeof( buf ), 0 );
 
-	if ( ar->skip && lseek( ar->fd, ar->skip, SEEK_CUR ) == -1 )
-    {
-    close_and_ret:
-      free( ar->extfn );
-      close( ar->fd );
-      ar->extfn = NULL;
-      ar->fd    = -1;
-      return false;
-    }
+  if ( len > 0 ) STATS_ADD( bytes_read, len );
+  return classify_header( buf, ( len > 0 ) ? len : 0, fd, fname, fc );
+}
 
-	if ( read( ar->fd, member->buf.raw,
-             sizeof( member->buf.raw )
-           ) != sizeof( member->buf.raw )
-     )
-    {
-      goto close_and_ret;
-    }
 
-	/* ar header starts on an even byte (2 byte aligned)
-	 * '\n' is used for padding */
-	if ( member->buf.raw[0] == '\n' )
-    {
-      memmove( member->buf.raw, member->buf.raw + 1, 59 );
-      if ( read( ar->fd, member->buf.raw + 59, 1 ) != 1 ) goto close_and_ret;
-    }
+  file_kind_t
+classify_path( const char * fname, file_class_t * fc )
+{
+  file_kind_t k  = FILE_KIND_OTHER;
+  int         fd = -1;
 
-	if ( ( member->buf.formatted.magic[0] != '`' ) ||
-       ( member->buf.formatted.magic[1] != '\n' )
-     )
+  STATS_START( t0 );
+  STATS_ADD( opens, 1 );
+  /* `O_NONBLOCK' keeps FIFOs from stalling the traversal. */
+  fd = open( fname, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK );
+
+  if ( fd == -1 )  /* Failed to open file. */
     {
-      /* When dealing with corrupt or random embedded cross-compilers, they may
-       * be abusing the archive format; only complain when in verbose mode. */
-      if ( ar->verbose )
+      if ( fc != NULL )
         {
-          fprintf( stderr, "%s: invalid ar entry\n", ar->fname );
+          memset( fc, 0, sizeof( file_class_t ) );
+          fc->kind = FILE_KIND_OTHER;
         }
-      goto close_and_ret;
+      STATS_STOP( STATS_PHASE_CLASSIFY, t0 );
+      return FILE_KIND_OTHER;
     }
 
-	if ( ( member->buf.formatted.name[0] == '/' ) &&
-       ( member->buf.formatted.name[1] == '/' )
-     )
-    {
-      if ( ar->extfn != NULL )
-        {
-          fprintf( stderr,
-                   "%s: Duplicate GNU extended filename section\n",
-                   ar->fname
-                 );
-          goto close_and_ret;
-        }
+  k = classify_fd( fd, fname, fc );
+  close( fd );
+  STATS_STOP( STATS_PHASE_CLASSIFY, t0 );
+  return k;
+}
 
-      len = atoi( member->buf.formatted.size );
-      ar->extfn = malloc( sizeof( char ) * ( len + 1 ) );
-      assert( ar->extfn != NULL );  /* FIXME */
 
-      if ( read( ar->fd, ar->extfn, len ) != len ) goto close_and_ret;
-      ar->extfn[len--] = '\0';
-      for (; len > 0; len--)
-        {
-          if ( ar->extfn[len] == '\n' ) ar->extfn[len] = '\0';
-        }
-      ar->skip = 0;
-      return ar_next( ar, member );
+/* -------------------------------------------------------------------------- */
+
+  void
+do_print_elf_objects( const char * fpath, void * _unused )
+{
+  file_kind_t k = classify_path( fpath, NULL );
+  if ( ( k == FILE_KIND_ELF ) || ( k == FILE_KIND_AR_ELF ) )
+    {
+      /* We have a hit! */
+      printf( "%s\n", fpath );
     }
+}
 
-	s = member->buf.formatted.name;
-	if ( ( s[0] == '#' ) && ( s[1] == '1' ) && ( s[2] == '/' ) )
+
+  void
+print_elfs_recur( char * const * paths, int pathc )
+{
+  map_opts_t opts = { .nthreads = 0, .concurrent = true };
+  print_elfs_recur_opts( paths, pathc, & opts, NULL, NULL, NULL, OUT_TEXT );
+}
+
+
+struct print_elfs_aux_s {
+  scan_cache_t       * cache;
+  const elf_filter_t * filter;
+  const elf_query_t  * query;
+  out_writer_t       * out;
+};
+
+/**
+ * Directories are never passed to `classify_path' here, sparing an `open'
+ * for each of them.
+ * The filter only needs the identification gathered while classifying, so
+ * it costs no further reads.
+ * The writer takes whole records, so lines never interleave.
+ */
+  static void
+do_print_elf_entry( const walk_ent_t * ent, void * aux )
+{
+  struct print_elfs_aux_s * pa = (struct print_elfs_aux_s *) aux;
+  file_class_t              fc = { .kind = FILE_KIND_OTHER };
+
+  if ( pa->cache != NULL )
     {
-      /* BSD extended filename, always in use on Darwin */
-      len = atoi( s + 3 );
-      if ( len <= (ssize_t) sizeof( member->buf.formatted.name ) )
-        {
-          if ( read( ar->fd, member->buf.formatted.name, len ) != len )
-            {
-              goto close_and_ret;
-            }
-        }
-      else
-        {
-          s = alloca( sizeof( char ) * len + 1 );
-          if ( read( ar->fd, s, len ) != len ) goto close_and_ret;
-          s[len] = '\0';
-        }
+      scan_cache_classify( pa->cache, ent, & fc );
     }
-  else if ( ( s[0] == '/' ) && ( s[1] >= '0' ) && ( s[1] <= '9' ) )
+  else if ( ! S_ISDIR( ent->type ) )
     {
-      /* GNU extended filename */
-      if ( ar->extfn == NULL )
-        {
-          fprintf( stderr,
-                   "%s: GNU extended filename without special data section\n",
-                   ar->fname
-                 );
-          goto close_and_ret;
-        }
-      s = ar->extfn + atoi( s + 1 );
+      fc = *walk_ent_classify( ent, & fc );
     }
 
-	snprintf( member->name, sizeof( member->name ), "%s:%s", ar->fname, s );
-	member->name[sizeof( member->name ) - 1] = '\0';
-	if ( ( s = strchr( member->name + strlen( ar->fname ), '/' ) ) != NULL )
+  if ( ( ( fc.kind == FILE_KIND_ELF ) || ( fc.kind == FILE_KIND_AR_ELF ) ) &&
+       ( ( pa->filter == NULL ) || elf_filter_match( pa->filter, & fc ) ) &&
+       ( ( pa->query == NULL ) ||
+         elf_query_match_file( pa->query, ent->path, & fc )
+       )
+     )
     {
-      *s = '\0';
+      out_rec_t rec = { .path = ent->path, .member = NULL, .fc = & fc,
+                        .symbol = NULL
+                      };
+      out_writer_put( pa->out, & rec );
     }
-	member->date = atoi( member->buf.formatted.date );
-	member->uid  = atoi( member->buf.formatted.uid );
-	member->gid  = atoi( member->buf.formatted.gid );
-	member->mode = strtol( member->buf.formatted.mode, NULL, 8 );
-	member->size = atoi( member->buf.formatted.size );
-	ar->skip = member->size - len;
+}
+
+  bool
+print_elfs_recur_opts( char       * const * paths,
+                       int                  pathc,
+                       const map_opts_t   * opts,
+                       scan_cache_t       * cache,
+                       const elf_filter_t * filter,
+                       const elf_query_t  * query,
+                       out_format_t         fmt
+                     )
+{
+  struct print_elfs_aux_s pa   = { cache, filter, query, NULL };
+  map_opts_t              mine;
 
-	return true;
+  /* Batches would classify files the cache answers for. */
+  if ( ( cache != NULL ) && ( opts != NULL ) && opts->classify )
+    {
+      mine          = *opts;
+      mine.classify = false;
+      opts          = & mine;
+    }
+  pa.out = out_writer_new( STDOUT_FILENO, fmt );
+  map_entries_recur_opts( paths, pathc, do_print_elf_entry, & pa, opts );
+  return out_writer_close( pa.out );
 }
 
 
+
 /* -------------------------------------------------------------------------- */
 
-  bool
-arelfp( const char * fname )
+/** A directory waiting to be read, with the device holding it. */
+typedef struct {
+  char  * path;
+  dev_t   dev;
+} walk_dir_t;
+
+/**
+ * Where a directory reader sends what it finds: `mark' records an inode as
+ * visited, returning true if it already was, `apply' runs the user's
+ * callback, and `push' queues a subdirectory, taking ownership of its path.
+ * Files are held back until their directory has been read when `io_order' is
+ * set, or `classify_depth' is not 0, which is then the depth of the thread's
+ * `classify_batch_t', whose thread pool is `classify_pool' if not NULL.
+ * Files held for classification are kept across directories until they fill
+ * a batch, see `walk_buf_duep'.
+ */
+typedef struct {
+  bool                 (*mark)( void * self, dev_t, ino_t );
+  void                 (*apply)( void * self, const walk_ent_t * ent );
+  void                 (*push)( void * self, char * path, dev_t dev );
+  void                 * self;
+  const char * const   * prune;           /* As in `map_opts_t' */
+  bool                   io_order;        /* As in `map_opts_t' */
+  unsigned               classify_depth;
+  classify_pool_t      * classify_pool;
+} walk_sink_t;
+
+/** Room for a few hundred entries per `getdents64' call. */
+#define WALK_DENTS_SIZE ( 32 * 1024 )
+
+/** A file held back until its directory has been read. */
+typedef struct {
+  size_t   path;  /* Offset of its path in `walk_buf_t.names' */
+  mode_t   type;
+  dev_t    dev;
+  ino_t    ino;
+  int      fd;    /* Opened ahead of its visit by `io_order', or -1 */
+} walk_held_t;
+
+/**
+ * Scratch space of one walking thread, reused for every directory it reads.
+ * The path of each entry is built in `path' by appending its name to the
+ * directory's and truncating it back afterwards, so visiting a file costs no
+ * allocation; only subdirectories get a copy, when they are queued.
+ * Held files keep their paths in `names', and their classification in `fcs',
+ * which only grow when more files are held than ever before.
+ */
+typedef struct {
+  char               * path;
+  size_t               cap;
+  char               * dents;  /* `WALK_DENTS_SIZE' bytes for `getdents64' */
+  walk_held_t        * held;
+  size_t               nheld;
+  size_t               held_cap;
+  size_t               nreg;        /* Regular files among `held' */
+  uint64_t             held_since;  /* When the first was held, in ns */
+  char               * names;
+  size_t               names_len;
+  size_t               names_cap;
+  const char        ** paths;  /* `held_cap' entries each */
+  file_class_t       * fcs;
+  classify_batch_t   * batch;  /* Created on first use */
+} walk_buf_t;
+
+  static void
+walk_buf_init( walk_buf_t * wb )
 {
-  ElfW(Ehdr)    header;
-  ar_handle_t   handle;
-  ar_member_t   member;
-  struct stat   st;
-  char        * ar_buffer = NULL;
+  wb->cap   = PATH_MAX;
+  wb->path  = malloc( wb->cap );
+  wb->dents = malloc( WALK_DENTS_SIZE );
+  assert( ( wb->path != NULL ) && ( wb->dents != NULL ) );
+  wb->held       = NULL;
+  wb->nheld      = 0;
+  wb->held_cap   = 0;
+  wb->nreg       = 0;
+  wb->held_since = 0;
+  wb->names      = NULL;
+  wb->names_len  = 0;
+  wb->names_cap  = 0;
+  wb->paths      = NULL;
+  wb->fcs        = NULL;
+  wb->batch      = NULL;
+}
 
-  if ( ! ar_open( fname, & handle, true ) ) return false;
+/** Make room for a path of `len' characters. */
+  static void
+walk_buf_reserve( walk_buf_t * wb, size_t len )
+{
+  if ( len < wb->cap ) return;
+  while ( wb->cap <= len ) wb->cap <<= 1;
+  wb->path = realloc( wb->path, wb->cap );
+  assert( wb->path != NULL );
+}
 
-  fstat( handle.fd, & st );
+  static void
+walk_buf_free( walk_buf_t * wb )
+{
+  free( wb->path );
+  free( wb->dents );
+  free( wb->held );
+  free( wb->names );
+  free( wb->paths );
+  free( wb->fcs );
+  if ( wb->batch != NULL ) classify_batch_free( wb->batch );
+}
 
-  ar_buffer = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, handle.fd, 0 );
+/**
+ * Files kept in flight by the `classify_batch_t' of each of `nworkers'
+ * walking threads, which share `WALK_CLASSIFY_DEPTH' between them; only
+ * walkers beyond that many get more, one each.
+ * Without `io_uring', their batches share a single pool of helpers.
+ */
+#define WALK_CLASSIFY_DEPTH  256
 
-  while ( ar_next( & handle, & member ) )
-    {
-      off_t cur_pos = lseek( handle.fd, 0, SEEK_CUR );
-      assert( cur_pos != -1 );  /* FIXME */
-      if ( member.size < sizeof( header ) ) continue;
-      memcpy( & header, ( ar_buffer + cur_pos ), sizeof( header ) );
-      if ( memcmp( header.e_ident, ELFMAG, SELFMAG ) == 0 )
-        {
-          munmap( ar_buffer, st.st_size );
-          free( handle.extfn );
-          handle.extfn = NULL;
-          close( handle.fd );
-          handle.fd = -1;
-          return true;
-        }
-    }
+  static unsigned
+walk_classify_depth( const map_opts_t * opts, int nworkers )
+{
+  unsigned depth = WALK_CLASSIFY_DEPTH / nworkers;
+  if ( ( opts == NULL ) || ( ! opts->classify ) ) return 0;
+  return ( depth == 0 ) ? 1 : depth;
+}
 
-  munmap( ar_buffer, st.st_size );
-  return false;
+/**
+ * Files held for classification wait at most this long, in nanoseconds, for
+ * enough others to fill a batch, so that a walk through sparse directories
+ * still hands them over promptly.
+ */
+#define WALK_HOLD_NS  ( 20 * 1000000 )
+
+  static uint64_t
+walk_now_ns( void )
+{
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, & ts );
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
+/** Hold back the file `ent', whose path is in `wb->path', until later. */
+  static void
+walk_buf_hold( walk_buf_t * wb, const walk_ent_t * ent )
+{
+  size_t len = strlen( wb->path ) + 1;
 
-/* -------------------------------------------------------------------------- */
+  if ( wb->nheld == 0 ) wb->held_since = walk_now_ns();
+  if ( S_ISREG( ent->type ) ) wb->nreg++;
 
-/** Used to track inodes which have been visited on a device. */
-typedef struct _dev_lst {
-  dev_t             dev; 
-  ino_t           * nodes;
-  size_t            ncnt;
-  size_t            ncap;
-  struct _dev_lst * nxt;
-} dev_lst;
+  if ( wb->nheld == wb->held_cap )
+    {
+      wb->held_cap = ( wb->held_cap == 0 ) ? 256 : 2 * wb->held_cap;
+      wb->held     = realloc( wb->held, sizeof( walk_held_t ) * wb->held_cap );
+      wb->paths    = realloc( wb->paths, sizeof( char * ) * wb->held_cap );
+      wb->fcs      = realloc( wb->fcs, sizeof( file_class_t ) * wb->held_cap );
+      assert( ( wb->held != NULL ) && ( wb->paths != NULL ) &&
+              ( wb->fcs != NULL )
+            );
+    }
+  if ( ( wb->names_len + len ) > wb->names_cap )
+    {
+      if ( wb->names_cap == 0 ) wb->names_cap = 16 * 1024;
+      while ( ( wb->names_len + len ) > wb->names_cap ) wb->names_cap <<= 1;
+      wb->names = realloc( wb->names, wb->names_cap );
+      assert( wb->names != NULL );
+    }
 
-#define DEV_LST_DEFAULT_SIZE 256
+  wb->held[wb->nheld].path  = wb->names_len;
+  wb->held[wb->nheld].type  = ent->type;
+  wb->held[wb->nheld].dev   = ent->dev;
+  wb->held[wb->nheld].ino   = ent->ino;
+  wb->held[wb->nheld++].fd  = -1;
+  memcpy( wb->names + wb->names_len, wb->path, len );
+  wb->names_len += len;
+}
 
 /**
- * Mark the file corresponding to the Device/Inode indicated as "visited".
- * Return true if the given file had already been visited previously.
+ * Detect if the files `wb' holds should be visited once the current directory
+ * has been read.
+ * Without classification they always are; otherwise only once they fill the
+ * batch's `classify_depth', or the first of them has waited `WALK_HOLD_NS',
+ * since directories of a few files each would never keep the batch busy.
  */
-static bool dev_lst_mark( dev_lst *, dev_t, ino_t ) __attribute__(( nonnull ));
-static void dev_lst_realloc( dev_lst *, size_t ) __attribute__(( nonnull ));
-static void dev_lst_free( dev_lst * ) __attribute__(( nonnull ));
+  static bool
+walk_buf_duep( const walk_buf_t * wb, const walk_sink_t * sink )
+{
+  return ( sink->classify_depth == 0 ) ||
+         ( wb->nreg >= sink->classify_depth ) ||
+         ( ( walk_now_ns() - wb->held_since ) >= WALK_HOLD_NS );
+}
 
-  static void
-dev_lst_realloc( dev_lst * elem, size_t nsize )
+/* Type and inode never change, so cached attributes are good enough. */
+#define WALK_STATX_FLAGS  ( AT_NO_AUTOMOUNT | AT_STATX_DONT_SYNC )
+#define WALK_STATX_MASK   ( STATX_TYPE | STATX_INO )
+
+/**
+ * Describe the entry `de' of the directory open on `dfd', which lives on
+ * device `ddev'.
+ *
+ * Entries of known type other than directories and symlinks are described
+ * from `d_type' and `d_ino' alone; they cannot be mount points, so share the
+ * directory's device.
+ * Others are `statx'ed for their type and inode only: directories for their
+ * device, which differs below mount points, and symlinks or entries of
+ * unknown type for their target, which is followed as `FTS_LOGICAL' would.
+ * Dangling symlinks are described by the link itself.
+ * Returns false if the entry vanished.
+ */
+  static bool
+walk_dirent( int dfd, dev_t ddev, const struct dirent64 * de,
+             walk_ent_t * ent
+           )
 {
-  if ( ( elem->nodes == NULL ) || ( elem->ncnt == 0 ) )
+  struct statx stx;
+
+  ent->st = NULL;
+  ent->fc = NULL;
+  ent->fd = -1;
+  if ( ( de->d_type != DT_DIR ) && ( de->d_type != DT_LNK ) &&
+       ( de->d_type != DT_UNKNOWN )
+     )
     {
-      elem->nodes = malloc( sizeof( ino_t ) * nsize );
+      ent->type = DTTOIF( de->d_type );
+      ent->dev  = ddev;
+      ent->ino  = de->d_ino;
+      return true;
     }
-  else
+
+  if ( ( statx( dfd, de->d_name, WALK_STATX_FLAGS, WALK_STATX_MASK, & stx )
+         != 0 ) &&
+       ( statx( dfd, de->d_name, WALK_STATX_FLAGS | AT_SYMLINK_NOFOLLOW,
+                WALK_STATX_MASK, & stx
+              ) != 0 )
+     )
     {
-      elem->nodes = realloc( elem->nodes, sizeof( ino_t ) * nsize );
+      return false;
     }
-  assert( elem->nodes != NULL );
-  elem->ncap = nsize;
+  ent->type = stx.stx_mode & S_IFMT;
+  ent->dev  = makedev( stx.stx_dev_major, stx.stx_dev_minor );
+  ent->ino  = stx.stx_ino;
+  return true;
 }
 
+/** Detect if the directory at `path', named `name', matches `prune'. */
   static bool
-dev_lst_mark( dev_lst * dlst, dev_t dev, ino_t ino )
+walk_prunedp( const char * const * prune, const char * path,
+              const char * name
+            )
+{
+  for ( ; *prune != NULL; prune++ )
+    {
+      const char * subject = ( strchr( *prune, '/' ) != NULL ) ? path : name;
+      if ( fnmatch( *prune, subject, FNM_PERIOD ) == 0 ) return true;
+    }
+  return false;
+}
+
+  bool
+map_prunedp( const char * const * prune, const char * path )
+{
+  const char * name = strrchr( path, '/' );
+  return walk_prunedp( prune, path, ( name == NULL ) ? path : ( name + 1 ) );
+}
+
+/** Describe a root of the traversal, which is always fully `stat'ed. */
+  static void
+walk_root_ent( const char * path, const struct stat * st, walk_ent_t * ent )
+{
+  ent->path = path;
+  ent->st   = st;
+  ent->fc   = NULL;
+  ent->fd   = -1;
+  ent->type = st->st_mode & S_IFMT;
+  ent->dev  = st->st_dev;
+  ent->ino  = st->st_ino;
+}
+
+/**
+ * Classification reads `CLASSIFY_PEEK_SIZE' bytes, one page covers them and
+ * the headers of most objects.
+ */
+#define WALK_HINT_SIZE 4096
+
+/**
+ * Files `io_order' keeps open ahead of the one being visited, with their
+ * first page requested; enough for the device to sort its reads, few enough
+ * to stay well within the descriptor limit.
+ */
+#define WALK_PREFETCH_FILES 128
+
+  static int
+walk_held_cmp( const void * a, const void * b )
 {
-  /* Find the device corresponding to `dev' if it exists */
-  while ( ( dlst != NULL ) && ( dlst->nxt != NULL ) && ( dlst->dev != dev ) )
+  ino_t ia = ( (const walk_held_t *) a )->ino;
+  ino_t ib = ( (const walk_held_t *) b )->ino;
+  return ( ia < ib ) ? -1 : ( ia > ib );
+}
+
+/**
+ * Visit the files `wb' held back while reading the directory open on `dfd',
+ * whose path with a trailing `/' is `dlen' bytes long.
+ * With `classify_depth' they may come from several directories, and `dfd' is
+ * not used.
+ *
+ * With `io_order', inode numbers being the only hint of on-disk placement
+ * known without a further system call per file, files are sorted by them.
+ * Unless the files are about to be classified, which reads them anyway,
+ * regular files are then opened up to `WALK_PREFETCH_FILES' ahead of their
+ * visit, and their first page requested with `POSIX_FADV_WILLNEED', which
+ * queues the read without waiting for it, so the device may service them in
+ * one sweep while earlier files are visited.  The descriptor is handed over
+ * in `walk_ent_t.fd', so classifying the file does not open it again.
+ *
+ * With `classify_depth' regular files are classified as one batch.
+ */
+  static void
+walk_release_held( walk_buf_t * wb, int dfd, size_t dlen,
+                   const walk_sink_t * sink
+                 )
+{
+  walk_ent_t ent;
+  size_t     nreg     = 0;
+  size_t     ahead    = 0;
+  bool       prefetch = sink->io_order && ( sink->classify_depth == 0 );
+
+  if ( sink->io_order )
     {
-      dlst = dlst->nxt;
+      qsort( wb->held, wb->nheld, sizeof( walk_held_t ), walk_held_cmp );
     }
-  if ( dlst->dev == dev )  /* Device was found */
+
+  if ( sink->classify_depth > 0 )
     {
-      for ( size_t i = 0; i < dlst->ncnt; i++ )  /* Find the inode */
+      for ( size_t i = 0; i < wb->nheld; i++ )
         {
-          if ( dlst->nodes[i] == ino ) return true;
+          if ( ! S_ISREG( wb->held[i].type ) ) continue;
+          wb->paths[nreg++] = wb->names + wb->held[i].path;
         }
-      /* Inode not found, add it. Doubling size of inode list if needed. */
-      if ( dlst->ncap <= ( dlst->ncnt + 1 ) )
+      if ( wb->batch == NULL )
         {
-          dev_lst_realloc( dlst, 2 * dlst->ncap );
+          wb->batch = classify_batch_new( sink->classify_depth, true,
+                                          sink->classify_pool
+                                        );
         }
-      dlst->nodes[dlst->ncnt++] = ino;
-    }
-  else  /* A new device was found, add it to the device list */
-    {
-      assert( dlst->nxt == NULL );
-      dlst->nxt = malloc( sizeof( dev_lst ) );
-      assert( dlst->nxt != NULL );
-      dlst = dlst->nxt;
-      dlst->dev   = dev;
-      dlst->nodes = NULL;
-      dlst->ncnt  = 0;
-      dlst->nxt   = NULL;
-      dev_lst_realloc( dlst, DEV_LST_DEFAULT_SIZE );
-      dlst->nodes[0] = ino;
-      dlst->ncnt++;
+      classify_batch_run( wb->batch, wb->paths, nreg, wb->fcs );
     }
-  return false;
+
+  ent.st = NULL;
+  nreg   = 0;
+  for ( size_t i = 0; i < wb->nheld; i++ )
+    {
+      for ( ; prefetch && ( ahead < wb->nheld ) &&
+              ( ahead < ( i + WALK_PREFETCH_FILES ) );
+            ahead++
+          )
+        {
+          walk_held_t * h = & wb->held[ahead];
+          if ( ! S_ISREG( h->type ) ) continue;
+          h->fd = openat( dfd, wb->names + h->path + dlen,
+                          O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK
+                        );
+          STATS_ADD( opens, 1 );
+          if ( h->fd == -1 ) continue;
+          posix_fadvise( h->fd, 0, WALK_HINT_SIZE, POSIX_FADV_WILLNEED );
+        }
+
+      ent.path = wb->names + wb->held[i].path;
+      ent.type = wb->held[i].type;
+      ent.dev  = wb->held[i].dev;
+      ent.ino  = wb->held[i].ino;
+      ent.fd   = wb->held[i].fd;
+      ent.fc   = NULL;
+      if ( ( sink->classify_depth > 0 ) && S_ISREG( ent.type ) )
+        {
+          ent.fc = & wb->fcs[nreg++];
+        }
+      STATS_ADD( files, 1 );
+      sink->apply( sink->self, & ent );
+      if ( ent.fd != -1 ) close( ent.fd );
+    }
+
+  wb->nheld     = 0;
+  wb->nreg      = 0;
+  wb->names_len = 0;
 }
 
+/**
+ * Read the directory `dpath' with `getdents64', handing each child not yet
+ * visited to `sink', and queueing subdirectories through it.
+ * With `sink->io_order' or `sink->classify_depth' files are only handed over
+ * once the whole directory has been read, see `walk_release_held', and with
+ * the latter maybe only after later directories, see `walk_buf_duep'.
+ * Children's paths are built in `wb', which must not hold `dpath'.
+ */
   static void
-dev_lst_free( dev_lst * dlst )
+walk_read_dir( walk_buf_t * wb, const char * dpath, dev_t ddev,
+               const walk_sink_t * sink
+             )
 {
-  free( dlst->nodes );
-  dlst->nodes = NULL;
-  if ( dlst->nxt != NULL )
+  size_t          dlen  = strlen( dpath );
+  size_t          nlen  = 0;
+  ssize_t         n     = 0;
+  bool            seen  = false;
+  int             dfd   = -1;
+  walk_ent_t      ent;
+
+  /* Time spent in `apply' is restarted over, it charges its own phases. */
+  STATS_START( t0 );
+
+  dfd = open( dpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOCTTY );
+  if ( dfd == -1 )
     {
-      dev_lst_free( dlst->nxt );
-      dlst->nxt = NULL;
+      fprintf( stderr, "%s: %s\n", dpath, strerror( errno ) );
+      return;
     }
-  free( dlst );
-}
+  STATS_ADD( dirs, 1 );
 
+  walk_buf_reserve( wb, dlen + 1 );
+  memcpy( wb->path, dpath, dlen );
+  if ( ( dlen == 0 ) || ( dpath[dlen - 1] != '/' ) ) wb->path[dlen++] = '/';
 
-/* -------------------------------------------------------------------------- */
+  while ( ( n = getdents64( dfd, wb->dents, WALK_DENTS_SIZE ) ) > 0 )
+    {
+      const struct dirent64 * de = NULL;
+      for ( ssize_t off = 0; off < n; off += de->d_reclen )
+        {
+          de = (const struct dirent64 *) ( wb->dents + off );
+          if ( ( strcmp( de->d_name, "." ) == 0 ) ||
+               ( strcmp( de->d_name, ".." ) == 0 ) ||
+               ( ! walk_dirent( dfd, ddev, de, & ent ) )
+             )
+            {
+              continue;
+            }
 
-  void
-do_print_elf_objects( const char * fpath, void * _unused )
-{
-  if ( elfp( fpath ) || arelfp( fpath ) )
+          nlen = strlen( de->d_name );
+          walk_buf_reserve( wb, dlen + nlen );
+          memcpy( wb->path + dlen, de->d_name, nlen + 1 );
+          if ( S_ISDIR( ent.type ) && ( sink->prune != NULL ) &&
+               walk_prunedp( sink->prune, wb->path, de->d_name )
+             )
+            {
+              continue;
+            }
+          STATS_LAP( STATS_PHASE_WALK, t0 );
+
+          seen = sink->mark( sink->self, ent.dev, ent.ino );
+          STATS_LAP( STATS_PHASE_DEDUPE, t0 );
+          if ( seen )
+            {
+              STATS_ADD( dedupe_hits, 1 );
+              continue;
+            }
+
+          if ( ( sink->io_order || ( sink->classify_depth > 0 ) ) &&
+               ( ! S_ISDIR( ent.type ) )
+             )
+            {
+              walk_buf_hold( wb, & ent );
+              continue;
+            }
+
+          ent.path = wb->path;
+          if ( ! S_ISDIR( ent.type ) ) STATS_ADD( files, 1 );
+          sink->apply( sink->self, & ent );
+          STATS_RESTART( t0 );
+
+          if ( S_ISDIR( ent.type ) )
+            {
+              char * copy = strdup( wb->path );
+              assert( copy != NULL );
+              sink->push( sink->self, copy, ent.dev );  /* Takes ownership */
+            }
+        }
+    }
+  if ( n < 0 ) fprintf( stderr, "%s: %s\n", dpath, strerror( errno ) );
+
+  if ( ( wb->nheld > 0 ) && walk_buf_duep( wb, sink ) )
     {
-      /* We have a hit! */
-      printf( "%s\n", fpath );
+      STATS_LAP( STATS_PHASE_WALK, t0 );
+      walk_release_held( wb, dfd, dlen, sink );
+      STATS_RESTART( t0 );
     }
+
+  close( dfd );
+  STATS_STOP( STATS_PHASE_WALK, t0 );
 }
 
 
-  void
-print_elfs_recur( char * const * paths, int pathc )
+  const struct stat *
+walk_ent_stat( const walk_ent_t * ent, struct stat * buf )
 {
-  map_files_recur( paths, pathc, do_print_elf_objects, NULL );
+  if ( ent->st != NULL ) return ent->st;
+  if ( ent->fd != -1 ) return ( fstat( ent->fd, buf ) == 0 ) ? buf : NULL;
+  if ( ( stat( ent->path, buf ) != 0 ) && ( lstat( ent->path, buf ) != 0 ) )
+    {
+      return NULL;
+    }
+  return buf;
 }
 
 
+  const file_class_t *
+walk_ent_classify( const walk_ent_t * ent, file_class_t * buf )
+{
+  if ( ent->fc != NULL ) return ent->fc;
+  if ( ent->fd != -1 )
+    {
+      STATS_START( t0 );
+      classify_fd( ent->fd, ent->path, buf );
+      STATS_STOP( STATS_PHASE_CLASSIFY, t0 );
+      return buf;
+    }
+  classify_path( ent->path, buf );
+  return buf;
+}
+
 
 /* -------------------------------------------------------------------------- */
 
+/**
+ * State of a serial traversal.
+ * Directories are read depth first from `stack', each directory's children
+ * being visited before any of its subdirectories, as `fts' would.
+ */
+typedef struct {
+  do_entry_fn   fn;
+  void        * aux;
+  ino_set_t   * visited;
+  walk_dir_t  * stack;
+  size_t        depth;
+  size_t        cap;
+} ser_walk_t;
 
-  void
-map_files_recur( char * const * paths, int pathc, do_file_fn fn, void * aux )
+  static bool
+ser_walk_mark( void * self, dev_t dev, ino_t ino )
 {
-  char    ** abspaths = NULL;
-  char    *  fpath    = NULL;
-  FTS     *  fs       = NULL;
-  FTSENT  *  child    = NULL;
-  FTSENT  *  parent   = NULL;
-  dev_lst *  visited  = NULL;
-
-  /* Initialize the marker list */
-  visited = malloc( sizeof( dev_lst ) );
-  assert( visited != NULL );
-  visited->nodes = NULL;
-  visited->ncnt  = 0;
-  visited->nxt   = NULL;
-  dev_lst_realloc( visited, DEV_LST_DEFAULT_SIZE );
-
-  /* Convert any relative paths to absolute paths */
-  abspaths = malloc( sizeof( char * ) * pathc );
-  assert( abspaths != NULL );
-  for ( int i = 0; i < pathc; i++ )
+  return ino_set_mark( ( (ser_walk_t *) self )->visited, dev, ino );
+}
+
+  static void
+ser_walk_apply( void * self, const walk_ent_t * ent )
+{
+  ser_walk_t * sw = (ser_walk_t *) self;
+  sw->fn( ent, sw->aux );
+}
+
+  static void
+ser_walk_push( void * self, char * path, dev_t dev )
+{
+  ser_walk_t * sw = (ser_walk_t *) self;
+  if ( sw->depth == sw->cap )
     {
-      abspaths[i] = realpath( paths[i], NULL );
-      assert( abspaths[i] != NULL );
+      sw->cap   = ( sw->cap == 0 ) ? 64 : 2 * sw->cap;
+      sw->stack = realloc( sw->stack, sizeof( walk_dir_t ) * sw->cap );
+      assert( sw->stack != NULL );
     }
+  sw->stack[sw->depth].path  = path;
+  sw->stack[sw->depth++].dev = dev;
+}
 
-  fs = fts_open( abspaths, FTS_LOGICAL|FTS_COMFOLLOW, NULL );
-  assert( fs != NULL );
+  static void
+map_files_recur_serial( char       * const * paths,
+                        int                  pathc,
+                        do_entry_fn          fn,
+                        void               * aux,
+                        const map_opts_t   * opts
+                      )
+{
+  ser_walk_t    sw      = { fn, aux, NULL, NULL, 0, 0 };
+  walk_sink_t   sink    = { ser_walk_mark, ser_walk_apply, ser_walk_push,
+                            & sw,
+                            ( opts == NULL ) ? NULL : opts->prune,
+                            ( opts != NULL ) && opts->io_order,
+                            walk_classify_depth( opts, 1 ), NULL
+                          };
+  char        * abspath = NULL;
+  walk_buf_t    wb;
+  walk_ent_t    ent;
+  struct stat   st;
 
-  while ( ( parent = fts_read( fs ) ) != NULL )
-    {
-      errno = 0;
-      child = fts_children( fs, 0 );
-      if ( errno != 0 ) perror( "fts_children" );
+  sw.visited = ino_set_new( 0 );
+  walk_buf_init( & wb );
 
-      /* The first file opened is used to assign the first device in the
-       * marker list */
-      if ( visited->ncnt <= 0 ) visited->dev = child->fts_statp->st_dev;
+  /* Roots are visited in order, regular files being handed to `fn'
+   * directly. */
+  for ( int i = 0; i < pathc; i++ )
+    {
+      if ( ( abspath = realpath( paths[i], NULL ) ) == NULL )
+        {
+          fprintf( stderr, "%s: %s\n", paths[i], strerror( errno ) );
+          continue;
+        }
+      if ( ( stat( abspath, & st ) != 0 ) ||
+           ino_set_mark( sw.visited, st.st_dev, st.st_ino )
+         )
+        {
+          free( abspath );
+          continue;
+        }
+      if ( ! S_ISDIR( st.st_mode ) )
+        {
+          walk_root_ent( abspath, & st, & ent );
+          STATS_ADD( files, 1 );
+          fn( & ent, aux );
+          free( abspath );
+          continue;
+        }
 
-      while ( child != NULL )
+      ser_walk_push( & sw, abspath, st.st_dev );
+      while ( sw.depth > 0 )
         {
-          if ( dev_lst_mark( visited,
-                             child->fts_statp->st_dev,
-                             child->fts_statp->st_ino
-                           )
-             )
-          {
-            child = child->fts_link;
-            continue;
-          }
-
-          /* Paste together the path and filenames */
-          asprintf( & fpath, "%s%s", child->fts_path, child->fts_name );
-          fn( fpath, aux );  /* Apply the provided function */
-
-          free( fpath );
-          fpath = NULL;
-          child = child->fts_link;
+          walk_dir_t dir   = sw.stack[--sw.depth];
+          size_t     first = sw.depth;
+          walk_read_dir( & wb, dir.path, dir.dev, & sink );
+          free( dir.path );
+          /* Subdirectories were pushed in order, reverse them so they are
+           * popped in order. */
+          for ( size_t a = first, b = sw.depth; ( a + 1 ) < b; a++, b-- )
+            {
+              walk_dir_t tmp  = sw.stack[a];
+              sw.stack[a]     = sw.stack[b - 1];
+              sw.stack[b - 1] = tmp;
+            }
         }
+      if ( wb.nheld > 0 ) walk_release_held( & wb, -1, 0, & sink );
     }
 
-  /* Cleanup */
-  parent = NULL;
-  child  = NULL;
-
-  for ( int i = 0; i < pathc; i++ ) free( abspaths[i] );
-  free( abspaths );
-  abspaths = NULL;
-
-  dev_lst_free( visited );
-  visited = NULL;
-
-  fts_close( fs );
-  fs = NULL;
+  walk_buf_free( & wb );
+  free( sw.stack );
+  ino_set_free( sw.visited );
 }
 
 
 /* -------------------------------------------------------------------------- */
 
-struct fn_aux_s { do_file_fn fn; void * aux; };
+/**
+ * Work-stealing deque of directories.
+ * The owning worker pushes and pops at the tail, walking depth-first so its
+ * working set stays small, while idle workers steal from the head where the
+ * oldest ( and typically largest ) subtrees sit.
+ */
+typedef struct {
+  pthread_mutex_t    lock;
+  walk_dir_t       * dirs;
+  size_t             head;
+  size_t             tail;
+  size_t             cap;
+} dir_deque_t;
 
+#define DIR_DEQUE_DEFAULT_SIZE 64
 
   static void
-do_to_elfs( const char * fname, void * aux )
+dir_deque_push( dir_deque_t * dq, walk_dir_t dir )
 {
-  if ( elfp( fname ) )
+  pthread_mutex_lock( & dq->lock );
+  if ( ( dq->tail - dq->head ) == dq->cap )
     {
-      ( (struct fn_aux_s *) aux )->fn( fname,
-                                       ( (struct fn_aux_s *) aux )->aux
-                                     );
+      /* Unroll the ring into a buffer twice the size. */
+      size_t       ncap  = ( dq->cap == 0 ) ? DIR_DEQUE_DEFAULT_SIZE
+                                            : 2 * dq->cap;
+      walk_dir_t * ndirs = malloc( sizeof( walk_dir_t ) * ncap );
+      assert( ndirs != NULL );
+      for ( size_t i = dq->head; i < dq->tail; i++ )
+        {
+          ndirs[i - dq->head] = dq->dirs[i % dq->cap];
+        }
+      free( dq->dirs );
+      dq->dirs  = ndirs;
+      dq->tail -= dq->head;
+      dq->head  = 0;
+      dq->cap   = ncap;
     }
-  else if ( arelfp( fname ) )
+  dq->dirs[dq->tail++ % dq->cap] = dir;
+  pthread_mutex_unlock( & dq->lock );
+}
+
+/** Pop from the tail; used by the owning worker. */
+  static bool
+dir_deque_pop( dir_deque_t * dq, walk_dir_t * dir )
+{
+  bool found = false;
+  pthread_mutex_lock( & dq->lock );
+  if ( dq->tail != dq->head )
     {
-      /* FIXME: Split AR members into temporary files and and apply */
+      *dir  = dq->dirs[--dq->tail % dq->cap];
+      found = true;
     }
+  pthread_mutex_unlock( & dq->lock );
+  return found;
 }
 
-  void
-map_elfs_recur( char * const * paths, int pathc, do_file_fn fn, void * aux )
+/** Pop from the head; used by thieves. */
+  static bool
+dir_deque_steal( dir_deque_t * dq, walk_dir_t * dir )
 {
-  struct fn_aux_s user_args = { fn, aux };
-  map_files_recur( paths, pathc, do_to_elfs, & user_args );
+  bool found = false;
+  pthread_mutex_lock( & dq->lock );
+  if ( dq->tail != dq->head )
+    {
+      *dir  = dq->dirs[dq->head++ % dq->cap];
+      found = true;
+    }
+  pthread_mutex_unlock( & dq->lock );
+  return found;
+}
+
+  static bool
+dir_deque_emptyp( dir_deque_t * dq )
+{
+  bool empty = true;
+  pthread_mutex_lock( & dq->lock );
+  empty = ( dq->tail == dq->head );
+  pthread_mutex_unlock( & dq->lock );
+  return empty;
 }
 
 
 /* -------------------------------------------------------------------------- */
 
-#if 0
-static inline Elf32_Shdr * elf_sheader_32( Elf32_Ehdr * hdr )
-  __attribute__(( nonnull ));
+/** State shared by all workers of a parallel traversal. */
+typedef struct {
+  do_entry_fn            fn;
+  void                 * aux;
+  const char * const   * prune;
+  bool                   io_order;
+  unsigned               classify_depth;
+  classify_pool_t      * classify_pool;  /* If `classify_depth' is not 0 */
+  bool                   concurrent;
+  int                    nworkers;
+  dir_deque_t      * deques;
+  pthread_mutex_t    fn_lock;       /* Serializes `fn' unless `concurrent' */
+  ino_set_shared_t * visited;
+  pthread_mutex_t    idle_lock;
+  pthread_cond_t     idle_cond;
+  int                nidle;         /* Guarded by `idle_lock' */
+  size_t             pending;       /* Directories queued or being read */
+} par_walk_t;
 
-  static inline Elf32_Shdr *
-elf_sheader_32( Elf32_Ehdr * hdr )
-{
-  return (Elf32_Shdr *) ( ( (int) hdr ) + hdr->e_shoff );
-}
+typedef struct {
+  par_walk_t * pw;
+  int          self;
+  walk_buf_t   wb;
+} par_worker_t;
 
-static inline Elf64_Shdr * elf_sheader_64( Elf64_Ehdr * hdr )
-  __attribute__(( nonnull ));
 
-  static inline Elf64_Shdr *
-elf_sheader_64( Elf64_Ehdr * hdr )
+  static bool
+par_walk_mark( void * self, dev_t dev, ino_t ino )
 {
-  return (Elf64_Shdr *) ( ( (int) hdr ) + hdr->e_shoff );
+  par_worker_t * w = (par_worker_t *) self;
+  return ino_set_shared_mark( w->pw->visited, dev, ino );
 }
 
+  static void
+par_walk_apply( void * self, const walk_ent_t * ent )
+{
+  par_walk_t * pw = ( (par_worker_t *) self )->pw;
+  if ( pw->concurrent )
+    {
+      pw->fn( ent, pw->aux );
+      return;
+    }
+  pthread_mutex_lock( & pw->fn_lock );
+  pw->fn( ent, pw->aux );
+  pthread_mutex_unlock( & pw->fn_lock );
+}
 
-/* -------------------------------------------------------------------------- */
-
-static inline Elf32_Shdr * elf_section_32( Elf32_Ehdr * hdr, int idx )
-  __attribute__(( nonnull ));
+/** Queue a directory on worker `self' and wake an idle thief if any. */
+  static void
+par_walk_enqueue( par_walk_t * pw, int self, char * dpath, dev_t dev )
+{
+  walk_dir_t dir = { dpath, dev };
+  __atomic_add_fetch( & pw->pending, 1, __ATOMIC_SEQ_CST );
+  dir_deque_push( & pw->deques[self], dir );
+  pthread_mutex_lock( & pw->idle_lock );
+  if ( pw->nidle > 0 ) pthread_cond_signal( & pw->idle_cond );
+  pthread_mutex_unlock( & pw->idle_lock );
+}
 
-  static inline Elf32_Shdr *
-elf_section_32( Elf32_Ehdr * hdr, int idx )
+  static void
+par_walk_push( void * self, char * dpath, dev_t dev )
 {
-  return & elf_sheader_32( hdr )[idx];
+  par_worker_t * w = (par_worker_t *) self;
+  par_walk_enqueue( w->pw, w->self, dpath, dev );
 }
 
-static inline Elf64_Shdr * elf_section_64( Elf64_Ehdr * hdr, int idx )
-  __attribute__(( nonnull ));
+  static bool
+par_walk_take( par_walk_t * pw, int self, walk_dir_t * dir )
+{
+  if ( dir_deque_pop( & pw->deques[self], dir ) ) return true;
+  for ( int i = 1; i < pw->nworkers; i++ )
+    {
+      if ( dir_deque_steal( & pw->deques[( self + i ) % pw->nworkers], dir ) )
+        {
+          return true;
+        }
+    }
+  return false;
+}
 
-  static inline Elf64_Shdr *
-elf_section_64( Elf64_Ehdr * hdr, int idx )
+  static bool
+par_walk_work_availablep( par_walk_t * pw )
 {
-  return & elf_sheader_64( hdr )[idx];
+  for ( int i = 0; i < pw->nworkers; i++ )
+    {
+      if ( ! dir_deque_emptyp( & pw->deques[i] ) ) return true;
+    }
+  return false;
 }
 
+  static void *
+par_walk_worker( void * arg )
+{
+  par_walk_t  * pw   = ( (par_worker_t *) arg )->pw;
+  int           self = ( (par_worker_t *) arg )->self;
+  walk_sink_t   sink = { par_walk_mark, par_walk_apply, par_walk_push, arg,
+                         pw->prune, pw->io_order, pw->classify_depth,
+                         pw->classify_pool
+                       };
+  walk_buf_t  * wb   = & ( (par_worker_t *) arg )->wb;
+  walk_dir_t    dir;
+  bool          done = false;
+
+  walk_buf_init( wb );
+  while ( ! done )
+    {
+      if ( par_walk_take( pw, self, & dir ) )
+        {
+          walk_read_dir( wb, dir.path, dir.dev, & sink );
+          free( dir.path );
+          if ( __atomic_sub_fetch( & pw->pending, 1, __ATOMIC_SEQ_CST ) == 0 )
+            {
+              pthread_mutex_lock( & pw->idle_lock );
+              pthread_cond_broadcast( & pw->idle_cond );
+              pthread_mutex_unlock( & pw->idle_lock );
+            }
+          continue;
+        }
 
-/* -------------------------------------------------------------------------- */
+      /* Nothing to steal: visit the files still held, which may take long
+       * enough for more work to show up. */
+      if ( wb->nheld > 0 )
+        {
+          walk_release_held( wb, -1, 0, & sink );
+          continue;
+        }
 
-static inline char * elf_str_table_32( Elf32_Ehdr * hdr )
-  __attribute__(( nonnull ));
+      /* Nothing to steal; sleep until a push or until the walk completes.
+       * Pushers signal while holding `idle_lock', so checking for work under
+       * the lock cannot miss a wakeup. */
+      pthread_mutex_lock( & pw->idle_lock );
+      while ( ( __atomic_load_n( & pw->pending, __ATOMIC_SEQ_CST ) != 0 ) &&
+              ( ! par_walk_work_availablep( pw ) )
+            )
+        {
+          pw->nidle++;
+          pthread_cond_wait( & pw->idle_cond, & pw->idle_lock );
+          pw->nidle--;
+        }
+      done = ( __atomic_load_n( & pw->pending, __ATOMIC_SEQ_CST ) == 0 );
+      pthread_mutex_unlock( & pw->idle_lock );
+    }
+
+  walk_buf_free( wb );
+  return NULL;
+}
 
-  static inline char *
-elf_str_table_32( Elf32_Ehdr * hdr )
+  static void
+map_files_recur_parallel( char       * const * paths,
+                          int                  pathc,
+                          do_entry_fn          fn,
+                          void               * aux,
+                          int                  nworkers,
+                          const map_opts_t   * opts
+                        )
 {
-  if( hdr->e_shstrndx == SHN_UNDEF )
+  par_walk_t     pw;
+  par_worker_t * workers = NULL;
+  pthread_t    * threads = NULL;
+  char         * abspath = NULL;
+  struct stat    st;
+
+  pw.fn         = fn;
+  pw.aux        = aux;
+  pw.prune          = opts->prune;
+  pw.io_order       = opts->io_order;
+  pw.classify_depth = walk_classify_depth( opts, nworkers );
+  /* Its helpers are capped well below the depth, and only start if needed. */
+  pw.classify_pool  = ( pw.classify_depth == 0 ) ? NULL :
+                      classify_pool_new( WALK_CLASSIFY_DEPTH );
+  pw.concurrent     = opts->concurrent;
+  pw.nworkers       = nworkers;
+  pw.nidle          = 0;
+  pw.pending        = 0;
+  pthread_mutex_init( & pw.fn_lock, NULL );
+  pthread_mutex_init( & pw.idle_lock, NULL );
+  pthread_cond_init( & pw.idle_cond, NULL );
+
+  pw.visited = ino_set_shared_new( 0 );
+
+  pw.deques = calloc( nworkers, sizeof( dir_deque_t ) );
+  assert( pw.deques != NULL );
+  for ( int i = 0; i < nworkers; i++ )
     {
-      return NULL;
+      pthread_mutex_init( & pw.deques[i].lock, NULL );
     }
-  return (char *) hdr + elf_section_32( hdr, hdr->e_shstrndx )->sh_offset;
-}
 
-static inline char * elf_str_table_64( Elf64_Ehdr * hdr )
-  __attribute__(( nonnull ));
+  /* Seed the deques round-robin with root directories; regular file roots are
+   * handled immediately. */
+  for ( int i = 0; i < pathc; i++ )
+    {
+      if ( ( abspath = realpath( paths[i], NULL ) ) == NULL )
+        {
+          fprintf( stderr, "%s: %s\n", paths[i], strerror( errno ) );
+          continue;
+        }
+      if ( ( stat( abspath, & st ) != 0 ) ||
+           ino_set_shared_mark( pw.visited, st.st_dev, st.st_ino )
+         )
+        {
+          free( abspath );
+          continue;
+        }
+      if ( S_ISDIR( st.st_mode ) )
+        {
+          par_walk_enqueue( & pw, i % nworkers, abspath, st.st_dev );
+        }
+      else
+        {
+          walk_ent_t ent;
+          walk_root_ent( abspath, & st, & ent );
+          STATS_ADD( files, 1 );
+          fn( & ent, aux );
+          free( abspath );
+        }
+    }
+  abspath = NULL;
+
+  workers = malloc( sizeof( par_worker_t ) * nworkers );
+  threads = malloc( sizeof( pthread_t ) * nworkers );
+  assert( ( workers != NULL ) && ( threads != NULL ) );
+  for ( int i = 0; i < nworkers; i++ )
+    {
+      workers[i].pw   = & pw;
+      workers[i].self = i;
+      if ( pthread_create( & threads[i], NULL, par_walk_worker, & workers[i] )
+           != 0
+         )
+        {
+          perror( "pthread_create" );
+          exit( EXIT_FAILURE );
+        }
+    }
+  for ( int i = 0; i < nworkers; i++ ) pthread_join( threads[i], NULL );
 
-  static inline char *
-elf_str_table_64( Elf64_Ehdr * hdr )
-{
-  if( hdr->e_shstrndx == SHN_UNDEF )
+  /* Cleanup */
+  free( threads );
+  free( workers );
+  for ( int i = 0; i < nworkers; i++ )
     {
-      return NULL;
+      free( pw.deques[i].dirs );
+      pthread_mutex_destroy( & pw.deques[i].lock );
     }
-  return (char *) hdr + elf_section_64( hdr, hdr->e_shstrndx )->sh_offset;
+  free( pw.deques );
+  if ( pw.classify_pool != NULL ) classify_pool_free( pw.classify_pool );
+  ino_set_shared_free( pw.visited );
+  pthread_cond_destroy( & pw.idle_cond );
+  pthread_mutex_destroy( & pw.idle_lock );
+  pthread_mutex_destroy( & pw.fn_lock );
 }
 
 
 /* -------------------------------------------------------------------------- */
 
-static inline char * elf_lookup_string_32( Elf32_Ehdr *hdr, int offset )
-  __attribute__(( nonnull ));
+/** Adapts a `do_file_fn' to the entry based walkers. */
+struct file_fn_aux_s { do_file_fn fn; void * aux; };
 
-  static inline char *
-elf_lookup_string_32( Elf32_Ehdr *hdr, int offset )
+  static void
+do_file_entry( const walk_ent_t * ent, void * aux )
 {
-  char * strtab = elf_str_table_32( hdr );
-  if( strtab == NULL )
-    {
-      return NULL;
-    }
-  return strtab + offset;
+  struct file_fn_aux_s * user_args = (struct file_fn_aux_s *) aux;
+  user_args->fn( ent->path, user_args->aux );
+}
+
+
+  void
+map_files_recur( char * const * paths, int pathc, do_file_fn fn, void * aux )
+{
+  struct file_fn_aux_s user_args = { fn, aux };
+  map_files_recur_serial( paths, pathc, do_file_entry, & user_args, NULL );
 }
 
-static inline char * elf_lookup_string_64( Elf64_Ehdr *hdr, int offset )
-  __attribute__(( nonnull ));
 
-  static inline char *
-elf_lookup_string_64( Elf64_Ehdr *hdr, int offset )
+  void
+map_entries_recur_opts( char       * const * paths,
+                        int                  pathc,
+                        do_entry_fn          fn,
+                        void               * aux,
+                        const map_opts_t   * opts
+                      )
 {
-  char * strtab = elf_str_table_64( hdr );
-  if( strtab == NULL )
+  int nworkers = ( opts == NULL ) ? 1 : opts->nthreads;
+
+  if ( nworkers <= 0 )
     {
-      return NULL;
+      long ncpu = sysconf( _SC_NPROCESSORS_ONLN );
+      nworkers = ( ncpu > 0 ) ? (int) ncpu : 1;
     }
-  return strtab + offset;
+
+  if ( nworkers == 1 )
+    {
+      map_files_recur_serial( paths, pathc, fn, aux, opts );
+    }
+  else
+    {
+      map_files_recur_parallel( paths, pathc, fn, aux, nworkers, opts );
+    }
+}
+
+
+  void
+map_files_recur_opts( char       * const * paths,
+                      int                  pathc,
+                      do_file_fn           fn,
+                      void               * aux,
+                      const map_opts_t   * opts
+                    )
+{
+  struct file_fn_aux_s user_args = { fn, aux };
+  map_entries_recur_opts( paths, pathc, do_file_entry, & user_args, opts );
 }
 
 
 /* -------------------------------------------------------------------------- */
 
-/** https://wiki.osdev.org/ELF_Tutorial */
-  int
-elf_get_symval_32( struct Elf32_Ehdr * hdr, int table, unsigned int idx )
+/**
+ * Describe the archive member `ent' of `ar' in `view' if it is an ELF object,
+ * naming it `archive:member' in the `namesz' bytes at `name'.
+ */
+  static bool
+ar_member_view( const ar_iter_t * ar,
+                const ar_ent_t  * ent,
+                char            * name,
+                size_t            namesz,
+                elf_view_t      * view
+              )
 {
-  if( ( table == SHN_UNDEF ) || ( idx == SHN_UNDEF ) )
+  STATS_ADD( members, 1 );
+  if ( ! classify_ehdr( ar->base + ent->offset, ent->size, & view->fc ) )
     {
-      return EXIT_SUCCESS;
+      return false;
     }
+  ar_ent_fullname( ar, ent, name, namesz );
+  view->name   = name;
+  view->offset = ent->offset;
+  view->size   = ent->size;
+  view->data   = ar->base + ent->offset;
+  view->member = true;
+  return true;
+}
 
-  Elf32_Shdr * symtab = elf_section_32( hdr, table );
+/**
+ * Maps the file open on `fd' and hands each ELF object in it to `fn': the
+ * file itself, or every ELF member when it is an AR archive.
+ * Members are visited in place inside of a single mapping of the archive.
+ *
+ * Archives of at least `split_size' bytes are not visited, their members are
+ * listed in `table' instead, which then owns the mapping and `fd'; true is
+ * returned in that case only.
+ */
+  static bool
+map_elf_objects_fd( const char * fname,
+                    int          fd,
+                    do_elf_fn    fn,
+                    void       * aux,
+                    size_t       split_size,
+                    ar_table_t * table
+                  )
+{
+  unsigned char   buf[CLASSIFY_PEEK_SIZE];
+  char            name[PATH_MAX];
+  file_class_t    fc;
+  ar_iter_t       ar;
+  ar_ent_t        ent;
+  elf_view_t      view;
+  struct stat     st;
+  unsigned char * base = NULL;
+  ssize_t         len  = pread( fd, buf, sizeof( buf ), 0 );
+  bool            is_ar;
 
-  uint32_t symtab_entries = symtab->sh_size / symtab->sh_entsize;
+  if ( len <= 0 ) return false;
+  STATS_ADD( bytes_read, len );
 
-  if( idx >= symtab_entries )
-    {
-      fprintf( stderr, "Symbol Index out of Range (%d:%u).\n", table, idx );
-      return EXIT_FAILURE;
-    }
+  is_ar = ( len >= (ssize_t) AR_MAGIC_SIZE ) &&
+          ( memcmp( buf, AR_MAGIC, AR_MAGIC_SIZE ) == 0 );
+
+  if ( ( ! is_ar ) && ( ! classify_ehdr( buf, len, & fc ) ) ) return false;
 
-  int symaddr = (int) hdr + symtab->sh_offset;
-  Elf32_Sym * symbol = & ( (Elf32_Sym *) symaddr )[idx];
+  if ( ( fstat( fd, & st ) != 0 ) || ( st.st_size <= 0 ) ) return false;
 
-  if( symbol->st_shndx == SHN_UNDEF )
+  /* A private writable mapping lets callbacks hand `data' to `elf_memory',
+   * which may convert in place; nothing is ever written back to the file. */
+  base = mmap( 0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+  if ( base == MAP_FAILED ) return false;
+  STATS_ADD( mmaps, 1 );
+
+  view.path = fname;
+  view.fd   = fd;
+
+  if ( ! is_ar )
     {
-      /* External symbol, lookup value */
-      Elf32_Shdr * strtab = elf_section_32( hdr, symtab->sh_link );
-      const char * name =
-        (const char *) hdr + strtab->sh_offset + symbol->st_name;
+      view.name   = fname;
+      view.offset = 0;
+      view.size   = st.st_size;
+      view.data   = base;
+      view.member = false;
+      view.fc     = fc;
+      fn( & view, aux );
+      munmap( base, st.st_size );
+      return false;
+    }
 
-      extern void * elf_lookup_symbol( const char *name );
-      void * target = elf_lookup_symbol( name );
+  STATS_ADD( archives, 1 );
+  /* Members are visited front to back, whether here or by `map_ar_table'. */
+  madvise( base, st.st_size, MADV_SEQUENTIAL );
+  /* Only iteration is charged to the archive phase, not `fn'. */
+  STATS_START( t0 );
+  ar_iter_init( & ar, base, st.st_size, fname, true );
 
-      if( target == NULL )
+  if ( (size_t) st.st_size >= split_size )
+    {
+      /* Headers only, members are classified by whoever visits them. */
+      size_t cap = 0;
+      memset( table, 0, sizeof( ar_table_t ) );
+      while ( ar_iter_next( & ar, & ent ) )
         {
-          /* Extern symbol not found */
-          if( ELF32_ST_BIND( symbol->st_info ) & STB_WEAK )
-            {
-              /* Weak symbol initialized as 0 */
-              return 0;
-            }
-          else
+          if ( table->nmembers == cap )
             {
-              fprintf( stderr, "Undefined External Symbol : %s.\n", name );
-              return EXIT_FAILURE;
+              cap = ( cap == 0 ) ? 1024 : 2 * cap;
+              table->members = realloc( table->members,
+                                        sizeof( ar_ent_t ) * cap
+                                      );
+              assert( table->members != NULL );
             }
+          table->members[table->nmembers++] = ent;
         }
-      else
+      table->ar = ar;
+      table->fd = fd;
+      STATS_STOP( STATS_PHASE_ARCHIVE, t0 );
+      return true;
+    }
+
+  while ( ar_iter_next( & ar, & ent ) )
+    {
+      if ( ! ar_member_view( & ar, & ent, name, sizeof( name ), & view ) )
         {
-          return (int) target;
+          continue;
         }
+      STATS_LAP( STATS_PHASE_ARCHIVE, t0 );
+      fn( & view, aux );
+      STATS_RESTART( t0 );
     }
-  else if( symbol->st_shndx == SHN_ABS )
+  STATS_STOP( STATS_PHASE_ARCHIVE, t0 );
+
+  munmap( base, st.st_size );
+  return false;
+}
+
+
+  void
+map_elf_objects( const char * fname, do_elf_fn fn, void * aux )
+{
+  int fd = open( fname, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK );
+  STATS_ADD( opens, 1 );
+  if ( fd == -1 ) return;
+  map_elf_objects_fd( fname, fd, fn, aux, SIZE_MAX, NULL );
+  close( fd );
+}
+
+
+  bool
+map_elf_objects_split( const char * fname,
+                       size_t       split_size,
+                       ar_table_t * table,
+                       do_elf_fn    fn,
+                       void       * aux
+                     )
+{
+  int fd = open( fname, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK );
+  STATS_ADD( opens, 1 );
+  if ( fd == -1 ) return false;
+  if ( map_elf_objects_fd( fname, fd, fn, aux, split_size, table ) )
     {
-      /* Absolute symbol */
-      return symbol->st_value;
+      return true;
     }
-  else
+  close( fd );
+  return false;
+}
+
+
+  void
+map_ar_table( const ar_table_t * table,
+              size_t             first,
+              size_t             last,
+              do_elf_fn          fn,
+              void             * aux
+            )
+{
+  char       name[PATH_MAX];
+  elf_view_t view;
+
+  view.path = table->ar.fname;
+  view.fd   = table->fd;
+  for ( size_t i = first; ( i < last ) && ( i < table->nmembers ); i++ )
+    {
+      if ( ar_member_view( & table->ar, & table->members[i], name,
+                           sizeof( name ), & view
+                         )
+         )
+        {
+          fn( & view, aux );
+        }
+    }
+}
+
+
+  void
+ar_table_close( ar_table_t * table )
+{
+  munmap( (void *) table->ar.base, table->ar.size );
+  close( table->fd );
+  free( table->members );
+  memset( table, 0, sizeof( ar_table_t ) );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * `lock' is set when the caller asked for serialized callbacks, in which case
+ * only the user's function is serialized while classification stays parallel.
+ */
+struct fn_aux_s { do_elf_fn fn; void * aux; pthread_mutex_t * lock; };
+
+
+  static void
+do_to_elf_view( const elf_view_t * view, void * aux )
+{
+  struct fn_aux_s * user_args = (struct fn_aux_s *) aux;
+  if ( user_args->lock != NULL ) pthread_mutex_lock( user_args->lock );
+  user_args->fn( view, user_args->aux );
+  if ( user_args->lock != NULL ) pthread_mutex_unlock( user_args->lock );
+}
+
+  static void
+do_to_elfs( const char * fname, void * aux )
+{
+  map_elf_objects( fname, do_to_elf_view, aux );
+}
+
+  void
+map_elfs_recur( char * const * paths, int pathc, do_elf_fn fn, void * aux )
+{
+  struct fn_aux_s user_args = { fn, aux, NULL };
+  map_files_recur( paths, pathc, do_to_elfs, & user_args );
+}
+
+
+  void
+map_elfs_recur_opts( char       * const * paths,
+                     int                  pathc,
+                     do_elf_fn            fn,
+                     void               * aux,
+                     const map_opts_t   * opts
+                   )
+{
+  pthread_mutex_t lock      = PTHREAD_MUTEX_INITIALIZER;
+  struct fn_aux_s user_args = { fn, aux, NULL };
+  map_opts_t      walk_opts = { .nthreads = 1, .concurrent = true };
+
+  if ( opts != NULL )
     {
-      /* Internally defined symbol */
-      Elf32_Shdr * target = elf_section( hdr, symbol->st_shndx );
-      return (int) hdr + symbol->st_value + target->sh_offset;
+      walk_opts.nthreads = opts->nthreads;
+      walk_opts.prune    = opts->prune;
+      walk_opts.io_order = opts->io_order;
+      if ( ! opts->concurrent ) user_args.lock = & lock;
     }
 
-  return EXIT_FAILURE;
+  map_files_recur_opts( paths, pathc, do_to_elfs, & user_args, & walk_opts );
+  pthread_mutex_destroy( & lock );
 }
-#endif
 
 
 /* -------------------------------------------------------------------------- */
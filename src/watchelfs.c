@@ -0,0 +1,903 @@
+/* -*- mode: c; -*- */
+
+#include "aa-elf-util.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <assert.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/vfs.h>
+#include <sys/inotify.h>
+#include <sys/fanotify.h>
+
+
+/* ========================================================================== */
+
+  static void
+usage( const char * argv0, FILE * out )
+{
+  fprintf( out,
+           "Usage: %s [-j THREADS] [--prune GLOB]... [--inotify] -s SOCKET"
+           " PATH...\n"
+           "       %s [--class CLASS] [--machine MACHINE] [--type TYPE]"
+           " -q SOCKET\n"
+           "Keep an inventory of the ELF files and AR archives of ELF objects\n"
+           "under the directories PATHs, serving it on the UNIX socket\n"
+           "SOCKET.\n"
+           "After an initial scan only files reported as created, written,\n"
+           "moved, or deleted are classified again.\n"
+           "  -s SOCKET    Scan PATHs and serve the inventory until killed.\n"
+           "  -j THREADS   Traversal threads for scans, 0 for one per CPU.\n"
+           "  --prune GLOB Skip directories matching GLOB, as `findelfs' does.\n"
+           "  --inotify    Do not try `fanotify', which needs CAP_SYS_ADMIN\n"
+           "               but watches whole filesystems at once.\n"
+           "  -q SOCKET    Print the inventory served on SOCKET, optionally\n"
+           "               restricted by the filters of `findelfs'.\n"
+           "Clients of SOCKET send one line of `class=', `machine=', or\n"
+           "`type=' filters, possibly empty, and receive one path per line.\n"
+           "Paths are canonical.  Symlinks are not reclassified when only\n"
+           "their targets change, and with `fanotify' changes below links to\n"
+           "directories are tracked under the links' targets.\n",
+           argv0, argv0
+         );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Filesystem marked for `fanotify', which resolves its file handles.
+ * Directories of unmarkable filesystems are watched with `inotify' instead.
+ */
+typedef struct {
+  dev_t   dev;
+  fsid_t  fsid;
+  int     fd;    /* On its first directory seen, -1 if unmarkable */
+} fan_fs_t;
+
+typedef struct {
+  elf_inventory_t    * inv;
+  pthread_mutex_t      lock;       /* Held by scan callbacks */
+  char              ** roots;      /* Canonical */
+  int                  nroots;
+  const char * const * prune;
+  int                  nthreads;
+  /* `fanotify' backend. */
+  int                  fan_fd;
+  fan_fs_t           * fss;
+  size_t               nfss;
+  /* `inotify' backend, also used below unmarkable filesystems, with
+   * directories indexed by watch descriptor. */
+  int                  in_fd;
+  char              ** wd_paths;
+  size_t               nwds;
+  bool                 wd_warned;
+} watch_t;
+
+#define FAN_WATCH_MASK                                                       \
+  ( FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO |                \
+    FAN_CLOSE_WRITE | FAN_ONDIR )
+
+#define IN_WATCH_MASK                                                        \
+  ( IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |   \
+    IN_EXCL_UNLINK | IN_ONLYDIR )
+
+static volatile sig_atomic_t stopping = 0;
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Mark the filesystem holding directory `path' unless it already was.
+ * Returns false if it cannot be marked.
+ */
+  static bool
+fan_mark_dir( watch_t * w, const char * path, dev_t dev )
+{
+  fan_fs_t     * fs = NULL;
+  struct statfs  sfs;
+
+  for ( size_t i = 0; i < w->nfss; i++ )
+    {
+      if ( w->fss[i].dev == dev ) return w->fss[i].fd != -1;
+    }
+
+  w->fss = realloc( w->fss, ( w->nfss + 1 ) * sizeof( fan_fs_t ) );
+  assert( w->fss != NULL );
+  fs      = & w->fss[w->nfss++];
+  fs->dev = dev;
+  fs->fd  = open( path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+  if ( ( fs->fd == -1 ) ||
+       ( fstatfs( fs->fd, & sfs ) != 0 ) ||
+       ( fanotify_mark( w->fan_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                        FAN_WATCH_MASK, AT_FDCWD, path
+                      ) != 0
+       )
+     )
+    {
+      fprintf( stderr, "%s: cannot watch filesystem: %s\n", path,
+               strerror( errno )
+             );
+      if ( fs->fd != -1 ) close( fs->fd );
+      fs->fd = -1;
+      return false;
+    }
+
+  fs->fsid = sfs.f_fsid;
+  return true;
+}
+
+/** Watch the directory `path', which must already be in the tree. */
+  static void
+in_watch_dir( watch_t * w, const char * path )
+{
+  int wd = inotify_add_watch( w->in_fd, path, IN_WATCH_MASK );
+
+  if ( wd < 0 )
+    {
+      if ( ( errno == ENOSPC ) && ( ! w->wd_warned ) )
+        {
+          fprintf( stderr, "%s: out of inotify watches, raise "
+                   "fs.inotify.max_user_watches\n", path
+                 );
+          w->wd_warned = true;
+        }
+      return;
+    }
+
+  /* Descriptors are small and allocated in sequence. */
+  if ( (size_t) wd >= w->nwds )
+    {
+      size_t n = ( w->nwds == 0 ) ? 1024 : w->nwds;
+      while ( n <= (size_t) wd ) n *= 2;
+      w->wd_paths = realloc( w->wd_paths, n * sizeof( char * ) );
+      assert( w->wd_paths != NULL );
+      memset( w->wd_paths + w->nwds, 0, ( n - w->nwds ) * sizeof( char * ) );
+      w->nwds = n;
+    }
+  free( w->wd_paths[wd] );
+  w->wd_paths[wd] = strdup( path );
+  assert( w->wd_paths[wd] != NULL );
+}
+
+/** Stop watching `dir' and everything below it. */
+  static void
+in_forget_dir( watch_t * w, const char * dir )
+{
+  size_t len = strlen( dir );
+  for ( size_t wd = 0; wd < w->nwds; wd++ )
+    {
+      const char * p = w->wd_paths[wd];
+      if ( ( p != NULL ) && ( strncmp( p, dir, len ) == 0 ) &&
+           ( ( p[len] == '\0' ) || ( p[len] == '/' ) )
+         )
+        {
+          inotify_rm_watch( w->in_fd, (int) wd );
+          free( w->wd_paths[wd] );
+          w->wd_paths[wd] = NULL;
+        }
+    }
+}
+
+/**
+ * Watch directory `path' on device `dev', with `inotify' unless its whole
+ * filesystem is watched with `fanotify'.
+ * Filesystems mounted below a root may not support `fanotify' where the
+ * root's does, and their subtrees must not silently go unwatched.
+ */
+  static void
+watch_dir( watch_t * w, const char * path, dev_t dev )
+{
+  if ( ( w->fan_fd == -1 ) || ( ! fan_mark_dir( w, path, dev ) ) )
+    {
+      in_watch_dir( w, path );
+    }
+}
+
+/** Detect if some filesystem could not be marked for `fanotify'. */
+  static bool
+watch_inotify_usedp( const watch_t * w )
+{
+  for ( size_t i = 0; i < w->nfss; i++ )
+    {
+      if ( w->fss[i].fd == -1 ) return true;
+    }
+  return false;
+}
+
+/**
+ * Use `fanotify' if every root's filesystem can be marked, which requires
+ * privileges and support for file handles, otherwise `inotify'.
+ * `inotify' is set up either way, for filesystems found later which cannot
+ * be marked.
+ */
+  static bool
+watch_init( watch_t * w, bool inotify )
+{
+  struct stat st;
+
+  if ( ! inotify )
+    {
+      w->fan_fd = fanotify_init( FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME |
+                                 FAN_CLOEXEC | FAN_NONBLOCK,
+                                 O_RDONLY | O_CLOEXEC
+                               );
+    }
+
+  for ( int i = 0; ( w->fan_fd != -1 ) && ( i < w->nroots ); i++ )
+    {
+      if ( ( stat( w->roots[i], & st ) != 0 ) || ! S_ISDIR( st.st_mode ) )
+        {
+          continue;
+        }
+      if ( ! fan_mark_dir( w, w->roots[i], st.st_dev ) )
+        {
+          fprintf( stderr, "falling back to inotify\n" );
+          for ( size_t j = 0; j < w->nfss; j++ )
+            {
+              if ( w->fss[j].fd != -1 ) close( w->fss[j].fd );
+            }
+          free( w->fss );
+          w->fss  = NULL;
+          w->nfss = 0;
+          close( w->fan_fd );
+          w->fan_fd = -1;
+        }
+    }
+
+  w->in_fd = inotify_init1( IN_CLOEXEC | IN_NONBLOCK );
+  if ( w->in_fd == -1 )
+    {
+      perror( "inotify_init1" );
+      return false;
+    }
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Record `path' if it is an ELF file or archive, otherwise drop it. */
+  static void
+watch_classify( watch_t * w, const char * path )
+{
+  file_class_t fc;
+  classify_path( path, & fc );
+  if ( ( fc.kind == FILE_KIND_ELF ) || ( fc.kind == FILE_KIND_AR_ELF ) )
+    {
+      elf_inventory_set( w->inv, path, & fc );
+    }
+  else
+    {
+      elf_inventory_remove( w->inv, path );
+    }
+}
+
+  static void
+do_scan_entry( const walk_ent_t * ent, void * aux )
+{
+  watch_t      * w  = (watch_t *) aux;
+  file_class_t   fc = { .kind = FILE_KIND_OTHER };
+
+  if ( S_ISDIR( ent->type ) )
+    {
+      pthread_mutex_lock( & w->lock );
+      watch_dir( w, ent->path, ent->dev );
+      pthread_mutex_unlock( & w->lock );
+      return;
+    }
+
+  /* Classify outside of the lock so workers overlap their reads. */
+  fc = *walk_ent_classify( ent, & fc );
+  if ( ( fc.kind == FILE_KIND_ELF ) || ( fc.kind == FILE_KIND_AR_ELF ) )
+    {
+      pthread_mutex_lock( & w->lock );
+      elf_inventory_set( w->inv, ent->path, & fc );
+      pthread_mutex_unlock( & w->lock );
+    }
+}
+
+/**
+ * Watch and scan the trees at `paths'.
+ * Directories are watched before they are read, so files created meanwhile
+ * are either seen by the scan or reported afterwards.
+ */
+  static void
+watch_scan( watch_t * w, char * const * paths, int pathc, int nthreads )
+{
+  map_opts_t  opts = { .nthreads = nthreads, .concurrent = true,
+                       .prune = w->prune
+                     };
+  struct stat st;
+
+  for ( int i = 0; i < pathc; i++ )
+    {
+      if ( ( stat( paths[i], & st ) == 0 ) && S_ISDIR( st.st_mode ) )
+        {
+          watch_dir( w, paths[i], st.st_dev );
+        }
+    }
+  map_entries_recur_opts( paths, pathc, do_scan_entry, w, & opts );
+}
+
+/** Start over after events were lost. */
+  static void
+watch_rescan( watch_t * w )
+{
+  fprintf( stderr, "event queue overflowed, rescanning\n" );
+  elf_inventory_clear( w->inv );
+  if ( w->in_fd != -1 )
+    {
+      for ( int i = 0; i < w->nroots; i++ ) in_forget_dir( w, w->roots[i] );
+    }
+  watch_scan( w, w->roots, w->nroots, w->nthreads );
+}
+
+/** Detect if `path' is below a root, and outside of pruned directories. */
+  static bool
+watch_coveredp( const watch_t * w, const char * path, bool isdir )
+{
+  for ( int i = 0; i < w->nroots; i++ )
+    {
+      size_t len = strlen( w->roots[i] );
+
+      if ( ( strncmp( path, w->roots[i], len ) != 0 ) ||
+           ( ( path[len] != '/' ) && ( w->roots[i][len - 1] != '/' ) )
+         )
+        {
+          continue;
+        }
+      if ( w->prune == NULL ) return true;
+
+      /* Check every directory between the root and `path'. */
+      for ( const char * s = strchr( path + len + 1, '/' ); ;
+            s = strchr( s + 1, '/' )
+          )
+        {
+          char * dir = NULL;
+          if ( s == NULL )
+            {
+              return ( ! isdir ) || ( ! map_prunedp( w->prune, path ) );
+            }
+          dir = strndup( path, s - path );
+          assert( dir != NULL );
+          if ( map_prunedp( w->prune, dir ) )
+            {
+              free( dir );
+              return false;
+            }
+          free( dir );
+        }
+    }
+  return false;
+}
+
+/**
+ * Apply a change to the directory entry `path'.
+ * `gone' is true if it was deleted or moved away, otherwise it was created,
+ * written, or moved in.
+ */
+  static void
+watch_apply( watch_t * w, const char * path, bool isdir, bool gone )
+{
+  char * paths[1] = { (char *) path };
+
+  if ( ! watch_coveredp( w, path, isdir ) ) return;
+
+  if ( ! isdir )
+    {
+      if ( gone )
+        {
+          elf_inventory_remove( w->inv, path );
+        }
+      else
+        {
+          watch_classify( w, path );
+        }
+      return;
+    }
+
+  elf_inventory_remove_under( w->inv, path );
+  if ( w->in_fd != -1 ) in_forget_dir( w, path );
+  if ( ! gone ) watch_scan( w, paths, 1, 1 );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+in_read_events( watch_t * w )
+{
+  char buf[64 * 1024] __attribute__(( aligned( 8 ) ));
+  ssize_t len = 0;
+
+  while ( ( len = read( w->in_fd, buf, sizeof( buf ) ) ) > 0 )
+    {
+      for ( char * p = buf; p < ( buf + len ); )
+        {
+          const struct inotify_event * ev   = (const struct inotify_event *) p;
+          char                       * path = NULL;
+
+          p += sizeof( struct inotify_event ) + ev->len;
+
+          if ( ev->mask & IN_Q_OVERFLOW )
+            {
+              watch_rescan( w );
+              continue;
+            }
+          if ( ( ev->wd < 0 ) || ( (size_t) ev->wd >= w->nwds ) ||
+               ( w->wd_paths[ev->wd] == NULL )
+             )
+            {
+              continue;
+            }
+          if ( ev->mask & IN_IGNORED )
+            {
+              free( w->wd_paths[ev->wd] );
+              w->wd_paths[ev->wd] = NULL;
+              continue;
+            }
+          if ( ev->len == 0 ) continue;
+
+          if ( asprintf( & path, "%s/%s", w->wd_paths[ev->wd], ev->name )
+               < 0
+             )
+            {
+              continue;
+            }
+          watch_apply( w, path, ( ev->mask & IN_ISDIR ) != 0,
+                       ( ev->mask & ( IN_DELETE | IN_MOVED_FROM ) ) != 0
+                     );
+          free( path );
+        }
+    }
+}
+
+
+/** Path of the directory `fh' on the filesystem `fsid', or NULL if gone. */
+  static char *
+fan_resolve_dir( const watch_t * w, const fsid_t * fsid,
+                 struct file_handle * fh
+               )
+{
+  char   * path = NULL;
+  char     link[64];
+  ssize_t  len  = -1;
+  int      fd   = -1;
+
+  for ( size_t i = 0; ( fd == -1 ) && ( i < w->nfss ); i++ )
+    {
+      if ( ( w->fss[i].fd != -1 ) &&
+           ( memcmp( & w->fss[i].fsid, fsid, sizeof( fsid_t ) ) == 0 )
+         )
+        {
+          fd = open_by_handle_at( w->fss[i].fd, fh, O_PATH | O_CLOEXEC );
+        }
+    }
+  if ( fd == -1 ) return NULL;
+
+  path = malloc( PATH_MAX );
+  assert( path != NULL );
+  snprintf( link, sizeof( link ), "/proc/self/fd/%d", fd );
+  len = readlink( link, path, PATH_MAX - 1 );
+  close( fd );
+  if ( len <= 0 )
+    {
+      free( path );
+      return NULL;
+    }
+  path[len] = '\0';
+  return path;
+}
+
+  static void
+fan_read_events( watch_t * w )
+{
+  char buf[64 * 1024] __attribute__(( aligned( 8 ) ));
+  ssize_t len = 0;
+
+  while ( ( len = read( w->fan_fd, buf, sizeof( buf ) ) ) > 0 )
+    {
+      const struct fanotify_event_metadata * m =
+        (const struct fanotify_event_metadata *) buf;
+
+      for ( ; FAN_EVENT_OK( m, len ); m = FAN_EVENT_NEXT( m, len ) )
+        {
+          struct fanotify_event_info_fid * fid  = NULL;
+          struct file_handle             * fh   = NULL;
+          char                           * dir  = NULL;
+          char                           * path = NULL;
+
+          if ( m->mask & FAN_Q_OVERFLOW )
+            {
+              watch_rescan( w );
+              continue;
+            }
+
+          fid = (struct fanotify_event_info_fid *) ( m + 1 );
+          if ( ( m->event_len < ( sizeof( *m ) + sizeof( *fid ) ) ) ||
+               ( fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME )
+             )
+            {
+              continue;
+            }
+          fh = (struct file_handle *) fid->handle;
+
+          if ( ( dir = fan_resolve_dir( w, (const fsid_t *) & fid->fsid, fh ) )
+               == NULL
+             )
+            {
+              continue;
+            }
+          if ( asprintf( & path, "%s%s%s", dir,
+                         ( strcmp( dir, "/" ) == 0 ) ? "" : "/",
+                         (const char *) fh->f_handle + fh->handle_bytes
+                       ) < 0
+             )
+            {
+              free( dir );
+              continue;
+            }
+          watch_apply( w, path, ( m->mask & FAN_ONDIR ) != 0,
+                       ( m->mask & ( FAN_DELETE | FAN_MOVED_FROM ) ) != 0
+                     );
+          free( path );
+          free( dir );
+        }
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Answer one client: read its request line, then send the matching paths.
+ * Timeouts keep a stalled client from holding up events for long.
+ */
+  static void
+serve_client( watch_t * w, int lfd )
+{
+  struct timeval   tv     = { .tv_sec = 1, .tv_usec = 0 };
+  elf_filter_t     filter = { .classes = 0, .types = 0, .nmachines = 0 };
+  bool             use    = false;
+  bool             ok     = true;
+  char             req[1024];
+  size_t           len    = 0;
+  obuf_t           out;
+  int              cfd    = accept4( lfd, NULL, NULL, SOCK_CLOEXEC );
+
+  if ( cfd == -1 ) return;
+  setsockopt( cfd, SOL_SOCKET, SO_RCVTIMEO, & tv, sizeof( tv ) );
+  setsockopt( cfd, SOL_SOCKET, SO_SNDTIMEO, & tv, sizeof( tv ) );
+
+  while ( ( len < ( sizeof( req ) - 1 ) ) &&
+          ( memchr( req, '\n', len ) == NULL )
+        )
+    {
+      ssize_t n = read( cfd, req + len, sizeof( req ) - 1 - len );
+      if ( n <= 0 ) break;
+      len += n;
+    }
+  req[len] = '\0';
+  req[strcspn( req, "\n" )] = '\0';
+
+  for ( char * save = NULL, * tok = strtok_r( req, " \t", & save );
+        ok && ( tok != NULL ); tok = strtok_r( NULL, " \t", & save )
+      )
+    {
+      char * eq = strchr( tok, '=' );
+      if ( eq == NULL )
+        {
+          ok = false;
+          break;
+        }
+      *eq = '\0';
+      ok  = elf_filter_add( & filter, tok, eq + 1 );
+      use = true;
+    }
+
+  obuf_init( & out, 0 );
+  if ( ok )
+    {
+      elf_inventory_dump( w->inv, use ? & filter : NULL, & out );
+    }
+  else
+    {
+      /* Paths are absolute, so this is never mistaken for one. */
+      obuf_putline( & out, "error: bad request" );
+    }
+  obuf_flush( & out, cfd );
+  obuf_free( & out );
+  close( cfd );
+}
+
+  static int
+serve_open( const char * path )
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  struct stat        st;
+  int                fd   = -1;
+
+  if ( strlen( path ) >= sizeof( addr.sun_path ) )
+    {
+      fprintf( stderr, "%s: socket path too long\n", path );
+      return -1;
+    }
+  strcpy( addr.sun_path, path );
+
+  /* Replace a socket left behind by a previous instance. */
+  if ( ( lstat( path, & st ) == 0 ) && S_ISSOCK( st.st_mode ) ) unlink( path );
+
+  if ( ( ( fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 ) ) == -1 ) ||
+       ( bind( fd, (struct sockaddr *) & addr, sizeof( addr ) ) != 0 ) ||
+       ( listen( fd, 64 ) != 0 )
+     )
+    {
+      fprintf( stderr, "%s: %s\n", path, strerror( errno ) );
+      if ( fd != -1 ) close( fd );
+      return -1;
+    }
+  return fd;
+}
+
+/** Send `request' to the server at `path' and copy its answer to stdout. */
+  static bool
+query( const char * path, const char * request )
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  char               buf[64 * 1024];
+  ssize_t            n    = 0;
+  bool               ok   = true;
+  bool               head = true;
+  int                fd   = -1;
+
+  if ( strlen( path ) >= sizeof( addr.sun_path ) )
+    {
+      fprintf( stderr, "%s: socket path too long\n", path );
+      return false;
+    }
+  strcpy( addr.sun_path, path );
+
+  if ( ( ( fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 ) ) == -1 ) ||
+       ( connect( fd, (struct sockaddr *) & addr, sizeof( addr ) ) != 0 ) ||
+       ( write( fd, request, strlen( request ) ) < 0 )
+     )
+    {
+      fprintf( stderr, "%s: %s\n", path, strerror( errno ) );
+      if ( fd != -1 ) close( fd );
+      return false;
+    }
+
+  while ( ( n = read( fd, buf, sizeof( buf ) ) ) > 0 )
+    {
+      if ( head && ( n >= 6 ) && ( memcmp( buf, "error:", 6 ) == 0 ) )
+        {
+          fwrite( buf, 1, n, stderr );
+          ok = false;
+          continue;
+        }
+      head = false;
+      fwrite( buf, 1, n, stdout );
+    }
+  close( fd );
+  return ok;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+  static void
+on_signal( int sig )
+{
+  stopping = 1;
+}
+
+static const struct option long_opts[] = {
+  { "prune",   required_argument, NULL, 'P' },
+  { "inotify", no_argument,       NULL, 'I' },
+  { "class",   required_argument, NULL, 'K' },
+  { "machine", required_argument, NULL, 'M' },
+  { "type",    required_argument, NULL, 'T' },
+  { NULL,      0,                 NULL, 0   }
+};
+
+  int
+main( int argc, char * argv[], char ** envp )
+{
+  watch_t            w          = { .nthreads = 0, .fan_fd = -1,
+                                    .in_fd = -1
+                                  };
+  const char       * serve_path = NULL;
+  const char       * query_path = NULL;
+  bool               inotify    = false;
+  char               request[1024] = "";
+  elf_filter_t       filter     = { .classes = 0, .types = 0, .nmachines = 0 };
+  const char      ** prune      = NULL;
+  size_t             nprune     = 0;
+  struct sigaction   sa         = { .sa_handler = on_signal };
+  struct stat        st;
+  int                lfd        = -1;
+  int                opt        = -1;
+
+  while ( ( opt = getopt_long( argc, argv, "hj:s:q:", long_opts, NULL ) )
+          != -1
+        )
+    {
+      switch ( opt )
+        {
+          case 'j':
+            w.nthreads = atoi( optarg );
+            break;
+
+          case 's':
+            serve_path = optarg;
+            break;
+
+          case 'q':
+            query_path = optarg;
+            break;
+
+          case 'I':
+            inotify = true;
+            break;
+
+          case 'K':
+          case 'M':
+          case 'T':
+            {
+              const char * what = ( opt == 'K' ) ? "class" :
+                                  ( opt == 'M' ) ? "machine" : "type";
+              size_t       used = strlen( request );
+              /* Validate here so mistakes are reported by the client. */
+              if ( ! elf_filter_add( & filter, what, optarg ) )
+                {
+                  return EXIT_FAILURE;
+                }
+              if ( snprintf( request + used, sizeof( request ) - used,
+                             "%s=%s ", what, optarg
+                           ) >= (int) ( sizeof( request ) - used )
+                 )
+                {
+                  fprintf( stderr, "%s: filters are too long\n", argv[0] );
+                  return EXIT_FAILURE;
+                }
+            }
+            break;
+
+          case 'P':
+            /* Kept NULL terminated. */
+            prune = realloc( prune, ( nprune + 2 ) * sizeof( char * ) );
+            if ( prune == NULL )
+              {
+                perror( "realloc" );
+                return EXIT_FAILURE;
+              }
+            prune[nprune++] = optarg;
+            prune[nprune]   = NULL;
+            break;
+
+          case 'h':
+            usage( argv[0], stdout );
+            return EXIT_SUCCESS;
+
+          default:
+            usage( argv[0], stderr );
+            return EXIT_FAILURE;
+        }
+    }
+
+  if ( query_path != NULL )
+    {
+      if ( ( serve_path != NULL ) || ( optind != argc ) )
+        {
+          usage( argv[0], stderr );
+          return EXIT_FAILURE;
+        }
+      strcat( request, "\n" );
+      return query( query_path, request ) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+  if ( ( serve_path == NULL ) || ( optind == argc ) )
+    {
+      usage( argv[0], stderr );
+      return EXIT_FAILURE;
+    }
+
+  w.inv   = elf_inventory_new( 0 );
+  w.prune = prune;
+  pthread_mutex_init( & w.lock, NULL );
+
+  /* Events name canonical paths, so roots must be canonical too. */
+  w.roots = calloc( argc - optind, sizeof( char * ) );
+  assert( w.roots != NULL );
+  for ( int i = optind; i < argc; i++ )
+    {
+      if ( ( w.roots[w.nroots] = realpath( argv[i], NULL ) ) == NULL )
+        {
+          fprintf( stderr, "%s: %s\n", argv[i], strerror( errno ) );
+          continue;
+        }
+      /* Only directories are watched, and only their entries reported. */
+      if ( ( stat( w.roots[w.nroots], & st ) != 0 ) ||
+           ( ! S_ISDIR( st.st_mode ) )
+         )
+        {
+          fprintf( stderr, "%s: %s\n", argv[i], strerror( ENOTDIR ) );
+          return EXIT_FAILURE;
+        }
+      w.nroots++;
+    }
+
+  if ( ! watch_init( & w, inotify ) ) return EXIT_FAILURE;
+
+  if ( ( lfd = serve_open( serve_path ) ) == -1 ) return EXIT_FAILURE;
+
+  watch_scan( & w, w.roots, w.nroots, w.nthreads );
+  fprintf( stderr, "%s: %zu ELF files, watching with %s\n", argv[0],
+           elf_inventory_count( w.inv ),
+           ( w.fan_fd == -1 ) ? "inotify" :
+           ( watch_inotify_usedp( & w ) ) ? "fanotify and inotify" : "fanotify"
+         );
+
+  sigaction( SIGINT, & sa, NULL );
+  sigaction( SIGTERM, & sa, NULL );
+  signal( SIGPIPE, SIG_IGN );
+
+  while ( ! stopping )
+    {
+      /* Negative descriptors are ignored. */
+      struct pollfd pfd[3] = {
+        { .fd = w.fan_fd, .events = POLLIN },
+        { .fd = w.in_fd,  .events = POLLIN },
+        { .fd = lfd,      .events = POLLIN }
+      };
+
+      if ( poll( pfd, 3, -1 ) < 0 )
+        {
+          if ( errno == EINTR ) continue;
+          perror( "poll" );
+          break;
+        }
+      if ( pfd[0].revents & POLLIN ) fan_read_events( & w );
+      if ( pfd[1].revents & POLLIN ) in_read_events( & w );
+      if ( pfd[2].revents & POLLIN ) serve_client( & w, lfd );
+    }
+
+  close( lfd );
+  unlink( serve_path );
+  elf_inventory_free( w.inv );
+  for ( int i = 0; i < w.nroots; i++ ) free( w.roots[i] );
+  free( w.roots );
+  for ( size_t i = 0; i < w.nwds; i++ ) free( w.wd_paths[i] );
+  free( w.wd_paths );
+  for ( size_t i = 0; i < w.nfss; i++ )
+    {
+      if ( w.fss[i].fd != -1 ) close( w.fss[i].fd );
+    }
+  free( w.fss );
+  if ( w.fan_fd != -1 ) close( w.fan_fd );
+  close( w.in_fd );
+  pthread_mutex_destroy( & w.lock );
+  free( prune );
+
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+
+
+/* ========================================================================== */
+
+/* vim: set filetype=c : */